@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <graphqlservice/GraphQLCache.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+ShardedFieldCache::ShardedFieldCache(size_t shardCount, size_t maxEntriesPerShard)
+	: _maxEntriesPerShard(std::max<size_t>(maxEntriesPerShard, 1))
+{
+	shardCount = std::max<size_t>(shardCount, 1);
+	_shards.reserve(shardCount);
+
+	for (size_t i = 0; i < shardCount; ++i)
+	{
+		_shards.push_back(std::unique_ptr<Shard>(new Shard()));
+	}
+}
+
+bool ShardedFieldCache::find(const std::string& key, response::Value& value)
+{
+	auto& shard = getShard(key);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto itr = shard.entries.find(key);
+
+	if (itr == shard.entries.end())
+	{
+		return false;
+	}
+
+	if (itr->second.expires <= std::chrono::steady_clock::now())
+	{
+		shard.entries.erase(itr);
+		return false;
+	}
+
+	value = response::Value(itr->second.value);
+
+	return true;
+}
+
+void ShardedFieldCache::insert(const std::string& key, const response::Value& value, std::chrono::seconds maxAge)
+{
+	auto& shard = getShard(key);
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	if (shard.entries.size() >= _maxEntriesPerShard
+		&& shard.entries.find(key) == shard.entries.end())
+	{
+		for (auto itr = shard.entries.begin(); itr != shard.entries.end();)
+		{
+			if (itr->second.expires <= now)
+			{
+				itr = shard.entries.erase(itr);
+				continue;
+			}
+
+			++itr;
+		}
+
+		if (shard.entries.size() >= _maxEntriesPerShard)
+		{
+			shard.entries.erase(std::min_element(shard.entries.begin(), shard.entries.end(),
+				[](const std::pair<const std::string, Entry>& lhs, const std::pair<const std::string, Entry>& rhs)
+			{
+				return lhs.second.expires < rhs.second.expires;
+			}));
+		}
+	}
+
+	auto& entry = shard.entries[key];
+
+	entry.value = response::Value(value);
+	entry.expires = now + maxAge;
+}
+
+void ShardedFieldCache::clear()
+{
+	for (const auto& shard : _shards)
+	{
+		std::lock_guard<std::mutex> lock(shard->mutex);
+
+		shard->entries.clear();
+	}
+}
+
+ShardedFieldCache::Shard& ShardedFieldCache::getShard(const std::string& key)
+{
+	return *_shards[std::hash<std::string>()(key) % _shards.size()];
+}
+
+ResponseCache::ResponseCache(Serializer&& serialize, size_t maxEntries)
+	: _serialize(std::move(serialize))
+	, _maxEntries(std::max<size_t>(maxEntries, 1))
+{
+}
+
+std::shared_ptr<const std::string> ResponseCache::serialize(response::Value&& response) const
+{
+	return std::make_shared<const std::string>(_serialize(std::move(response)));
+}
+
+std::shared_ptr<const std::string> ResponseCache::find(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itr = _entries.find(key);
+
+	if (itr == _entries.end())
+	{
+		return nullptr;
+	}
+
+	if (itr->second.expires <= std::chrono::steady_clock::now())
+	{
+		erase(itr);
+		return nullptr;
+	}
+
+	return itr->second.response;
+}
+
+void ResponseCache::insert(std::string&& key, std::shared_ptr<const std::string> response, std::chrono::seconds maxAge, const std::vector<std::string>& tags)
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itr = _entries.find(key);
+
+	if (itr != _entries.end())
+	{
+		erase(itr);
+	}
+	else if (_entries.size() >= _maxEntries)
+	{
+		for (itr = _entries.begin(); itr != _entries.end();)
+		{
+			itr = (itr->second.expires <= now)
+				? erase(itr)
+				: std::next(itr);
+		}
+
+		if (_entries.size() >= _maxEntries)
+		{
+			erase(std::min_element(_entries.begin(), _entries.end(),
+				[](const EntryMap::value_type& lhs, const EntryMap::value_type& rhs)
+			{
+				return lhs.second.expires < rhs.second.expires;
+			}));
+		}
+	}
+
+	for (const auto& tag : tags)
+	{
+		_tags[tag].insert(key);
+	}
+
+	_entries.emplace(std::move(key), Entry { std::move(response), now + maxAge, tags });
+}
+
+void ResponseCache::invalidate(const std::string& tag)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto itrTag = _tags.find(tag);
+
+	if (itrTag == _tags.end())
+	{
+		return;
+	}
+
+	const auto keys = std::move(itrTag->second);
+
+	_tags.erase(itrTag);
+
+	for (const auto& key : keys)
+	{
+		auto itr = _entries.find(key);
+
+		if (itr != _entries.end())
+		{
+			erase(itr);
+		}
+	}
+}
+
+void ResponseCache::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_entries.clear();
+	_tags.clear();
+}
+
+ResponseCache::EntryMap::iterator ResponseCache::erase(EntryMap::iterator itr)
+{
+	// Remove the key from the index for each of its tags, dropping any tags which are left empty.
+	for (const auto& tag : itr->second.tags)
+	{
+		auto itrTag = _tags.find(tag);
+
+		if (itrTag != _tags.end())
+		{
+			itrTag->second.erase(itr->first);
+
+			if (itrTag->second.empty())
+			{
+				_tags.erase(itrTag);
+			}
+		}
+	}
+
+	return _entries.erase(itr);
+}
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -0,0 +1,384 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <graphqlservice/GraphQLExecutor.h>
+
+#include <algorithm>
+#include <deque>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+Cancellation::Cancellation() noexcept
+	: _cancelled(false)
+	, _hasDeadline(false)
+	, _deadline(std::chrono::steady_clock::time_point::max())
+	, _abandoned(0)
+{
+}
+
+Cancellation::Cancellation(std::chrono::steady_clock::time_point deadline) noexcept
+	: _cancelled(false)
+	, _hasDeadline(true)
+	, _deadline(deadline)
+	, _abandoned(0)
+{
+}
+
+void Cancellation::cancel() noexcept
+{
+	_cancelled = true;
+}
+
+bool Cancellation::isCancelled() const noexcept
+{
+	return _cancelled
+		|| (_hasDeadline && std::chrono::steady_clock::now() >= _deadline);
+}
+
+void Cancellation::throwIfCancelled() const
+{
+	if (_cancelled)
+	{
+		throw cancelled_exception("Request cancelled");
+	}
+	else if (_hasDeadline && std::chrono::steady_clock::now() >= _deadline)
+	{
+		throw cancelled_exception("Deadline exceeded");
+	}
+}
+
+bool Cancellation::hasDeadline() const noexcept
+{
+	return _hasDeadline;
+}
+
+std::chrono::steady_clock::time_point Cancellation::getDeadline() const noexcept
+{
+	return _deadline;
+}
+
+void Cancellation::addError(std::string&& error)
+{
+	std::lock_guard<std::mutex> lock(_errorsMutex);
+
+	_errors.push_back(std::move(error));
+}
+
+std::vector<std::string> Cancellation::releaseErrors()
+{
+	std::lock_guard<std::mutex> lock(_errorsMutex);
+	std::vector<std::string> errors(std::move(_errors));
+
+	_errors.clear();
+
+	return errors;
+}
+
+void Cancellation::waitForAbandoned()
+{
+	std::unique_lock<std::mutex> lock(_abandonedMutex);
+
+	_abandonedFinished.wait(lock, [this]()
+	{
+		return _abandoned == 0;
+	});
+}
+
+void Cancellation::holdWhileAbandoned(std::shared_ptr<const void>&& owner)
+{
+	std::lock_guard<std::mutex> lock(_abandonedMutex);
+
+	if (_abandoned > 0)
+	{
+		_abandonedOwners.push_back(std::move(owner));
+	}
+}
+
+void Cancellation::addAbandoned()
+{
+	std::lock_guard<std::mutex> lock(_abandonedMutex);
+
+	++_abandoned;
+}
+
+void Cancellation::releaseAbandoned()
+{
+	// The owners may hold the last reference to the RequestState and this Cancellation, so release
+	// them after unlocking the mutex.
+	std::vector<std::shared_ptr<const void>> owners;
+
+	{
+		std::lock_guard<std::mutex> lock(_abandonedMutex);
+
+		if (--_abandoned > 0)
+		{
+			return;
+		}
+
+		owners = std::move(_abandonedOwners);
+		_abandonedOwners.clear();
+		_abandonedFinished.notify_all();
+	}
+}
+
+struct ThreadPool::SharedState
+{
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> work;
+	};
+
+	explicit SharedState(size_t threadCount, size_t queueLimit);
+
+	bool tryPop(size_t index, std::function<void()>& work);
+
+	const size_t queueLimit;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	size_t nextQueue = 0;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t pending = 0;
+	bool stopping = false;
+};
+
+namespace {
+
+// Remember which ThreadPool and queue the current thread belongs to, so work posted from inside of
+// a worker thread goes on its own queue.
+thread_local const void* t_pool = nullptr;
+thread_local size_t t_queueIndex = 0;
+
+// Work posted to an Executor reports its own errors, e.g. through the std::future from launchCancellable,
+// so an exception which escapes it is dropped instead of taking down the worker thread.
+void runWork(std::function<void()>& work) noexcept
+{
+	try
+	{
+		work();
+	}
+	catch (...)
+	{
+	}
+}
+
+} /* namespace */
+
+ThreadPool::SharedState::SharedState(size_t threadCount, size_t queueLimit)
+	: queueLimit(std::max<size_t>(queueLimit, 1))
+{
+	queues.reserve(threadCount);
+
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+}
+
+bool ThreadPool::SharedState::tryPop(size_t index, std::function<void()>& work)
+{
+	// Take the most recent work from our own queue first, it's more likely to still be in the cache.
+	{
+		auto& queue = *queues[index];
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+
+		if (!queue.work.empty())
+		{
+			work = std::move(queue.work.back());
+			queue.work.pop_back();
+			return true;
+		}
+	}
+
+	// Steal the oldest work from one of the other queues.
+	for (size_t offset = 1; offset < queues.size(); ++offset)
+	{
+		auto& queue = *queues[(index + offset) % queues.size()];
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+
+		if (!queue.work.empty())
+		{
+			work = std::move(queue.work.front());
+			queue.work.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+ThreadPool::ThreadPool(size_t threadCount, size_t queueLimit)
+{
+	threadCount = std::max<size_t>(threadCount, 1);
+	_shared = std::make_shared<SharedState>(threadCount, queueLimit);
+	_threads.reserve(threadCount);
+
+	for (size_t i = 0; i < threadCount; ++i)
+	{
+		_threads.push_back(std::thread(&ThreadPool::runWorker, _shared, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_shared->mutex);
+
+		_shared->stopping = true;
+	}
+
+	_shared->condition.notify_all();
+
+	for (auto& thread : _threads)
+	{
+		if (thread.get_id() == std::this_thread::get_id())
+		{
+			// The last reference was released by work running in this thread, it will exit as soon
+			// as it returns to runWorker and finds there's nothing left to do.
+			thread.detach();
+		}
+		else
+		{
+			thread.join();
+		}
+	}
+}
+
+void ThreadPool::post(std::function<void()>&& work)
+{
+	{
+		std::lock_guard<std::mutex> lock(_shared->mutex);
+
+		if (!_shared->stopping && _shared->pending < _shared->queueLimit)
+		{
+			const size_t index = (t_pool == _shared.get())
+				? t_queueIndex
+				: _shared->nextQueue++ % _shared->queues.size();
+			auto& queue = *_shared->queues[index];
+
+			{
+				std::lock_guard<std::mutex> queueLock(queue.mutex);
+
+				queue.work.push_back(std::move(work));
+			}
+
+			++_shared->pending;
+			_shared->condition.notify_one();
+			return;
+		}
+	}
+
+	// The pool is saturated, so run it in the calling thread.
+	runWork(work);
+}
+
+void ThreadPool::runWorker(std::shared_ptr<SharedState> shared, size_t index)
+{
+	t_pool = shared.get();
+	t_queueIndex = index;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(shared->mutex);
+
+			shared->condition.wait(lock, [&shared]() noexcept
+			{
+				return shared->stopping || shared->pending > 0;
+			});
+
+			if (shared->pending == 0)
+			{
+				// We're stopping and there's nothing left to do.
+				break;
+			}
+
+			// Reserve one of the pending work items, it's already in one of the queues.
+			--shared->pending;
+		}
+
+		std::function<void()> work;
+
+		while (!shared->tryPop(index, work))
+		{
+			std::this_thread::yield();
+		}
+
+		runWork(work);
+	}
+
+	t_pool = nullptr;
+}
+
+LimitedExecutor::LimitedExecutor(std::shared_ptr<Executor> executor, size_t maxConcurrency)
+	: _executor(std::move(executor))
+	, _maxConcurrency(std::max<size_t>(maxConcurrency, 1))
+{
+}
+
+void LimitedExecutor::post(std::function<void()>&& work)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_running >= _maxConcurrency)
+		{
+			_waiting.push(std::move(work));
+			return;
+		}
+
+		++_running;
+	}
+
+	dispatch(std::move(work));
+}
+
+void LimitedExecutor::dispatch(std::function<void()>&& work)
+{
+	auto spThis = shared_from_this();
+	auto wrapped = std::make_shared<std::function<void()>>(std::move(work));
+
+	_executor->post([spThis, wrapped]()
+	{
+		// Give up the slot even if the work throws, otherwise the work waiting for it would never run.
+		try
+		{
+			(*wrapped)();
+		}
+		catch (...)
+		{
+			spThis->complete();
+			throw;
+		}
+
+		spThis->complete();
+	});
+}
+
+void LimitedExecutor::complete()
+{
+	std::function<void()> next;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_waiting.empty())
+		{
+			--_running;
+			return;
+		}
+
+		// Hand our slot to the next work item in line.
+		next = std::move(_waiting.front());
+		_waiting.pop();
+	}
+
+	dispatch(std::move(next));
+}
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -0,0 +1,171 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include <graphqlservice/GraphQLMetrics.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+namespace {
+
+std::atomic<Metrics*> s_installed { nullptr };
+
+std::mutex s_installedMutex;
+std::vector<std::shared_ptr<Metrics>> s_keepAlive;
+
+std::atomic<uint64_t> s_nextAggregateId { 1 };
+
+} /* namespace */
+
+void Metrics::record(MetricsPhase, std::chrono::steady_clock::duration)
+{
+}
+
+void Metrics::install(std::shared_ptr<Metrics> metrics)
+{
+	std::lock_guard<std::mutex> lock(s_installedMutex);
+
+	s_installed = metrics.get();
+
+	if (metrics)
+	{
+		s_keepAlive.push_back(std::move(metrics));
+	}
+}
+
+Metrics* Metrics::get() noexcept
+{
+	return s_installed.load(std::memory_order_acquire);
+}
+
+MetricsTimer::MetricsTimer(MetricsPhase phase) noexcept
+	: _metrics(Metrics::get())
+	, _phase(phase)
+{
+	if (_metrics)
+	{
+		_start = std::chrono::steady_clock::now();
+	}
+}
+
+MetricsTimer::~MetricsTimer()
+{
+	if (_metrics)
+	{
+		_metrics->record(_phase, std::chrono::steady_clock::now() - _start);
+	}
+}
+
+constexpr size_t AggregateMetrics::s_phaseCount;
+constexpr size_t AggregateMetrics::s_bucketCount;
+
+// Only the thread which owns these counters ever writes to them, so they don't need any read-modify-write
+// operations, but other threads may read them at the same time in getPhaseMetrics.
+struct AggregateMetrics::ThreadMetrics
+{
+	struct PhaseCounters
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> nanoseconds;
+		std::array<std::atomic<uint64_t>, s_bucketCount> histogram;
+	};
+
+	std::thread::id owner;
+	std::array<PhaseCounters, s_phaseCount> phases;
+};
+
+static void increment(std::atomic<uint64_t>& counter, uint64_t value) noexcept
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+AggregateMetrics::AggregateMetrics()
+	: _id(s_nextAggregateId++)
+{
+}
+
+AggregateMetrics::~AggregateMetrics() = default;
+
+void AggregateMetrics::record(MetricsPhase phase, std::chrono::steady_clock::duration latency)
+{
+	auto& counters = getThreadMetrics().phases[static_cast<size_t>(phase)];
+	const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+	auto microseconds = static_cast<uint64_t>(nanoseconds > 0 ? nanoseconds : 0) / 1000;
+	size_t bucket = 0;
+
+	while (microseconds > 0 && bucket + 1 < s_bucketCount)
+	{
+		microseconds >>= 1;
+		++bucket;
+	}
+
+	increment(counters.count, 1);
+	increment(counters.nanoseconds, static_cast<uint64_t>(nanoseconds > 0 ? nanoseconds : 0));
+	increment(counters.histogram[bucket], 1);
+}
+
+AggregateMetrics::PhaseMetrics AggregateMetrics::getPhaseMetrics(MetricsPhase phase) const
+{
+	PhaseMetrics result {};
+	uint64_t nanoseconds = 0;
+	std::lock_guard<std::mutex> lock(_threadsMutex);
+
+	for (const auto& thread : _threads)
+	{
+		const auto& counters = thread->phases[static_cast<size_t>(phase)];
+
+		result.count += counters.count.load(std::memory_order_relaxed);
+		nanoseconds += counters.nanoseconds.load(std::memory_order_relaxed);
+
+		for (size_t i = 0; i < s_bucketCount; ++i)
+		{
+			result.histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	result.totalLatency = std::chrono::nanoseconds(nanoseconds);
+
+	return result;
+}
+
+AggregateMetrics::ThreadMetrics& AggregateMetrics::getThreadMetrics()
+{
+	// Remember the counters from the last AggregateMetrics this thread recorded to, so we only
+	// take the lock when a thread switches to a different one.
+	static thread_local uint64_t t_id = 0;
+	static thread_local ThreadMetrics* t_metrics = nullptr;
+
+	if (t_id != _id)
+	{
+		const auto owner = std::this_thread::get_id();
+		std::lock_guard<std::mutex> lock(_threadsMutex);
+		auto itr = std::find_if(_threads.cbegin(), _threads.cend(),
+			[owner](const std::unique_ptr<ThreadMetrics>& thread)
+		{
+			return thread->owner == owner;
+		});
+
+		if (itr == _threads.cend())
+		{
+			// Value-initializing ThreadMetrics starts all of the counters at 0.
+			std::unique_ptr<ThreadMetrics> metrics(new ThreadMetrics());
+
+			metrics->owner = owner;
+			_threads.push_back(std::move(metrics));
+			itr = _threads.cend() - 1;
+		}
+
+		t_metrics = itr->get();
+		t_id = _id;
+	}
+
+	return *t_metrics;
+}
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
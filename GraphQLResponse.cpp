@@ -9,14 +9,22 @@ namespace facebook {
 namespace graphql {
 namespace response {
 
+// Shared by every empty Map which hasn't allocated its members yet.
+static const MapType& emptyMap()
+{
+	static const MapType empty;
+
+	return empty;
+}
+
 Value::Value(Type type /*= Type::Null*/)
 	: _type(type)
 {
 	switch (type)
 	{
 		case Type::Map:
-			_members.reset(new std::unordered_map<std::string, size_t>());
-			_map.reset(new MapType());
+			// Most maps (e.g. arguments and directives) are empty, so wait until they're used to
+			// allocate the members.
 			break;
 
 		case Type::List:
@@ -95,33 +103,16 @@ Value::Value(Value&& other) noexcept
 
 Value::Value(const Value& other)
 	: _type(other._type)
+	, _members(other._members)
+	, _map(other._map)
+	, _list(other._list)
+	, _string(other._string)
+	, _from_json(other._from_json)
 	, _boolean(other._boolean)
 	, _int(other._int)
 	, _float(other._float)
+	, _scalar(other._scalar)
 {
-	switch (_type)
-	{
-		case Type::Map:
-			_members.reset(new std::unordered_map<std::string, size_t>(*other._members));
-			_map.reset(new MapType(*other._map));
-			break;
-
-		case Type::List:
-			_list.reset(new ListType(*other._list));
-			break;
-
-		case Type::String:
-		case Type::EnumValue:
-			_string.reset(new StringType(*other._string));
-			break;
-
-		case Type::Scalar:
-			_scalar.reset(new Value(*other._scalar));
-			break;
-
-		default:
-			break;
-	}
 }
 
 Value& Value::operator=(Value&& rhs) noexcept
@@ -156,7 +147,7 @@ bool Value::operator==(const Value& rhs) const noexcept
 	switch (_type)
 	{
 		case Type::Map:
-			return *_map == *rhs._map;
+			return (_map ? *_map : emptyMap()) == (rhs._map ? *rhs._map : emptyMap());
 
 		case Type::List:
 			return *_list == *rhs._list;
@@ -185,6 +176,32 @@ bool Value::operator==(const Value& rhs) const noexcept
 	}
 }
 
+void Value::allocateMap()
+{
+	if (!_map)
+	{
+		_members.reset(new std::unordered_map<std::string, size_t>());
+		_map.reset(new MapType());
+	}
+}
+
+void Value::detachMap()
+{
+	if (_map && _map.use_count() > 1)
+	{
+		_members.reset(new std::unordered_map<std::string, size_t>(*_members));
+		_map.reset(new MapType(*_map));
+	}
+}
+
+void Value::detachList()
+{
+	if (_list.use_count() > 1)
+	{
+		_list.reset(new ListType(*_list));
+	}
+}
+
 bool Value::operator!=(const Value& rhs) const noexcept
 {
 	return !(*this == rhs);
@@ -213,11 +230,14 @@ void Value::reserve(size_t count)
 	switch (_type)
 	{
 		case Type::Map:
+			allocateMap();
+			detachMap();
 			_members->reserve(count);
 			_map->reserve(count);
 			break;
 
 		case Type::List:
+			detachList();
 			_list->reserve(count);
 			break;
 
@@ -231,7 +251,7 @@ size_t Value::size() const
 	switch (_type)
 	{
 		case Type::Map:
-			return _map->size();
+			return (_map ? _map->size() : 0);
 
 		case Type::List:
 			return _list->size();
@@ -248,6 +268,9 @@ void Value::emplace_back(std::string&& name, Value&& value)
 		throw std::logic_error("Invalid call to Value::emplace_back for MapType");
 	}
 
+	allocateMap();
+	detachMap();
+
 	if (_members->find(name) != _members->cend())
 	{
 		throw std::runtime_error("Duplicate Map member");
@@ -264,6 +287,11 @@ MapType::const_iterator Value::find(const std::string& name) const
 		throw std::logic_error("Invalid call to Value::find for MapType");
 	}
 
+	if (!_map)
+	{
+		return emptyMap().cend();
+	}
+
 	const auto itr = _members->find(name);
 
 	if (itr == _members->cend())
@@ -281,7 +309,7 @@ MapType::const_iterator Value::begin() const
 		throw std::logic_error("Invalid call to Value::end for MapType");
 	}
 
-	return _map->cbegin();
+	return (_map ? _map->cbegin() : emptyMap().cbegin());
 }
 
 MapType::const_iterator Value::end() const
@@ -291,14 +319,14 @@ MapType::const_iterator Value::end() const
 		throw std::logic_error("Invalid call to Value::end for MapType");
 	}
 
-	return _map->cend();
+	return (_map ? _map->cend() : emptyMap().cend());
 }
 
 const Value& Value::operator[](const std::string& name) const
 {
 	const auto itr = find(name);
 
-	if (itr == _map->cend())
+	if (itr == end())
 	{
 		throw std::runtime_error("Missing Map member");
 	}
@@ -313,6 +341,7 @@ void Value::emplace_back(Value&& value)
 		throw std::logic_error("Invalid call to Value::emplace_back for ListType");
 	}
 
+	detachList();
 	_list->emplace_back(std::move(value));
 }
 
@@ -335,7 +364,14 @@ void Value::set<StringType>(StringType&& value)
 		throw std::logic_error("Invalid call to Value::set for StringType");
 	}
 
-	*_string = std::move(value);
+	if (_string.use_count() > 1)
+	{
+		_string.reset(new StringType(std::move(value)));
+	}
+	else
+	{
+		*_string = std::move(value);
+	}
 }
 
 template <>
@@ -379,7 +415,14 @@ void Value::set<ScalarType>(ScalarType&& value)
 		throw std::logic_error("Invalid call to Value::set for ScalarType");
 	}
 
-	*_scalar = std::move(value);
+	if (_scalar.use_count() > 1)
+	{
+		_scalar.reset(new ScalarType(std::move(value)));
+	}
+	else
+	{
+		*_scalar = std::move(value);
+	}
 }
 
 template <>
@@ -390,7 +433,7 @@ const MapType& Value::get<const MapType&>() const
 		throw std::logic_error("Invalid call to Value::get for MapType");
 	}
 
-	return *_map;
+	return (_map ? *_map : emptyMap());
 }
 
 template <>
@@ -468,9 +511,22 @@ MapType Value::release<MapType>()
 		throw std::logic_error("Invalid call to Value::release for MapType");
 	}
 
-	MapType result = std::move(*_map);
+	MapType result;
 
-	_members->clear();
+	if (_map)
+	{
+		if (_map.use_count() > 1)
+		{
+			result = MapType(*_map);
+		}
+		else
+		{
+			result = std::move(*_map);
+		}
+
+		_map.reset();
+		_members.reset();
+	}
 
 	return result;
 }
@@ -483,6 +539,8 @@ ListType Value::release<ListType>()
 		throw std::logic_error("Invalid call to Value::release for ListType");
 	}
 
+	detachList();
+
 	ListType result = std::move(*_list);
 
 	return result;
@@ -497,6 +555,11 @@ StringType Value::release<StringType>()
 		throw std::logic_error("Invalid call to Value::release for StringType");
 	}
 
+	if (_string.use_count() > 1)
+	{
+		return *_string;
+	}
+
 	StringType result = std::move(*_string);
 
 	return result;
@@ -510,6 +573,11 @@ ScalarType Value::release<ScalarType>()
 		throw std::logic_error("Invalid call to Value::release for ScalarType");
 	}
 
+	if (_scalar.use_count() > 1)
+	{
+		return ScalarType(*_scalar);
+	}
+
 	ScalarType result = std::move(*_scalar);
 
 	return result;
@@ -2,13 +2,17 @@
 // Licensed under the MIT License.
 
 #include "GraphQLGrammar.h"
+#include "Validation.h"
 
 #include <graphqlservice/GraphQLService.h>
+#include <graphqlservice/GraphQLMetrics.h>
 
 #include <iostream>
 #include <algorithm>
 #include <array>
+#include <deque>
 #include <stack>
+#include <random>
 
 namespace facebook {
 namespace graphql {
@@ -33,12 +37,136 @@ const response::Value& schema_exception::getErrors() const noexcept
 	return _errors;
 }
 
+Tracer::Tracer(double sampleRate)
+	: _sampleRate(sampleRate)
+{
+}
+
+bool Tracer::sample()
+{
+	if (_sampleRate >= 1.0)
+	{
+		return true;
+	}
+	else if (_sampleRate <= 0.0)
+	{
+		return false;
+	}
+
+	static thread_local std::mt19937 s_generator { std::random_device()() };
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+	return distribution(s_generator) < _sampleRate;
+}
+
+void Tracer::traceField(FieldTrace&& trace)
+{
+	std::lock_guard<std::mutex> lock(_tracesMutex);
+
+	_traces.push_back(std::move(trace));
+}
+
+std::vector<FieldTrace> Tracer::releaseTraces()
+{
+	std::lock_guard<std::mutex> lock(_tracesMutex);
+	std::vector<FieldTrace> traces(std::move(_traces));
+
+	_traces.clear();
+
+	return traces;
+}
+
+void RequestState::addBatchDispatcher(std::shared_ptr<BatchDispatcher> dispatcher)
+{
+	std::lock_guard<std::mutex> lock(_batchMutex);
+
+	_batchDispatchers.push_back(std::move(dispatcher));
+}
+
+void RequestState::dispatchBatches()
+{
+	std::vector<std::shared_ptr<BatchDispatcher>> dispatchers;
+
+	{
+		std::lock_guard<std::mutex> lock(_batchMutex);
+
+		// A BatchLoader still dispatches itself if something waits on it while the batches are held.
+		if (_batchHolds > 0)
+		{
+			return;
+		}
+
+		dispatchers = _batchDispatchers;
+	}
+
+	for (const auto& dispatcher : dispatchers)
+	{
+		dispatcher->dispatch();
+	}
+}
+
+void RequestState::holdBatches()
+{
+	std::lock_guard<std::mutex> lock(_batchMutex);
+
+	++_batchHolds;
+}
+
+void RequestState::releaseBatches()
+{
+	{
+		std::lock_guard<std::mutex> lock(_batchMutex);
+
+		--_batchHolds;
+	}
+
+	dispatchBatches();
+}
+
+void RequestState::releaseCollectedFields(const FragmentMap& fragments)
+{
+	std::lock_guard<std::mutex> lock(_collectedFieldsMutex);
+	const CollectedFieldsKey first { &fragments, std::string(), std::vector<const peg::ast_node*>() };
+	auto itr = _collectedFields.lower_bound(first);
+
+	while (itr != _collectedFields.end()
+		&& std::get<0>(itr->first) == &fragments)
+	{
+		itr = _collectedFields.erase(itr);
+	}
+
+	auto itrSelected = _selectedFields.lower_bound(first);
+
+	while (itrSelected != _selectedFields.end()
+		&& std::get<0>(itrSelected->first) == &fragments)
+	{
+		itrSelected = _selectedFields.erase(itrSelected);
+	}
+}
+
+bool SelectionSetParams::isCancelled() const noexcept
+{
+	return state
+		&& state->cancellation
+		&& state->cancellation->isCancelled();
+}
+
 FieldParams::FieldParams(const SelectionSetParams& selectionSetParams, response::Value&& directives)
 	: SelectionSetParams(selectionSetParams)
 	, fieldDirectives(std::move(directives))
 {
 }
 
+FieldParams::FieldParams(const ResolverParams& resolverParams, response::Value&& directives)
+	: SelectionSetParams(resolverParams)
+	, fieldDirectives(std::move(directives))
+	, _selection(resolverParams.selection)
+	, _mergedSelections(resolverParams.mergedSelections)
+	, _fragments(&resolverParams.fragments)
+	, _variables(&resolverParams.variables)
+{
+}
+
 // ValueVisitor visits the AST and builds a response::Value representation of any value
 // hardcoded or referencing a variable in an operation.
 class ValueVisitor
@@ -135,6 +263,8 @@ void ValueVisitor::visitVariable(const peg::ast_node& variable)
 		throw schema_exception({ error.str() });
 	}
 
+	// The copy shares the coerced value with the variables, so referencing the same variable in the
+	// arguments of many fields doesn't copy it for each of them.
 	_value = response::Value(itr->second);
 }
 
@@ -207,6 +337,7 @@ public:
 	void visit(const peg::ast_node& directives);
 
 	bool shouldSkip() const;
+	bool shouldDefer(std::string& label) const;
 	response::Value getDirectives();
 
 private:
@@ -268,6 +399,44 @@ response::Value DirectiveVisitor::getDirectives()
 	return result;
 }
 
+// Fragments with an @defer directive are deferred unless its if argument is false. The label is
+// optional and only used to identify the patch.
+bool DirectiveVisitor::shouldDefer(std::string& label) const
+{
+	auto itrDirective = _directives.find("defer");
+
+	if (itrDirective == _directives.end())
+	{
+		return false;
+	}
+
+	const auto& arguments = itrDirective->second;
+
+	if (arguments.type() != response::Type::Map)
+	{
+		throw schema_exception({ "Invalid arguments to directive: defer" });
+	}
+
+	auto itrIf = arguments.find("if");
+
+	if (itrIf != arguments.end()
+		&& itrIf->second.type() == response::Type::Boolean
+		&& !itrIf->second.get<response::BooleanType>())
+	{
+		return false;
+	}
+
+	auto itrLabel = arguments.find("label");
+
+	if (itrLabel != arguments.end()
+		&& itrLabel->second.type() == response::Type::String)
+	{
+		label = itrLabel->second.get<const response::StringType&>();
+	}
+
+	return true;
+}
+
 bool DirectiveVisitor::shouldSkip() const
 {
 	static const std::array<std::pair<bool, std::string>, 2> skippedNames = {
@@ -600,152 +769,164 @@ std::vector<uint8_t> ModifiedArgument<std::vector<uint8_t>>::convert(const respo
 }
 
 template <>
-std::future<response::Value> ModifiedResult<response::IntType>::convert(std::future<response::IntType>&& result, ResolverParams&&)
+response::Value ModifiedResult<response::IntType>::serialize(response::IntType&& result, const ResolverParams&)
 {
-	return std::async(std::launch::deferred,
-		[](std::future<response::IntType>&& resultFuture)
-	{
-		return response::Value(resultFuture.get());
-	}, std::move(result));
+	return response::Value(result);
 }
 
 template <>
-std::future<response::Value> ModifiedResult<response::FloatType>::convert(std::future<response::FloatType>&& result, ResolverParams&&)
+response::Value ModifiedResult<response::FloatType>::serialize(response::FloatType&& result, const ResolverParams&)
 {
-	return std::async(std::launch::deferred,
-		[](std::future<response::FloatType>&& resultFuture)
-	{
-		return response::Value(resultFuture.get());
-	}, std::move(result));
+	return response::Value(result);
 }
 
 template <>
-std::future<response::Value> ModifiedResult<response::StringType>::convert(std::future<response::StringType>&& result, ResolverParams&& params)
+response::Value ModifiedResult<response::StringType>::serialize(response::StringType&& result, const ResolverParams&)
 {
-	return std::async(std::launch::deferred,
-		[&](std::future<response::StringType>&& resultFuture, ResolverParams&& paramsFuture)
-	{
-		return response::Value(resultFuture.get());
-	}, std::move(result), std::move(params));
+	return response::Value(std::move(result));
 }
 
 template <>
-std::future<response::Value> ModifiedResult<response::BooleanType>::convert(std::future<response::BooleanType>&& result, ResolverParams&&)
+response::Value ModifiedResult<response::BooleanType>::serialize(response::BooleanType&& result, const ResolverParams&)
 {
-	return std::async(std::launch::deferred,
-		[](std::future<response::BooleanType>&& resultFuture)
-	{
-		return response::Value(resultFuture.get());
-	}, std::move(result));
+	return response::Value(result);
 }
 
 template <>
-std::future<response::Value> ModifiedResult<response::Value>::convert(std::future<response::Value>&& result, ResolverParams&&)
+response::Value ModifiedResult<response::Value>::serialize(response::Value&& result, const ResolverParams&)
 {
-	return std::move(result);
+	return response::Value(std::move(result));
 }
 
 template <>
-std::future<response::Value> ModifiedResult<std::vector<uint8_t>>::convert(std::future<std::vector<uint8_t>>&& result, ResolverParams&& params)
+response::Value ModifiedResult<std::vector<uint8_t>>::serialize(std::vector<uint8_t>&& result, const ResolverParams&)
 {
-	return std::async(std::launch::deferred,
-		[](std::future<std::vector<uint8_t>>&& resultFuture, ResolverParams&& paramsFuture)
-	{
-		return response::Value(Base64::toBase64(resultFuture.get()));
-	}, std::move(result), std::move(params));
+	return response::Value(Base64::toBase64(result));
 }
 
-template <>
-std::future<response::Value> ModifiedResult<Object>::convert(std::future<std::shared_ptr<Object>> result, ResolverParams&& params)
+// As we recursively expand fragment spreads and inline fragments, we want to accumulate the directives
+// at each location and merge them with any directives included in outer fragments to build the complete
+// set of directives for nested fragments. Directives with the same name at the same location will be
+// overwritten by the innermost fragment. Nested fragments share any of the maps which they don't
+// change with the outer fragment instead of copying them.
+struct FragmentDirectives
 {
-	return std::async(std::launch::deferred,
-		[](std::future<std::shared_ptr<Object>>&& resultFuture, ResolverParams&& paramsFuture)
+	std::shared_ptr<const response::Value> fragmentDefinitionDirectives;
+	std::shared_ptr<const response::Value> fragmentSpreadDirectives;
+	std::shared_ptr<const response::Value> inlineFragmentDirectives;
+};
+
+// Merge the directives at an inner location with the outer directives as long as they don't conflict.
+static std::shared_ptr<const response::Value> mergeDirectives(response::Value&& directives, const std::shared_ptr<const response::Value>& outerDirectives)
+{
+	if (directives.size() == 0)
 	{
-		auto wrappedResult = resultFuture.get();
+		return outerDirectives;
+	}
 
-		if (!wrappedResult || !paramsFuture.selection)
+	for (const auto& entry : *outerDirectives)
+	{
+		if (directives.find(entry.first) == directives.end())
 		{
-			return response::Value(!wrappedResult
-				? response::Type::Null
-				: response::Type::Map);
+			directives.emplace_back(std::string(entry.first), response::Value(entry.second));
 		}
+	}
 
-		return wrappedResult->resolve(paramsFuture, *paramsFuture.selection, paramsFuture.fragments, paramsFuture.variables).get();
-	}, std::move(result), std::move(params));
+	return std::make_shared<const response::Value>(std::move(directives));
 }
 
-// As we recursively expand fragment spreads and inline fragments, we want to accumulate the directives
-// at each location and merge them with any directives included in outer fragments to build the complete
-// set of directives for nested fragments. Directives with the same name at the same location will be
-// overwritten by the innermost fragment.
-struct FragmentDirectives
+// Every selection of the same response key in a selection set is merged into a single field, as
+// described in the CollectFields and MergeSelectionSets algorithms in the spec. The first selection
+// determines the arguments and directives, the sub-selections are merged from all of them.
+struct CollectedField
+{
+	std::string name;
+	std::string alias;
+	const peg::ast_node* field;
+	response::Value arguments;
+	response::Value fieldDirectives;
+	std::shared_ptr<FragmentDirectives> fragmentDirectives;
+	std::vector<const peg::ast_node*> selections;
+	std::string typeCondition;
+};
+
+// A fragment with an @defer directive in an operation which is delivered incrementally. Its selection
+// set is collected and resolved separately on the same Object after the rest of the selection set.
+struct DeferredFragment
+{
+	std::string label;
+	const peg::ast_node* selection;
+	std::shared_ptr<FragmentDirectives> fragmentDirectives;
+};
+
+struct CollectedSelection
 {
-	response::Value fragmentDefinitionDirectives;
-	response::Value fragmentSpreadDirectives;
-	response::Value inlineFragmentDirectives;
+	std::vector<CollectedField> fields;
+	std::vector<DeferredFragment> deferred;
 };
 
-// SelectionVisitor visits the AST and resolves a field or fragment, unless it's skipped by
-// a directive or type condition.
+// SelectionVisitor visits the AST and collects the fields in a selection set, unless they're
+// skipped by a directive or type condition. The result only depends on the operation and the
+// type names, so the RequestState can share it between every Object of the same type. If the
+// operation is delivered incrementally, fragments with an @defer directive are set aside instead.
+// Without any type names, it ignores the type conditions and collects the fields in every fragment.
 class SelectionVisitor
 {
 public:
-	explicit SelectionVisitor(const SelectionSetParams& selectionSetParams, const FragmentMap& fragments, const response::Value& variables,
-		const TypeNames& typeNames, const ResolverMap& resolvers);
+	explicit SelectionVisitor(const FragmentMap& fragments, const response::Value& variables, const TypeNames& typeNames, bool validated,
+		bool deferFragments = false, std::shared_ptr<FragmentDirectives> fragmentDirectives = nullptr);
 
 	void visit(const peg::ast_node& selection);
 
-	std::future<response::Value> getValues();
+	CollectedSelection getSelection();
 
 private:
 	void visitField(const peg::ast_node& field);
 	void visitFragmentSpread(const peg::ast_node& fragmentSpread);
 	void visitInlineFragment(const peg::ast_node& inlineFragment);
 
-	const std::shared_ptr<RequestState>& _state;
-	const response::Value& _operationDirectives;
 	const FragmentMap& _fragments;
 	const response::Value& _variables;
 	const TypeNames& _typeNames;
-	const ResolverMap& _resolvers;
-
-	std::stack<FragmentDirectives> _fragmentDirectives;
-	std::queue<std::pair<std::string, std::future<response::Value>>> _values;
+	const bool _validated;
+	const bool _deferFragments;
+
+	// Fields which are resolved on the Executor share ownership of the directives with the visitor.
+	std::stack<std::shared_ptr<FragmentDirectives>> _fragmentDirectives;
+	std::stack<std::string> _typeConditions;
+	std::vector<CollectedField> _fields;
+	std::unordered_map<std::string, size_t> _fieldIndex;
+	std::vector<DeferredFragment> _deferred;
 };
 
-SelectionVisitor::SelectionVisitor(const SelectionSetParams& selectionSetParams, const FragmentMap& fragments, const response::Value& variables,
-	const TypeNames& typeNames, const ResolverMap& resolvers)
-	: _state(selectionSetParams.state)
-	, _operationDirectives(selectionSetParams.operationDirectives)
-	, _fragments(fragments)
+SelectionVisitor::SelectionVisitor(const FragmentMap& fragments, const response::Value& variables, const TypeNames& typeNames, bool validated,
+	bool deferFragments, std::shared_ptr<FragmentDirectives> fragmentDirectives)
+	: _fragments(fragments)
 	, _variables(variables)
 	, _typeNames(typeNames)
-	, _resolvers(resolvers)
+	, _validated(validated)
+	, _deferFragments(deferFragments)
 {
-	_fragmentDirectives.push({
-		response::Value(response::Type::Map),
-		response::Value(response::Type::Map),
-		response::Value(response::Type::Map)
-		});
-}
+	if (!fragmentDirectives)
+	{
+		auto emptyDirectives = std::make_shared<const response::Value>(response::Type::Map);
 
-std::future<response::Value> SelectionVisitor::getValues()
-{
-	return std::async(std::launch::deferred,
-		[](std::queue<std::pair<std::string, std::future<response::Value>>>&& values)
-		{
-			response::Value result(response::Type::Map);
+		fragmentDirectives = std::make_shared<FragmentDirectives>(FragmentDirectives {
+			emptyDirectives,
+			emptyDirectives,
+			emptyDirectives
+			});
+	}
 
-			while (!values.empty())
-			{
-				auto& entry = values.front();
+	_fragmentDirectives.push(std::move(fragmentDirectives));
+	_typeConditions.push(std::string());
+}
 
-				result.emplace_back(std::move(entry.first), entry.second.get());
-				values.pop();
-			}
+CollectedSelection SelectionVisitor::getSelection()
+{
+	_fieldIndex.clear();
 
-			return result;
-		}, std::move(_values));
+	return { std::move(_fields), std::move(_deferred) };
 }
 
 void SelectionVisitor::visit(const peg::ast_node& selection)
@@ -787,20 +968,6 @@ void SelectionVisitor::visitField(const peg::ast_node& field)
 		alias = name;
 	}
 
-	const auto itr = _resolvers.find(name);
-
-	if (itr == _resolvers.cend())
-	{
-		auto position = field.begin();
-		std::ostringstream error;
-
-		error << "Unknown field name: " << name
-			<< " line: " << position.line
-			<< " column: " << position.byte_in_line;
-
-		throw schema_exception({ error.str() });
-	}
-
 	DirectiveVisitor directiveVisitor(_variables);
 
 	peg::on_first_child<peg::directives>(field,
@@ -837,793 +1004,2969 @@ void SelectionVisitor::visitField(const peg::ast_node& field)
 			selection = &child;
 		});
 
-	SelectionSetParams selectionSetParams {
-		_state,
-		_operationDirectives,
-		_fragmentDirectives.top().fragmentDefinitionDirectives,
-		_fragmentDirectives.top().fragmentSpreadDirectives,
-		_fragmentDirectives.top().inlineFragmentDirectives
-	};
+	// Without any type names we're looking ahead at an interface or union field before the concrete
+	// type is known, so fragments with different type conditions may legitimately use the same alias
+	// for different fields. Keep those apart by type condition and leave the conflict check to the
+	// execution of the field on its concrete type.
+	const bool lookahead = _typeNames.empty();
+	std::string fieldKey(alias);
+	auto indexItr = _fieldIndex.find(fieldKey);
+
+	if (lookahead
+		&& indexItr != _fieldIndex.cend()
+		&& (_fields[indexItr->second].name != name
+			|| _fields[indexItr->second].arguments != arguments))
+	{
+		fieldKey.append(" on ").append(_typeConditions.top());
+		indexItr = _fieldIndex.find(fieldKey);
+	}
 
-	_values.push({
-		std::move(alias),
-		itr->second(ResolverParams(selectionSetParams, std::move(arguments), directiveVisitor.getDirectives(), selection, _fragments, _variables))
-		});
-}
+	if (indexItr != _fieldIndex.cend())
+	{
+		// We've already collected this response key, so merge the sub-selection into that field. A
+		// validated document can't have any conflicting fields, so we only need to compare them if
+		// it wasn't validated.
+		auto& collected = _fields[indexItr->second];
+
+		if (!_validated
+			&& !lookahead
+			&& (collected.name != name
+				|| collected.arguments != arguments))
+		{
+			auto position = field.begin();
+			std::ostringstream error;
 
-void SelectionVisitor::visitFragmentSpread(const peg::ast_node& fragmentSpread)
-{
-	const std::string name(fragmentSpread.children.front()->content());
-	auto itr = _fragments.find(name);
+			error << "Conflicting fields for response key: " << alias
+				<< " line: " << position.line
+				<< " column: " << position.byte_in_line;
 
-	if (itr == _fragments.cend())
-	{
-		auto position = fragmentSpread.begin();
-		std::ostringstream error;
+			throw schema_exception({ error.str() });
+		}
 
-		error << "Unknown fragment name: " << name
-			<< " line: " << position.line
-			<< " column: " << position.byte_in_line;
+		if (selection != nullptr)
+		{
+			collected.selections.push_back(selection);
+		}
 
-		throw schema_exception({ error.str() });
+		return;
 	}
 
-	bool skip = (_typeNames.count(itr->second.getType()) == 0);
-	DirectiveVisitor directiveVisitor(_variables);
+	std::vector<const peg::ast_node*> selections;
 
-	if (!skip)
+	if (selection != nullptr)
 	{
-		peg::on_first_child<peg::directives>(fragmentSpread,
-			[&directiveVisitor](const peg::ast_node& child)
-			{
-
-				directiveVisitor.visit(child);
-			});
-
-		skip = directiveVisitor.shouldSkip();
+		selections.push_back(selection);
 	}
 
-	if (skip)
-	{
-		return;
-	}
+	_fieldIndex[std::move(fieldKey)] = _fields.size();
+	_fields.push_back({
+		std::move(name),
+		std::move(alias),
+		&field,
+		std::move(arguments),
+		directiveVisitor.getDirectives(),
+		_fragmentDirectives.top(),
+		std::move(selections),
+		_typeConditions.top()
+		});
+}
 
-	auto fragmentSpreadDirectives = directiveVisitor.getDirectives();
+// The pending result of a field in resolveFields, along with the field itself and whether it's
+// non-null in case it's cancelled, and the trace if the operation is being traced. The time spent
+// calling the resolver is added to the time spent waiting for its value, without counting anything
+// else which happens in between.
+struct FieldResult
+{
+	std::string alias;
+	const peg::ast_node* field;
+	std::future<response::Value> value;
+	std::shared_ptr<FieldTrace> trace;
+	std::chrono::steady_clock::duration elapsed;
+	bool nonNull;
+};
 
-	// Merge outer fragment spread directives as long as they don't conflict.
-	for (const auto& entry : _fragmentDirectives.top().fragmentSpreadDirectives)
+// Wait for a field whose value is being thrown away and ignore the result. Fields launched on the
+// Executor (including any in their nested selection sets) borrow the resolver from the Object and
+// the directives, fragments, and variables from the operation, so they need to finish before
+// an error lets the caller release either of those. Fields which are abandoned at the deadline
+// hold onto the Object, and the operation keeps the rest alive with Cancellation::holdWhileAbandoned.
+static void discardFieldValue(FieldResult& entry) noexcept
+{
+	try
 	{
-		if (fragmentSpreadDirectives.find(entry.first) == fragmentSpreadDirectives.end())
+		if (entry.value.valid())
 		{
-			fragmentSpreadDirectives.emplace_back(std::string(entry.first), response::Value(entry.second));
+			entry.value.get();
 		}
 	}
+	catch (...)
+	{
+	}
+}
+
+// Everything else resolveFields needs to finish a field after waiting for its value.
+struct FieldContext
+{
+	Metrics* metrics;
+	bool launchFields;
+	std::shared_ptr<Cancellation> cancellation;
+	std::shared_ptr<Tracer> tracer;
+
+	// Fields which are queued in a ResolveQueue keep the Object alive until they're resolved, along
+	// with the collected fields whose directives and selections are borrowed by their resolvers. If
+	// there's no RequestState to cache them, nothing else holds onto them once the selection set returns.
+	std::shared_ptr<const Object> object;
+	std::shared_ptr<const CollectedSelection> collected;
+};
+
+// Each selection set waits for the values of its fields while its parent field is waiting for it, so
+// without a limit the native stack would grow with the depth of the operation. Once the selection
+// sets on a thread are nested more than s_maxNestedSelectionSets levels deep, their fields are left
+// null and queued here instead. The outermost selection set on the thread owns the queue, and it
+// fills them in one at a time after its own fields, so the stack stays within that many levels no
+// matter how deep the operation is. The values in between are only moved until then, and moving a
+// response::Value doesn't move the members of a Map, so the queued pointers stay valid.
+class ResolveQueue
+{
+public:
+	ResolveQueue();
+	~ResolveQueue();
 
-	response::Value fragmentDefinitionDirectives(itr->second.getDirectives());
+	// The innermost ResolveQueue on this thread, or nullptr if there isn't one yet.
+	static ResolveQueue* current() noexcept;
 
-	// Merge outer fragment definition directives as long as they don't conflict.
-	for (const auto& entry : _fragmentDirectives.top().fragmentDefinitionDirectives)
+	// Track how deeply the selection sets are nested on this thread.
+	class NestedSelectionSet
 	{
-		if (fragmentDefinitionDirectives.find(entry.first) == fragmentDefinitionDirectives.end())
-		{
-			fragmentDefinitionDirectives.emplace_back(std::string(entry.first), response::Value(entry.second));
-		}
-	}
+	public:
+		explicit NestedSelectionSet(ResolveQueue& queue) noexcept;
+		~NestedSelectionSet();
 
-	_fragmentDirectives.push({
-		std::move(fragmentDefinitionDirectives),
-		std::move(fragmentSpreadDirectives),
-		response::Value(_fragmentDirectives.top().inlineFragmentDirectives)
-		});
+		bool tooDeep() const noexcept;
 
-	for (const auto& selection : itr->second.getSelection().children)
+	private:
+		ResolveQueue& _queue;
+	};
+
+	void push(response::Value& value, FieldResult&& entry, const FieldContext& context);
+
+	// If a field is cancelled, the values for any of its fields which were queued in the meantime
+	// are discarded with it.
+	size_t mark() const noexcept;
+	void truncate(size_t mark);
+
+	// Fill in every queued field, including any which are queued while doing that.
+	void drain();
+
+private:
+	struct PendingField
 	{
-		visit(*selection);
-	}
+		response::Value* value;
+		FieldResult entry;
+		FieldContext context;
+	};
 
-	_fragmentDirectives.pop();
-}
+	ResolveQueue* const _previous;
+	size_t _depth = 0;
+	std::deque<PendingField> _pending;
+};
 
-void SelectionVisitor::visitInlineFragment(const peg::ast_node& inlineFragment)
+static const size_t s_maxNestedSelectionSets = 32;
+
+static thread_local ResolveQueue* t_resolveQueue = nullptr;
+static thread_local size_t t_eagerSelectionSets = 0;
+
+// @synchronous accessors return their Objects right away, so ModifiedResult resolves the selection
+// set of each one while its parent selection set is still calling resolvers, before anything waits
+// for a value. That nests on the stack too, so once it's more than s_maxNestedSelectionSets levels
+// deep the rest of the selection set is deferred until its value is waited on, where the depth is
+// bounded by the ResolveQueue instead.
+class EagerSelectionSet
 {
-	DirectiveVisitor directiveVisitor(_variables);
+public:
+	EagerSelectionSet() noexcept
+	{
+		++t_eagerSelectionSets;
+	}
 
-	peg::on_first_child<peg::directives>(inlineFragment,
-		[&directiveVisitor](const peg::ast_node& child)
-		{
-			directiveVisitor.visit(child);
-		});
+	~EagerSelectionSet()
+	{
+		--t_eagerSelectionSets;
+	}
 
-	if (directiveVisitor.shouldSkip())
+	bool tooDeep() const noexcept
 	{
-		return;
+		return t_eagerSelectionSets > s_maxNestedSelectionSets;
 	}
+};
 
-	const peg::ast_node* typeCondition = nullptr;
+// Wait for the value of a field in resolveFields, and record its metrics and trace. If the request was
+// cancelled, the error is added to the Cancellation and the value is null. If the field is non-null,
+// it throws a propagated_cancellation instead, so the null replaces its parent.
+static response::Value getFieldValue(FieldResult& entry, const FieldContext& context)
+{
+	auto queue = ResolveQueue::current();
+	const auto mark = queue->mark();
 
-	peg::on_first_child<peg::type_condition>(inlineFragment,
-		[&typeCondition](const peg::ast_node& child)
+	try
+	{
+		// Fields which were launched on the Executor record their own metrics.
+		const bool recordMetrics = (context.metrics && !context.launchFields);
+		std::chrono::steady_clock::time_point waitStart;
+
+		if (recordMetrics || entry.trace)
 		{
-			typeCondition = &child;
-		});
+			waitStart = std::chrono::steady_clock::now();
+		}
 
-	if (typeCondition == nullptr
-		|| _typeNames.count(typeCondition->children.front()->content()) > 0)
-	{
-		peg::on_first_child<peg::selection_set>(inlineFragment,
-			[this, &directiveVisitor](const peg::ast_node& child)
+		auto value = entry.value.get();
+
+		// The sibling fields before this one were waited on after its resolver returned, so only
+		// count the time it actually spent resolving, not when we got around to it.
+		if (recordMetrics || entry.trace)
 		{
-			auto inlineFragmentDirectives = directiveVisitor.getDirectives();
+			const auto elapsed = entry.elapsed + (std::chrono::steady_clock::now() - waitStart);
 
-			// Merge outer inline fragment directives as long as they don't conflict.
-			for (const auto& entry : _fragmentDirectives.top().inlineFragmentDirectives)
+			if (recordMetrics)
 			{
-				if (inlineFragmentDirectives.find(entry.first) == inlineFragmentDirectives.end())
-				{
-					inlineFragmentDirectives.emplace_back(std::string(entry.first), response::Value(entry.second));
-				}
+				context.metrics->record(MetricsPhase::Resolve, elapsed);
 			}
 
-			_fragmentDirectives.push({
-				response::Value(_fragmentDirectives.top().fragmentDefinitionDirectives),
-				response::Value(_fragmentDirectives.top().fragmentSpreadDirectives),
-				std::move(inlineFragmentDirectives)
-				});
-
-			for (const auto& selection : child.children)
+			if (entry.trace)
 			{
-				visit(*selection);
+				entry.trace->end = entry.trace->start + elapsed;
+				context.tracer->traceField(std::move(*entry.trace));
 			}
+		}
 
-			_fragmentDirectives.pop();
-		});
+		return value;
 	}
-}
+	catch (const propagated_cancellation&)
+	{
+		// The error was already recorded for the non-null field nested inside of this one.
+		queue->truncate(mark);
 
-Object::Object(TypeNames&& typeNames, ResolverMap&& resolvers)
-	: _typeNames(std::move(typeNames))
-	, _resolvers(std::move(resolvers))
-{
-}
+		if (entry.nonNull)
+		{
+			throw;
+		}
+	}
+	catch (const cancelled_exception& ex)
+	{
+		if (!context.cancellation)
+		{
+			throw;
+		}
 
-std::future<response::Value> Object::resolve(const SelectionSetParams& selectionSetParams, const peg::ast_node& selection, const FragmentMap& fragments, const response::Value& variables) const
-{
-	std::queue<std::future<response::Value>> selections;
+		queue->truncate(mark);
 
-	beginSelectionSet(selectionSetParams);
+		auto position = entry.field->begin();
+		std::ostringstream error;
 
-	for (const auto& child : selection.children)
-	{
-		SelectionVisitor visitor(selectionSetParams, fragments, variables, _typeNames, _resolvers);
+		error << ex.what()
+			<< " field: " << entry.alias
+			<< " line: " << position.line
+			<< " column: " << position.byte_in_line;
 
-		visitor.visit(*child);
-		selections.push(visitor.getValues());
+		context.cancellation->addError(error.str());
+
+		if (entry.nonNull)
+		{
+			throw propagated_cancellation(ex.what());
+		}
 	}
 
-	endSelectionSet(selectionSetParams);
+	return response::Value();
+}
 
-	return std::async(std::launch::deferred,
-		[](std::queue<std::future<response::Value>>&& promises)
+// Only fields in a request with a Cancellation need to know if they're non-null, and only if there's
+// a schema from introspection to look them up in.
+static bool isNonNullField(const ValidationSchema* schema, const std::string& typeName, const std::string& fieldName)
+{
+	if (!schema)
 	{
-		response::Value result(response::Type::Map);
+		return false;
+	}
 
-		while (!promises.empty())
-		{
-			auto values = promises.front().get();
+	const auto type = schema->getType(typeName);
+	const auto field = type
+		? schema->getField(typeName, *type, fieldName)
+		: nullptr;
 
-			promises.pop();
+	return field
+		&& !field->type.empty()
+		&& field->type.back() == '!';
+}
 
-			if (values.type() == response::Type::Map)
-			{
-				auto members = values.release<response::MapType>();
+// Wait for a value which is shared with other resolvers or handed off to another thread in its own
+// ResolveQueue, so any fields which are nested too deeply are filled in before anything else sees it.
+static response::Value waitForValue(std::future<response::Value>&& value)
+{
+	ResolveQueue queue;
+	auto result = value.get();
 
-				for (auto& entry : members)
-				{
-					result.emplace_back(std::move(entry.first), std::move(entry.second));
-				}
-			}
-		}
+	queue.drain();
 
-		return result;
-	}, std::move(selections));
+	return result;
 }
 
-bool Object::matchesType(const std::string& typeName) const
+ResolveQueue::ResolveQueue()
+	: _previous(t_resolveQueue)
 {
-	return _typeNames.find(typeName) != _typeNames.cend();
+	t_resolveQueue = this;
 }
 
-void Object::beginSelectionSet(const SelectionSetParams& params) const
+ResolveQueue::~ResolveQueue()
 {
+	// If a field threw while draining the queue, the rest of them are abandoned.
+	truncate(0);
+	t_resolveQueue = _previous;
 }
 
-void Object::endSelectionSet(const SelectionSetParams& params) const
+ResolveQueue* ResolveQueue::current() noexcept
 {
+	return t_resolveQueue;
 }
 
-OperationData::OperationData(std::shared_ptr<RequestState>&& state, response::Value&& variables,
-	response::Value&& directives, FragmentMap&& fragments)
-	: state(std::move(state))
-	, variables(std::move(variables))
-	, directives(std::move(directives))
-	, fragments(std::move(fragments))
+ResolveQueue::NestedSelectionSet::NestedSelectionSet(ResolveQueue& queue) noexcept
+	: _queue(queue)
 {
+	++_queue._depth;
 }
 
-// FragmentDefinitionVisitor visits the AST and collects all of the fragment
-// definitions in the document.
-class FragmentDefinitionVisitor
+ResolveQueue::NestedSelectionSet::~NestedSelectionSet()
 {
-public:
-	FragmentDefinitionVisitor(const response::Value& variables);
-
-	FragmentMap getFragments();
-
-	void visit(const peg::ast_node& fragmentDefinition);
-
-private:
-	const response::Value& _variables;
-
-	FragmentMap _fragments;
-};
+	--_queue._depth;
+}
 
-FragmentDefinitionVisitor::FragmentDefinitionVisitor(const response::Value& variables)
-	: _variables(variables)
+bool ResolveQueue::NestedSelectionSet::tooDeep() const noexcept
 {
+	return _queue._depth > s_maxNestedSelectionSets;
 }
 
-FragmentMap FragmentDefinitionVisitor::getFragments()
+void ResolveQueue::push(response::Value& value, FieldResult&& entry, const FieldContext& context)
 {
-	FragmentMap result(std::move(_fragments));
-	return result;
+	_pending.push_back({ &value, std::move(entry), context });
 }
 
-void FragmentDefinitionVisitor::visit(const peg::ast_node& fragmentDefinition)
+size_t ResolveQueue::mark() const noexcept
 {
-	_fragments.insert({ fragmentDefinition.children.front()->content(), Fragment(fragmentDefinition, _variables) });
+	return _pending.size();
 }
 
-// OperationDefinitionVisitor visits the AST and executes the one with the specified
-// operation name.
-class OperationDefinitionVisitor
+void ResolveQueue::truncate(size_t mark)
 {
-public:
-	OperationDefinitionVisitor(std::shared_ptr<RequestState> state, const TypeMap& operations, const std::string& operationName, response::Value&& variables, FragmentMap&& fragments);
-
-	std::future<response::Value> getValue();
-
-	void visit(const peg::ast_node& operationDefinition);
+	// Nothing is taken off the front of the queue while waiting for a field, so everything after
+	// the mark was queued by that field.
+	while (_pending.size() > mark)
+	{
+		auto pending = std::move(_pending.back());
 
-private:
-	std::shared_ptr<OperationData> _params;
-	const TypeMap& _operations;
-	const std::string& _operationName;
-	std::future<response::Value> _result;
-};
+		_pending.pop_back();
+		discardFieldValue(pending.entry);
+	}
+}
 
-OperationDefinitionVisitor::OperationDefinitionVisitor(std::shared_ptr<RequestState> state, const TypeMap& operations, const std::string& operationName, response::Value&& variables, FragmentMap&& fragments)
-	: _params(std::make_shared<OperationData>(
-		std::move(state),
-		std::move(variables),
-		response::Value(),
-		std::move(fragments)))
-	, _operations(operations)
-	, _operationName(operationName)
+void ResolveQueue::drain()
 {
+	while (!_pending.empty())
+	{
+		auto pending = std::move(_pending.front());
+
+		_pending.pop_front();
+		*pending.value = getFieldValue(pending.entry, pending.context);
+	}
 }
 
-std::future<response::Value> OperationDefinitionVisitor::getValue()
+// Convert a ResponsePath to the list of response keys and indices in a FieldTrace, skipping the
+// empty segment at the root.
+static response::Value getPathValue(const ResponsePath& path)
 {
-	auto result = std::move(_result);
+	std::vector<const PathSegment*> segments;
 
-	try
+	for (auto segment = path.get(); segment && segment->parent; segment = segment->parent.get())
 	{
-		if (!result.valid())
-		{
-			std::ostringstream error;
+		segments.push_back(segment);
+	}
 
-			error << "Missing operation";
+	response::Value value(response::Type::List);
 
-			if (!_operationName.empty())
-			{
-				error << " name: " << _operationName;
-			}
+	value.reserve(segments.size());
 
-			throw schema_exception({ error.str() });
-		}
-	}
-	catch (const schema_exception& ex)
+	for (auto itr = segments.crbegin(); itr != segments.crend(); ++itr)
 	{
-		std::promise<response::Value> promise;
-		response::Value document(response::Type::Map);
-
-		document.emplace_back("data", response::Value());
-		document.emplace_back("errors", response::Value(ex.getErrors()));
-		promise.set_value(std::move(document));
-
-		result = promise.get_future();
+		if ((*itr)->responseKey.empty())
+		{
+			value.emplace_back(response::Value(static_cast<response::IntType>((*itr)->index)));
+		}
+		else
+		{
+			value.emplace_back(response::Value(std::string((*itr)->responseKey)));
+		}
 	}
 
-	return result;
+	return value;
 }
 
-void OperationDefinitionVisitor::visit(const peg::ast_node& operationDefinition)
+// Parse the @stream directive on a field in an operation which is delivered incrementally. It's
+// ignored unless the field resolves to a list of Objects.
+static std::shared_ptr<const StreamDirective> getStreamDirective(const CollectedField& field)
 {
-	std::string operation;
+	if (field.fieldDirectives.type() != response::Type::Map)
+	{
+		return nullptr;
+	}
 
-	peg::on_first_child<peg::operation_type>(operationDefinition,
-		[&operation](const peg::ast_node& child)
-		{
-			operation = child.content();
-		});
+	auto itrDirective = field.fieldDirectives.find("stream");
 
-	if (operation.empty())
+	if (itrDirective == field.fieldDirectives.end()
+		|| itrDirective->second.type() != response::Type::Map)
 	{
-		operation = "query";
+		return nullptr;
 	}
-	else if (operation == "subscription")
+
+	const auto& arguments = itrDirective->second;
+	auto itrIf = arguments.find("if");
+
+	if (itrIf != arguments.end()
+		&& itrIf->second.type() == response::Type::Boolean
+		&& !itrIf->second.get<response::BooleanType>())
 	{
-		// Skip subscription operations, they should use subscribe instead of resolve.
-		return;
+		return nullptr;
 	}
 
-	auto position = operationDefinition.begin();
-	std::string name;
+	auto stream = std::make_shared<StreamDirective>();
+	auto itrInitialCount = arguments.find("initialCount");
+	auto itrLabel = arguments.find("label");
 
-	peg::on_first_child<peg::operation_name>(operationDefinition,
-		[&name](const peg::ast_node& child)
+	stream->initialCount = 0;
+
+	if (itrInitialCount != arguments.end()
+		&& itrInitialCount->second.type() == response::Type::Int)
+	{
+		const auto initialCount = itrInitialCount->second.get<response::IntType>();
+
+		if (initialCount < 0)
 		{
-			name = child.content();
-		});
+			auto position = field.field->begin();
+			std::ostringstream error;
 
-	if (!_operationName.empty()
-		&& name != _operationName)
+			error << "Invalid initialCount argument to directive: stream field: " << field.alias
+				<< " line: " << position.line
+				<< " column: " << position.byte_in_line;
+
+			throw schema_exception({ error.str() });
+		}
+
+		stream->initialCount = static_cast<size_t>(initialCount);
+	}
+
+	if (itrLabel != arguments.end()
+		&& itrLabel->second.type() == response::Type::String)
 	{
-		// Skip the operations that don't match the name
-		return;
+		stream->label = itrLabel->second.get<const response::StringType&>();
+	}
+
+	return stream;
+}
+
+// Call the resolver for each of the collected fields in a selection set and build a map of the
+// results in the same order. If the request is cancelled, any fields which haven't been resolved
+// yet are returned as null and the errors are recorded on the Cancellation.
+static std::future<response::Value> resolveFields(const Object& object, const SelectionSetParams& selectionSetParams, const std::string& typeName, const std::shared_ptr<const CollectedSelection>& collected,
+	const ResolverMap& resolvers, const FragmentMap& fragments, const response::Value& variables, ExecutionMode mode)
+{
+	const auto& state = selectionSetParams.state;
+	const bool launchFields = (ExecutionMode::Concurrent == mode && state && state->executor);
+	const auto metrics = Metrics::get();
+	const auto& tracer = selectionSetParams.tracer;
+	const auto& incremental = selectionSetParams.incremental;
+	const bool validated = selectionSetParams.validated;
+	const auto schema = selectionSetParams.schema;
+	std::shared_ptr<Cancellation> cancellation;
+	std::queue<FieldResult> values;
+
+	if (state)
+	{
+		cancellation = state->cancellation;
 	}
 
 	try
 	{
-		if (_result.valid())
+		for (const auto& field : collected->fields)
 		{
-			std::ostringstream error;
+			const auto itr = resolvers.find(field.name);
 
-			if (_operationName.empty())
-			{
-				error << "No operationName specified with extra operation";
-			}
-			else
+			if (itr == resolvers.cend())
 			{
-				error << "Duplicate operation";
-			}
+				auto position = field.field->begin();
+				std::ostringstream error;
 
-			if (!name.empty())
-			{
-				error << " name: " << name;
+				error << "Unknown field name: " << field.name
+					<< " line: " << position.line
+					<< " column: " << position.byte_in_line;
+
+				throw schema_exception({ error.str() });
 			}
 
-			error << " line: " << position.line
-				<< " column: " << position.byte_in_line;
+			const auto& resolver = itr->second;
+			const bool nonNull = (cancellation && isNonNullField(schema, typeName, field.name));
+			const peg::ast_node* selection = field.selections.empty()
+				? nullptr
+				: field.selections.front();
+			std::vector<const peg::ast_node*> mergedSelections;
 
-			throw schema_exception({ error.str() });
-		}
+			if (field.selections.size() > 1)
+			{
+				mergedSelections = field.selections;
+			}
 
-		auto itr = _operations.find(operation);
+			ResponsePath fieldPath;
+			std::shared_ptr<FieldTrace> trace;
+			std::shared_ptr<const StreamDirective> stream;
 
-		if (itr == _operations.cend())
-		{
-			std::ostringstream error;
+			if (tracer || incremental)
+			{
+				fieldPath = std::make_shared<const PathSegment>(PathSegment { selectionSetParams.path, field.alias, 0 });
+			}
 
-			error << "Unknown operation type: " << operation;
+			if (incremental)
+			{
+				stream = getStreamDirective(field);
+			}
 
-			if (!name.empty())
+			if (tracer)
 			{
-				error << " name: " << name;
+				trace = std::make_shared<FieldTrace>();
+				trace->path = getPathValue(fieldPath);
+				trace->parentType = typeName;
+				trace->fieldName = field.name;
 			}
 
-			error << " line: " << position.line
-				<< " column: " << position.byte_in_line;
+			if (launchFields)
+			{
+				// The caller is gone by the time this runs, so the task needs to hold onto its own copy
+				// of the RequestState and the fragment directives. Everything else is owned by the
+				// OperationData, the AST, or the Object, which all outlive the future for the field.
+				// If the field is abandoned at the deadline, the task holds onto the Object that owns
+				// the resolver, and the operation holds onto the OperationData until it's done.
+				const auto& operationDirectives = selectionSetParams.operationDirectives;
+				auto fragmentDirectives = field.fragmentDirectives;
+
+				values.push({
+					field.alias,
+					field.field,
+					launchCancellable(state->executor, cancellation,
+						[&resolver, state, &operationDirectives, fragmentDirectives, selection, &fragments, &variables, fieldPath, tracer, incremental, validated, schema, stream, trace, metrics](std::shared_ptr<const Object>&&, response::Value&& wrappedArguments, response::Value&& wrappedDirectives, std::vector<const peg::ast_node*>&& wrappedSelections)
+					{
+						if (state->cancellation)
+						{
+							state->cancellation->throwIfCancelled();
+						}
 
-			throw schema_exception({ error.str() });
-		}
+						std::chrono::steady_clock::time_point start;
 
-		// Filter the variable definitions down to the ones referenced in this operation
-		response::Value operationVariables(response::Type::Map);
+						if (metrics)
+						{
+							start = std::chrono::steady_clock::now();
+						}
 
-		peg::for_each_child<peg::variable>(operationDefinition,
-			[this, &operationVariables](const peg::ast_node& variable)
-			{
-				std::string variableName;
+						// Start the clock when the task runs, instead of counting the time it spent in the queue.
+						if (trace)
+						{
+							trace->start = std::chrono::steady_clock::now();
+						}
+
+						const SelectionSetParams selectionSetParams {
+							state,
+							operationDirectives,
+							*fragmentDirectives->fragmentDefinitionDirectives,
+							*fragmentDirectives->fragmentSpreadDirectives,
+							*fragmentDirectives->inlineFragmentDirectives,
+							fieldPath,
+							tracer,
+							incremental,
+							validated,
+							schema
+						};
+						ResolverParams params(selectionSetParams, std::move(wrappedArguments), std::move(wrappedDirectives), selection, fragments, variables);
+
+						params.mergedSelections = std::move(wrappedSelections);
+						params.stream = stream;
+
+						// Wait for the result in the task, so nested selection sets are resolved while the
+						// references in selectionSetParams are still valid.
+						auto value = waitForValue(resolver(std::move(params)));
+
+						if (metrics)
+						{
+							metrics->record(MetricsPhase::Resolve, std::chrono::steady_clock::now() - start);
+						}
 
-				peg::on_first_child<peg::variable_name>(variable,
-					[&variableName](const peg::ast_node& name)
-					{
-						// Skip the $ prefix
-						variableName = name.content().c_str() + 1;
+						if (trace)
+						{
+							trace->end = std::chrono::steady_clock::now();
+							tracer->traceField(std::move(*trace));
+						}
+
+						return value;
+					}, object.shared_from_this(), response::Value(field.arguments), response::Value(field.fieldDirectives), std::move(mergedSelections)),
+					nullptr,
+					std::chrono::steady_clock::duration(),
+					nonNull
 					});
 
-				auto itrVar = _params->variables.find(variableName);
-				response::Value valueVar;
+				continue;
+			}
+
+			std::future<response::Value> value;
+			std::chrono::steady_clock::time_point start;
+			auto elapsed = std::chrono::steady_clock::duration::zero();
 
-				if (itrVar != _params->variables.get<const response::MapType&>().cend())
+			try
+			{
+				if (cancellation)
 				{
-					valueVar = response::Value(itrVar->second);
+					cancellation->throwIfCancelled();
 				}
-				else
+
+				const SelectionSetParams fieldSelectionSetParams {
+					state,
+					selectionSetParams.operationDirectives,
+					*field.fragmentDirectives->fragmentDefinitionDirectives,
+					*field.fragmentDirectives->fragmentSpreadDirectives,
+					*field.fragmentDirectives->inlineFragmentDirectives,
+					std::move(fieldPath),
+					tracer,
+					incremental,
+					selectionSetParams.validated,
+					selectionSetParams.schema
+				};
+				ResolverParams params(fieldSelectionSetParams, response::Value(field.arguments), response::Value(field.fieldDirectives), selection, fragments, variables);
+
+				params.mergedSelections = std::move(mergedSelections);
+				params.stream = std::move(stream);
+
+				if (metrics || trace)
 				{
-					peg::on_first_child<peg::default_value>(variable,
-						[this, &valueVar](const peg::ast_node& defaultValue)
-						{
-							ValueVisitor visitor(_params->variables);
+					start = std::chrono::steady_clock::now();
+				}
 
-							visitor.visit(*defaultValue.children.front());
-							valueVar = visitor.getValue();
-						});
+				if (trace)
+				{
+					trace->start = start;
 				}
 
-				operationVariables.emplace_back(std::move(variableName), std::move(valueVar));
-			});
+				value = resolver(std::move(params));
 
-		_params->variables = std::move(operationVariables);
+				if (metrics || trace)
+				{
+					elapsed = std::chrono::steady_clock::now() - start;
+				}
+			}
+			catch (const cancelled_exception&)
+			{
+				std::promise<response::Value> promise;
 
-		response::Value operationDirectives(response::Type::Map);
+				promise.set_exception(std::current_exception());
+				value = promise.get_future();
+				trace.reset();
+			}
 
-		peg::on_first_child<peg::directives>(operationDefinition,
-			[this, &operationDirectives](const peg::ast_node& child)
+			values.push({ field.alias, field.field, std::move(value), std::move(trace), elapsed, nonNull });
+		}
+	}
+	catch (...)
+	{
+		// Don't leave any fields which were already launched running after the error is returned.
+		while (!values.empty())
 		{
-			DirectiveVisitor directiveVisitor(_params->variables);
+			discardFieldValue(values.front());
+			values.pop();
+		}
 
-			directiveVisitor.visit(child);
-			operationDirectives = directiveVisitor.getDirectives();
-		});
+		throw;
+	}
 
-		_params->directives = std::move(operationDirectives);
+	return std::async(std::launch::deferred,
+		[&object, collected, metrics, launchFields, cancellation, tracer](std::queue<FieldResult>&& wrappedValues)
+		{
+			std::unique_ptr<ResolveQueue> ownQueue;
+			auto queue = ResolveQueue::current();
 
-		// Keep the params alive until the deferred lambda has executed
-		auto params = std::move(_params);
+			if (!queue)
+			{
+				ownQueue.reset(new ResolveQueue());
+				queue = ownQueue.get();
+			}
 
-		// The top level object doesn't come from inside of a fragment, so all of the fragment directives are empty.
-		response::Value emptyFragmentDirectives(response::Type::Map);
+			ResolveQueue::NestedSelectionSet nested(*queue);
+			const bool queueFields = nested.tooDeep();
+			const FieldContext context { metrics, launchFields, cancellation, tracer,
+				queueFields ? object.shared_from_this() : nullptr,
+				queueFields ? collected : nullptr };
+			response::Value result(response::Type::Map);
+			std::vector<FieldResult> queued;
+
+			// Reserve all of the members up front, so the queued values don't move.
+			result.reserve(wrappedValues.size());
+
+			try
+			{
+				while (!wrappedValues.empty())
+				{
+					auto& entry = wrappedValues.front();
+
+					if (queueFields)
+					{
+						result.emplace_back(std::string(entry.alias), response::Value());
+						queued.push_back(std::move(entry));
+					}
+					else
+					{
+						auto value = getFieldValue(entry, context);
+
+						result.emplace_back(std::move(entry.alias), std::move(value));
+					}
+
+					wrappedValues.pop();
+				}
+			}
+			catch (...)
+			{
+				// The caller may release the operation as soon as the error reaches it, so wait for
+				// the rest of the fields first.
+				while (!wrappedValues.empty())
+				{
+					discardFieldValue(wrappedValues.front());
+					wrappedValues.pop();
+				}
+
+				throw;
+			}
+
+			if (!queued.empty())
+			{
+				auto itr = result.begin();
+
+				for (auto& entry : queued)
+				{
+					queue->push(const_cast<response::Value&>((itr++)->second), std::move(entry), context);
+				}
+			}
+
+			if (ownQueue)
+			{
+				ownQueue->drain();
+			}
+
+			return result;
+		}, std::move(values));
+}
+
+void SelectionVisitor::visitFragmentSpread(const peg::ast_node& fragmentSpread)
+{
+	const std::string name(fragmentSpread.children.front()->content());
+	auto itr = _fragments.find(name);
+
+	if (itr == _fragments.cend())
+	{
+		auto position = fragmentSpread.begin();
+		std::ostringstream error;
+
+		error << "Unknown fragment name: " << name
+			<< " line: " << position.line
+			<< " column: " << position.byte_in_line;
+
+		throw schema_exception({ error.str() });
+	}
+
+	bool skip = (!_typeNames.empty() && _typeNames.count(itr->second.getType()) == 0);
+	DirectiveVisitor directiveVisitor(_variables);
+
+	if (!skip)
+	{
+		peg::on_first_child<peg::directives>(fragmentSpread,
+			[&directiveVisitor](const peg::ast_node& child)
+			{
+
+				directiveVisitor.visit(child);
+			});
+
+		skip = directiveVisitor.shouldSkip();
+	}
+
+	if (skip)
+	{
+		return;
+	}
+
+	std::string label;
+	const bool defer = (_deferFragments && directiveVisitor.shouldDefer(label));
+	const auto& outerDirectives = *_fragmentDirectives.top();
+
+	_fragmentDirectives.push(std::make_shared<FragmentDirectives>(FragmentDirectives {
+		mergeDirectives(response::Value(itr->second.getDirectives()), outerDirectives.fragmentDefinitionDirectives),
+		mergeDirectives(directiveVisitor.getDirectives(), outerDirectives.fragmentSpreadDirectives),
+		outerDirectives.inlineFragmentDirectives
+		}));
+
+	if (defer)
+	{
+		_deferred.push_back({ std::move(label), &itr->second.getSelection(), _fragmentDirectives.top() });
+		_fragmentDirectives.pop();
+		return;
+	}
+
+	_typeConditions.push(itr->second.getType());
+
+	for (const auto& selection : itr->second.getSelection().children)
+	{
+		visit(*selection);
+	}
+
+	_typeConditions.pop();
+	_fragmentDirectives.pop();
+}
+
+void SelectionVisitor::visitInlineFragment(const peg::ast_node& inlineFragment)
+{
+	DirectiveVisitor directiveVisitor(_variables);
+
+	peg::on_first_child<peg::directives>(inlineFragment,
+		[&directiveVisitor](const peg::ast_node& child)
+		{
+			directiveVisitor.visit(child);
+		});
+
+	if (directiveVisitor.shouldSkip())
+	{
+		return;
+	}
+
+	const peg::ast_node* typeCondition = nullptr;
+
+	peg::on_first_child<peg::type_condition>(inlineFragment,
+		[&typeCondition](const peg::ast_node& child)
+		{
+			typeCondition = &child;
+		});
+
+	if (typeCondition == nullptr
+		|| _typeNames.empty()
+		|| _typeNames.count(typeCondition->children.front()->content()) > 0)
+	{
+		peg::on_first_child<peg::selection_set>(inlineFragment,
+			[this, &directiveVisitor, typeCondition](const peg::ast_node& child)
+		{
+			std::string label;
+			const bool defer = (_deferFragments && directiveVisitor.shouldDefer(label));
+			const auto& outerDirectives = *_fragmentDirectives.top();
+
+			_fragmentDirectives.push(std::make_shared<FragmentDirectives>(FragmentDirectives {
+				outerDirectives.fragmentDefinitionDirectives,
+				outerDirectives.fragmentSpreadDirectives,
+				mergeDirectives(directiveVisitor.getDirectives(), outerDirectives.inlineFragmentDirectives)
+				}));
+
+			if (defer)
+			{
+				_deferred.push_back({ std::move(label), &child, _fragmentDirectives.top() });
+				_fragmentDirectives.pop();
+				return;
+			}
+
+			_typeConditions.push(typeCondition == nullptr
+				? _typeConditions.top()
+				: typeCondition->children.front()->content());
+
+			for (const auto& selection : child.children)
+			{
+				visit(*selection);
+			}
+
+			_typeConditions.pop();
+			_fragmentDirectives.pop();
+		});
+	}
+}
+
+std::shared_ptr<const SelectedFields> FieldParams::getSelectedFields() const
+{
+	if (!_selection || !_fragments || !_variables)
+	{
+		return std::make_shared<const SelectedFields>();
+	}
+
+	RequestState::SelectedFieldsKey key { _fragments, std::string(), _mergedSelections.empty()
+		? std::vector<const peg::ast_node*> { _selection }
+		: _mergedSelections };
+
+	if (state)
+	{
+		std::lock_guard<std::mutex> lock(state->_collectedFieldsMutex);
+		auto itr = state->_selectedFields.find(key);
+
+		if (itr != state->_selectedFields.end())
+		{
+			return itr->second;
+		}
+	}
+
+	const TypeNames anyType;
+	SelectionVisitor visitor(*_fragments, *_variables, anyType, false);
+
+	for (const auto selection : std::get<2>(key))
+	{
+		for (const auto& child : selection->children)
+		{
+			visitor.visit(*child);
+		}
+	}
+
+	auto collected = visitor.getSelection();
+	auto selectedFields = std::make_shared<SelectedFields>();
+
+	selectedFields->reserve(collected.fields.size());
+
+	for (auto& field : collected.fields)
+	{
+		selectedFields->push_back({ std::move(field.name), std::move(field.alias), std::move(field.arguments), std::move(field.typeCondition) });
+	}
+
+	std::shared_ptr<const SelectedFields> result = std::move(selectedFields);
+
+	if (state)
+	{
+		std::lock_guard<std::mutex> lock(state->_collectedFieldsMutex);
+
+		result = state->_selectedFields.insert({ std::move(key), std::move(result) }).first->second;
+	}
+
+	return result;
+}
+
+Object::Object(TypeNames&& typeNames, ResolverMap&& resolvers, std::string&& typeName)
+	: _typeNames(std::move(typeNames))
+	, _resolvers(std::move(resolvers))
+	, _typeName(std::move(typeName))
+{
+	if (_typeName.empty() && _typeNames.size() == 1)
+	{
+		_typeName = *_typeNames.cbegin();
+	}
+
+	std::vector<std::string> sortedNames(_typeNames.cbegin(), _typeNames.cend());
+
+	std::sort(sortedNames.begin(), sortedNames.end());
+
+	for (const auto& typeName : sortedNames)
+	{
+		_typeKey.append(typeName);
+		_typeKey.push_back(',');
+	}
+}
+
+std::future<response::Value> Object::resolve(const SelectionSetParams& selectionSetParams, const peg::ast_node& selection, const FragmentMap& fragments, const response::Value& variables,
+	ExecutionMode mode) const
+{
+	return resolve(selectionSetParams, std::vector<const peg::ast_node*> { &selection }, fragments, variables, mode);
+}
+
+std::future<response::Value> Object::resolve(const SelectionSetParams& selectionSetParams, const std::vector<const peg::ast_node*>& selections, const FragmentMap& fragments, const response::Value& variables,
+	ExecutionMode mode) const
+{
+	const auto& state = selectionSetParams.state;
+	RequestState::CollectedFieldsKey key;
+	RequestState::CollectedFields fields;
+
+	if (state)
+	{
+		// The 2nd through Nth Objects of the same type in a list can skip straight to the resolvers.
+		key = RequestState::CollectedFieldsKey { &fragments, _typeKey, selections };
+
+		std::lock_guard<std::mutex> lock(state->_collectedFieldsMutex);
+		auto itr = state->_collectedFields.find(key);
+
+		if (itr != state->_collectedFields.end())
+		{
+			fields = itr->second;
+		}
+	}
+
+	if (!fields)
+	{
+		// Collect all of the fields first, so each response key is only resolved once. The key
+		// includes the FragmentMap, which belongs to a single operation, so it's either delivered
+		// incrementally every time or not at all.
+		SelectionVisitor visitor(fragments, variables, _typeNames, selectionSetParams.validated, static_cast<bool>(selectionSetParams.incremental));
+
+		for (const auto selection : selections)
+		{
+			for (const auto& child : selection->children)
+			{
+				visitor.visit(*child);
+			}
+		}
+
+		fields = std::make_shared<const CollectedSelection>(visitor.getSelection());
+
+		if (state)
+		{
+			std::lock_guard<std::mutex> lock(state->_collectedFieldsMutex);
+
+			fields = state->_collectedFields.insert({ std::move(key), std::move(fields) }).first->second;
+		}
+	}
+
+	return resolveCollected(selectionSetParams, std::move(fields), fragments, variables, mode);
+}
+
+std::future<response::Value> Object::resolveCollected(const SelectionSetParams& selectionSetParams, RequestState::CollectedFields&& fields, const FragmentMap& fragments, const response::Value& variables,
+	ExecutionMode mode) const
+{
+	const auto& state = selectionSetParams.state;
+	EagerSelectionSet eager;
+
+	if (eager.tooDeep())
+	{
+		// Everything the SelectionSetParams borrow outlives the future, but the caller's copy of
+		// them might not.
+		auto object = shared_from_this();
+
+		return std::async(std::launch::deferred,
+			[object, selectionSetParams, &fragments, &variables, mode](RequestState::CollectedFields&& wrappedFields)
+		{
+			return object->resolveCollected(selectionSetParams, std::move(wrappedFields), fragments, variables, mode).get();
+		}, std::move(fields));
+	}
+
+	beginSelectionSet(selectionSetParams);
+
+	auto values = resolveFields(*this, selectionSetParams, _typeName, fields, _resolvers, fragments, variables, mode);
+
+	endSelectionSet(selectionSetParams);
+
+	// Every field in this selection set which isn't running on the Executor has already called its
+	// resolver, so now we can send any batched requests.
+	if (state)
+	{
+		state->dispatchBatches();
+	}
+
+	// Deferred fragments are resolved on the same Object in a separate patch, after the rest of the
+	// selection set. They aren't cached with the other collected fields, because their fragment
+	// directives include the directives on the deferred fragment itself.
+	if (selectionSetParams.incremental)
+	{
+		const auto& incremental = selectionSetParams.incremental;
+
+		for (const auto& deferred : fields->deferred)
+		{
+			auto object = shared_from_this();
+			const auto& operationDirectives = selectionSetParams.operationDirectives;
+			const auto path = selectionSetParams.path;
+			const auto tracer = selectionSetParams.tracer;
+			const auto validated = selectionSetParams.validated;
+			const auto schema = selectionSetParams.schema;
+			const auto& patchState = incremental->getState();
+			const std::weak_ptr<IncrementalDelivery> weakIncremental(incremental);
+
+			// The IncrementalDelivery holds onto the patch, so the patch only gets a weak reference to it.
+			incremental->addDeferredFragment(path, deferred.label, launchCancellable(patchState->executor, patchState->cancellation,
+				[object, weakIncremental, deferred, &operationDirectives, &fragments, &variables, path, tracer, validated, schema, mode]()
+			{
+				const auto incremental = weakIncremental.lock();
+
+				// The operation directives, fragments, and variables are released along with it.
+				if (!incremental)
+				{
+					return response::Value();
+				}
+
+				const SelectionSetParams deferredParams {
+					incremental->getState(),
+					operationDirectives,
+					*deferred.fragmentDirectives->fragmentDefinitionDirectives,
+					*deferred.fragmentDirectives->fragmentSpreadDirectives,
+					*deferred.fragmentDirectives->inlineFragmentDirectives,
+					path,
+					tracer,
+					incremental,
+					validated,
+					schema
+				};
+				SelectionVisitor visitor(fragments, variables, object->_typeNames, validated, true, deferred.fragmentDirectives);
+
+				for (const auto& child : deferred.selection->children)
+				{
+					visitor.visit(*child);
+				}
+
+				return waitForValue(object->resolveCollected(deferredParams, std::make_shared<const CollectedSelection>(visitor.getSelection()),
+					fragments, variables, mode));
+			}));
+		}
+	}
+
+	// Keep the collected fields alive until all of the fields have been resolved, the fragment
+	// directives are borrowed by the ResolverParams.
+	return std::async(std::launch::deferred,
+		[](RequestState::CollectedFields&&, std::future<response::Value>&& wrappedValues)
+	{
+		return wrappedValues.get();
+	}, std::move(fields), std::move(values));
+}
+
+// Build a key for the argument values which doesn't depend on the order of the members in a map.
+static void appendCanonicalValue(std::ostringstream& output, const response::Value& value)
+{
+	switch (value.type())
+	{
+		case response::Type::Map:
+		{
+			const auto& members = value.get<const response::MapType&>();
+			std::vector<const response::MapType::value_type*> sorted;
+
+			sorted.reserve(members.size());
+
+			for (const auto& entry : members)
+			{
+				sorted.push_back(&entry);
+			}
+
+			std::sort(sorted.begin(), sorted.end(),
+				[](const response::MapType::value_type* lhs, const response::MapType::value_type* rhs) noexcept
+			{
+				return lhs->first < rhs->first;
+			});
+
+			output << '{';
+
+			for (const auto entry : sorted)
+			{
+				output << entry->first.size() << ':' << entry->first << '=';
+				appendCanonicalValue(output, entry->second);
+				output << ',';
+			}
+
+			output << '}';
+			break;
+		}
+
+		case response::Type::List:
+		{
+			output << '[';
+
+			for (const auto& entry : value.get<const response::ListType&>())
+			{
+				appendCanonicalValue(output, entry);
+				output << ',';
+			}
+
+			output << ']';
+			break;
+		}
+
+		case response::Type::String:
+		case response::Type::EnumValue:
+		{
+			const auto& text = value.get<const response::StringType&>();
+
+			output << (value.type() == response::Type::String ? 's' : 'e') << text.size() << ':' << text;
+			break;
+		}
+
+		case response::Type::Null:
+			output << 'n';
+			break;
+
+		case response::Type::Boolean:
+			output << (value.get<response::BooleanType>() ? 't' : 'f');
+			break;
+
+		case response::Type::Int:
+			output << 'i' << value.get<response::IntType>();
+			break;
+
+		case response::Type::Float:
+			output << 'd' << value.get<response::FloatType>();
+			break;
+
+		case response::Type::Scalar:
+			output << 'x';
+			appendCanonicalValue(output, value.get<const response::ScalarType&>());
+			break;
+	}
+}
+
+std::future<response::Value> Object::memoize(const char* fieldName, ResolverParams&& params, Resolver&& resolver) const
+{
+	const auto state = params.state;
+
+	if (!state || !state->memoizePureFields)
+	{
+		return resolver(std::move(params));
+	}
+
+	std::ostringstream arguments;
+
+	// The field directives are visible to the accessor too, so they need to match as well.
+	arguments.precision(17);
+	appendCanonicalValue(arguments, params.arguments);
+	appendCanonicalValue(arguments, params.fieldDirectives);
+
+	RequestState::FieldMemoKey key { shared_from_this(), fieldName,
+		params.mergedSelections.empty()
+			? std::vector<const peg::ast_node*> { params.selection }
+			: params.mergedSelections,
+		arguments.str() };
+	std::shared_future<response::Value> result;
+
+	{
+		std::lock_guard<std::mutex> lock(state->_memoMutex);
+		auto itr = state->_fieldMemo.find(key);
+
+		if (itr != state->_fieldMemo.end())
+		{
+			result = itr->second;
+		}
+	}
+
+	if (!result.valid())
+	{
+		// Call the resolver outside of the lock, since it may resolve nested fields which are also
+		// memoized. If another thread beats us to it, we'll share its result instead.
+		auto resolved = std::async(std::launch::deferred, waitForValue, resolver(std::move(params))).share();
+		std::lock_guard<std::mutex> lock(state->_memoMutex);
+
+		result = state->_fieldMemo.insert({ std::move(key), std::move(resolved) }).first->second;
+	}
+
+	return std::async(std::launch::deferred,
+		[](std::shared_future<response::Value>&& wrappedResult)
+	{
+		return response::Value(wrappedResult.get());
+	}, std::move(result));
+}
+
+std::string Object::getCacheIdentity() const
+{
+	return std::string();
+}
+
+std::future<response::Value> Object::cacheField(const char* fieldName, std::chrono::seconds maxAge, CacheScope scope, ResolverParams&& params, Resolver&& resolver) const
+{
+	const auto state = params.state;
+
+	if (!state
+		|| !state->fieldCache
+		|| maxAge.count() <= 0
+		|| (CacheScope::Private == scope && state->cacheScope.empty()))
+	{
+		return resolver(std::move(params));
+	}
+
+	const auto identity = getCacheIdentity();
+
+	if (identity.empty())
+	{
+		return resolver(std::move(params));
+	}
+
+	std::ostringstream output;
+
+	output.precision(17);
+	output << _typeName << '\n' << identity << '\n' << fieldName << '\n';
+	appendCanonicalValue(output, params.arguments);
+	output << '\n';
+	appendCanonicalValue(output, params.fieldDirectives);
+
+	if (CacheScope::Private == scope)
+	{
+		output << '\n' << state->cacheScope;
+	}
+
+	auto key = output.str();
+	response::Value cached;
+
+	if (state->fieldCache->find(key, cached))
+	{
+		std::promise<response::Value> promise;
+
+		promise.set_value(std::move(cached));
+
+		return promise.get_future();
+	}
+
+	// Only successful results are cached, if the resolver throws it will be called again next time.
+	auto fieldCache = state->fieldCache;
+
+	return std::async(std::launch::deferred,
+		[fieldCache, maxAge](std::string&& wrappedKey, std::future<response::Value>&& wrappedResult)
+	{
+		auto value = wrappedResult.get();
+
+		fieldCache->insert(wrappedKey, value, maxAge);
+
+		return value;
+	}, std::move(key), resolver(std::move(params)));
+}
+
+// FieldBatch queues the parents of a field marked @batch in the schema which select it with the same
+// arguments and directives, until the RequestState dispatches it or something waits on one of them.
+class FieldBatch : public BatchDispatcher, public std::enable_shared_from_this<FieldBatch>
+{
+public:
+	explicit FieldBatch(BatchResolver&& resolver);
+
+	std::future<response::Value> enqueue(BatchedField&& field);
+
+	// Call the batch resolver with all of the pending fields.
+	void dispatch() override;
+
+private:
+	const BatchResolver _resolver;
+
+	std::mutex _mutex;
+	std::vector<BatchedField> _pendingFields;
+	std::vector<std::promise<std::future<response::Value>>> _pendingPromises;
+};
+
+FieldBatch::FieldBatch(BatchResolver&& resolver)
+	: _resolver(std::move(resolver))
+{
+}
+
+std::future<response::Value> FieldBatch::enqueue(BatchedField&& field)
+{
+	std::promise<std::future<response::Value>> promise;
+	auto result = promise.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_pendingFields.push_back(std::move(field));
+		_pendingPromises.push_back(std::move(promise));
+	}
+
+	auto spThis = shared_from_this();
+
+	return std::async(std::launch::deferred,
+		[spThis](std::future<std::future<response::Value>>&& wrappedResult)
+	{
+		spThis->dispatch();
+		return wrappedResult.get().get();
+	}, std::move(result));
+}
+
+void FieldBatch::dispatch()
+{
+	std::vector<BatchedField> fields;
+	std::vector<std::promise<std::future<response::Value>>> promises;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		fields.swap(_pendingFields);
+		promises.swap(_pendingPromises);
+	}
+
+	if (fields.empty())
+	{
+		return;
+	}
+
+	try
+	{
+		auto results = _resolver(std::move(fields));
+
+		if (results.size() != promises.size())
+		{
+			throw schema_exception({ "Batch resolver returned the wrong number of results" });
+		}
+
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			promises[i].set_value(std::move(results[i]));
+		}
+	}
+	catch (...)
+	{
+		const auto ex = std::current_exception();
+
+		for (auto& promise : promises)
+		{
+			try
+			{
+				promise.set_exception(ex);
+			}
+			catch (const std::future_error&)
+			{
+				// This promise was already satisfied before the exception.
+			}
+		}
+	}
+}
+
+std::future<response::Value> Object::batchField(const char* fieldName, ResolverParams&& params, BatchResolver&& resolver) const
+{
+	const auto state = params.state;
+
+	if (!state)
+	{
+		std::vector<BatchedField> fields;
+
+		fields.push_back({ shared_from_this(), std::move(params) });
+
+		auto results = resolver(std::move(fields));
+
+		if (results.size() != 1)
+		{
+			throw schema_exception({ "Batch resolver returned the wrong number of results" });
+		}
+
+		return std::move(results.front());
+	}
+
+	std::ostringstream output;
+
+	output.precision(17);
+	output << _typeName << '\n' << fieldName << '\n';
+	appendCanonicalValue(output, params.arguments);
+	output << '\n';
+	appendCanonicalValue(output, params.fieldDirectives);
+
+	auto key = output.str();
+	std::shared_ptr<FieldBatch> batch;
+
+	{
+		std::lock_guard<std::mutex> lock(state->_batchMutex);
+		auto itr = state->_fieldBatches.find(key);
+
+		if (itr == state->_fieldBatches.end())
+		{
+			batch = std::make_shared<FieldBatch>(std::move(resolver));
+			state->_fieldBatches.insert({ std::move(key), batch });
+			state->_batchDispatchers.push_back(batch);
+		}
+		else
+		{
+			batch = itr->second;
+		}
+	}
+
+	return batch->enqueue({ shared_from_this(), std::move(params) });
+}
+
+bool Object::matchesType(const std::string& typeName) const
+{
+	return _typeNames.find(typeName) != _typeNames.cend();
+}
+
+void Object::beginSelectionSet(const SelectionSetParams& params) const
+{
+}
+
+void Object::endSelectionSet(const SelectionSetParams& params) const
+{
+}
+
+OperationData::OperationData(std::shared_ptr<RequestState>&& state, response::Value&& variables,
+	response::Value&& directives, FragmentMap&& fragments)
+	: state(std::move(state))
+	, variables(std::move(variables))
+	, directives(std::move(directives))
+	, fragments(std::move(fragments))
+{
+}
+
+OperationData::~OperationData()
+{
+	// The collected fields for this operation are keyed on the address of the FragmentMap, so
+	// make sure they aren't reused by another operation at the same address.
+	if (state)
+	{
+		state->releaseCollectedFields(fragments);
+	}
+}
+
+// FragmentDefinitionVisitor visits the AST and collects all of the fragment
+// definitions in the document.
+class FragmentDefinitionVisitor
+{
+public:
+	FragmentDefinitionVisitor(const response::Value& variables);
+
+	FragmentMap getFragments();
+
+	void visit(const peg::ast_node& fragmentDefinition);
+
+private:
+	const response::Value& _variables;
+
+	FragmentMap _fragments;
+};
+
+FragmentDefinitionVisitor::FragmentDefinitionVisitor(const response::Value& variables)
+	: _variables(variables)
+{
+}
+
+FragmentMap FragmentDefinitionVisitor::getFragments()
+{
+	FragmentMap result(std::move(_fragments));
+	return result;
+}
+
+void FragmentDefinitionVisitor::visit(const peg::ast_node& fragmentDefinition)
+{
+	_fragments.insert({ fragmentDefinition.children.front()->content(), Fragment(fragmentDefinition, _variables) });
+}
+
+// Collect the fragment definitions in the document. The directives on each fragment definition are
+// evaluated with the variables, so they need to be coerced for the operation first.
+static FragmentMap getFragmentDefinitions(const peg::ast_node& root, const response::Value& variables)
+{
+	FragmentDefinitionVisitor fragmentVisitor(variables);
+
+	peg::for_each_child<peg::fragment_definition>(root,
+		[&fragmentVisitor](const peg::ast_node& child)
+	{
+		fragmentVisitor.visit(child);
+	});
+
+	return fragmentVisitor.getFragments();
+}
+
+// Filter the variables down to the ones defined in the operation, fill in any default values, and
+// coerce them to their declared types. This happens once per operation, before any resolvers run,
+// so invalid variables are reported without partially executing the operation.
+static response::Value coerceVariables(const peg::ast_node& operationDefinition, const response::Value& variables, const ValidationSchema* schema)
+{
+	response::Value operationVariables(response::Type::Map);
+
+	peg::for_each_child<peg::variable>(operationDefinition,
+		[&variables, &operationVariables, schema](const peg::ast_node& variable)
+		{
+			std::string variableName;
+			const peg::ast_node* typeName = nullptr;
+			const peg::ast_node* defaultValue = nullptr;
+
+			for (const auto& child : variable.children)
+			{
+				if (child->is<peg::variable_name>())
+				{
+					// Skip the $ prefix
+					variableName = child->content().c_str() + 1;
+				}
+				else if (child->is<peg::named_type>()
+					|| child->is<peg::list_type>()
+					|| child->is<peg::nonnull_type>())
+				{
+					typeName = child.get();
+				}
+				else if (child->is<peg::default_value>())
+				{
+					defaultValue = child.get();
+				}
+			}
+
+			auto itrVar = variables.find(variableName);
+			response::Value valueVar;
+
+			if (itrVar != variables.end())
+			{
+				valueVar = response::Value(itrVar->second);
+			}
+			else if (defaultValue != nullptr)
+			{
+				ValueVisitor visitor(variables);
+
+				visitor.visit(*defaultValue->children.front());
+				valueVar = visitor.getValue();
+			}
+
+			if (typeName != nullptr)
+			{
+				try
+				{
+					valueVar = coerceVariableValue(schema, *typeName, std::move(valueVar));
+				}
+				catch (const schema_exception& ex)
+				{
+					auto position = variable.begin();
+					std::ostringstream error;
+
+					error << "Invalid variable: " << variableName
+						<< " line: " << position.line
+						<< " column: " << position.byte_in_line
+						<< " message: " << ex.getErrors()[0]["message"].get<const response::StringType&>();
+
+					throw schema_exception({ error.str() });
+				}
+			}
+
+			operationVariables.emplace_back(std::move(variableName), std::move(valueVar));
+		});
+
+	return operationVariables;
+}
+
+// Fields which were cancelled are null in the data (or their nearest nullable parent is), so report
+// them after any other errors.
+static void addCancellationErrors(const std::shared_ptr<RequestState>& state, response::Value& errors)
+{
+	if (!state || !state->cancellation)
+	{
+		return;
+	}
+
+	for (auto& message : state->cancellation->releaseErrors())
+	{
+		response::Value error(response::Type::Map);
+
+		error.emplace_back("message", response::Value(std::move(message)));
+		errors.emplace_back(std::move(error));
+	}
+}
+
+static response::Value getNanoseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+	return response::Value(static_cast<response::FloatType>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count()));
+}
+
+// Add the traces collected by the default Tracer to the "extensions" in the response, in the same
+// format as Apollo Tracing. The offsets and durations are in nanoseconds.
+static void addTracingExtensions(Tracer& tracer, std::chrono::steady_clock::time_point start, response::Value& document)
+{
+	auto traces = tracer.releaseTraces();
+
+	if (traces.empty())
+	{
+		return;
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+	response::Value resolvers(response::Type::List);
+
+	resolvers.reserve(traces.size());
+
+	for (auto& trace : traces)
+	{
+		response::Value resolver(response::Type::Map);
+
+		resolver.emplace_back("path", std::move(trace.path));
+		resolver.emplace_back("parentType", response::Value(std::move(trace.parentType)));
+		resolver.emplace_back("fieldName", response::Value(std::move(trace.fieldName)));
+		resolver.emplace_back("startOffset", getNanoseconds(start, trace.start));
+		resolver.emplace_back("duration", getNanoseconds(trace.start, trace.end));
+		resolvers.emplace_back(std::move(resolver));
+	}
+
+	response::Value execution(response::Type::Map);
+
+	execution.emplace_back("resolvers", std::move(resolvers));
+
+	response::Value tracing(response::Type::Map);
+
+	tracing.emplace_back("version", response::Value(1));
+	tracing.emplace_back("duration", getNanoseconds(start, end));
+	tracing.emplace_back("execution", std::move(execution));
+
+	response::Value extensions(response::Type::Map);
+
+	extensions.emplace_back("tracing", std::move(tracing));
+	document.emplace_back("extensions", std::move(extensions));
+}
+
+IncrementalDelivery::IncrementalDelivery(IncrementalCallback&& callback)
+	: _callback(std::move(callback))
+{
+}
+
+const std::shared_ptr<RequestState>& IncrementalDelivery::getState() const
+{
+	return _operation->state;
+}
+
+void IncrementalDelivery::addDeferredFragment(const ResponsePath& path, const std::string& label, std::future<response::Value>&& data)
+{
+	addPatch({ getPathValue(path), label, false, std::move(data) });
+}
+
+void IncrementalDelivery::addStreamedItem(const ResponsePath& path, const std::string& label, std::future<response::Value>&& item)
+{
+	addPatch({ getPathValue(path), label, true, std::move(item) });
+}
+
+void IncrementalDelivery::addPatch(Patch&& patch)
+{
+	std::lock_guard<std::mutex> lock(_patchesMutex);
+
+	_patches.push(std::move(patch));
+}
+
+void IncrementalDelivery::clearPatches() noexcept
+{
+	std::queue<Patch> patches;
+
+	{
+		std::lock_guard<std::mutex> lock(_patchesMutex);
+
+		std::swap(patches, _patches);
+	}
+}
+
+bool IncrementalDelivery::popPatch(Patch& patch)
+{
+	std::lock_guard<std::mutex> lock(_patchesMutex);
+
+	if (_patches.empty())
+	{
+		return false;
+	}
+
+	patch = std::move(_patches.front());
+	_patches.pop();
+
+	return true;
+}
+
+void IncrementalDelivery::deliver(response::Value&& document)
+{
+	try
+	{
+		deliverPatches(std::move(document));
+	}
+	catch (...)
+	{
+		clearPatches();
+		throw;
+	}
+
+	_operation.reset();
+}
+
+void IncrementalDelivery::deliverPatches(response::Value&& document)
+{
+	Patch patch;
+	bool hasNext = popPatch(patch);
+
+	// If the initial payload doesn't have any data, e.g. because of a validation error, there won't be
+	// anywhere to put the patches, but we still need to wait for them before releasing the operation.
+	auto itrData = document.find("data");
+	const bool hasData = (itrData != document.end() && itrData->second.type() != response::Type::Null);
+
+	if (!hasData)
+	{
+		while (hasNext)
+		{
+			try
+			{
+				patch.value.get();
+			}
+			catch (const std::exception&)
+			{
+			}
+
+			hasNext = popPatch(patch);
+		}
+	}
+
+	document.emplace_back("hasNext", response::Value(hasNext));
+	_callback(std::move(document));
+
+	while (hasNext)
+	{
+		response::Value value;
+		response::Value errors(response::Type::List);
+
+		try
+		{
+			value = patch.value.get();
+		}
+		catch (const schema_exception& ex)
+		{
+			errors = response::Value(ex.getErrors());
+		}
+		catch (const propagated_cancellation&)
+		{
+			// The error was recorded on the Cancellation for the non-null field which was cancelled.
+		}
+		catch (const cancelled_exception& ex)
+		{
+			response::Value error(response::Type::Map);
+
+			error.emplace_back("message", response::Value(std::string(ex.what())));
+			errors.emplace_back(std::move(error));
+		}
+
+		addCancellationErrors(getState(), errors);
+
+		response::Value payload(response::Type::Map);
+
+		if (patch.streamed)
+		{
+			response::Value items(response::Type::List);
+
+			items.emplace_back(std::move(value));
+			payload.emplace_back("items", std::move(items));
+		}
+		else
+		{
+			payload.emplace_back("data", std::move(value));
+		}
+
+		payload.emplace_back("path", std::move(patch.path));
+
+		if (!patch.label.empty())
+		{
+			payload.emplace_back("label", response::Value(std::move(patch.label)));
+		}
+
+		if (errors.size() > 0)
+		{
+			payload.emplace_back("errors", std::move(errors));
+		}
+
+		// Resolving this patch may have added more patches nested inside of it.
+		hasNext = popPatch(patch);
+		payload.emplace_back("hasNext", response::Value(hasNext));
+		_callback(std::move(payload));
+	}
+}
+
+// OperationDefinitionVisitor visits the AST and executes the one with the specified
+// operation name.
+class OperationDefinitionVisitor
+{
+public:
+	OperationDefinitionVisitor(std::shared_ptr<RequestState> state, const TypeMap& operations, const std::string& operationName, response::Value&& variables, const peg::ast_node& root,
+		std::shared_ptr<IncrementalDelivery> incremental, bool validated, std::shared_ptr<const ValidationSchema> schema);
+
+	std::future<response::Value> getValue();
+
+	void visit(const peg::ast_node& operationDefinition);
+
+private:
+	std::shared_ptr<OperationData> _params;
+	const TypeMap& _operations;
+	const std::string& _operationName;
+	const peg::ast_node& _root;
+	const std::shared_ptr<IncrementalDelivery> _incremental;
+	std::future<response::Value> _result;
+};
+
+OperationDefinitionVisitor::OperationDefinitionVisitor(std::shared_ptr<RequestState> state, const TypeMap& operations, const std::string& operationName, response::Value&& variables, const peg::ast_node& root,
+	std::shared_ptr<IncrementalDelivery> incremental, bool validated, std::shared_ptr<const ValidationSchema> schema)
+	: _params(std::make_shared<OperationData>(
+		std::move(state),
+		std::move(variables),
+		response::Value(),
+		FragmentMap()))
+	, _operations(operations)
+	, _operationName(operationName)
+	, _root(root)
+	, _incremental(std::move(incremental))
+{
+	_params->validated = validated;
+	_params->schema = std::move(schema);
+}
+
+std::future<response::Value> OperationDefinitionVisitor::getValue()
+{
+	auto result = std::move(_result);
+
+	try
+	{
+		if (!result.valid())
+		{
+			std::ostringstream error;
+
+			error << "Missing operation";
+
+			if (!_operationName.empty())
+			{
+				error << " name: " << _operationName;
+			}
+
+			throw schema_exception({ error.str() });
+		}
+	}
+	catch (const schema_exception& ex)
+	{
+		std::promise<response::Value> promise;
+		response::Value document(response::Type::Map);
+
+		document.emplace_back("data", response::Value());
+		document.emplace_back("errors", response::Value(ex.getErrors()));
+		promise.set_value(std::move(document));
+
+		result = promise.get_future();
+	}
+
+	return result;
+}
+
+void OperationDefinitionVisitor::visit(const peg::ast_node& operationDefinition)
+{
+	std::string operation;
+
+	peg::on_first_child<peg::operation_type>(operationDefinition,
+		[&operation](const peg::ast_node& child)
+		{
+			operation = child.content();
+		});
+
+	if (operation.empty())
+	{
+		operation = "query";
+	}
+	else if (operation == "subscription")
+	{
+		// Skip subscription operations, they should use subscribe instead of resolve.
+		return;
+	}
+
+	auto position = operationDefinition.begin();
+	std::string name;
+
+	peg::on_first_child<peg::operation_name>(operationDefinition,
+		[&name](const peg::ast_node& child)
+		{
+			name = child.content();
+		});
+
+	if (!_operationName.empty()
+		&& name != _operationName)
+	{
+		// Skip the operations that don't match the name
+		return;
+	}
+
+	try
+	{
+		if (_result.valid())
+		{
+			std::ostringstream error;
+
+			if (_operationName.empty())
+			{
+				error << "No operationName specified with extra operation";
+			}
+			else
+			{
+				error << "Duplicate operation";
+			}
+
+			if (!name.empty())
+			{
+				error << " name: " << name;
+			}
+
+			error << " line: " << position.line
+				<< " column: " << position.byte_in_line;
+
+			throw schema_exception({ error.str() });
+		}
+
+		auto itr = _operations.find(operation);
+
+		if (itr == _operations.cend())
+		{
+			std::ostringstream error;
+
+			error << "Unknown operation type: " << operation;
+
+			if (!name.empty())
+			{
+				error << " name: " << name;
+			}
+
+			error << " line: " << position.line
+				<< " column: " << position.byte_in_line;
+
+			throw schema_exception({ error.str() });
+		}
+
+		// Filter the variable definitions down to the ones referenced in this operation, and coerce
+		// them to their declared types before any of the resolvers run.
+		auto operationVariables = coerceVariables(operationDefinition, _params->variables, _params->schema.get());
+
+		_params->variables = std::move(operationVariables);
+		_params->fragments = getFragmentDefinitions(_root, _params->variables);
+
+		response::Value operationDirectives(response::Type::Map);
+
+		peg::on_first_child<peg::directives>(operationDefinition,
+			[this, &operationDirectives](const peg::ast_node& child)
+		{
+			DirectiveVisitor directiveVisitor(_params->variables);
+
+			directiveVisitor.visit(child);
+			operationDirectives = directiveVisitor.getDirectives();
+		});
+
+		_params->directives = std::move(operationDirectives);
+
+		// Keep the params alive until the deferred lambda has executed
+		auto params = std::move(_params);
+
+		// Only sampled operations track the path to each field, which is what turns on tracing in
+		// the resolvers.
+		const auto start = std::chrono::steady_clock::now();
+		std::shared_ptr<Tracer> tracer;
+		ResponsePath rootPath;
+
+		if (params->state
+			&& params->state->tracer
+			&& params->state->tracer->sample())
+		{
+			tracer = params->state->tracer;
+			rootPath = std::make_shared<const PathSegment>();
+		}
+
+		// Incremental delivery also needs the path to each field to report where the patches go, and
+		// the patches keep the operation alive after the initial payload.
+		if (_incremental)
+		{
+			_incremental->_operation = params;
+
+			if (!rootPath)
+			{
+				rootPath = std::make_shared<const PathSegment>();
+			}
+		}
+
+		// The top level object doesn't come from inside of a fragment, so all of the fragment directives are empty.
+		response::Value emptyFragmentDirectives(response::Type::Map);
 		const SelectionSetParams selectionSetParams {
 			params->state,
 			params->directives,
 			emptyFragmentDirectives,
 			emptyFragmentDirectives,
-			emptyFragmentDirectives
+			emptyFragmentDirectives,
+			std::move(rootPath),
+			tracer,
+			_incremental,
+			params->validated,
+			params->schema.get()
 		};
 
-		_result = std::async(std::launch::deferred,
-			[params](std::future<response::Value> data)
-			{
-				response::Value document(response::Type::Map);
+		// The top level fields in a mutation must be resolved serially.
+		const auto mode = (operation == "mutation")
+			? ExecutionMode::Serial
+			: ExecutionMode::Concurrent;
+
+		_result = std::async(std::launch::deferred,
+			[params, tracer, start](std::future<response::Value> data)
+			{
+				response::Value document(response::Type::Map);
+				response::Value errors(response::Type::List);
+
+				try
+				{
+					document.emplace_back("data", data.get());
+				}
+				catch (const schema_exception& ex)
+				{
+					// Fields resolved on the Executor report errors when we wait for them instead
+					// of while we're visiting the operation.
+					document.emplace_back("data", response::Value());
+					errors = response::Value(ex.getErrors());
+				}
+				catch (const propagated_cancellation&)
+				{
+					// A non-null field was cancelled and there's no nullable field between it and
+					// the root, so the data is null.
+					document.emplace_back("data", response::Value());
+				}
+
+				addCancellationErrors(params->state, errors);
+
+				// Fields which were abandoned at the deadline may still be using the operation.
+				if (params->state && params->state->cancellation)
+				{
+					params->state->cancellation->holdWhileAbandoned(params);
+				}
+
+				if (errors.size() > 0)
+				{
+					document.emplace_back("errors", std::move(errors));
+				}
+
+				if (tracer)
+				{
+					addTracingExtensions(*tracer, start, document);
+				}
+
+				return document;
+		}, itr->second->resolve(selectionSetParams, *operationDefinition.children.back(), params->fragments, params->variables, mode));
+	}
+	catch (const schema_exception& ex)
+	{
+		std::promise<response::Value> promise;
+		response::Value document(response::Type::Map);
+
+		document.emplace_back("data", response::Value());
+		document.emplace_back("errors", response::Value(ex.getErrors()));
+		promise.set_value(std::move(document));
+
+		_result = promise.get_future();
+	}
+}
+
+SubscriptionData::SubscriptionData(std::shared_ptr<OperationData>&& data, std::unordered_map<SubscriptionName, std::vector<response::Value>>&& fieldNamesAndArgs,
+	peg::ast<std::string>&& query, std::string&& operationName, SubscriptionCallback&& callback,
+	const peg::ast_node& selection)
+	: data(std::move(data))
+	, fieldNamesAndArgs(std::move(fieldNamesAndArgs))
+	, query(std::move(query))
+	, operationName(std::move(operationName))
+	, callback(std::move(callback))
+	, selection(selection)
+{
+}
+
+// SubscriptionDefinitionVisitor visits the AST collects the fields referenced in the subscription at the point
+// where we create a subscription.
+class SubscriptionDefinitionVisitor
+{
+public:
+	SubscriptionDefinitionVisitor(SubscriptionParams&& params, SubscriptionCallback&& callback, const std::shared_ptr<Object>& subscriptionObject, std::shared_ptr<const ValidationSchema> schema);
+
+	const peg::ast_node& getRoot() const;
+	std::shared_ptr<SubscriptionData> getRegistration();
+
+	void visit(const peg::ast_node& operationDefinition);
+
+private:
+	void visitField(const peg::ast_node& field);
+	void visitFragmentSpread(const peg::ast_node& fragmentSpread);
+	void visitInlineFragment(const peg::ast_node& inlineFragment);
+
+	SubscriptionParams _params;
+	SubscriptionCallback _callback;
+	FragmentMap _fragments;
+	const std::shared_ptr<Object>& _subscriptionObject;
+	std::shared_ptr<const ValidationSchema> _schema;
+	std::unordered_map<SubscriptionName, std::vector<response::Value>> _fieldNamesAndArgs;
+	std::shared_ptr<SubscriptionData> _result;
+};
+
+SubscriptionDefinitionVisitor::SubscriptionDefinitionVisitor(SubscriptionParams&& params, SubscriptionCallback&& callback, const std::shared_ptr<Object>& subscriptionObject, std::shared_ptr<const ValidationSchema> schema)
+	: _params(std::move(params))
+	, _callback(std::move(callback))
+	, _subscriptionObject(subscriptionObject)
+	, _schema(std::move(schema))
+{
+}
+
+const peg::ast_node& SubscriptionDefinitionVisitor::getRoot() const
+{
+	return *_params.query.root;
+}
+
+std::shared_ptr<SubscriptionData> SubscriptionDefinitionVisitor::getRegistration()
+{
+	if (!_result)
+	{
+		std::ostringstream error;
+
+		error << "Missing operation";
+
+		if (!_params.operationName.empty())
+		{
+			error << " name: " << _params.operationName;
+		}
+
+		throw schema_exception({ error.str() });
+	}
+
+	auto result = std::move(_result);
+
+	_result.reset();
+
+	return result;
+}
+
+void SubscriptionDefinitionVisitor::visit(const peg::ast_node& operationDefinition)
+{
+	std::string operation;
+
+	peg::on_first_child<peg::operation_type>(operationDefinition,
+		[&operation](const peg::ast_node& child)
+		{
+			operation = child.content();
+		});
+
+	if (operation != "subscription")
+	{
+		// Skip operations other than subscription.
+		return;
+	}
+
+	auto position = operationDefinition.begin();
+	std::string name;
+
+	peg::on_first_child<peg::operation_name>(operationDefinition,
+		[&name](const peg::ast_node& child)
+		{
+			name = child.content();
+		});
+
+	if (!_params.operationName.empty()
+		&& name != _params.operationName)
+	{
+		// Skip the subscriptions that don't match the name
+		return;
+	}
+
+	if (_result)
+	{
+		std::ostringstream error;
+
+		if (_params.operationName.empty())
+		{
+			error << "No operationName specified with extra subscription";
+		}
+		else
+		{
+			error << "Duplicate subscription";
+		}
+
+		if (!name.empty())
+		{
+			error << " name: " << name;
+		}
+
+		error << " line: " << position.line
+			<< " column: " << position.byte_in_line;
+
+		throw schema_exception({ error.str() });
+	}
+
+	_params.variables = coerceVariables(operationDefinition, _params.variables, _schema.get());
+	_fragments = getFragmentDefinitions(*_params.query.root, _params.variables);
+
+	const auto& selection = *operationDefinition.children.back();
+
+	for (const auto& child : selection.children)
+	{
+		if (child->is<peg::field>())
+		{
+			visitField(*child);
+		}
+		else if (child->is<peg::fragment_spread>())
+		{
+			visitFragmentSpread(*child);
+		}
+		else if (child->is<peg::inline_fragment>())
+		{
+			visitInlineFragment(*child);
+		}
+	}
+
+	response::Value directives(response::Type::Map);
+
+	peg::on_first_child<peg::directives>(operationDefinition,
+		[this, &directives](const peg::ast_node& child)
+	{
+		DirectiveVisitor directiveVisitor(_params.variables);
+
+		directiveVisitor.visit(child);
+		directives = directiveVisitor.getDirectives();
+	});
+
+	auto data = std::make_shared<OperationData>(
+		std::move(_params.state),
+		std::move(_params.variables),
+		std::move(directives),
+		std::move(_fragments));
+
+	data->schema = std::move(_schema);
+	_result = std::make_shared<SubscriptionData>(
+		std::move(data),
+		std::move(_fieldNamesAndArgs),
+		std::move(_params.query),
+		std::move(_params.operationName),
+		std::move(_callback),
+		selection);
+}
+
+void SubscriptionDefinitionVisitor::visitField(const peg::ast_node& field)
+{
+	std::string name;
+
+	peg::on_first_child<peg::field_name>(field,
+		[&name](const peg::ast_node& child)
+	{
+		name = child.content();
+	});
 
-				document.emplace_back("data", data.get());
+	DirectiveVisitor directiveVisitor(_params.variables);
 
-				return document;
-		}, itr->second->resolve(selectionSetParams, *operationDefinition.children.back(), params->fragments, params->variables));
+	peg::on_first_child<peg::directives>(field,
+		[&directiveVisitor](const peg::ast_node& child)
+	{
+		directiveVisitor.visit(child);
+	});
+
+	if (directiveVisitor.shouldSkip())
+	{
+		return;
 	}
-	catch (const schema_exception& ex)
+
+	response::Value arguments(response::Type::Map);
+
+	peg::on_first_child<peg::arguments>(field,
+		[this, &arguments](const peg::ast_node& child)
 	{
-		std::promise<response::Value> promise;
-		response::Value document(response::Type::Map);
+		ValueVisitor visitor(_params.variables);
 
-		document.emplace_back("data", response::Value());
-		document.emplace_back("errors", response::Value(ex.getErrors()));
-		promise.set_value(std::move(document));
+		for (auto& argument : child.children)
+		{
+			visitor.visit(*argument->children.back());
 
-		_result = promise.get_future();
+			arguments.emplace_back(argument->children.front()->content(), visitor.getValue());
+		}
+	});
+
+	_fieldNamesAndArgs[std::move(name)].emplace_back(std::move(arguments));
+}
+
+void SubscriptionDefinitionVisitor::visitFragmentSpread(const peg::ast_node& fragmentSpread)
+{
+	const std::string name(fragmentSpread.children.front()->content());
+	auto itr = _fragments.find(name);
+
+	if (itr == _fragments.cend())
+	{
+		auto position = fragmentSpread.begin();
+		std::ostringstream error;
+
+		error << "Unknown fragment name: " << name
+			<< " line: " << position.line
+			<< " column: " << position.byte_in_line;
+
+		throw schema_exception({ error.str() });
+	}
+
+	bool skip = !_subscriptionObject->matchesType(itr->second.getType());
+	DirectiveVisitor directiveVisitor(_params.variables);
+
+	if (!skip)
+	{
+		peg::on_first_child<peg::directives>(fragmentSpread,
+			[&directiveVisitor](const peg::ast_node& child)
+		{
+			directiveVisitor.visit(child);
+		});
+
+		skip = directiveVisitor.shouldSkip();
+	}
+
+	if (skip)
+	{
+		return;
+	}
+
+	for (const auto& selection : itr->second.getSelection().children)
+	{
+		visit(*selection);
 	}
 }
 
-SubscriptionData::SubscriptionData(std::shared_ptr<OperationData>&& data, std::unordered_map<SubscriptionName, std::vector<response::Value>>&& fieldNamesAndArgs,
-	peg::ast<std::string>&& query, std::string&& operationName, SubscriptionCallback&& callback,
-	const peg::ast_node& selection)
-	: data(std::move(data))
-	, fieldNamesAndArgs(std::move(fieldNamesAndArgs))
-	, query(std::move(query))
-	, operationName(std::move(operationName))
-	, callback(std::move(callback))
-	, selection(selection)
+void SubscriptionDefinitionVisitor::visitInlineFragment(const peg::ast_node& inlineFragment)
 {
+	DirectiveVisitor directiveVisitor(_params.variables);
+
+	peg::on_first_child<peg::directives>(inlineFragment,
+		[&directiveVisitor](const peg::ast_node& child)
+	{
+		directiveVisitor.visit(child);
+	});
+
+	if (directiveVisitor.shouldSkip())
+	{
+		return;
+	}
+
+	const peg::ast_node* typeCondition = nullptr;
+
+	peg::on_first_child<peg::type_condition>(inlineFragment,
+		[&typeCondition](const peg::ast_node& child)
+	{
+		typeCondition = &child;
+	});
+
+	if (typeCondition == nullptr
+		|| _subscriptionObject->matchesType(typeCondition->children.front()->content()))
+	{
+		peg::on_first_child<peg::selection_set>(inlineFragment,
+			[this](const peg::ast_node& child)
+		{
+			for (const auto& selection : child.children)
+			{
+				visit(*selection);
+			}
+		});
+	}
 }
 
-// SubscriptionDefinitionVisitor visits the AST collects the fields referenced in the subscription at the point
-// where we create a subscription.
-class SubscriptionDefinitionVisitor
+// Each Request remembers the validation results for this many documents before it starts over.
+static const size_t s_maxValidationResults = 1024;
+
+// ValidateExecutableVisitor and CostAnalysisVisitor recurse through each level of the document, so
+// anything nested more deeply than this is rejected before either of them visits it.
+static const size_t s_maxDocumentDepth = 1024;
+
+static std::string checkDocumentDepth(const peg::ast_node& root)
 {
-public:
-	SubscriptionDefinitionVisitor(SubscriptionParams&& params, SubscriptionCallback&& callback, FragmentMap&& fragments, const std::shared_ptr<Object>& subscriptionObject);
+	const auto depth = getDocumentDepth(root);
 
-	const peg::ast_node& getRoot() const;
-	std::shared_ptr<SubscriptionData> getRegistration();
+	if (depth <= s_maxDocumentDepth)
+	{
+		return std::string();
+	}
 
-	void visit(const peg::ast_node& operationDefinition);
+	std::ostringstream error;
 
-private:
-	void visitField(const peg::ast_node& field);
-	void visitFragmentSpread(const peg::ast_node& fragmentSpread);
-	void visitInlineFragment(const peg::ast_node& inlineFragment);
+	error << "Document nesting depth: " << depth
+		<< " exceeds the limit: " << s_maxDocumentDepth;
 
-	SubscriptionParams _params;
-	SubscriptionCallback _callback;
-	FragmentMap _fragments;
-	const std::shared_ptr<Object>& _subscriptionObject;
-	std::unordered_map<SubscriptionName, std::vector<response::Value>> _fieldNamesAndArgs;
-	std::shared_ptr<SubscriptionData> _result;
-};
+	return error.str();
+}
 
-SubscriptionDefinitionVisitor::SubscriptionDefinitionVisitor(SubscriptionParams&& params, SubscriptionCallback&& callback, FragmentMap&& fragments, const std::shared_ptr<Object>& subscriptionObject)
-	: _params(std::move(params))
-	, _callback(std::move(callback))
-	, _fragments(std::move(fragments))
-	, _subscriptionObject(subscriptionObject)
+// Identify a document by the text of each of its definitions, ignoring any whitespace or comments
+// between them.
+static std::string getDocumentKey(const peg::ast_node& root)
 {
+	std::string key;
+
+	for (const auto& child : root.children)
+	{
+		key.append(child->content());
+		key.push_back('\n');
+	}
+
+	return key;
 }
 
-const peg::ast_node& SubscriptionDefinitionVisitor::getRoot() const
+// Check if the operation which will be executed is a query. The operation type is optional for
+// query operations.
+static bool isQueryOperation(const peg::ast_node& root, const std::string& operationName)
 {
-	return *_params.query.root;
+	bool found = false;
+	bool query = false;
+
+	peg::for_each_child<peg::operation_definition>(root,
+		[&operationName, &found, &query](const peg::ast_node& operationDefinition)
+	{
+		std::string name;
+		std::string operation;
+
+		peg::on_first_child<peg::operation_name>(operationDefinition,
+			[&name](const peg::ast_node& child)
+		{
+			name = child.content();
+		});
+
+		if (!operationName.empty()
+			&& name != operationName)
+		{
+			return;
+		}
+
+		peg::on_first_child<peg::operation_type>(operationDefinition,
+			[&operation](const peg::ast_node& child)
+		{
+			operation = child.content();
+		});
+
+		// If there's more than one match, the request is going to fail anyway.
+		query = !found && (operation.empty() || operation == "query");
+		found = true;
+	});
+
+	return query;
 }
 
-std::shared_ptr<SubscriptionData> SubscriptionDefinitionVisitor::getRegistration()
+Request::Request(TypeMap&& operationTypes, FieldCosts&& fieldCosts)
+	: _operations(std::move(operationTypes))
+	, _fieldCosts(std::move(fieldCosts))
 {
-	if (!_result)
+	// Load the schema for validation with an introspection query. If the query type doesn't support
+	// introspection, there's nothing to validate against and documents are only checked while
+	// they're executed.
+	response::Value result;
+
+	try
+	{
+		result = execute(nullptr, ValidationSchema::getIntrospectionQuery(), "", response::Value(response::Type::Map)).get();
+	}
+	catch (const std::exception&)
+	{
+		return;
+	}
+
+	const auto itrData = result.find("data");
+
+	if (itrData == result.end()
+		|| itrData->second.type() != response::Type::Map)
+	{
+		return;
+	}
+
+	const auto itrSchema = itrData->second.find("__schema");
+
+	if (itrSchema == itrData->second.end()
+		|| itrSchema->second.type() != response::Type::Map)
+	{
+		return;
+	}
+
+	// If the schema does support introspection, a failure to load it is a bug in the schema and
+	// shouldn't quietly turn validation off.
+	try
+	{
+		_validation = std::make_shared<ValidationSchema>(itrSchema->second);
+	}
+	catch (const std::exception& ex)
 	{
 		std::ostringstream error;
 
-		error << "Missing operation";
+		error << "Failed to load the schema for validation: " << ex.what();
+
+		throw schema_exception({ error.str() });
+	}
+}
+
+bool Request::validate(const peg::ast_node& root) const
+{
+	MetricsTimer timer(MetricsPhase::Validate);
+
+	if (!_validation)
+	{
+		return false;
+	}
+
+	// The same document always gets the same result, so we only need to remember the errors.
+	auto key = getDocumentKey(root);
+	std::vector<std::string> errors;
+
+	{
+		std::lock_guard<std::mutex> lock(_validationMutex);
+		auto itr = _validationResults.find(key);
+
+		if (itr != _validationResults.end())
+		{
+			if (itr->second.empty())
+			{
+				return true;
+			}
+
+			errors = itr->second;
+		}
+	}
+
+	if (errors.empty())
+	{
+		auto depthError = checkDocumentDepth(root);
+
+		if (depthError.empty())
+		{
+			ValidateExecutableVisitor visitor(*_validation);
+
+			visitor.visit(root);
+			errors = visitor.getErrors();
+		}
+		else
+		{
+			errors.push_back(std::move(depthError));
+		}
+
+		std::lock_guard<std::mutex> lock(_validationMutex);
+
+		// Don't let a client which sends a stream of unique documents grow the cache forever.
+		if (_validationResults.size() >= s_maxValidationResults)
+		{
+			_validationResults.clear();
+		}
+
+		_validationResults.insert({ std::move(key), errors });
+	}
+
+	if (!errors.empty())
+	{
+		throw schema_exception(std::move(errors));
+	}
+
+	return true;
+}
+
+QueryCost Request::analyzeCost(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, const response::Value& variables) const
+{
+	if (!_validation)
+	{
+		return QueryCost();
+	}
+
+	auto depthError = checkDocumentDepth(root);
+
+	if (!depthError.empty())
+	{
+		throw schema_exception({ std::move(depthError) });
+	}
+
+	static const RequestState s_defaultState;
+	CostAnalysisVisitor visitor(*_validation, _fieldCosts, variables, (state ? *state : s_defaultState).defaultListSize);
+
+	visitor.visit(root, operationName);
+
+	return visitor.getCost();
+}
+
+std::future<response::Value> Request::resolve(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables) const
+{
+	return admit(state, root, operationName, std::move(variables), nullptr);
+}
 
-		if (!_params.operationName.empty())
+std::future<void> Request::resolveIncremental(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+	IncrementalCallback&& callback) const
+{
+	// The patches are resolved after the initial payload, so they always need a RequestState to hold
+	// onto, even if the caller didn't pass one in.
+	auto incremental = std::make_shared<IncrementalDelivery>(std::move(callback));
+	auto initial = admit(state ? state : std::make_shared<RequestState>(), root, operationName, std::move(variables), incremental);
+
+	// If the caller releases the std::future without waiting for it, nothing is ever delivered, but
+	// the patches which were added while resolving the initial payload still need to be dropped.
+	struct PatchesOwner
+	{
+		explicit PatchesOwner(std::shared_ptr<IncrementalDelivery>&& owned)
+			: incremental(std::move(owned))
 		{
-			error << " name: " << _params.operationName;
 		}
 
-		throw schema_exception({ error.str() });
-	}
+		~PatchesOwner()
+		{
+			incremental->clearPatches();
+		}
 
-	auto result = std::move(_result);
+		const std::shared_ptr<IncrementalDelivery> incremental;
+	};
 
-	_result.reset();
+	auto owner = std::make_shared<PatchesOwner>(std::move(incremental));
 
-	return result;
+	return std::async(std::launch::deferred,
+		[owner](std::future<response::Value>&& wrappedInitial)
+	{
+		owner->incremental->deliver(wrappedInitial.get());
+	}, std::move(initial));
 }
 
-void SubscriptionDefinitionVisitor::visit(const peg::ast_node& operationDefinition)
+std::future<response::Value> Request::resolveBatch(const std::shared_ptr<RequestState>& state, std::vector<BatchedOperation>&& operations) const
 {
-	std::string operation;
+	// Share a RequestState between the operations even if the caller didn't pass one in.
+	auto batchState = state ? state : std::make_shared<RequestState>();
+	std::vector<std::future<response::Value>> results;
 
-	peg::on_first_child<peg::operation_type>(operationDefinition,
-		[&operation](const peg::ast_node& child)
-		{
-			operation = child.content();
-		});
+	results.reserve(operations.size());
+	batchState->holdBatches();
 
-	if (operation != "subscription")
+	try
 	{
-		// Skip operations other than subscription.
-		return;
+		for (auto& operation : operations)
+		{
+			results.push_back(resolve(batchState, operation.root, operation.operationName, std::move(operation.variables)));
+		}
+	}
+	catch (...)
+	{
+		batchState->releaseBatches();
+		throw;
 	}
 
-	auto position = operationDefinition.begin();
-	std::string name;
+	batchState->releaseBatches();
 
-	peg::on_first_child<peg::operation_name>(operationDefinition,
-		[&name](const peg::ast_node& child)
-		{
-			name = child.content();
-		});
+	// Wait for each of the operations on the Executor, so one of them waiting on a slow resolver
+	// doesn't hold up the others.
+	std::queue<std::future<response::Value>> responses;
 
-	if (!_params.operationName.empty()
-		&& name != _params.operationName)
+	for (auto& result : results)
 	{
-		// Skip the subscriptions that don't match the name
-		return;
+		responses.push(launch(batchState->executor,
+			[](std::future<response::Value>&& wrappedResult)
+		{
+			return wrappedResult.get();
+		}, std::move(result)));
 	}
 
-	if (_result)
+	return std::async(std::launch::deferred,
+		[batchState](std::queue<std::future<response::Value>>&& wrappedResponses)
 	{
-		std::ostringstream error;
+		response::Value result(response::Type::List);
 
-		if (_params.operationName.empty())
-		{
-			error << "No operationName specified with extra subscription";
-		}
-		else
-		{
-			error << "Duplicate subscription";
-		}
+		result.reserve(wrappedResponses.size());
 
-		if (!name.empty())
+		while (!wrappedResponses.empty())
 		{
-			error << " name: " << name;
+			result.emplace_back(wrappedResponses.front().get());
+			wrappedResponses.pop();
 		}
 
-		error << " line: " << position.line
-			<< " column: " << position.byte_in_line;
+		return result;
+	}, std::move(responses));
+}
 
-		throw schema_exception({ error.str() });
+std::future<std::shared_ptr<const std::string>> Request::resolveCached(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+	const std::shared_ptr<ResponseCache>& cache, std::chrono::seconds maxAge, std::vector<std::string>&& tags) const
+{
+	if (!cache)
+	{
+		throw schema_exception({ "Missing ResponseCache" });
 	}
 
-	const auto& selection = *operationDefinition.children.back();
+	std::string key;
 
-	for (const auto& child : selection.children)
+	if (maxAge.count() > 0
+		&& isQueryOperation(root, operationName))
 	{
-		if (child->is<peg::field>())
-		{
-			visitField(*child);
-		}
-		else if (child->is<peg::fragment_spread>())
-		{
-			visitFragmentSpread(*child);
-		}
-		else if (child->is<peg::inline_fragment>())
+		std::ostringstream output;
+
+		output.precision(17);
+		output << getDocumentKey(root) << operationName << '\n';
+		appendCanonicalValue(output, variables);
+		key = output.str();
+
+		auto cached = cache->find(key);
+
+		if (cached)
 		{
-			visitInlineFragment(*child);
+			std::promise<std::shared_ptr<const std::string>> promise;
+
+			promise.set_value(std::move(cached));
+
+			return promise.get_future();
 		}
 	}
 
-	response::Value directives(response::Type::Map);
-
-	peg::on_first_child<peg::directives>(operationDefinition,
-		[this, &directives](const peg::ast_node& child)
+	return std::async(std::launch::deferred,
+		[cache, maxAge](std::string&& wrappedKey, std::vector<std::string>&& wrappedTags, std::future<response::Value>&& wrappedResult)
 	{
-		DirectiveVisitor directiveVisitor(_params.variables);
+		auto document = wrappedResult.get();
+		const bool cacheable = (!wrappedKey.empty()
+			&& document.find("errors") == document.end());
+		auto response = cache->serialize(std::move(document));
 
-		directiveVisitor.visit(child);
-		directives = directiveVisitor.getDirectives();
-	});
+		if (cacheable)
+		{
+			cache->insert(std::move(wrappedKey), response, maxAge, wrappedTags);
+		}
 
-	_result = std::make_shared<SubscriptionData>(
-		std::make_shared<OperationData>(
-			std::move(_params.state),
-			std::move(_params.variables),
-			std::move(directives),
-			std::move(_fragments)),
-		std::move(_fieldNamesAndArgs),
-		std::move(_params.query),
-		std::move(_params.operationName),
-		std::move(_callback),
-		selection);
+		return response;
+	}, std::move(key), std::move(tags), resolve(state, root, operationName, std::move(variables)));
 }
 
-void SubscriptionDefinitionVisitor::visitField(const peg::ast_node& field)
+struct Request::SharedFlight
 {
-	std::string name;
+	explicit SharedFlight(const Request& request, std::string&& key, std::shared_future<std::shared_future<response::Value>>&& execution);
+	~SharedFlight();
 
-	peg::on_first_child<peg::field_name>(field,
-		[&name](const peg::ast_node& child)
-	{
-		name = child.content();
-	});
+	// Stop attaching new requests to this execution.
+	void complete();
 
-	DirectiveVisitor directiveVisitor(_params.variables);
+	const Request& request;
+	const std::string key;
+	const std::shared_future<std::shared_future<response::Value>> execution;
+};
 
-	peg::on_first_child<peg::directives>(field,
-		[&directiveVisitor](const peg::ast_node& child)
-	{
-		directiveVisitor.visit(child);
-	});
+Request::SharedFlight::SharedFlight(const Request& request, std::string&& key, std::shared_future<std::shared_future<response::Value>>&& execution)
+	: request(request)
+	, key(std::move(key))
+	, execution(std::move(execution))
+{
+}
 
-	if (directiveVisitor.shouldSkip())
+Request::SharedFlight::~SharedFlight()
+{
+	std::lock_guard<std::mutex> lock(request._flightsMutex);
+	auto itr = request._flights.find(key);
+
+	if (itr != request._flights.end()
+		&& itr->second.expired())
 	{
-		return;
+		request._flights.erase(itr);
 	}
+}
 
-	response::Value arguments(response::Type::Map);
+void Request::SharedFlight::complete()
+{
+	std::lock_guard<std::mutex> lock(request._flightsMutex);
+	auto itr = request._flights.find(key);
 
-	peg::on_first_child<peg::arguments>(field,
-		[this, &arguments](const peg::ast_node& child)
+	if (itr != request._flights.end()
+		&& itr->second.lock().get() == this)
 	{
-		ValueVisitor visitor(_params.variables);
-
-		for (auto& argument : child.children)
-		{
-			visitor.visit(*argument->children.back());
-
-			arguments.emplace_back(argument->children.front()->content(), visitor.getValue());
-		}
-	});
-
-	_fieldNamesAndArgs[std::move(name)].emplace_back(std::move(arguments));
+		request._flights.erase(itr);
+	}
 }
 
-void SubscriptionDefinitionVisitor::visitFragmentSpread(const peg::ast_node& fragmentSpread)
+std::future<response::Value> Request::resolveShared(const std::shared_ptr<RequestState>& state, const std::shared_ptr<const peg::ast_node>& root, const std::string& operationName, response::Value&& variables) const
 {
-	const std::string name(fragmentSpread.children.front()->content());
-	auto itr = _fragments.find(name);
+	if (!root)
+	{
+		throw schema_exception({ "Missing document" });
+	}
 
-	if (itr == _fragments.cend())
+	// Cancelling one of the coalesced requests would cancel all of them.
+	if (!state
+		|| !state->shareable
+		|| state->cancellation
+		|| !isQueryOperation(*root, operationName))
 	{
-		auto position = fragmentSpread.begin();
-		std::ostringstream error;
+		return std::async(std::launch::deferred,
+			[state, root](std::future<response::Value>&& wrappedResult)
+		{
+			auto result = wrappedResult.get();
 
-		error << "Unknown fragment name: " << name
-			<< " line: " << position.line
-			<< " column: " << position.byte_in_line;
+			// Fields which were abandoned at the deadline may still be reading the document.
+			if (state && state->cancellation)
+			{
+				state->cancellation->holdWhileAbandoned(root);
+			}
 
-		throw schema_exception({ error.str() });
+			return result;
+		}, resolve(state, *root, operationName, std::move(variables)));
 	}
 
-	bool skip = !_subscriptionObject->matchesType(itr->second.getType());
-	DirectiveVisitor directiveVisitor(_params.variables);
+	std::ostringstream output;
+
+	output.precision(17);
+	output << state->shareScope << '\n' << getDocumentKey(*root) << operationName << '\n';
+	appendCanonicalValue(output, variables);
+
+	auto key = output.str();
+	std::shared_ptr<SharedFlight> flight;
+	std::promise<std::shared_future<response::Value>> publish;
+	bool leader = false;
 
-	if (!skip)
 	{
-		peg::on_first_child<peg::directives>(fragmentSpread,
-			[&directiveVisitor](const peg::ast_node& child)
-		{
-			directiveVisitor.visit(child);
-		});
+		std::lock_guard<std::mutex> lock(_flightsMutex);
+		auto& entry = _flights[key];
 
-		skip = directiveVisitor.shouldSkip();
+		flight = entry.lock();
+
+		if (!flight)
+		{
+			flight = std::make_shared<SharedFlight>(*this, std::move(key), publish.get_future().share());
+			entry = flight;
+			leader = true;
+		}
 	}
 
-	if (skip)
+	// The first request starts executing the operation outside of the lock, and the others wait for
+	// it to publish the std::shared_future. Whichever one waits for the result first finishes it.
+	if (leader)
 	{
-		return;
+		try
+		{
+			publish.set_value(std::async(std::launch::deferred,
+				[root](std::future<response::Value>&& wrappedResult)
+			{
+				return wrappedResult.get();
+			}, resolve(state, *root, operationName, std::move(variables))).share());
+		}
+		catch (...)
+		{
+			publish.set_exception(std::current_exception());
+			flight->complete();
+			throw;
+		}
 	}
 
-	for (const auto& selection : itr->second.getSelection().children)
+	return std::async(std::launch::deferred,
+		[flight]()
 	{
-		visit(*selection);
-	}
+		try
+		{
+			response::Value result(flight->execution.get().get());
+
+			flight->complete();
+
+			return result;
+		}
+		catch (...)
+		{
+			flight->complete();
+			throw;
+		}
+	});
 }
 
-void SubscriptionDefinitionVisitor::visitInlineFragment(const peg::ast_node& inlineFragment)
+std::future<response::Value> Request::admit(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+	const std::shared_ptr<IncrementalDelivery>& incremental) const
 {
-	DirectiveVisitor directiveVisitor(_params.variables);
+	bool validated = false;
 
-	peg::on_first_child<peg::directives>(inlineFragment,
-		[&directiveVisitor](const peg::ast_node& child)
+	try
 	{
-		directiveVisitor.visit(child);
-	});
+		validated = validate(root);
 
-	if (directiveVisitor.shouldSkip())
-	{
-		return;
-	}
+		if (state
+			&& (state->maxDepth != 0 || state->maxComplexity != 0))
+		{
+			const auto cost = analyzeCost(state, root, operationName, variables);
+			std::vector<std::string> errors;
 
-	const peg::ast_node* typeCondition = nullptr;
+			if (state->maxDepth != 0 && cost.depth > state->maxDepth)
+			{
+				std::ostringstream error;
 
-	peg::on_first_child<peg::type_condition>(inlineFragment,
-		[&typeCondition](const peg::ast_node& child)
-	{
-		typeCondition = &child;
-	});
+				error << "Query depth: " << cost.depth
+					<< " exceeds the limit: " << state->maxDepth;
 
-	if (typeCondition == nullptr
-		|| _subscriptionObject->matchesType(typeCondition->children.front()->content()))
-	{
-		peg::on_first_child<peg::selection_set>(inlineFragment,
-			[this](const peg::ast_node& child)
-		{
-			for (const auto& selection : child.children)
+				errors.push_back(error.str());
+			}
+
+			if (state->maxComplexity != 0 && cost.complexity > state->maxComplexity)
 			{
-				visit(*selection);
+				std::ostringstream error;
+
+				error << "Query complexity: " << cost.complexity
+					<< " exceeds the limit: " << state->maxComplexity;
+
+				errors.push_back(error.str());
 			}
-		});
+
+			if (!errors.empty())
+			{
+				throw schema_exception(std::move(errors));
+			}
+		}
 	}
-}
+	catch (const schema_exception& ex)
+	{
+		// Validation and cost errors are reported before execution begins, so there's no data entry.
+		std::promise<response::Value> promise;
+		response::Value document(response::Type::Map);
 
-Request::Request(TypeMap&& operationTypes)
-	: _operations(std::move(operationTypes))
-{
-}
+		document.emplace_back("errors", response::Value(ex.getErrors()));
+		promise.set_value(std::move(document));
 
-std::future<response::Value> Request::resolve(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables) const
-{
-	FragmentDefinitionVisitor fragmentVisitor(variables);
+		return promise.get_future();
+	}
 
-	peg::for_each_child<peg::fragment_definition>(root,
-		[&fragmentVisitor](const peg::ast_node& child)
-	{
-		fragmentVisitor.visit(child);
-	});
+	return execute(state, root, operationName, std::move(variables), incremental, validated);
+}
 
-	auto fragments = fragmentVisitor.getFragments();
-	OperationDefinitionVisitor operationVisitor(state, _operations, operationName, std::move(variables), std::move(fragments));
+std::future<response::Value> Request::execute(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+	const std::shared_ptr<IncrementalDelivery>& incremental, bool validated) const
+{
+	MetricsTimer timer(MetricsPhase::Prepare);
+	OperationDefinitionVisitor operationVisitor(state, _operations, operationName, std::move(variables), root, incremental, validated, _validation);
 
 	peg::for_each_child<peg::operation_definition>(root,
 		[&operationVisitor](const peg::ast_node& child)
@@ -1643,16 +3986,9 @@ SubscriptionKey Request::subscribe(SubscriptionParams&& params, SubscriptionCall
 		throw schema_exception({ "Schema does not include a subscription type" });
 	}
 
-	FragmentDefinitionVisitor fragmentVisitor(params.variables);
-
-	peg::for_each_child<peg::fragment_definition>(*params.query.root,
-		[&fragmentVisitor](const peg::ast_node& child)
-		{
-			fragmentVisitor.visit(child);
-		});
+	const bool validated = validate(*params.query.root);
 
-	auto fragments = fragmentVisitor.getFragments();
-	SubscriptionDefinitionVisitor subscriptionVisitor(std::move(params), std::move(callback), std::move(fragments), itr->second);
+	SubscriptionDefinitionVisitor subscriptionVisitor(std::move(params), std::move(callback), itr->second, _validation);
 
 	peg::for_each_child<peg::operation_definition>(subscriptionVisitor.getRoot(),
 		[&subscriptionVisitor](const peg::ast_node& child)
@@ -1663,6 +3999,8 @@ SubscriptionKey Request::subscribe(SubscriptionParams&& params, SubscriptionCall
 	auto registration = subscriptionVisitor.getRegistration();
 	auto key = _nextKey++;
 
+	registration->data->validated = validated;
+
 	for (const auto& entry : registration->fieldNamesAndArgs)
 	{
 		_listeners[entry.first].insert(key);
@@ -1725,6 +4063,7 @@ void Request::deliver(const SubscriptionName& name, const SubscriptionArguments&
 
 void Request::deliver(const SubscriptionName& name, const SubscriptionFilterCallback& apply, const std::shared_ptr<Object>& subscriptionObject) const
 {
+	MetricsTimer timer(MetricsPhase::Deliver);
 	const auto& optionalOrDefaultSubscription = subscriptionObject
 		? subscriptionObject
 		: _operations.find("subscription")->second;
@@ -1776,7 +4115,12 @@ void Request::deliver(const SubscriptionName& name, const SubscriptionFilterCall
 			registration->data->directives,
 			emptyFragmentDirectives,
 			emptyFragmentDirectives,
-			emptyFragmentDirectives
+			emptyFragmentDirectives,
+			nullptr,
+			nullptr,
+			nullptr,
+			registration->data->validated,
+			registration->data->schema.get()
 		};
 
 		try
@@ -1785,8 +4129,28 @@ void Request::deliver(const SubscriptionName& name, const SubscriptionFilterCall
 				[registration](std::future<response::Value> data)
 				{
 					response::Value document(response::Type::Map);
+					response::Value errors(response::Type::List);
 
-					document.emplace_back("data", data.get());
+					try
+					{
+						document.emplace_back("data", data.get());
+					}
+					catch (const schema_exception& ex)
+					{
+						document.emplace_back("data", response::Value());
+						errors = response::Value(ex.getErrors());
+					}
+					catch (const propagated_cancellation&)
+					{
+						document.emplace_back("data", response::Value());
+					}
+
+					addCancellationErrors(registration->data->state, errors);
+
+					if (errors.size() > 0)
+					{
+						document.emplace_back("errors", std::move(errors));
+					}
 
 					return document;
 				}, optionalOrDefaultSubscription->resolve(selectionSetParams, registration->selection, registration->data->fragments, registration->data->variables));
@@ -3,6 +3,8 @@
 
 #include "GraphQLGrammar.h"
 
+#include <graphqlservice/GraphQLMetrics.h>
+
 #include <tao/pegtl/contrib/unescape.hpp>
 
 #include <memory>
@@ -658,6 +660,7 @@ ast<const char*>::~ast()
 
 ast<std::string> parseString(std::string&& input)
 {
+	service::MetricsTimer timer(service::MetricsPhase::Parse);
 	ast<std::string> result { std::move(input), nullptr };
 	memory_input<> in(result.input.c_str(), result.input.size(), "GraphQL");
 
@@ -668,6 +671,7 @@ ast<std::string> parseString(std::string&& input)
 
 ast<std::unique_ptr<file_input<>>> parseFile(const char* filename)
 {
+	service::MetricsTimer timer(service::MetricsPhase::Parse);
 	std::unique_ptr<file_input<>> in(new file_input<>(std::string(filename)));
 	ast<std::unique_ptr<file_input<>>> result { std::move(in), nullptr };
 
@@ -680,6 +684,7 @@ ast<std::unique_ptr<file_input<>>> parseFile(const char* filename)
 
 peg::ast<const char*> operator "" _graphql(const char* text, size_t size)
 {
+	service::MetricsTimer timer(service::MetricsPhase::Parse);
 	peg::memory_input<> in(text, size, "GraphQL");
 
 	return { text, peg::parse_tree::parse<peg::document, peg::ast_node, peg::ast_selector, peg::nothing, peg::ast_control>(std::move(in)) };
@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include <graphqlservice/JSONResponse.h>
+#include <graphqlservice/GraphQLMetrics.h>
 
 #define RAPIDJSON_NAMESPACE facebook::graphql::rapidjson
 #define RAPIDJSON_NAMESPACE_BEGIN namespace facebook { namespace graphql { namespace rapidjson {
@@ -104,6 +105,7 @@ void writeResponse(rapidjson::Writer<rapidjson::StringBuffer>& writer, Value&& r
 
 std::string toJSON(Value&& response)
 {
+	service::MetricsTimer timer(service::MetricsPhase::Serialize);
 	rapidjson::StringBuffer buffer;
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 
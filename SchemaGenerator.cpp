@@ -222,6 +222,75 @@ bool Generator::validateSchema()
 		}
 	}
 
+	// Fields inherit the @synchronous directive from the type which declares them. The accessors for
+	// interface fields are declared on the interface, so they override the object type fields, and
+	// they can't be marked @batch because the parents may be different types.
+	for (auto& entry : _interfaceTypes)
+	{
+		for (auto& field : entry.fields)
+		{
+			if (field.batch
+				|| (field.lazy && (field.modifiers.empty() || field.modifiers.front() != service::TypeModifier::List)))
+			{
+				return false;
+			}
+
+			field.synchronous = field.synchronous || entry.synchronous;
+		}
+	}
+
+	for (auto& entry : _objectTypes)
+	{
+		for (auto& field : entry.fields)
+		{
+			field.synchronous = field.synchronous || entry.synchronous;
+
+			// A @cacheControl hint on the field takes precedence over the hint on the object type.
+			if (!field.cacheControl && entry.cacheControl)
+			{
+				field.cacheControl.reset(new CacheControlHint(*entry.cacheControl));
+			}
+		}
+
+		for (const auto& interfaceName : entry.interfaces)
+		{
+			const auto& interfaceType = _interfaceTypes[_interfaceNames[interfaceName]];
+
+			for (const auto& interfaceField : interfaceType.fields)
+			{
+				for (auto& field : entry.fields)
+				{
+					if (field.name == interfaceField.name)
+					{
+						if (field.batch)
+						{
+							return false;
+						}
+
+						field.synchronous = interfaceField.synchronous;
+						field.lazy = interfaceField.lazy;
+
+						if (!field.cacheControl && interfaceField.cacheControl)
+						{
+							field.cacheControl.reset(new CacheControlHint(*interfaceField.cacheControl));
+						}
+					}
+				}
+			}
+		}
+
+		// The LazyList replaces the outermost std::vector, so @lazy fields must be non-nullable lists,
+		// and batch accessors return all of the results at once.
+		for (const auto& field : entry.fields)
+		{
+			if (field.lazy
+				&& (field.batch || field.modifiers.empty() || field.modifiers.front() != service::TypeModifier::List))
+			{
+				return false;
+			}
+		}
+	}
+
 	return true;
 }
 
@@ -402,7 +471,7 @@ void Generator::visitObjectTypeDefinition(const peg::ast_node& objectTypeDefinit
 
 	_schemaTypes[name] = SchemaType::Object;
 	_objectNames[name] = _objectTypes.size();
-	_objectTypes.push_back({ std::move(name), {}, {}, std::move(description) });
+	_objectTypes.push_back({ std::move(name), {}, {}, std::move(description), false, nullptr });
 
 	visitObjectTypeExtension(objectTypeDefinition);
 }
@@ -429,6 +498,23 @@ void Generator::visitObjectTypeExtension(const peg::ast_node& objectTypeExtensio
 			objectType.interfaces.push_back(child.content());
 		});
 
+		peg::on_first_child<peg::directives>(objectTypeExtension,
+			[&objectType](const peg::ast_node& child)
+		{
+			objectType.synchronous = objectType.synchronous || hasDirective(child, "synchronous");
+
+			peg::for_each_child<peg::directive>(child,
+				[&objectType](const peg::ast_node& directive)
+			{
+				auto cacheControl = getCacheControl(directive);
+
+				if (cacheControl)
+				{
+					objectType.cacheControl = std::move(cacheControl);
+				}
+			});
+		});
+
 		peg::on_first_child<peg::fields_definition>(objectTypeExtension,
 			[&objectType](const peg::ast_node& child)
 		{
@@ -462,7 +548,7 @@ void Generator::visitInterfaceTypeDefinition(const peg::ast_node& interfaceTypeD
 
 	_schemaTypes[name] = SchemaType::Interface;
 	_interfaceNames[name] = _interfaceTypes.size();
-	_interfaceTypes.push_back({ std::move(name), {}, std::move(description) });
+	_interfaceTypes.push_back({ std::move(name), {}, std::move(description), false });
 
 	visitInterfaceTypeExtension(interfaceTypeDefinition);
 }
@@ -483,6 +569,12 @@ void Generator::visitInterfaceTypeExtension(const peg::ast_node& interfaceTypeEx
 	{
 		auto& interfaceType = _interfaceTypes[itrType->second];
 
+		peg::on_first_child<peg::directives>(interfaceTypeExtension,
+			[&interfaceType](const peg::ast_node& child)
+		{
+			interfaceType.synchronous = interfaceType.synchronous || hasDirective(child, "synchronous");
+		});
+
 		peg::on_first_child<peg::fields_definition>(interfaceTypeExtension,
 			[&interfaceType](const peg::ast_node& child)
 		{
@@ -843,6 +935,60 @@ OutputFieldList Generator::getOutputFields(const std::vector<std::unique_ptr<peg
 
 						field.deprecationReason.reset(new std::string(std::move(deprecationReason)));
 					}
+					else if (directiveName == "synchronous")
+					{
+						field.synchronous = true;
+					}
+					else if (directiveName == "pure")
+					{
+						field.pure = true;
+					}
+					else if (directiveName == "batch")
+					{
+						field.batch = true;
+					}
+					else if (directiveName == "lazy")
+					{
+						field.lazy = true;
+					}
+					else if (directiveName == "cacheControl")
+					{
+						field.cacheControl = getCacheControl(directive);
+					}
+					else if (directiveName == "cost")
+					{
+						peg::on_first_child<peg::arguments>(directive,
+							[&field](const peg::ast_node& arguments)
+						{
+							peg::for_each_child<peg::argument>(arguments,
+								[&field](const peg::ast_node& argument)
+							{
+								std::string argumentName;
+
+								peg::on_first_child<peg::argument_name>(argument,
+									[&argumentName](const peg::ast_node& name)
+								{
+									argumentName = name.content();
+								});
+
+								if (argumentName == "weight")
+								{
+									peg::on_first_child<peg::integer_value>(argument,
+										[&field](const peg::ast_node& weight)
+									{
+										const auto value = std::atoi(weight.content().c_str());
+
+										if (value < 0)
+										{
+											throw std::runtime_error("Invalid @cost weight: " + weight.content());
+										}
+
+										field.cost.reset(new size_t(static_cast<size_t>(value)));
+									});
+								}
+							});
+						});
+					}
 				});
 			}
 		}
@@ -854,6 +1000,92 @@ OutputFieldList Generator::getOutputFields(const std::vector<std::unique_ptr<peg
 	return outputFields;
 }
 
+std::unique_ptr<CacheControlHint> Generator::getCacheControl(const peg::ast_node& directive)
+{
+	std::string directiveName;
+
+	peg::on_first_child<peg::directive_name>(directive,
+		[&directiveName](const peg::ast_node& name)
+	{
+		directiveName = name.content();
+	});
+
+	if (directiveName != "cacheControl")
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<CacheControlHint> cacheControl(new CacheControlHint { 0, false });
+
+	peg::on_first_child<peg::arguments>(directive,
+		[&cacheControl](const peg::ast_node& arguments)
+	{
+		peg::for_each_child<peg::argument>(arguments,
+			[&cacheControl](const peg::ast_node& argument)
+		{
+			std::string argumentName;
+
+			peg::on_first_child<peg::argument_name>(argument,
+				[&argumentName](const peg::ast_node& name)
+			{
+				argumentName = name.content();
+			});
+
+			if (argumentName == "maxAge")
+			{
+				peg::on_first_child<peg::integer_value>(argument,
+					[&cacheControl](const peg::ast_node& maxAge)
+				{
+					const auto value = std::atoi(maxAge.content().c_str());
+
+					if (value < 0)
+					{
+						throw std::runtime_error("Invalid @cacheControl maxAge: " + maxAge.content());
+					}
+
+					cacheControl->maxAge = static_cast<size_t>(value);
+				});
+			}
+			else if (argumentName == "scope")
+			{
+				peg::on_first_child<peg::enum_value>(argument,
+					[&cacheControl](const peg::ast_node& scope)
+				{
+					const auto value = scope.content();
+
+					if (value == "PRIVATE")
+					{
+						cacheControl->privateScope = true;
+					}
+					else if (value != "PUBLIC")
+					{
+						throw std::runtime_error("Invalid @cacheControl scope: " + value);
+					}
+				});
+			}
+		});
+	});
+
+	return cacheControl;
+}
+
+bool Generator::hasDirective(const peg::ast_node& directives, const std::string& name)
+{
+	bool found = false;
+
+	peg::for_each_child<peg::directive>(directives,
+		[&name, &found](const peg::ast_node& directive)
+	{
+		peg::on_first_child<peg::directive_name>(directive,
+			[&name, &found](const peg::ast_node& directiveName)
+		{
+			found = found || directiveName.content() == name;
+		});
+	});
+
+	return found;
+}
+
 InputFieldList Generator::getInputFields(const std::vector<std::unique_ptr<peg::ast_node>>& fields)
 {
 	InputFieldList inputFields;
@@ -1129,6 +1361,8 @@ std::string Generator::getOutputCppType(const OutputField& field, bool interface
 	size_t templateCount = 0;
 	std::ostringstream outputType;
 
+	bool lazy = field.lazy;
+
 	for (auto modifier : field.modifiers)
 	{
 		if (!nonNull)
@@ -1149,10 +1383,15 @@ std::string Generator::getOutputCppType(const OutputField& field, bool interface
 
 			case service::TypeModifier::List:
 				nonNull = true;
-				outputType << R"cpp(std::vector<)cpp";
+				outputType << (lazy
+					? R"cpp(service::LazyList<)cpp"
+					: R"cpp(std::vector<)cpp");
 				++templateCount;
 				break;
 		}
+
+		// Only the outermost list is lazy.
+		lazy = false;
 	}
 
 	switch (field.fieldType)
@@ -1430,7 +1669,9 @@ public:
 						firstField = false;
 					}
 
-					headerFile << getFieldDeclaration(outputField, false);
+					headerFile << (outputField.batch
+						? getBatchFieldDeclaration(outputField, objectType.type)
+						: getFieldDeclaration(outputField, false));
 				}
 
 				headerFile << R"cpp(
@@ -1532,8 +1773,53 @@ std::string Generator::getFieldDeclaration(const OutputField& outputField, bool
 	std::string fieldName(outputField.name);
 
 	fieldName[0] = std::toupper(fieldName[0]);
-	output << R"cpp(	virtual std::future<)cpp" << getOutputCppType(outputField, interfaceField)
-		<< R"cpp(> get)cpp" << fieldName << R"cpp((service::FieldParams&& params)cpp";
+	output << R"cpp(	virtual )cpp";
+
+	if (outputField.synchronous)
+	{
+		output << getOutputCppType(outputField, interfaceField);
+	}
+	else
+	{
+		output << R"cpp(std::future<)cpp" << getOutputCppType(outputField, interfaceField)
+			<< R"cpp(>)cpp";
+	}
+
+	output << R"cpp( get)cpp" << fieldName << R"cpp((service::FieldParams&& params)cpp";
+
+	for (const auto& argument : outputField.arguments)
+	{
+		output << R"cpp(, )cpp" << getInputCppType(argument)
+			<< R"cpp(&& )cpp" << argument.name << "Arg";
+	}
+
+	output << R"cpp() const = 0;
+)cpp";
+
+	return output.str();
+}
+
+std::string Generator::getBatchFieldDeclaration(const OutputField& outputField, const std::string& objectType) const noexcept
+{
+	std::ostringstream output;
+	std::string fieldName(outputField.name);
+
+	fieldName[0] = std::toupper(fieldName[0]);
+	output << R"cpp(	virtual )cpp";
+
+	if (outputField.synchronous)
+	{
+		output << R"cpp(std::vector<)cpp" << getOutputCppType(outputField, false)
+			<< R"cpp(>)cpp";
+	}
+	else
+	{
+		output << R"cpp(std::future<std::vector<)cpp" << getOutputCppType(outputField, false)
+			<< R"cpp(>>)cpp";
+	}
+
+	output << R"cpp( get)cpp" << fieldName << R"cpp((service::FieldParams&& params, const std::vector<const )cpp"
+		<< objectType << R"cpp(*>& parents)cpp";
 
 	for (const auto& argument : outputField.arguments)
 	{
@@ -1553,9 +1839,19 @@ std::string Generator::getResolverDeclaration(const OutputField& outputField) co
 	std::string fieldName(outputField.name);
 
 	fieldName[0] = std::toupper(fieldName[0]);
-	output << R"cpp(	std::future<response::Value> resolve)cpp" << fieldName
-		<< R"cpp((service::ResolverParams&& params);
+
+	if (outputField.batch)
+	{
+		output << R"cpp(	static std::vector<std::future<response::Value>> resolve)cpp" << fieldName
+			<< R"cpp((std::vector<service::BatchedField>&& fields);
+)cpp";
+	}
+	else
+	{
+		output << R"cpp(	std::future<response::Value> resolve)cpp" << fieldName
+			<< R"cpp((service::ResolverParams&& params);
 )cpp";
+	}
 
 	return output.str();
 }
@@ -1639,9 +1935,9 @@ template <>
 }
 
 template <>
-std::future<response::Value> ModifiedResult<)cpp" << _schemaNamespace << R"cpp(::)cpp" << enumType.type
-<< R"cpp(>::convert(std::future<)cpp" << _schemaNamespace << R"cpp(::)cpp" << enumType.type
-<< R"cpp(>&& value, ResolverParams&&)
+response::Value ModifiedResult<)cpp" << _schemaNamespace << R"cpp(::)cpp" << enumType.type
+<< R"cpp(>::serialize()cpp" << _schemaNamespace << R"cpp(::)cpp" << enumType.type
+<< R"cpp(&& value, const ResolverParams&)
 {
 	static const std::string s_names[] = {
 )cpp";
@@ -1663,13 +1959,11 @@ std::future<response::Value> ModifiedResult<)cpp" << _schemaNamespace << R"cpp(:
 			sourceFile << R"cpp(
 	};
 
-	std::promise<response::Value> promise;
 	response::Value result(response::Type::EnumValue);
 
-	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value.get())]));
-	promise.set_value(std::move(result));
+	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value)]));
 
-	return promise.get_future();
+	return result;
 }
 )cpp";
 		}
@@ -1693,7 +1987,7 @@ template <>
 					if (firstField)
 					{
 						firstField = false;
-						sourceFile << R"cpp(	const auto defaultValue = []()
+						sourceFile << R"cpp(	static const auto defaultValue = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -1817,9 +2111,57 @@ namespace object {
 				std::string fieldName(outputField.name);
 
 				fieldName[0] = std::toupper(fieldName[0]);
-				sourceFile << R"cpp(		{ ")cpp" << outputField.name
-					<< R"cpp(", [this](service::ResolverParams&& params) { return resolve)cpp" << fieldName
-					<< R"cpp((std::move(params)); } })cpp";
+
+				// Only scalar and enum values are cached, the values of complex types depend on the selection set.
+				const bool cacheField = (outputField.cacheControl
+					&& outputField.cacheControl->maxAge > 0
+					&& (outputField.fieldType == OutputFieldType::Builtin
+						|| outputField.fieldType == OutputFieldType::Scalar
+						|| outputField.fieldType == OutputFieldType::Enum));
+
+				if (cacheField)
+				{
+					sourceFile << R"cpp(		{ ")cpp" << outputField.name
+						<< R"cpp(", [this](service::ResolverParams&& params) { return cacheField(")cpp" << outputField.name
+						<< R"cpp(", std::chrono::seconds()cpp" << outputField.cacheControl->maxAge
+						<< R"cpp(), service::CacheScope::)cpp" << (outputField.cacheControl->privateScope ? "Private" : "Public")
+						<< R"cpp(, std::move(params), [this](service::ResolverParams&& params) { return )cpp";
+				}
+				else
+				{
+					sourceFile << R"cpp(		{ ")cpp" << outputField.name
+						<< R"cpp(", [this](service::ResolverParams&& params) { return )cpp";
+				}
+
+				std::ostringstream resolveField;
+
+				if (outputField.batch)
+				{
+					resolveField << R"cpp(batchField(")cpp" << outputField.name
+						<< R"cpp(", std::move(params), [](std::vector<service::BatchedField>&& fields) { return resolve)cpp" << fieldName
+						<< R"cpp((std::move(fields)); }))cpp";
+				}
+				else
+				{
+					resolveField << R"cpp(resolve)cpp" << fieldName
+						<< R"cpp((std::move(params)))cpp";
+				}
+
+				if (outputField.pure)
+				{
+					sourceFile << R"cpp(memoize(")cpp" << outputField.name
+						<< R"cpp(", std::move(params), [this](service::ResolverParams&& params) { return )cpp" << resolveField.str()
+						<< R"cpp(; }); })cpp";
+				}
+				else
+				{
+					sourceFile << resolveField.str()
+						<< R"cpp(; })cpp";
+				}
+
+				sourceFile << (cacheField
+					? R"cpp(); } })cpp"
+					: R"cpp( })cpp");
 			}
 
 			if (!firstField)
@@ -1839,7 +2181,7 @@ namespace object {
 			}
 
 			sourceFile << R"cpp(
-	}))cpp";
+	}, ")cpp" << objectType.type << R"cpp("))cpp";
 
 			if (objectType.type == queryType)
 			{
@@ -1871,12 +2213,28 @@ namespace object {
 				std::string fieldName(outputField.name);
 
 				fieldName[0] = std::toupper(fieldName[0]);
-				sourceFile << R"cpp(
+
+				if (outputField.batch)
+				{
+					// Batch resolvers take the arguments and directives from the first field, they're
+					// the same for every field in the batch.
+					sourceFile << R"cpp(
+std::vector<std::future<response::Value>> )cpp" << objectType.type
+<< R"cpp(::resolve)cpp" << fieldName
+<< R"cpp((std::vector<service::BatchedField>&& fields)
+{
+	auto& params = fields.front().params;
+)cpp";
+				}
+				else
+				{
+					sourceFile << R"cpp(
 std::future<response::Value> )cpp" << objectType.type
 << R"cpp(::resolve)cpp" << fieldName
 << R"cpp((service::ResolverParams&& params)
 {
 )cpp";
+				}
 
 				// Output a preamble to retrieve all of the arguments from the resolver parameters.
 				if (!outputField.arguments.empty())
@@ -1890,7 +2248,7 @@ std::future<response::Value> )cpp" << objectType.type
 							if (firstArgument)
 							{
 								firstArgument = false;
-								sourceFile << R"cpp(	const auto defaultArguments = []()
+								sourceFile << R"cpp(	static const auto defaultArguments = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -1920,7 +2278,23 @@ std::future<response::Value> )cpp" << objectType.type
 					}
 				}
 
-				sourceFile << R"cpp(	auto result = get)cpp" << fieldName << R"cpp((service::FieldParams(params, std::move(params.fieldDirectives)))cpp";
+				if (outputField.batch)
+				{
+					sourceFile << R"cpp(	std::vector<const )cpp" << objectType.type << R"cpp(*> parents;
+
+	parents.reserve(fields.size());
+
+	for (const auto& field : fields)
+	{
+		parents.push_back(static_cast<const )cpp" << objectType.type << R"cpp(*>(field.object.get()));
+	}
+
+	auto result = parents.front()->get)cpp" << fieldName << R"cpp((service::FieldParams(params, std::move(params.fieldDirectives)), parents)cpp";
+				}
+				else
+				{
+					sourceFile << R"cpp(	auto result = get)cpp" << fieldName << R"cpp((service::FieldParams(params, std::move(params.fieldDirectives)))cpp";
+				}
 
 				if (!outputField.arguments.empty())
 				{
@@ -1935,11 +2309,24 @@ std::future<response::Value> )cpp" << objectType.type
 
 				sourceFile << R"cpp();
 
-	return )cpp" << getResultAccessType(outputField)
-					<< R"cpp(::convert)cpp" << getTypeModifiers(outputField.modifiers)
-					<< R"cpp((std::move(result), std::move(params));
+	return )cpp" << getResultAccessType(outputField);
+
+				if (outputField.batch)
+				{
+					sourceFile << R"cpp(::convertBatch)cpp" << getTypeModifiers(outputField.modifiers)
+						<< R"cpp((std::move(result), std::move(fields));
+}
+)cpp";
+				}
+				else
+				{
+					sourceFile << (outputField.lazy
+						? R"cpp(::convertLazy)cpp"
+						: R"cpp(::convert)cpp") << getTypeModifiers(outputField.modifiers)
+						<< R"cpp((std::move(result), std::move(params));
 }
 )cpp";
+				}
 			}
 
 			sourceFile << R"cpp(
@@ -2026,7 +2413,49 @@ Operations::Operations()cpp";
 		}
 
 		sourceFile << R"cpp(
-	})
+	})cpp";
+
+		// Pass the weights from any @cost(weight: Int) directives to the Request for cost analysis.
+		bool firstCost = true;
+		const auto outputCosts = [&sourceFile, &firstCost](const std::string& type, const OutputFieldList& fields)
+		{
+			for (const auto& outputField : fields)
+			{
+				if (!outputField.cost)
+				{
+					continue;
+				}
+
+				sourceFile << (firstCost
+					? R"cpp(, {
+)cpp"
+					: R"cpp(,
+)cpp");
+
+				firstCost = false;
+				sourceFile << R"cpp(		{ ")cpp" << type << R"cpp(.)cpp" << outputField.name
+					<< R"cpp(", )cpp" << *outputField.cost
+					<< R"cpp( })cpp";
+			}
+		};
+
+		for (const auto& interfaceType : _interfaceTypes)
+		{
+			outputCosts(interfaceType.type, interfaceType.fields);
+		}
+
+		for (const auto& objectType : _objectTypes)
+		{
+			outputCosts(objectType.type, objectType.fields);
+		}
+
+		if (!firstCost)
+		{
+			sourceFile << R"cpp(
+	})cpp";
+		}
+
+		sourceFile << R"cpp()
 )cpp";
 
 		for (const auto& operation : _operationTypes)
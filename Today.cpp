@@ -32,6 +32,26 @@ Folder::Folder(std::vector<uint8_t>&& id, std::string&& name, int unreadCount)
 {
 }
 
+std::vector<response::IntType> Folder::getUnreadCount(service::FieldParams&& params, const std::vector<const object::Folder*>& parents) const
+{
+	if (params.state)
+	{
+		auto todayState = std::static_pointer_cast<RequestState>(params.state);
+
+		todayState->unreadCountBatchesCount++;
+	}
+
+	std::vector<response::IntType> result(parents.size());
+
+	std::transform(parents.cbegin(), parents.cend(), result.begin(),
+		[](const object::Folder* parent)
+	{
+		return static_cast<const Folder*>(parent)->_unreadCount;
+	});
+
+	return result;
+}
+
 Query::Query(appointmentsLoader&& getAppointments, tasksLoader&& getTasks, unreadCountsLoader&& getUnreadCounts)
 	: _getAppointments(std::move(getAppointments))
 	, _getTasks(std::move(getTasks))
@@ -62,7 +82,7 @@ std::shared_ptr<Appointment> Query::findAppointment(const service::FieldParams&
 
 	for (const auto& appointment : _appointments)
 	{
-		auto appointmentId = appointment->getId(service::FieldParams(params, response::Value(response::Type::Map))).get();
+		auto appointmentId = appointment->getId(service::FieldParams(params, response::Value(response::Type::Map)));
 
 		if (appointmentId == id)
 		{
@@ -96,7 +116,7 @@ std::shared_ptr<Task> Query::findTask(const service::FieldParams& params, const
 
 	for (const auto& task : _tasks)
 	{
-		auto taskId = task->getId(service::FieldParams(params, response::Value(response::Type::Map))).get();
+		auto taskId = task->getId(service::FieldParams(params, response::Value(response::Type::Map)));
 
 		if (taskId == id)
 		{
@@ -130,7 +150,7 @@ std::shared_ptr<Folder> Query::findUnreadCount(const service::FieldParams& param
 
 	for (const auto& folder : _unreadCounts)
 	{
-		auto folderId = folder->getId(service::FieldParams(params, response::Value(response::Type::Map))).get();
+		auto folderId = folder->getId(service::FieldParams(params, response::Value(response::Type::Map)));
 
 		if (folderId == id)
 		{
@@ -141,34 +161,101 @@ std::shared_ptr<Folder> Query::findUnreadCount(const service::FieldParams& param
 	return nullptr;
 }
 
-std::future<std::shared_ptr<service::Object>> Query::getNode(service::FieldParams&& params, std::vector<uint8_t>&& id) const
+std::shared_ptr<RequestState::NodeLoader> Query::getNodeLoader(const std::shared_ptr<service::RequestState>& state) const
+{
+	if (!state)
+	{
+		return nullptr;
+	}
+
+	auto todayState = std::static_pointer_cast<RequestState>(state);
+	std::lock_guard<std::mutex> lock(todayState->nodeLoaderMutex);
+
+	if (!todayState->nodeLoader)
+	{
+		auto spThis = std::static_pointer_cast<const Query>(shared_from_this());
+
+		// The RequestState owns the loader, so don't hold a strong reference to it in the batch function.
+		std::weak_ptr<service::RequestState> weakState(state);
+
+		todayState->nodeLoader = std::make_shared<RequestState::NodeLoader>(
+			[spThis, weakState](const std::vector<std::vector<uint8_t>>& ids)
+		{
+			auto batchState = weakState.lock();
+			const response::Value unusedDirectives;
+			const service::SelectionSetParams selectionSetParams {
+				batchState,
+				unusedDirectives,
+				unusedDirectives,
+				unusedDirectives,
+				unusedDirectives,
+				nullptr,
+				nullptr,
+				nullptr,
+				false,
+				nullptr
+			};
+			const service::FieldParams params(selectionSetParams, response::Value(response::Type::Map));
+			std::vector<std::shared_ptr<service::Object>> result(ids.size());
+
+			if (batchState)
+			{
+				std::static_pointer_cast<RequestState>(batchState)->loadNodesCount++;
+			}
+
+			std::transform(ids.cbegin(), ids.cend(), result.begin(),
+				[&spThis, &params](const std::vector<uint8_t>& id)
+			{
+				return spThis->findNode(params, id);
+			});
+
+			return result;
+		});
+		state->addBatchDispatcher(todayState->nodeLoader);
+	}
+
+	return todayState->nodeLoader;
+}
+
+std::shared_ptr<service::Object> Query::findNode(const service::FieldParams& params, const std::vector<uint8_t>& id) const
 {
-	std::promise<std::shared_ptr<service::Object>> promise;
 	auto appointment = findAppointment(params, id);
 
 	if (appointment)
 	{
-		promise.set_value(appointment);
-		return promise.get_future();
+		return appointment;
 	}
 
 	auto task = findTask(params, id);
 
 	if (task)
 	{
-		promise.set_value(task);
-		return promise.get_future();
+		return task;
 	}
 
 	auto folder = findUnreadCount(params, id);
 
 	if (folder)
 	{
-		promise.set_value(folder);
-		return promise.get_future();
+		return folder;
 	}
 
-	promise.set_value(nullptr);
+	return nullptr;
+}
+
+std::future<std::shared_ptr<service::Object>> Query::getNode(service::FieldParams&& params, std::vector<uint8_t>&& id) const
+{
+	auto loader = getNodeLoader(params.state);
+
+	if (loader)
+	{
+		return loader->load(id);
+	}
+
+	std::promise<std::shared_ptr<service::Object>> promise;
+
+	promise.set_value(findNode(params, id));
+
 	return promise.get_future();
 }
 
@@ -196,6 +283,11 @@ struct EdgeConstraints
 			unusedDirectives,
 			unusedDirectives,
 			unusedDirectives,
+			nullptr,
+			nullptr,
+			nullptr,
+			false,
+			nullptr
 		};
 
 		if (after)
@@ -205,7 +297,7 @@ struct EdgeConstraints
 			auto itrAfter = std::find_if(itrFirst, itrLast,
 				[this, &selectionSetParams, &afterId](const std::shared_ptr<_Object>& entry)
 			{
-				return entry->getId(service::FieldParams(selectionSetParams, {})).get() == afterId;
+				return entry->getId(service::FieldParams(selectionSetParams, {})) == afterId;
 			});
 
 			if (itrAfter != itrLast)
@@ -221,7 +313,7 @@ struct EdgeConstraints
 			auto itrBefore = std::find_if(itrFirst, itrLast,
 				[this, &selectionSetParams, &beforeId](const std::shared_ptr<_Object>& entry)
 			{
-				return entry->getId(service::FieldParams(selectionSetParams, {})).get() == beforeId;
+				return entry->getId(service::FieldParams(selectionSetParams, {})) == beforeId;
 			});
 
 			if (itrBefore != itrLast)
@@ -279,7 +371,9 @@ std::future<std::shared_ptr<object::AppointmentConnection>> Query::getAppointmen
 {
 	auto spThis = shared_from_this();
 	auto state = params.state;
-	return std::async(std::launch::async,
+	auto executor = state ? state->executor : nullptr;
+
+	return service::launch(executor,
 		[this, spThis, state](std::unique_ptr<int>&& firstWrapped, std::unique_ptr<response::Value>&& afterWrapped, std::unique_ptr<int>&& lastWrapped, std::unique_ptr<response::Value>&& beforeWrapped)
 	{
 		loadAppointments(state);
@@ -295,7 +389,9 @@ std::future<std::shared_ptr<object::TaskConnection>> Query::getTasks(service::Fi
 {
 	auto spThis = shared_from_this();
 	auto state = params.state;
-	return std::async(std::launch::async,
+	auto executor = state ? state->executor : nullptr;
+
+	return service::launch(executor,
 		[this, spThis, state](std::unique_ptr<int>&& firstWrapped, std::unique_ptr<response::Value>&& afterWrapped, std::unique_ptr<int>&& lastWrapped, std::unique_ptr<response::Value>&& beforeWrapped)
 	{
 		loadTasks(state);
@@ -311,7 +407,9 @@ std::future<std::shared_ptr<object::FolderConnection>> Query::getUnreadCounts(se
 {
 	auto spThis = shared_from_this();
 	auto state = params.state;
-	return std::async(std::launch::async,
+	auto executor = state ? state->executor : nullptr;
+
+	return service::launch(executor,
 		[this, spThis, state](std::unique_ptr<int>&& firstWrapped, std::unique_ptr<response::Value>&& afterWrapped, std::unique_ptr<int>&& lastWrapped, std::unique_ptr<response::Value>&& beforeWrapped)
 	{
 		loadUnreadCounts(state);
@@ -338,17 +436,45 @@ std::future<std::vector<std::shared_ptr<object::Appointment>>> Query::getAppoint
 	return promise.get_future();
 }
 
-std::future<std::vector<std::shared_ptr<object::Task>>> Query::getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const
+std::future<service::LazyList<std::shared_ptr<object::Task>>> Query::getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const
 {
-	std::promise<std::vector<std::shared_ptr<object::Task>>> promise;
-	std::vector<std::shared_ptr<object::Task>> result(ids.size());
+	std::promise<service::LazyList<std::shared_ptr<object::Task>>> promise;
 
-	std::transform(ids.cbegin(), ids.cend(), result.begin(),
-		[this, &params](const std::vector<uint8_t>& id)
+	loadTasks(params.state);
+
+	// The tasks are already loaded, so look each of them up without the RequestState while the list is
+	// converted. The FieldParams are gone by then.
+	auto spThis = std::static_pointer_cast<const Query>(shared_from_this());
+	auto lookupIds = std::make_shared<const std::vector<std::vector<uint8_t>>>(std::move(ids));
+	size_t index = 0;
+
+	promise.set_value(service::LazyList<std::shared_ptr<object::Task>>(
+		[spThis, lookupIds, index](std::shared_ptr<object::Task>& entry) mutable
 	{
-		return std::static_pointer_cast<object::Task>(findTask(params, id));
-	});
-	promise.set_value(std::move(result));
+		if (index >= lookupIds->size())
+		{
+			return false;
+		}
+
+		const std::shared_ptr<service::RequestState> lookupState;
+		const response::Value unusedDirectives;
+		const service::SelectionSetParams selectionSetParams {
+			lookupState,
+			unusedDirectives,
+			unusedDirectives,
+			unusedDirectives,
+			unusedDirectives,
+			nullptr,
+			nullptr,
+			nullptr,
+			false,
+			nullptr
+		};
+
+		entry = std::static_pointer_cast<object::Task>(spThis->findTask(service::FieldParams(selectionSetParams, response::Value(response::Type::Map)), (*lookupIds)[index++]));
+
+		return true;
+	}));
 
 	return promise.get_future();
 }
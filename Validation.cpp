@@ -0,0 +1,2074 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "GraphQLGrammar.h"
+#include "Validation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+static bool isNonNullType(const std::string& type)
+{
+	return !type.empty() && type.back() == '!';
+}
+
+static std::string getNullableType(const std::string& type)
+{
+	return isNonNullType(type)
+		? type.substr(0, type.size() - 1)
+		: type;
+}
+
+static bool isListType(const std::string& type)
+{
+	return !type.empty() && type.front() == '[';
+}
+
+static std::string getListItemType(const std::string& type)
+{
+	const auto nullableType = getNullableType(type);
+
+	return nullableType.substr(1, nullableType.size() - 2);
+}
+
+static std::string getNamedType(const std::string& type)
+{
+	std::string namedType;
+
+	std::copy_if(type.cbegin(), type.cend(), std::back_inserter(namedType),
+		[](char ch) noexcept
+	{
+		return ch != '[' && ch != ']' && ch != '!';
+	});
+
+	return namedType;
+}
+
+// https://facebook.github.io/graphql/June2018/#AreTypesCompatible()
+static bool areTypesCompatible(const std::string& variableType, const std::string& locationType)
+{
+	if (isNonNullType(locationType))
+	{
+		return isNonNullType(variableType)
+			&& areTypesCompatible(getNullableType(variableType), getNullableType(locationType));
+	}
+	else if (isNonNullType(variableType))
+	{
+		return areTypesCompatible(getNullableType(variableType), locationType);
+	}
+	else if (isListType(locationType))
+	{
+		return isListType(variableType)
+			&& areTypesCompatible(getListItemType(variableType), getListItemType(locationType));
+	}
+	else if (isListType(variableType))
+	{
+		return false;
+	}
+
+	return variableType == locationType;
+}
+
+// Convert the type in a variable definition to the same notation we use for the schema types.
+static std::string getVariableType(const peg::ast_node& type)
+{
+	if (type.is<peg::nonnull_type>())
+	{
+		return getVariableType(*type.children.front()) + "!";
+	}
+	else if (type.is<peg::list_type>())
+	{
+		return "[" + getVariableType(*type.children.front()) + "]";
+	}
+
+	return type.content();
+}
+
+// Print a value in the AST with the members of input objects in a stable order, so arguments which
+// only differ in formatting compare equal.
+static std::string getValueKey(const peg::ast_node& value)
+{
+	if (value.is<peg::list_value>())
+	{
+		std::string key("[");
+
+		for (const auto& child : value.children)
+		{
+			key += getValueKey(*child);
+			key += ',';
+		}
+
+		return key + "]";
+	}
+	else if (value.is<peg::object_value>())
+	{
+		std::map<std::string, std::string> fields;
+		std::string key("{");
+
+		for (const auto& field : value.children)
+		{
+			fields[field->children.front()->content()] = getValueKey(*field->children.back());
+		}
+
+		for (const auto& entry : fields)
+		{
+			key += entry.first + ':' + entry.second + ',';
+		}
+
+		return key + "}";
+	}
+
+	return value.content();
+}
+
+static std::string getArgumentsKey(const peg::ast_node& field)
+{
+	std::map<std::string, std::string> arguments;
+	std::string key;
+
+	peg::on_first_child<peg::arguments>(field,
+		[&arguments](const peg::ast_node& child)
+		{
+			for (const auto& argument : child.children)
+			{
+				arguments[argument->children.front()->content()] = getValueKey(*argument->children.back());
+			}
+		});
+
+	for (const auto& entry : arguments)
+	{
+		key += entry.first + ':' + entry.second + ',';
+	}
+
+	return key;
+}
+
+// Convert a __Type from the introspection query to the same notation as the schema. The TypeRef
+// fragment only nests so many levels of ofType, e.g. [[ID!]!]! needs 5 of them.
+static std::string getTypeRef(const response::Value& typeRef)
+{
+	const auto& kind = typeRef["kind"].get<const response::StringType&>();
+
+	if (kind == "NON_NULL" || kind == "LIST")
+	{
+		const auto itrOfType = typeRef.find("ofType");
+
+		if (itrOfType == typeRef.end()
+			|| itrOfType->second.type() != response::Type::Map)
+		{
+			throw schema_exception({ "Type modifiers are nested too deeply for the TypeRef fragment" });
+		}
+
+		return (kind == "NON_NULL")
+			? getTypeRef(itrOfType->second) + "!"
+			: "[" + getTypeRef(itrOfType->second) + "]";
+	}
+
+	return typeRef["name"].get<const response::StringType&>();
+}
+
+// Convert a constant value in the AST, which can't reference any variables.
+static response::Value getLiteralValue(const peg::ast_node& value)
+{
+	if (value.is<peg::integer_value>())
+	{
+		return response::Value(std::atoi(value.content().c_str()));
+	}
+	else if (value.is<peg::float_value>())
+	{
+		return response::Value(std::atof(value.content().c_str()));
+	}
+	else if (value.is<peg::string_value>())
+	{
+		return response::Value(std::string(value.unescaped));
+	}
+	else if (value.is<peg::true_keyword>()
+		|| value.is<peg::false_keyword>())
+	{
+		return response::Value(value.is<peg::true_keyword>());
+	}
+	else if (value.is<peg::enum_value>())
+	{
+		response::Value result(response::Type::EnumValue);
+
+		result.set<response::StringType>(value.content());
+
+		return result;
+	}
+	else if (value.is<peg::list_value>())
+	{
+		response::Value result(response::Type::List);
+
+		result.reserve(value.children.size());
+
+		for (const auto& child : value.children)
+		{
+			result.emplace_back(getLiteralValue(*child));
+		}
+
+		return result;
+	}
+	else if (value.is<peg::object_value>())
+	{
+		response::Value result(response::Type::Map);
+
+		result.reserve(value.children.size());
+
+		for (const auto& field : value.children)
+		{
+			result.emplace_back(field->children.front()->content(), getLiteralValue(*field->children.back()));
+		}
+
+		return result;
+	}
+
+	return response::Value();
+}
+
+// The introspection results print the default values as GraphQL literals, so parse them the same way
+// as the default value of a variable.
+static response::Value parseDefaultValue(const std::string& defaultValue)
+{
+	const auto ast = peg::parseString("query($value: Boolean = " + defaultValue + ") { __typename }");
+	const peg::ast_node* value = nullptr;
+
+	peg::on_first_child<peg::operation_definition>(*ast.root,
+		[&value](const peg::ast_node& operationDefinition)
+		{
+			peg::on_first_child<peg::variable>(operationDefinition,
+				[&value](const peg::ast_node& variable)
+				{
+					peg::on_first_child<peg::default_value>(variable,
+						[&value](const peg::ast_node& child)
+						{
+							value = child.children.front().get();
+						});
+				});
+		});
+
+	if (value == nullptr)
+	{
+		throw schema_exception({ "Invalid default value: " + defaultValue });
+	}
+
+	return getLiteralValue(*value);
+}
+
+static ValidateArguments getArguments(const response::Value& inputValues)
+{
+	ValidateArguments arguments;
+
+	if (inputValues.type() == response::Type::List)
+	{
+		for (const auto& inputValue : inputValues.get<const response::ListType&>())
+		{
+			ValidateArgument argument;
+
+			const auto& defaultValue = inputValue["defaultValue"];
+
+			argument.type = getTypeRef(inputValue["type"]);
+			argument.defaultValue = defaultValue.type() != response::Type::Null;
+
+			if (argument.defaultValue)
+			{
+				argument.parsedDefault = parseDefaultValue(defaultValue.get<const response::StringType&>());
+			}
+			arguments[inputValue["name"].get<const response::StringType&>()] = std::move(argument);
+		}
+	}
+
+	return arguments;
+}
+
+static std::set<std::string> getNames(const response::Value& namedValues)
+{
+	std::set<std::string> names;
+
+	if (namedValues.type() == response::Type::List)
+	{
+		for (const auto& namedValue : namedValues.get<const response::ListType&>())
+		{
+			names.insert(namedValue["name"].get<const response::StringType&>());
+		}
+	}
+
+	return names;
+}
+
+ValidationSchema::ValidationSchema(const response::Value& introspection)
+{
+	const std::pair<const char*, const char*> operationTypes[] = {
+		{ "query", "queryType" },
+		{ "mutation", "mutationType" },
+		{ "subscription", "subscriptionType" }
+	};
+
+	for (const auto& operationType : operationTypes)
+	{
+		const auto& rootType = introspection[operationType.second];
+
+		if (rootType.type() == response::Type::Map)
+		{
+			_operationTypes[operationType.first] = rootType["name"].get<const response::StringType&>();
+		}
+	}
+
+	// Interfaces don't list their possibleTypes, so we fill them in from the object types.
+	std::map<std::string, std::set<std::string>> implementations;
+
+	for (const auto& entry : introspection["types"].get<const response::ListType&>())
+	{
+		const auto& name = entry["name"].get<const response::StringType&>();
+		ValidateType type;
+
+		type.kind = entry["kind"].get<const response::StringType&>();
+
+		const auto& fields = entry["fields"];
+
+		if (fields.type() == response::Type::List)
+		{
+			for (const auto& field : fields.get<const response::ListType&>())
+			{
+				ValidateField validateField;
+
+				validateField.type = getTypeRef(field["type"]);
+				validateField.arguments = getArguments(field["args"]);
+				type.fields[field["name"].get<const response::StringType&>()] = std::move(validateField);
+			}
+		}
+
+		type.inputFields = getArguments(entry["inputFields"]);
+		type.enumValues = getNames(entry["enumValues"]);
+		type.possibleTypes = getNames(entry["possibleTypes"]);
+
+		if (type.kind == "OBJECT")
+		{
+			type.possibleTypes.insert(name);
+
+			for (const auto& interfaceName : getNames(entry["interfaces"]))
+			{
+				implementations[interfaceName].insert(name);
+			}
+		}
+
+		_types[name] = std::move(type);
+	}
+
+	for (const auto& entry : implementations)
+	{
+		auto itr = _types.find(entry.first);
+
+		if (itr != _types.end())
+		{
+			itr->second.possibleTypes.insert(entry.second.cbegin(), entry.second.cend());
+		}
+	}
+
+	for (const auto& entry : introspection["directives"].get<const response::ListType&>())
+	{
+		ValidateDirective directive;
+
+		for (const auto& location : entry["locations"].get<const response::ListType&>())
+		{
+			directive.locations.insert(location.get<const response::StringType&>());
+		}
+
+		directive.arguments = getArguments(entry["args"]);
+		_directives[entry["name"].get<const response::StringType&>()] = std::move(directive);
+	}
+
+	// The @skip and @include directives are built into the service.
+	for (const auto name : { "skip", "include" })
+	{
+		if (_directives.find(name) == _directives.end())
+		{
+			ValidateDirective directive;
+			ValidateArgument argument;
+
+			directive.locations = { "FIELD", "FRAGMENT_SPREAD", "INLINE_FRAGMENT" };
+			argument.type = "Boolean!";
+			directive.arguments["if"] = std::move(argument);
+			_directives[name] = std::move(directive);
+		}
+	}
+
+	// So are @defer and @stream, which only change anything in Request::resolveIncremental.
+	if (_directives.find("defer") == _directives.end())
+	{
+		ValidateDirective directive;
+		ValidateArgument ifArgument;
+		ValidateArgument labelArgument;
+
+		directive.locations = { "FRAGMENT_SPREAD", "INLINE_FRAGMENT" };
+		ifArgument.type = "Boolean";
+		ifArgument.defaultValue = true;
+		labelArgument.type = "String";
+		directive.arguments["if"] = std::move(ifArgument);
+		directive.arguments["label"] = std::move(labelArgument);
+		_directives["defer"] = std::move(directive);
+	}
+
+	if (_directives.find("stream") == _directives.end())
+	{
+		ValidateDirective directive;
+		ValidateArgument ifArgument;
+		ValidateArgument labelArgument;
+		ValidateArgument initialCountArgument;
+
+		directive.locations = { "FIELD" };
+		ifArgument.type = "Boolean";
+		ifArgument.defaultValue = true;
+		labelArgument.type = "String";
+		initialCountArgument.type = "Int";
+		initialCountArgument.defaultValue = true;
+		directive.arguments["if"] = std::move(ifArgument);
+		directive.arguments["label"] = std::move(labelArgument);
+		directive.arguments["initialCount"] = std::move(initialCountArgument);
+		_directives["stream"] = std::move(directive);
+	}
+}
+
+const peg::ast_node& ValidationSchema::getIntrospectionQuery()
+{
+	static const auto s_introspectionQuery = R"(query IntrospectionQuery {
+			__schema {
+				queryType { name }
+				mutationType { name }
+				subscriptionType { name }
+				types {
+					kind
+					name
+					fields(includeDeprecated: true) {
+						name
+						args { ...InputValue }
+						type { ...TypeRef }
+					}
+					inputFields { ...InputValue }
+					interfaces { name }
+					enumValues(includeDeprecated: true) { name }
+					possibleTypes { name }
+				}
+				directives {
+					name
+					locations
+					args { ...InputValue }
+				}
+			}
+		}
+
+		fragment InputValue on __InputValue {
+			name
+			type { ...TypeRef }
+			defaultValue
+		}
+
+		fragment TypeRef on __Type {
+			kind
+			name
+			ofType {
+				kind
+				name
+				ofType {
+					kind
+					name
+					ofType {
+						kind
+						name
+						ofType {
+							kind
+							name
+							ofType {
+								kind
+								name
+								ofType {
+									kind
+									name
+									ofType {
+										kind
+										name
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		})"_graphql;
+
+	return *s_introspectionQuery.root;
+}
+
+const ValidateType* ValidationSchema::getType(const std::string& name) const
+{
+	const auto itr = _types.find(name);
+
+	return (itr == _types.cend())
+		? nullptr
+		: &itr->second;
+}
+
+const ValidateField* ValidationSchema::getField(const std::string& typeName, const ValidateType& type, const std::string& name) const
+{
+	static const ValidateField s_typenameField = []()
+	{
+		ValidateField typenameField;
+
+		typenameField.type = "String!";
+
+		return typenameField;
+	}();
+	static const ValidateField s_schemaField = []()
+	{
+		ValidateField schemaField;
+
+		schemaField.type = "__Schema!";
+
+		return schemaField;
+	}();
+	static const ValidateField s_typeField = []()
+	{
+		ValidateField typeField;
+		ValidateArgument nameArgument;
+
+		nameArgument.type = "String!";
+		typeField.type = "__Type";
+		typeField.arguments["name"] = std::move(nameArgument);
+
+		return typeField;
+	}();
+
+	// The introspection fields are implicit, so they aren't in the list of fields for the type.
+	if (name == "__typename")
+	{
+		return &s_typenameField;
+	}
+	else if (typeName == getOperationType("query"))
+	{
+		if (name == "__schema")
+		{
+			return &s_schemaField;
+		}
+		else if (name == "__type")
+		{
+			return &s_typeField;
+		}
+	}
+
+	const auto itr = type.fields.find(name);
+
+	return (itr == type.fields.cend())
+		? nullptr
+		: &itr->second;
+}
+
+const ValidateDirective* ValidationSchema::getDirective(const std::string& name) const
+{
+	const auto itr = _directives.find(name);
+
+	return (itr == _directives.cend())
+		? nullptr
+		: &itr->second;
+}
+
+const std::string& ValidationSchema::getOperationType(const std::string& operation) const
+{
+	static const std::string s_unsupported;
+	const auto itr = _operationTypes.find(operation);
+
+	return (itr == _operationTypes.cend())
+		? s_unsupported
+		: itr->second;
+}
+
+static response::Value coerceValue(const ValidationSchema* schema, const std::string& type, response::Value&& value)
+{
+	if (isNonNullType(type))
+	{
+		if (value.type() == response::Type::Null)
+		{
+			throw schema_exception({ "missing non-null value" });
+		}
+
+		return coerceValue(schema, getNullableType(type), std::move(value));
+	}
+
+	if (value.type() == response::Type::Null)
+	{
+		return std::move(value);
+	}
+
+	if (isListType(type))
+	{
+		const auto elementType = getListItemType(type);
+		response::Value result(response::Type::List);
+
+		if (value.type() != response::Type::List)
+		{
+			// A single value is coerced to a list with one entry.
+			result.emplace_back(coerceValue(schema, elementType, std::move(value)));
+			return result;
+		}
+
+		auto elements = value.release<response::ListType>();
+
+		result.reserve(elements.size());
+
+		for (auto& element : elements)
+		{
+			result.emplace_back(coerceValue(schema, elementType, std::move(element)));
+		}
+
+		return result;
+	}
+
+	if (type == "Int")
+	{
+		if (value.type() != response::Type::Int)
+		{
+			throw schema_exception({ "not an integer" });
+		}
+	}
+	else if (type == "Float")
+	{
+		if (value.type() == response::Type::Int)
+		{
+			return response::Value(static_cast<response::FloatType>(value.get<response::IntType>()));
+		}
+		else if (value.type() != response::Type::Float)
+		{
+			throw schema_exception({ "not a float" });
+		}
+	}
+	else if (type == "String"
+		|| type == "ID")
+	{
+		if (value.type() != response::Type::String)
+		{
+			throw schema_exception({ "not a string" });
+		}
+	}
+	else if (type == "Boolean")
+	{
+		if (value.type() != response::Type::Boolean)
+		{
+			throw schema_exception({ "not a boolean" });
+		}
+	}
+	else if (schema != nullptr)
+	{
+		const auto namedType = schema->getType(type);
+
+		if (namedType == nullptr)
+		{
+			return std::move(value);
+		}
+
+		if (namedType->kind == "ENUM")
+		{
+			// JSON doesn't have enum values, so the variables have strings instead.
+			if (value.type() != response::Type::EnumValue
+				&& value.type() != response::Type::String)
+			{
+				throw schema_exception({ "not an enum value" });
+			}
+
+			auto enumValue = value.release<response::StringType>();
+
+			if (namedType->enumValues.find(enumValue) == namedType->enumValues.cend())
+			{
+				throw schema_exception({ "not a valid " + type + " value: " + enumValue });
+			}
+
+			response::Value result(response::Type::EnumValue);
+
+			result.set<response::StringType>(std::move(enumValue));
+
+			return result;
+		}
+		else if (namedType->kind == "INPUT_OBJECT")
+		{
+			if (value.type() != response::Type::Map)
+			{
+				throw schema_exception({ "not an input object" });
+			}
+
+			for (const auto& entry : value)
+			{
+				if (namedType->inputFields.find(entry.first) == namedType->inputFields.cend())
+				{
+					throw schema_exception({ "unknown field: " + entry.first + " on input object: " + type });
+				}
+			}
+
+			response::Value result(response::Type::Map);
+
+			for (const auto& inputField : namedType->inputFields)
+			{
+				const auto itrField = value.find(inputField.first);
+
+				if (itrField != value.end())
+				{
+					try
+					{
+						result.emplace_back(std::string(inputField.first), coerceValue(schema, inputField.second.type, response::Value(itrField->second)));
+					}
+					catch (const schema_exception& ex)
+					{
+						throw schema_exception({ "field: " + inputField.first + " " + ex.getErrors()[0]["message"].get<const response::StringType&>() });
+					}
+				}
+				else if (inputField.second.defaultValue)
+				{
+					result.emplace_back(std::string(inputField.first), response::Value(inputField.second.parsedDefault));
+				}
+				else if (isNonNullType(inputField.second.type))
+				{
+					throw schema_exception({ "missing non-null field: " + inputField.first + " on input object: " + type });
+				}
+			}
+
+			return result;
+		}
+	}
+
+	return std::move(value);
+}
+
+response::Value coerceVariableValue(const ValidationSchema* schema, const peg::ast_node& type, response::Value&& value)
+{
+	return coerceValue(schema, getVariableType(type), std::move(value));
+}
+
+// How deeply a definition is nested on its own, and the deepest level where it spreads each fragment.
+struct DefinitionDepth
+{
+	size_t depth;
+	std::map<std::string, size_t> spreads;
+};
+
+static DefinitionDepth measureDefinition(const peg::ast_node& definition)
+{
+	DefinitionDepth result { 0, {} };
+	std::vector<std::pair<const peg::ast_node*, size_t>> nodes { { &definition, 1 } };
+
+	while (!nodes.empty())
+	{
+		const auto node = nodes.back().first;
+		const auto depth = nodes.back().second;
+
+		nodes.pop_back();
+		result.depth = std::max(result.depth, depth);
+
+		if (node->is<peg::fragment_spread>())
+		{
+			auto& spread = result.spreads[node->children.front()->content()];
+
+			spread = std::max(spread, depth);
+		}
+
+		for (const auto& child : node->children)
+		{
+			nodes.push_back({ child.get(), depth + 1 });
+		}
+	}
+
+	return result;
+}
+
+size_t getDocumentDepth(const peg::ast_node& root)
+{
+	std::map<std::string, DefinitionDepth> fragments;
+	std::vector<DefinitionDepth> operations;
+
+	for (const auto& child : root.children)
+	{
+		if (child->is<peg::fragment_definition>())
+		{
+			fragments.insert({ child->children.front()->content(), measureDefinition(*child) });
+		}
+		else
+		{
+			operations.push_back(measureDefinition(*child));
+		}
+	}
+
+	// Add the depth of each fragment to the level where it's spread, working through the fragments
+	// it spreads first. Fragments which spread themselves are reported by validation, so a cycle
+	// just stops adding to the depth.
+	using FragmentItr = std::map<std::string, DefinitionDepth>::const_iterator;
+	using SpreadItr = std::map<std::string, size_t>::const_iterator;
+
+	std::map<std::string, size_t> fragmentDepths;
+	std::set<std::string> visiting;
+	size_t documentDepth = 0;
+
+	const auto addSpreads = [&fragmentDepths](const DefinitionDepth& definition)
+	{
+		auto depth = definition.depth;
+
+		for (const auto& spread : definition.spreads)
+		{
+			auto itr = fragmentDepths.find(spread.first);
+
+			if (itr != fragmentDepths.end())
+			{
+				depth = std::max(depth, spread.second + itr->second);
+			}
+		}
+
+		return depth;
+	};
+
+	for (auto itrFragment = fragments.cbegin(); itrFragment != fragments.cend(); ++itrFragment)
+	{
+		if (fragmentDepths.count(itrFragment->first) != 0)
+		{
+			continue;
+		}
+
+		std::vector<std::pair<FragmentItr, SpreadItr>> stack { { itrFragment, itrFragment->second.spreads.cbegin() } };
+
+		visiting.insert(itrFragment->first);
+
+		while (!stack.empty())
+		{
+			auto& top = stack.back();
+
+			if (top.second != top.first->second.spreads.cend())
+			{
+				const auto& name = (top.second++)->first;
+				auto itrSpread = fragments.find(name);
+
+				if (itrSpread != fragments.cend()
+					&& fragmentDepths.count(name) == 0
+					&& visiting.insert(name).second)
+				{
+					stack.push_back({ itrSpread, itrSpread->second.spreads.cbegin() });
+				}
+
+				continue;
+			}
+
+			const auto& name = top.first->first;
+
+			fragmentDepths[name] = addSpreads(top.first->second);
+			documentDepth = std::max(documentDepth, fragmentDepths[name]);
+			visiting.erase(name);
+			stack.pop_back();
+		}
+	}
+
+	for (const auto& operation : operations)
+	{
+		documentDepth = std::max(documentDepth, addSpreads(operation));
+	}
+
+	// Count the document itself too.
+	return documentDepth + 1;
+}
+
+ValidateExecutableVisitor::ValidateExecutableVisitor(const ValidationSchema& schema)
+	: _schema(schema)
+{
+}
+
+std::vector<std::string> ValidateExecutableVisitor::getErrors()
+{
+	auto errors = std::move(_errors);
+
+	return errors;
+}
+
+void ValidateExecutableVisitor::addError(std::string&& message, const peg::ast_node& node)
+{
+	auto position = node.begin();
+	std::ostringstream error;
+
+	error << message
+		<< " line: " << position.line
+		<< " column: " << position.byte_in_line;
+
+	_errors.push_back(error.str());
+}
+
+void ValidateExecutableVisitor::visit(const peg::ast_node& root)
+{
+	// Find all of the fragment definitions before visiting anything else, spreads can refer to
+	// fragments which are defined later in the document.
+	for (const auto& child : root.children)
+	{
+		if (child->is<peg::fragment_definition>())
+		{
+			const auto name = child->children.front()->content();
+
+			if (!_fragmentDefinitions.insert({ name, child.get() }).second)
+			{
+				addError("Duplicate fragment name: " + name, *child);
+			}
+		}
+		else if (!child->is<peg::operation_definition>())
+		{
+			// https://facebook.github.io/graphql/June2018/#sec-Executable-Definitions
+			addError("Unexpected type definition", *child);
+		}
+	}
+
+	for (const auto& entry : _fragmentDefinitions)
+	{
+		visitFragmentDefinition(entry.first, *entry.second);
+	}
+
+	// https://facebook.github.io/graphql/June2018/#sec-Fragment-spreads-must-not-form-cycles
+	for (const auto& entry : _fragmentDefinitions)
+	{
+		std::set<std::string> fragmentSpreads;
+
+		collectFragmentSpreads(entry.first, fragmentSpreads);
+
+		if (fragmentSpreads.find(entry.first) != fragmentSpreads.end())
+		{
+			addError("Cyclic fragment spread name: " + entry.first, *entry.second);
+			_fragmentCycles = true;
+		}
+	}
+
+	std::set<std::string> operationNames;
+	size_t operationCount = 0;
+	const peg::ast_node* anonymousOperation = nullptr;
+	std::set<std::string> usedFragments;
+
+	for (const auto& child : root.children)
+	{
+		if (!child->is<peg::operation_definition>())
+		{
+			continue;
+		}
+
+		++operationCount;
+
+		std::string name;
+
+		peg::on_first_child<peg::operation_name>(*child,
+			[&name](const peg::ast_node& operationName)
+			{
+				name = operationName.content();
+			});
+
+		if (name.empty())
+		{
+			anonymousOperation = child.get();
+		}
+		else if (!operationNames.insert(name).second)
+		{
+			// https://facebook.github.io/graphql/June2018/#sec-Operation-Name-Uniqueness
+			addError("Duplicate operation name: " + name, *child);
+		}
+
+		DefinitionUsage usage;
+
+		_usage = &usage;
+		visitOperationDefinition(*child);
+		_usage = nullptr;
+
+		for (const auto& fragmentSpread : usage.fragmentSpreads)
+		{
+			usedFragments.insert(fragmentSpread);
+			collectFragmentSpreads(fragmentSpread, usedFragments);
+		}
+	}
+
+	if (anonymousOperation && operationCount > 1)
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Lone-Anonymous-Operation
+		addError("Anonymous operation not alone", *anonymousOperation);
+	}
+
+	// https://facebook.github.io/graphql/June2018/#sec-Fragments-Must-Be-Used
+	for (const auto& entry : _fragmentDefinitions)
+	{
+		if (usedFragments.find(entry.first) == usedFragments.end())
+		{
+			addError("Unused fragment definition name: " + entry.first, *entry.second);
+		}
+	}
+}
+
+void ValidateExecutableVisitor::collectFragmentSpreads(const std::string& name, std::set<std::string>& fragmentSpreads) const
+{
+	const auto itr = _fragmentUsages.find(name);
+
+	if (itr == _fragmentUsages.cend())
+	{
+		return;
+	}
+
+	for (const auto& fragmentSpread : itr->second.fragmentSpreads)
+	{
+		if (fragmentSpreads.insert(fragmentSpread).second)
+		{
+			collectFragmentSpreads(fragmentSpread, fragmentSpreads);
+		}
+	}
+}
+
+const ValidateType* ValidateExecutableVisitor::getCompositeType(const std::string& typeName, const peg::ast_node& node)
+{
+	const auto type = _schema.getType(typeName);
+
+	if (!type)
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Fragment-Spread-Type-Existence
+		addError("Unknown target type name: " + typeName, node);
+		return nullptr;
+	}
+
+	if (type->kind != "OBJECT"
+		&& type->kind != "INTERFACE"
+		&& type->kind != "UNION")
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Fragments-On-Composite-Types
+		addError("Fragment target type is not composite name: " + typeName, node);
+		return nullptr;
+	}
+
+	return type;
+}
+
+bool ValidateExecutableVisitor::isPossibleSpread(const std::string& typeName, const std::string& fragmentTypeName) const
+{
+	const auto type = _schema.getType(typeName);
+	const auto fragmentType = _schema.getType(fragmentTypeName);
+
+	if (!type || !fragmentType)
+	{
+		// We already reported an error for the missing type.
+		return true;
+	}
+
+	return std::any_of(type->possibleTypes.cbegin(), type->possibleTypes.cend(),
+		[fragmentType](const std::string& possibleType)
+	{
+		return fragmentType->possibleTypes.find(possibleType) != fragmentType->possibleTypes.end();
+	});
+}
+
+void ValidateExecutableVisitor::visitFragmentDefinition(const std::string& name, const peg::ast_node& fragmentDefinition)
+{
+	auto& usage = _fragmentUsages[name];
+	const auto& typeCondition = *fragmentDefinition.children[1]->children.front();
+	const auto typeName = typeCondition.content();
+
+	_usage = &usage;
+	visitDirectives("FRAGMENT_DEFINITION", fragmentDefinition);
+
+	if (getCompositeType(typeName, typeCondition))
+	{
+		visitSelectionSet(typeName, *fragmentDefinition.children.back());
+	}
+
+	_usage = nullptr;
+}
+
+void ValidateExecutableVisitor::visitOperationDefinition(const peg::ast_node& operationDefinition)
+{
+	std::string operation;
+
+	peg::on_first_child<peg::operation_type>(operationDefinition,
+		[&operation](const peg::ast_node& child)
+		{
+			operation = child.content();
+		});
+
+	if (operation.empty())
+	{
+		operation = "query";
+	}
+
+	const auto& typeName = _schema.getOperationType(operation);
+
+	if (typeName.empty())
+	{
+		addError("Unknown operation type: " + operation, operationDefinition);
+		return;
+	}
+
+	// https://facebook.github.io/graphql/June2018/#sec-All-Variables-Used
+	std::map<std::string, std::pair<std::string, bool>> variableDefinitions;
+	std::set<std::string> unusedVariables;
+
+	peg::for_each_child<peg::variable>(operationDefinition,
+		[this, &variableDefinitions, &unusedVariables](const peg::ast_node& variable)
+		{
+			std::string variableName;
+			std::string variableType;
+			const peg::ast_node* defaultValue = nullptr;
+
+			for (const auto& child : variable.children)
+			{
+				if (child->is<peg::variable_name>())
+				{
+					// Skip the $ prefix
+					variableName = child->content().c_str() + 1;
+				}
+				else if (child->is<peg::named_type>()
+					|| child->is<peg::list_type>()
+					|| child->is<peg::nonnull_type>())
+				{
+					variableType = getVariableType(*child);
+				}
+				else if (child->is<peg::default_value>())
+				{
+					defaultValue = child.get();
+				}
+			}
+
+			// https://facebook.github.io/graphql/June2018/#sec-Variables-Are-Input-Types
+			const auto type = _schema.getType(getNamedType(variableType));
+
+			if (!type
+				|| (type->kind != "SCALAR"
+					&& type->kind != "ENUM"
+					&& type->kind != "INPUT_OBJECT"))
+			{
+				addError("Invalid variable type: " + variableType + " name: " + variableName, variable);
+			}
+			else if (defaultValue)
+			{
+				// Variables aren't allowed in default values, so this shouldn't record any usages.
+				DefinitionUsage defaultUsage;
+				auto usage = _usage;
+
+				_usage = &defaultUsage;
+				visitInputValue(variableName, variableType, false, *defaultValue->children.front());
+				_usage = usage;
+
+				for (const auto& variableUsage : defaultUsage.variables)
+				{
+					addError("Variable in default value name: " + variableUsage.name, *variableUsage.variable);
+				}
+			}
+
+			const bool nonNullDefault = defaultValue
+				&& !defaultValue->children.front()->is<peg::null_keyword>();
+
+			if (!variableDefinitions.insert({ variableName, { std::move(variableType), nonNullDefault } }).second)
+			{
+				// https://facebook.github.io/graphql/June2018/#sec-Variable-Uniqueness
+				addError("Duplicate variable name: " + variableName, variable);
+			}
+			else
+			{
+				unusedVariables.insert(variableName);
+			}
+		});
+
+	visitDirectives(operation == "query"
+		? "QUERY"
+		: (operation == "mutation"
+			? "MUTATION"
+			: "SUBSCRIPTION"), operationDefinition);
+
+	const auto& selectionSet = *operationDefinition.children.back();
+
+	visitSelectionSet(typeName, selectionSet);
+
+	// Merging the fields would expand the fragment spreads forever if there's a cycle, and we've
+	// already reported that.
+	if (!_fragmentCycles)
+	{
+		visitFieldsToMerge({ { typeName, &selectionSet } });
+	}
+
+	if (operation == "subscription")
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Single-root-field
+		std::set<std::string> responseKeys;
+		std::set<std::string> visitedFragments;
+
+		collectRootFields(selectionSet, responseKeys, visitedFragments);
+
+		if (responseKeys.size() > 1)
+		{
+			addError("Subscription with more than one root field", operationDefinition);
+		}
+	}
+
+	// Gather the variables used in this operation and every fragment it references.
+	std::vector<const VariableUsage*> variableUsages;
+	std::set<std::string> fragmentSpreads;
+
+	for (const auto& variableUsage : _usage->variables)
+	{
+		variableUsages.push_back(&variableUsage);
+	}
+
+	for (const auto& fragmentSpread : _usage->fragmentSpreads)
+	{
+		fragmentSpreads.insert(fragmentSpread);
+		collectFragmentSpreads(fragmentSpread, fragmentSpreads);
+	}
+
+	for (const auto& fragmentSpread : fragmentSpreads)
+	{
+		const auto itr = _fragmentUsages.find(fragmentSpread);
+
+		if (itr != _fragmentUsages.cend())
+		{
+			for (const auto& variableUsage : itr->second.variables)
+			{
+				variableUsages.push_back(&variableUsage);
+			}
+		}
+	}
+
+	for (const auto variableUsage : variableUsages)
+	{
+		const auto itr = variableDefinitions.find(variableUsage->name);
+
+		if (itr == variableDefinitions.cend())
+		{
+			// https://facebook.github.io/graphql/June2018/#sec-All-Variable-Uses-Defined
+			addError("Undefined variable name: " + variableUsage->name, *variableUsage->variable);
+			continue;
+		}
+
+		unusedVariables.erase(variableUsage->name);
+
+		// https://facebook.github.io/graphql/June2018/#sec-All-Variable-Usages-are-Allowed
+		const auto& variableType = itr->second.first;
+		auto locationType = variableUsage->type;
+
+		if (isNonNullType(locationType) && !isNonNullType(variableType))
+		{
+			if (!itr->second.second && !variableUsage->defaultValue)
+			{
+				addError("Nullable variable used in non-null location name: " + variableUsage->name, *variableUsage->variable);
+				continue;
+			}
+
+			locationType = getNullableType(locationType);
+		}
+
+		if (!areTypesCompatible(variableType, locationType))
+		{
+			addError("Incompatible variable type: " + variableType + " name: " + variableUsage->name, *variableUsage->variable);
+		}
+	}
+
+	for (const auto& name : unusedVariables)
+	{
+		addError("Unused variable name: " + name, operationDefinition);
+	}
+}
+
+void ValidateExecutableVisitor::collectRootFields(const peg::ast_node& selectionSet, std::set<std::string>& responseKeys, std::set<std::string>& visitedFragments) const
+{
+	for (const auto& selection : selectionSet.children)
+	{
+		if (selection->is<peg::field>())
+		{
+			std::string responseKey;
+
+			peg::on_first_child<peg::alias_name>(*selection,
+				[&responseKey](const peg::ast_node& child)
+				{
+					responseKey = child.content();
+				});
+
+			if (responseKey.empty())
+			{
+				peg::on_first_child<peg::field_name>(*selection,
+					[&responseKey](const peg::ast_node& child)
+					{
+						responseKey = child.content();
+					});
+			}
+
+			responseKeys.insert(std::move(responseKey));
+		}
+		else if (selection->is<peg::fragment_spread>())
+		{
+			const auto name = selection->children.front()->content();
+			const auto itr = _fragmentDefinitions.find(name);
+
+			if (itr != _fragmentDefinitions.cend()
+				&& visitedFragments.insert(name).second)
+			{
+				collectRootFields(*itr->second->children.back(), responseKeys, visitedFragments);
+			}
+		}
+		else if (selection->is<peg::inline_fragment>())
+		{
+			collectRootFields(*selection->children.back(), responseKeys, visitedFragments);
+		}
+	}
+}
+
+void ValidateExecutableVisitor::collectFieldsToMerge(const std::string& typeName, const peg::ast_node& selectionSet, std::map<std::string, std::vector<FieldToMerge>>& fields, std::set<std::string>& visitedFragments) const
+{
+	const auto type = _schema.getType(typeName);
+
+	for (const auto& selection : selectionSet.children)
+	{
+		if (selection->is<peg::field>())
+		{
+			FieldToMerge field;
+			std::string responseKey;
+
+			field.parentType = typeName;
+			field.arguments = getArgumentsKey(*selection);
+			field.field = selection.get();
+			field.selectionSet = nullptr;
+
+			for (const auto& child : selection->children)
+			{
+				if (child->is<peg::alias_name>())
+				{
+					responseKey = child->content();
+				}
+				else if (child->is<peg::field_name>())
+				{
+					field.name = child->content();
+				}
+				else if (child->is<peg::selection_set>())
+				{
+					field.selectionSet = child.get();
+				}
+			}
+
+			if (responseKey.empty())
+			{
+				responseKey = field.name;
+			}
+
+			const auto definition = type
+				? _schema.getField(typeName, *type, field.name)
+				: nullptr;
+
+			if (definition)
+			{
+				field.fieldType = getNamedType(definition->type);
+			}
+
+			fields[responseKey].push_back(std::move(field));
+		}
+		else if (selection->is<peg::fragment_spread>())
+		{
+			const auto name = selection->children.front()->content();
+			const auto itr = _fragmentDefinitions.find(name);
+
+			// Spreading the same fragment again doesn't add any fields.
+			if (itr != _fragmentDefinitions.cend()
+				&& visitedFragments.insert(name).second)
+			{
+				collectFieldsToMerge(itr->second->children[1]->children.front()->content(), *itr->second->children.back(), fields, visitedFragments);
+			}
+		}
+		else if (selection->is<peg::inline_fragment>())
+		{
+			std::string fragmentTypeName = typeName;
+
+			peg::on_first_child<peg::type_condition>(*selection,
+				[&fragmentTypeName](const peg::ast_node& child)
+				{
+					fragmentTypeName = child.children.front()->content();
+				});
+
+			collectFieldsToMerge(fragmentTypeName, *selection->children.back(), fields, visitedFragments);
+		}
+	}
+}
+
+// https://facebook.github.io/graphql/June2018/#sec-Field-Selection-Merging
+void ValidateExecutableVisitor::visitFieldsToMerge(SelectionSetsToMerge&& selectionSets)
+{
+	// The same fragment may be spread in many places, but we only need to check it once for each
+	// combination of selection sets it's merged with.
+	std::sort(selectionSets.begin(), selectionSets.end());
+
+	if (!_mergedSelectionSets.insert(selectionSets).second)
+	{
+		return;
+	}
+
+	std::map<std::string, std::vector<FieldToMerge>> fields;
+	std::set<std::string> visitedFragments;
+
+	for (const auto& entry : selectionSets)
+	{
+		collectFieldsToMerge(entry.first, *entry.second, fields, visitedFragments);
+	}
+
+	const auto isObjectType = [this](const std::string& typeName)
+	{
+		const auto type = _schema.getType(typeName);
+
+		return type && type->kind == "OBJECT";
+	};
+
+	for (const auto& entry : fields)
+	{
+		const auto& responseKey = entry.first;
+		const auto& fieldsToMerge = entry.second;
+		const FieldToMerge* conflict = nullptr;
+
+		// Fields on different object types are never selected for the same object, but if either
+		// of them is on an interface or union they might be.
+		for (auto itr = fieldsToMerge.cbegin() + 1; !conflict && itr < fieldsToMerge.cend(); ++itr)
+		{
+			for (auto itrPrevious = fieldsToMerge.cbegin(); itrPrevious != itr; ++itrPrevious)
+			{
+				if ((itr->parentType == itrPrevious->parentType
+						|| !isObjectType(itr->parentType)
+						|| !isObjectType(itrPrevious->parentType))
+					&& (itr->name != itrPrevious->name
+						|| itr->arguments != itrPrevious->arguments))
+				{
+					conflict = &*itr;
+					break;
+				}
+			}
+		}
+
+		if (conflict)
+		{
+			addError("Conflicting fields for response key: " + responseKey, *conflict->field);
+			continue;
+		}
+
+		SelectionSetsToMerge subSelectionSets;
+
+		for (const auto& field : fieldsToMerge)
+		{
+			if (field.selectionSet && !field.fieldType.empty())
+			{
+				subSelectionSets.push_back({ field.fieldType, field.selectionSet });
+			}
+		}
+
+		if (!subSelectionSets.empty())
+		{
+			visitFieldsToMerge(std::move(subSelectionSets));
+		}
+	}
+}
+
+void ValidateExecutableVisitor::visitSelectionSet(const std::string& typeName, const peg::ast_node& selectionSet)
+{
+	const auto type = _schema.getType(typeName);
+
+	if (!type)
+	{
+		return;
+	}
+
+	for (const auto& selection : selectionSet.children)
+	{
+		if (selection->is<peg::field>())
+		{
+			visitField(typeName, *type, *selection);
+		}
+		else if (selection->is<peg::fragment_spread>())
+		{
+			visitFragmentSpread(typeName, *selection);
+		}
+		else if (selection->is<peg::inline_fragment>())
+		{
+			visitInlineFragment(typeName, *selection);
+		}
+	}
+}
+
+void ValidateExecutableVisitor::visitField(const std::string& typeName, const ValidateType& type, const peg::ast_node& field)
+{
+	std::string name;
+
+	peg::on_first_child<peg::field_name>(field,
+		[&name](const peg::ast_node& child)
+		{
+			name = child.content();
+		});
+
+	const auto definition = _schema.getField(typeName, type, name);
+
+	if (!definition)
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Field-Selections-on-Objects-Interfaces-and-Unions-Types
+		addError("Unknown field type: " + typeName + " name: " + name, field);
+		return;
+	}
+
+	visitArguments("field: " + name, definition->arguments, field);
+	visitDirectives("FIELD", field);
+
+	// https://facebook.github.io/graphql/June2018/#sec-Leaf-Field-Selections
+	const auto fieldTypeName = getNamedType(definition->type);
+	const auto fieldType = _schema.getType(fieldTypeName);
+	const peg::ast_node* selectionSet = nullptr;
+
+	peg::on_first_child<peg::selection_set>(field,
+		[&selectionSet](const peg::ast_node& child)
+		{
+			selectionSet = &child;
+		});
+
+	if (!fieldType)
+	{
+		return;
+	}
+
+	const bool leafType = (fieldType->kind == "SCALAR" || fieldType->kind == "ENUM");
+
+	if (leafType && selectionSet)
+	{
+		addError("Field on scalar type: " + fieldTypeName + " name: " + name, field);
+	}
+	else if (!leafType && !selectionSet)
+	{
+		addError("Missing fields on non-scalar type: " + fieldTypeName + " name: " + name, field);
+	}
+	else if (selectionSet)
+	{
+		visitSelectionSet(fieldTypeName, *selectionSet);
+	}
+}
+
+void ValidateExecutableVisitor::visitFragmentSpread(const std::string& typeName, const peg::ast_node& fragmentSpread)
+{
+	const auto name = fragmentSpread.children.front()->content();
+	const auto itr = _fragmentDefinitions.find(name);
+
+	visitDirectives("FRAGMENT_SPREAD", fragmentSpread);
+
+	if (itr == _fragmentDefinitions.cend())
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Fragment-spread-target-defined
+		addError("Undefined fragment spread name: " + name, fragmentSpread);
+		return;
+	}
+
+	_usage->fragmentSpreads.insert(name);
+
+	const auto fragmentTypeName = itr->second->children[1]->children.front()->content();
+
+	if (!isPossibleSpread(typeName, fragmentTypeName))
+	{
+		// https://facebook.github.io/graphql/June2018/#sec-Fragment-spread-is-possible
+		addError("Incompatible fragment spread name: " + name + " type: " + typeName, fragmentSpread);
+	}
+}
+
+void ValidateExecutableVisitor::visitInlineFragment(const std::string& typeName, const peg::ast_node& inlineFragment)
+{
+	std::string fragmentTypeName = typeName;
+	const peg::ast_node* typeCondition = nullptr;
+
+	peg::on_first_child<peg::type_condition>(inlineFragment,
+		[&fragmentTypeName, &typeCondition](const peg::ast_node& child)
+		{
+			typeCondition = child.children.front().get();
+			fragmentTypeName = typeCondition->content();
+		});
+
+	visitDirectives("INLINE_FRAGMENT", inlineFragment);
+
+	if (typeCondition)
+	{
+		if (!getCompositeType(fragmentTypeName, *typeCondition))
+		{
+			return;
+		}
+
+		if (!isPossibleSpread(typeName, fragmentTypeName))
+		{
+			// https://facebook.github.io/graphql/June2018/#sec-Fragment-spread-is-possible
+			addError("Incompatible target type on inline fragment name: " + fragmentTypeName + " type: " + typeName, inlineFragment);
+			return;
+		}
+	}
+
+	visitSelectionSet(fragmentTypeName, *inlineFragment.children.back());
+}
+
+void ValidateExecutableVisitor::visitDirectives(const std::string& location, const peg::ast_node& parent)
+{
+	std::set<std::string> directiveNames;
+
+	peg::on_first_child<peg::directives>(parent,
+		[this, &location, &directiveNames](const peg::ast_node& directives)
+		{
+			for (const auto& directive : directives.children)
+			{
+				const auto name = directive->children.front()->content();
+				const auto definition = _schema.getDirective(name);
+
+				if (!definition)
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Directives-Are-Defined
+					addError("Unknown directive name: " + name, *directive);
+					continue;
+				}
+
+				if (definition->locations.find(location) == definition->locations.end())
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Directives-Are-In-Valid-Locations
+					addError("Unexpected location for directive name: " + name + " location: " + location, *directive);
+				}
+
+				if (!directiveNames.insert(name).second)
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Directives-Are-Unique-Per-Location
+					addError("Conflicting directive name: " + name, *directive);
+				}
+
+				visitArguments("directive: " + name, definition->arguments, *directive);
+			}
+		});
+}
+
+void ValidateExecutableVisitor::visitArguments(const std::string& owner, const ValidateArguments& definitions, const peg::ast_node& parent)
+{
+	std::set<std::string> argumentNames;
+
+	peg::on_first_child<peg::arguments>(parent,
+		[this, &owner, &definitions, &argumentNames](const peg::ast_node& arguments)
+		{
+			for (const auto& argument : arguments.children)
+			{
+				const auto name = argument->children.front()->content();
+				const auto itr = definitions.find(name);
+
+				if (itr == definitions.cend())
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Argument-Names
+					addError("Unknown argument name: " + name + " " + owner, *argument);
+					continue;
+				}
+
+				if (!argumentNames.insert(name).second)
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Argument-Uniqueness
+					addError("Conflicting argument name: " + name + " " + owner, *argument);
+					continue;
+				}
+
+				visitInputValue(name, itr->second.type, itr->second.defaultValue, *argument->children.back());
+			}
+		});
+
+	// https://facebook.github.io/graphql/June2018/#sec-Required-Arguments
+	for (const auto& entry : definitions)
+	{
+		if (isNonNullType(entry.second.type)
+			&& !entry.second.defaultValue
+			&& argumentNames.find(entry.first) == argumentNames.end())
+		{
+			addError("Missing argument name: " + entry.first + " " + owner, parent);
+		}
+	}
+}
+
+// https://facebook.github.io/graphql/June2018/#sec-Values-of-Correct-Type
+void ValidateExecutableVisitor::visitInputValue(const std::string& name, const std::string& type, bool defaultValue, const peg::ast_node& value)
+{
+	if (value.is<peg::variable_value>())
+	{
+		// Variable usages are checked against the variable definitions once we've visited all of
+		// the fragments referenced by the operation.
+		_usage->variables.push_back({ value.content().c_str() + 1, type, defaultValue, &value });
+		return;
+	}
+
+	if (value.is<peg::null_keyword>())
+	{
+		if (isNonNullType(type))
+		{
+			addError("Expected non-null value name: " + name + " type: " + type, value);
+		}
+
+		return;
+	}
+
+	if (isListType(type))
+	{
+		const auto itemType = getListItemType(type);
+
+		if (value.is<peg::list_value>())
+		{
+			for (const auto& item : value.children)
+			{
+				visitInputValue(name, itemType, false, *item);
+			}
+		}
+		else
+		{
+			// A single value is coerced to a list with one entry.
+			visitInputValue(name, itemType, false, value);
+		}
+
+		return;
+	}
+
+	const auto typeName = getNullableType(type);
+	const auto inputType = _schema.getType(typeName);
+
+	if (!inputType)
+	{
+		return;
+	}
+
+	bool valid = true;
+
+	if (inputType->kind == "SCALAR")
+	{
+		if (typeName == "Int")
+		{
+			valid = value.is<peg::integer_value>();
+		}
+		else if (typeName == "Float")
+		{
+			valid = value.is<peg::integer_value>() || value.is<peg::float_value>();
+		}
+		else if (typeName == "String")
+		{
+			valid = value.is<peg::string_value>();
+		}
+		else if (typeName == "Boolean")
+		{
+			valid = value.is<peg::true_keyword>() || value.is<peg::false_keyword>();
+		}
+		else if (typeName == "ID")
+		{
+			valid = value.is<peg::string_value>() || value.is<peg::integer_value>();
+		}
+	}
+	else if (inputType->kind == "ENUM")
+	{
+		valid = value.is<peg::enum_value>()
+			&& inputType->enumValues.find(value.content()) != inputType->enumValues.end();
+	}
+	else if (inputType->kind == "INPUT_OBJECT")
+	{
+		valid = value.is<peg::object_value>();
+
+		if (valid)
+		{
+			std::set<std::string> fieldNames;
+
+			for (const auto& field : value.children)
+			{
+				const auto fieldName = field->children.front()->content();
+				const auto itr = inputType->inputFields.find(fieldName);
+
+				if (itr == inputType->inputFields.cend())
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Input-Object-Field-Names
+					addError("Unknown input field name: " + fieldName + " type: " + typeName, *field);
+					continue;
+				}
+
+				if (!fieldNames.insert(fieldName).second)
+				{
+					// https://facebook.github.io/graphql/June2018/#sec-Input-Object-Field-Uniqueness
+					addError("Conflicting input field name: " + fieldName + " type: " + typeName, *field);
+					continue;
+				}
+
+				visitInputValue(fieldName, itr->second.type, itr->second.defaultValue, *field->children.back());
+			}
+
+			// https://facebook.github.io/graphql/June2018/#sec-Input-Object-Required-Fields
+			for (const auto& entry : inputType->inputFields)
+			{
+				if (isNonNullType(entry.second.type)
+					&& !entry.second.defaultValue
+					&& fieldNames.find(entry.first) == fieldNames.end())
+				{
+					addError("Missing input field name: " + entry.first + " type: " + typeName, value);
+				}
+			}
+		}
+	}
+	else
+	{
+		valid = false;
+	}
+
+	if (!valid)
+	{
+		addError("Incompatible value name: " + name + " type: " + type, value);
+	}
+}
+
+// Costs saturate instead of overflowing, so a huge first argument can't wrap around to a small cost.
+static size_t addCost(size_t lhs, size_t rhs)
+{
+	return (rhs > std::numeric_limits<size_t>::max() - lhs)
+		? std::numeric_limits<size_t>::max()
+		: lhs + rhs;
+}
+
+static size_t multiplyCost(size_t lhs, size_t rhs)
+{
+	return (lhs != 0 && rhs > std::numeric_limits<size_t>::max() / lhs)
+		? std::numeric_limits<size_t>::max()
+		: lhs * rhs;
+}
+
+CostAnalysisVisitor::CostAnalysisVisitor(const ValidationSchema& schema, const FieldCosts& fieldCosts, const response::Value& variables, size_t defaultListSize)
+	: _schema(schema)
+	, _fieldCosts(fieldCosts)
+	, _variables(variables)
+	, _defaultListSize(defaultListSize)
+{
+}
+
+QueryCost CostAnalysisVisitor::getCost()
+{
+	auto cost = _cost;
+
+	_cost = QueryCost();
+
+	return cost;
+}
+
+void CostAnalysisVisitor::visit(const peg::ast_node& root, const std::string& operationName)
+{
+	const peg::ast_node* operationDefinition = nullptr;
+
+	for (const auto& child : root.children)
+	{
+		if (child->is<peg::fragment_definition>())
+		{
+			_fragmentDefinitions[child->children.front()->content()] = child.get();
+		}
+		else if (child->is<peg::operation_definition>())
+		{
+			std::string name;
+
+			peg::on_first_child<peg::operation_name>(*child,
+				[&name](const peg::ast_node& operationName)
+				{
+					name = operationName.content();
+				});
+
+			if (operationName.empty() || name == operationName)
+			{
+				operationDefinition = child.get();
+			}
+		}
+	}
+
+	if (!operationDefinition)
+	{
+		return;
+	}
+
+	std::string operation;
+
+	peg::on_first_child<peg::operation_type>(*operationDefinition,
+		[&operation](const peg::ast_node& child)
+		{
+			operation = child.content();
+		});
+
+	if (operation.empty())
+	{
+		operation = "query";
+	}
+
+	const auto& typeName = _schema.getOperationType(operation);
+
+	if (!typeName.empty())
+	{
+		visitSelectionSet(typeName, *operationDefinition->children.back(), 1, 0, 1);
+	}
+}
+
+// Fragments don't add any depth, and the estimate includes every fragment whether or not its type
+// condition matches, so abstract types are charged for the most expensive possibility.
+void CostAnalysisVisitor::visitSelectionSet(const std::string& typeName, const peg::ast_node& selectionSet, size_t multiplier, size_t connectionSize, size_t depth)
+{
+	const auto type = _schema.getType(typeName);
+
+	if (!type)
+	{
+		return;
+	}
+
+	for (const auto& selection : selectionSet.children)
+	{
+		if (selection->is<peg::field>())
+		{
+			visitField(typeName, *type, *selection, multiplier, connectionSize, depth);
+		}
+		else if (selection->is<peg::fragment_spread>())
+		{
+			const auto name = selection->children.front()->content();
+			const auto key = std::make_pair(name, connectionSize);
+			auto itrCost = _fragmentCosts.find(key);
+
+			if (itrCost == _fragmentCosts.cend())
+			{
+				const auto itr = _fragmentDefinitions.find(name);
+
+				if (itr == _fragmentDefinitions.cend()
+					|| !_fragmentPath.insert(name).second)
+				{
+					continue;
+				}
+
+				// A fragment which is spread in more than one place would be visited again every
+				// time, which grows exponentially if fragments spread other fragments more than
+				// once. Visit it once on its own and scale the result for each spread.
+				const auto& fragmentDefinition = *itr->second;
+				const auto cost = _cost;
+
+				_cost = QueryCost();
+				visitSelectionSet(fragmentDefinition.children[1]->children.front()->content(),
+					*fragmentDefinition.children.back(), 1, connectionSize, 0);
+				_fragmentPath.erase(name);
+
+				itrCost = _fragmentCosts.insert({ key, _cost }).first;
+				_cost = cost;
+			}
+
+			_cost.depth = std::max(_cost.depth, depth + itrCost->second.depth);
+			_cost.complexity = addCost(_cost.complexity, multiplyCost(multiplier, itrCost->second.complexity));
+		}
+		else if (selection->is<peg::inline_fragment>())
+		{
+			std::string fragmentTypeName = typeName;
+
+			peg::on_first_child<peg::type_condition>(*selection,
+				[&fragmentTypeName](const peg::ast_node& child)
+				{
+					fragmentTypeName = child.children.front()->content();
+				});
+
+			visitSelectionSet(fragmentTypeName, *selection->children.back(), multiplier, connectionSize, depth);
+		}
+	}
+}
+
+void CostAnalysisVisitor::visitField(const std::string& typeName, const ValidateType& type, const peg::ast_node& field, size_t multiplier, size_t connectionSize, size_t depth)
+{
+	std::string name;
+
+	peg::on_first_child<peg::field_name>(field,
+		[&name](const peg::ast_node& child)
+		{
+			name = child.content();
+		});
+
+	const auto definition = _schema.getField(typeName, type, name);
+
+	if (!definition)
+	{
+		return;
+	}
+
+	const auto fieldTypeName = getNamedType(definition->type);
+	const auto fieldType = _schema.getType(fieldTypeName);
+	const bool leafType = !fieldType
+		|| fieldType->kind == "SCALAR"
+		|| fieldType->kind == "ENUM";
+	const auto itrCost = _fieldCosts.find(typeName + "." + name);
+	const size_t weight = (itrCost == _fieldCosts.cend())
+		? (leafType ? 0 : 1)
+		: itrCost->second;
+
+	_cost.depth = std::max(_cost.depth, depth);
+	_cost.complexity = addCost(_cost.complexity, multiplyCost(multiplier, weight));
+
+	if (leafType)
+	{
+		return;
+	}
+
+	const peg::ast_node* selectionSet = nullptr;
+
+	peg::on_first_child<peg::selection_set>(field,
+		[&selectionSet](const peg::ast_node& child)
+		{
+			selectionSet = &child;
+		});
+
+	if (!selectionSet)
+	{
+		return;
+	}
+
+	// Relay connections take the first or last argument on the connection field, but the list
+	// is in the edges field right below it.
+	const size_t listSize = getListSize(field);
+
+	if (isListType(definition->type))
+	{
+		const size_t count = (listSize != 0)
+			? listSize
+			: ((connectionSize != 0)
+				? connectionSize
+				: _defaultListSize);
+
+		visitSelectionSet(fieldTypeName, *selectionSet, multiplyCost(multiplier, count), 0, depth + 1);
+	}
+	else
+	{
+		visitSelectionSet(fieldTypeName, *selectionSet, multiplier, listSize, depth + 1);
+	}
+}
+
+size_t CostAnalysisVisitor::getListSize(const peg::ast_node& field) const
+{
+	size_t listSize = 0;
+
+	peg::on_first_child<peg::arguments>(field,
+		[this, &listSize](const peg::ast_node& arguments)
+		{
+			for (const auto& argument : arguments.children)
+			{
+				const auto name = argument->children.front()->content();
+
+				if (name != "first" && name != "last")
+				{
+					continue;
+				}
+
+				const auto& value = *argument->children.back();
+				response::IntType count = 0;
+
+				if (value.is<peg::integer_value>())
+				{
+					count = std::atoi(value.content().c_str());
+				}
+				else if (value.is<peg::variable_value>()
+					&& _variables.type() == response::Type::Map)
+				{
+					const auto itr = _variables.find(value.content().c_str() + 1);
+
+					if (itr != _variables.end()
+						&& itr->second.type() == response::Type::Int)
+					{
+						count = itr->second.get<response::IntType>();
+					}
+				}
+
+				if (count > 0)
+				{
+					listSize = std::max(listSize, static_cast<size_t>(count));
+				}
+			}
+		});
+
+	return listSize;
+}
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -146,6 +146,14 @@ enum class OutputFieldType
 	Object,
 };
 
+// The @cacheControl(maxAge: Int, scope: PUBLIC | PRIVATE) hint on a field, or on the object type which
+// declares it, see service::FieldCache.
+struct CacheControlHint
+{
+	size_t maxAge;
+	bool privateScope;
+};
+
 struct OutputField
 {
 	std::string type;
@@ -155,6 +163,30 @@ struct OutputField
 	TypeModifierStack modifiers;
 	std::string description;
 	std::unique_ptr<std::string> deprecationReason;
+
+	// Fields marked @synchronous (directly or on the type which declares them) have accessors which
+	// return the value itself instead of a std::future.
+	bool synchronous = false;
+
+	// Fields marked @pure only depend on the object and the arguments, so their results may be shared
+	// by every resolution of the same field in a request.
+	bool pure = false;
+
+	// Fields marked @batch on object types have accessors which take all of the parent Objects which
+	// select the field at once, and return a result for each of them. See service::BatchedField.
+	bool batch = false;
+
+	// Fields marked @lazy must be non-nullable lists, and their accessors return a service::LazyList
+	// which produces the entries one at a time instead of a std::vector.
+	bool lazy = false;
+
+	// Fields marked @cost(weight: Int) override the default weight of the field in the cost analysis
+	// for an operation, see service::FieldCosts.
+	std::unique_ptr<size_t> cost;
+
+	// Scalar and enum fields with a @cacheControl hint (directly, on the object type which declares
+	// them, or on the interface field they implement) are looked up in the FieldCache.
+	std::unique_ptr<CacheControlHint> cacheControl;
 };
 
 using OutputFieldList = std::vector<OutputField>;
@@ -168,6 +200,7 @@ struct InterfaceType
 	std::string type;
 	OutputFieldList fields;
 	std::string description;
+	bool synchronous;
 };
 
 using InterfaceTypeList = std::vector<InterfaceType>;
@@ -180,6 +213,8 @@ struct ObjectType
 	std::vector<std::string> interfaces;
 	OutputFieldList fields;
 	std::string description;
+	bool synchronous;
+	std::unique_ptr<CacheControlHint> cacheControl;
 };
 
 using ObjectTypeList = std::vector<ObjectType>;
@@ -223,6 +258,8 @@ private:
 	void visitDirectiveDefinition(const peg::ast_node& directiveDefinition);
 
 	static OutputFieldList getOutputFields(const std::vector<std::unique_ptr<peg::ast_node>>& fields);
+	static bool hasDirective(const peg::ast_node& directives, const std::string& name);
+	static std::unique_ptr<CacheControlHint> getCacheControl(const peg::ast_node& directive);
 	static InputFieldList getInputFields(const std::vector<std::unique_ptr<peg::ast_node>>& fields);
 
 	// Recursively visit a Type node until we reach a NamedType and we've
@@ -277,6 +314,7 @@ private:
 	bool outputHeader() const noexcept;
 	std::string getFieldDeclaration(const InputField& inputField) const noexcept;
 	std::string getFieldDeclaration(const OutputField& outputField, bool interfaceField) const noexcept;
+	std::string getBatchFieldDeclaration(const OutputField& outputField, const std::string& objectType) const noexcept;
 	std::string getResolverDeclaration(const OutputField& outputField) const noexcept;
 
 	bool outputSource() const noexcept;
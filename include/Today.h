@@ -5,6 +5,8 @@
 
 #include "TodaySchema.h"
 
+#include <graphqlservice/GraphQLBatchLoader.h>
+
 #include <stack>
 
 namespace facebook {
@@ -27,6 +29,14 @@ struct RequestState : service::RequestState
 	size_t loadAppointmentsCount = 0;
 	size_t loadTasksCount = 0;
 	size_t loadUnreadCountsCount = 0;
+	size_t loadNodesCount = 0;
+	size_t unreadCountBatchesCount = 0;
+
+	// Batch the node(id) lookups in each selection set.
+	using NodeLoader = service::BatchLoader<std::vector<uint8_t>, std::shared_ptr<service::Object>>;
+
+	std::mutex nodeLoaderMutex;
+	std::shared_ptr<NodeLoader> nodeLoader;
 };
 
 class Appointment;
@@ -47,11 +57,13 @@ public:
 	std::future<std::shared_ptr<object::TaskConnection>> getTasks(service::FieldParams&& params, std::unique_ptr<response::IntType>&& first, std::unique_ptr<response::Value>&& after, std::unique_ptr<response::IntType>&& last, std::unique_ptr<response::Value>&& before) const override;
 	std::future<std::shared_ptr<object::FolderConnection>> getUnreadCounts(service::FieldParams&& params, std::unique_ptr<response::IntType>&& first, std::unique_ptr<response::Value>&& after, std::unique_ptr<response::IntType>&& last, std::unique_ptr<response::Value>&& before) const override;
 	std::future<std::vector<std::shared_ptr<object::Appointment>>> getAppointmentsById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const override;
-	std::future<std::vector<std::shared_ptr<object::Task>>> getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const override;
+	std::future<service::LazyList<std::shared_ptr<object::Task>>> getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const override;
 	std::future<std::vector<std::shared_ptr<object::Folder>>> getUnreadCountsById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& ids) const override;
 	std::future<std::shared_ptr<object::NestedType>> getNested(service::FieldParams&& params) const override;
 
 private:
+	std::shared_ptr<RequestState::NodeLoader> getNodeLoader(const std::shared_ptr<service::RequestState>& state) const;
+	std::shared_ptr<service::Object> findNode(const service::FieldParams& params, const std::vector<uint8_t>& id) const;
 	std::shared_ptr<Appointment> findAppointment(const service::FieldParams& params, const std::vector<uint8_t>& id) const;
 	std::shared_ptr<Task> findTask(const service::FieldParams& params, const std::vector<uint8_t>& id) const;
 	std::shared_ptr<Folder> findUnreadCount(const service::FieldParams& params, const std::vector<uint8_t>& id) const;
@@ -79,22 +91,14 @@ public:
 	{
 	}
 
-	std::future<bool> getHasNextPage(service::FieldParams&&) const override
+	bool getHasNextPage(service::FieldParams&&) const override
 	{
-		std::promise<bool> promise;
-
-		promise.set_value(_hasNextPage);
-
-		return promise.get_future();
+		return _hasNextPage;
 	}
 
-	std::future<bool> getHasPreviousPage(service::FieldParams&&) const override
+	bool getHasPreviousPage(service::FieldParams&&) const override
 	{
-		std::promise<bool> promise;
-
-		promise.set_value(_hasPreviousPage);
-
-		return promise.get_future();
+		return _hasPreviousPage;
 	}
 
 private:
@@ -107,40 +111,29 @@ class Appointment : public object::Appointment
 public:
 	explicit Appointment(std::vector<uint8_t>&& id, std::string&& when, std::string&& subject, bool isNow);
 
-	std::future<std::vector<uint8_t>> getId(service::FieldParams&&) const override
+	std::vector<uint8_t> getId(service::FieldParams&&) const override
 	{
-		std::promise<std::vector<uint8_t>> promise;
-
-		promise.set_value(_id);
-
-		return promise.get_future();
+		return _id;
 	}
 
-	std::future<std::unique_ptr<response::Value>> getWhen(service::FieldParams&&) const override
+	std::unique_ptr<response::Value> getWhen(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<response::Value>> promise;
-
-		promise.set_value(std::unique_ptr<response::Value>(new response::Value(std::string(_when))));
-
-		return promise.get_future();
+		return std::unique_ptr<response::Value>(new response::Value(std::string(_when)));
 	}
 
-	std::future<std::unique_ptr<response::StringType>> getSubject(service::FieldParams&&) const override
+	std::unique_ptr<response::StringType> getSubject(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<response::StringType>> promise;
-
-		promise.set_value(std::unique_ptr<response::StringType>(new std::string(_subject)));
-
-		return promise.get_future();
+		return std::unique_ptr<response::StringType>(new std::string(_subject));
 	}
 
-	std::future<bool> getIsNow(service::FieldParams&&) const override
+	bool getIsNow(service::FieldParams&&) const override
 	{
-		std::promise<bool> promise;
-
-		promise.set_value(_isNow);
+		return _isNow;
+	}
 
-		return promise.get_future();
+	std::string getCacheIdentity() const override
+	{
+		return service::Base64::toBase64(_id);
 	}
 
 private:
@@ -158,22 +151,14 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::Appointment>> getNode(service::FieldParams&&) const override
+	std::shared_ptr<object::Appointment> getNode(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::Appointment>> promise;
-
-		promise.set_value(std::static_pointer_cast<object::Appointment>(_appointment));
-
-		return promise.get_future();
+		return std::static_pointer_cast<object::Appointment>(_appointment);
 	}
 
-	std::future<response::Value> getCursor(service::FieldParams&& params) const override
+	response::Value getCursor(service::FieldParams&& params) const override
 	{
-		std::promise<response::Value> promise;
-
-		promise.set_value(response::Value(service::Base64::toBase64(_appointment->getId(std::move(params)).get())));
-
-		return promise.get_future();
+		return response::Value(service::Base64::toBase64(_appointment->getId(std::move(params))));
 	}
 
 private:
@@ -189,18 +174,13 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::PageInfo>> getPageInfo(service::FieldParams&&) const override
+	std::shared_ptr<object::PageInfo> getPageInfo(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::PageInfo>> promise;
-
-		promise.set_value(_pageInfo);
-
-		return promise.get_future();
+		return _pageInfo;
 	}
 
-	std::future<std::unique_ptr<std::vector<std::shared_ptr<object::AppointmentEdge>>>> getEdges(service::FieldParams&&) const override
+	std::unique_ptr<std::vector<std::shared_ptr<object::AppointmentEdge>>> getEdges(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<std::vector<std::shared_ptr<object::AppointmentEdge>>>> promise;
 		auto result = std::unique_ptr<std::vector<std::shared_ptr<object::AppointmentEdge>>>(new std::vector<std::shared_ptr<object::AppointmentEdge>>(_appointments.size()));
 
 		std::transform(_appointments.cbegin(), _appointments.cend(), result->begin(),
@@ -208,9 +188,8 @@ public:
 		{
 			return std::make_shared<AppointmentEdge>(node);
 		});
-		promise.set_value(std::move(result));
 
-		return promise.get_future();
+		return result;
 	}
 
 private:
@@ -223,31 +202,19 @@ class Task : public object::Task
 public:
 	explicit Task(std::vector<uint8_t>&& id, std::string&& title, bool isComplete);
 
-	std::future<std::vector<uint8_t>> getId(service::FieldParams&&) const override
+	std::vector<uint8_t> getId(service::FieldParams&&) const override
 	{
-		std::promise<std::vector<uint8_t>> promise;
-
-		promise.set_value(_id);
-
-		return promise.get_future();
+		return _id;
 	}
 
-	std::future<std::unique_ptr<response::StringType>> getTitle(service::FieldParams&&) const override
+	std::unique_ptr<response::StringType> getTitle(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<response::StringType>> promise;
-
-		promise.set_value(std::unique_ptr<response::StringType>(new std::string(_title)));
-
-		return promise.get_future();
+		return std::unique_ptr<response::StringType>(new std::string(_title));
 	}
 
-	std::future<bool> getIsComplete(service::FieldParams&&) const override
+	bool getIsComplete(service::FieldParams&&) const override
 	{
-		std::promise<bool> promise;
-
-		promise.set_value(_isComplete);
-
-		return promise.get_future();
+		return _isComplete;
 	}
 
 private:
@@ -265,22 +232,14 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::Task>> getNode(service::FieldParams&&) const override
+	std::shared_ptr<object::Task> getNode(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::Task>> promise;
-
-		promise.set_value(std::static_pointer_cast<object::Task>(_task));
-
-		return promise.get_future();
+		return std::static_pointer_cast<object::Task>(_task);
 	}
 
-	std::future<response::Value> getCursor(service::FieldParams&& params) const override
+	response::Value getCursor(service::FieldParams&& params) const override
 	{
-		std::promise<response::Value> promise;
-
-		promise.set_value(response::Value(service::Base64::toBase64(_task->getId(std::move(params)).get())));
-
-		return promise.get_future();
+		return response::Value(service::Base64::toBase64(_task->getId(std::move(params))));
 	}
 
 private:
@@ -296,18 +255,13 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::PageInfo>> getPageInfo(service::FieldParams&&) const override
+	std::shared_ptr<object::PageInfo> getPageInfo(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::PageInfo>> promise;
-
-		promise.set_value(_pageInfo);
-
-		return promise.get_future();
+		return _pageInfo;
 	}
 
-	std::future<std::unique_ptr<std::vector<std::shared_ptr<object::TaskEdge>>>> getEdges(service::FieldParams&&) const override
+	std::unique_ptr<std::vector<std::shared_ptr<object::TaskEdge>>> getEdges(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<std::vector<std::shared_ptr<object::TaskEdge>>>> promise;
 		auto result = std::unique_ptr<std::vector<std::shared_ptr<object::TaskEdge>>>(new std::vector<std::shared_ptr<object::TaskEdge>>(_tasks.size()));
 
 		std::transform(_tasks.cbegin(), _tasks.cend(), result->begin(),
@@ -315,9 +269,8 @@ public:
 		{
 			return std::make_shared<TaskEdge>(node);
 		});
-		promise.set_value(std::move(result));
 
-		return promise.get_future();
+		return result;
 	}
 
 private:
@@ -330,31 +283,21 @@ class Folder : public object::Folder
 public:
 	explicit Folder(std::vector<uint8_t>&& id, std::string&& name, int unreadCount);
 
-	std::future<std::vector<uint8_t>> getId(service::FieldParams&&) const override
+	std::vector<uint8_t> getId(service::FieldParams&&) const override
 	{
-		std::promise<std::vector<uint8_t>> promise;
-
-		promise.set_value(_id);
-
-		return promise.get_future();
+		return _id;
 	}
 
-	std::future<std::unique_ptr<response::StringType>> getName(service::FieldParams&&) const override
+	std::unique_ptr<response::StringType> getName(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<response::StringType>> promise;
-
-		promise.set_value(std::unique_ptr<response::StringType>(new std::string(_name)));
-
-		return promise.get_future();
+		return std::unique_ptr<response::StringType>(new std::string(_name));
 	}
 
-	std::future<int> getUnreadCount(service::FieldParams&&) const override
-	{
-		std::promise<int> promise;
-
-		promise.set_value(_unreadCount);
+	std::vector<response::IntType> getUnreadCount(service::FieldParams&& params, const std::vector<const object::Folder*>& parents) const override;
 
-		return promise.get_future();
+	std::string getCacheIdentity() const override
+	{
+		return service::Base64::toBase64(_id);
 	}
 
 private:
@@ -371,22 +314,14 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::Folder>> getNode(service::FieldParams&&) const override
+	std::shared_ptr<object::Folder> getNode(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::Folder>> promise;
-
-		promise.set_value(std::static_pointer_cast<object::Folder>(_folder));
-
-		return promise.get_future();
+		return std::static_pointer_cast<object::Folder>(_folder);
 	}
 
-	std::future<response::Value> getCursor(service::FieldParams&& params) const override
+	response::Value getCursor(service::FieldParams&& params) const override
 	{
-		std::promise<response::Value> promise;
-
-		promise.set_value(response::Value(service::Base64::toBase64(_folder->getId(std::move(params)).get())));
-
-		return promise.get_future();
+		return response::Value(service::Base64::toBase64(_folder->getId(std::move(params))));
 	}
 
 private:
@@ -402,18 +337,13 @@ public:
 	{
 	}
 
-	std::future<std::shared_ptr<object::PageInfo>> getPageInfo(service::FieldParams&&) const override
+	std::shared_ptr<object::PageInfo> getPageInfo(service::FieldParams&&) const override
 	{
-		std::promise<std::shared_ptr<object::PageInfo>> promise;
-
-		promise.set_value(_pageInfo);
-
-		return promise.get_future();
+		return _pageInfo;
 	}
 
-	std::future<std::unique_ptr<std::vector<std::shared_ptr<object::FolderEdge>>>> getEdges(service::FieldParams&&) const override
+	std::unique_ptr<std::vector<std::shared_ptr<object::FolderEdge>>> getEdges(service::FieldParams&&) const override
 	{
-		std::promise<std::unique_ptr<std::vector<std::shared_ptr<object::FolderEdge>>>> promise;
 		auto result = std::unique_ptr<std::vector<std::shared_ptr<object::FolderEdge>>>(new std::vector<std::shared_ptr<object::FolderEdge>>(_folders.size()));
 
 		std::transform(_folders.cbegin(), _folders.cend(), result->begin(),
@@ -421,9 +351,8 @@ public:
 		{
 			return std::make_shared<FolderEdge>(node);
 		});
-		promise.set_value(std::move(result));
 
-		return promise.get_future();
+		return result;
 	}
 
 private:
@@ -0,0 +1,196 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <graphqlservice/GraphQLService.h>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+// Types are stored in the same notation as the schema, e.g. "[ID!]!", so comparing the type of a
+// variable with the type of the argument where it's used doesn't need anything more than a string.
+struct ValidateArgument
+{
+	std::string type;
+	bool defaultValue = false;
+
+	// The default value is parsed from the introspection results, so missing input object fields can
+	// be filled in when the variables are coerced.
+	response::Value parsedDefault;
+};
+
+using ValidateArguments = std::map<std::string, ValidateArgument>;
+
+struct ValidateField
+{
+	std::string type;
+	ValidateArguments arguments;
+};
+
+using ValidateFields = std::map<std::string, ValidateField>;
+
+struct ValidateType
+{
+	std::string kind;
+	ValidateFields fields;
+	ValidateArguments inputFields;
+	std::set<std::string> enumValues;
+	std::set<std::string> possibleTypes;
+};
+
+struct ValidateDirective
+{
+	std::set<std::string> locations;
+	ValidateArguments arguments;
+};
+
+// ValidationSchema is a snapshot of everything in the schema that we need to validate an executable
+// document. It's loaded from the results of the introspection query, so it works with any service
+// that exposes the introspection fields on its query type.
+class ValidationSchema
+{
+public:
+	explicit ValidationSchema(const response::Value& introspection);
+
+	// The query which returns the __schema field that the constructor expects.
+	static const peg::ast_node& getIntrospectionQuery();
+
+	const ValidateType* getType(const std::string& name) const;
+
+	// Look up a field on a type, including the implicit introspection fields.
+	const ValidateField* getField(const std::string& typeName, const ValidateType& type, const std::string& name) const;
+	const ValidateDirective* getDirective(const std::string& name) const;
+
+	// Returns the name of the root type for query, mutation, or subscription operations, or an empty
+	// string if the schema doesn't support that operation type.
+	const std::string& getOperationType(const std::string& operation) const;
+
+private:
+	std::map<std::string, ValidateType> _types;
+	std::map<std::string, ValidateDirective> _directives;
+	std::map<std::string, std::string> _operationTypes;
+};
+
+// Coerce the value of a variable to its type in the variable definition. Enum values and the fields of
+// input objects are checked against the ValidationSchema, and missing input object fields get their
+// default values. If the service doesn't support introspection there's no ValidationSchema, so only
+// the built-in scalar types are checked, and any other named type is converted by the
+// ModifiedArgument specialization when the resolver reads it. Throws a schema_exception if the value
+// isn't valid.
+response::Value coerceVariableValue(const ValidationSchema* schema, const peg::ast_node& type, response::Value&& value);
+
+// Measure how deeply the document is nested, including the fragments it spreads wherever they're
+// spread. It doesn't recurse on the native stack, so it's safe to use on documents which are too deep
+// for ValidateExecutableVisitor or CostAnalysisVisitor.
+size_t getDocumentDepth(const peg::ast_node& root);
+
+// ValidateExecutableVisitor visits every definition in the document and collects the errors from the
+// validation rules in the spec, without calling any of the resolvers.
+// https://facebook.github.io/graphql/June2018/#sec-Validation
+class ValidateExecutableVisitor
+{
+public:
+	explicit ValidateExecutableVisitor(const ValidationSchema& schema);
+
+	void visit(const peg::ast_node& root);
+
+	std::vector<std::string> getErrors();
+
+private:
+	struct VariableUsage
+	{
+		std::string name;
+		std::string type;
+		bool defaultValue;
+		const peg::ast_node* variable;
+	};
+
+	// The variables and fragments referenced directly by an operation or fragment definition.
+	struct DefinitionUsage
+	{
+		std::vector<VariableUsage> variables;
+		std::set<std::string> fragmentSpreads;
+	};
+
+	// A field which shares its response key with other fields in the same selection set, either
+	// directly or through fragments, so they need to be merged.
+	struct FieldToMerge
+	{
+		std::string parentType;
+		std::string name;
+		std::string arguments;
+		std::string fieldType;
+		const peg::ast_node* field;
+		const peg::ast_node* selectionSet;
+	};
+
+	// The parent type and AST node for each of the selection sets which are merged together.
+	using SelectionSetsToMerge = std::vector<std::pair<std::string, const peg::ast_node*>>;
+
+	void visitFragmentDefinition(const std::string& name, const peg::ast_node& fragmentDefinition);
+	void visitOperationDefinition(const peg::ast_node& operationDefinition);
+
+	void visitSelectionSet(const std::string& typeName, const peg::ast_node& selectionSet);
+	void visitField(const std::string& typeName, const ValidateType& type, const peg::ast_node& field);
+	void visitFragmentSpread(const std::string& typeName, const peg::ast_node& fragmentSpread);
+	void visitInlineFragment(const std::string& typeName, const peg::ast_node& inlineFragment);
+
+	void visitDirectives(const std::string& location, const peg::ast_node& parent);
+	void visitArguments(const std::string& owner, const ValidateArguments& definitions, const peg::ast_node& parent);
+	void visitInputValue(const std::string& name, const std::string& type, bool defaultValue, const peg::ast_node& value);
+
+	const ValidateType* getCompositeType(const std::string& typeName, const peg::ast_node& node);
+	bool isPossibleSpread(const std::string& typeName, const std::string& fragmentTypeName) const;
+	void collectRootFields(const peg::ast_node& selectionSet, std::set<std::string>& responseKeys, std::set<std::string>& visitedFragments) const;
+	void collectFragmentSpreads(const std::string& name, std::set<std::string>& fragmentSpreads) const;
+	void collectFieldsToMerge(const std::string& typeName, const peg::ast_node& selectionSet, std::map<std::string, std::vector<FieldToMerge>>& fields, std::set<std::string>& visitedFragments) const;
+	void visitFieldsToMerge(SelectionSetsToMerge&& selectionSets);
+
+	void addError(std::string&& message, const peg::ast_node& node);
+
+	const ValidationSchema& _schema;
+	std::vector<std::string> _errors;
+
+	std::map<std::string, const peg::ast_node*> _fragmentDefinitions;
+	std::map<std::string, DefinitionUsage> _fragmentUsages;
+	DefinitionUsage* _usage = nullptr;
+	bool _fragmentCycles = false;
+	std::set<SelectionSetsToMerge> _mergedSelectionSets;
+};
+
+// CostAnalysisVisitor estimates the cost of a single operation in a valid document. Each field adds
+// its weight multiplied by the number of times it could be resolved, which is the product of the
+// list sizes of every list field above it.
+class CostAnalysisVisitor
+{
+public:
+	CostAnalysisVisitor(const ValidationSchema& schema, const FieldCosts& fieldCosts, const response::Value& variables, size_t defaultListSize);
+
+	void visit(const peg::ast_node& root, const std::string& operationName);
+
+	QueryCost getCost();
+
+private:
+	void visitSelectionSet(const std::string& typeName, const peg::ast_node& selectionSet, size_t multiplier, size_t connectionSize, size_t depth);
+	void visitField(const std::string& typeName, const ValidateType& type, const peg::ast_node& field, size_t multiplier, size_t connectionSize, size_t depth);
+
+	size_t getListSize(const peg::ast_node& field) const;
+
+	const ValidationSchema& _schema;
+	const FieldCosts& _fieldCosts;
+	const response::Value& _variables;
+	const size_t _defaultListSize;
+
+	std::map<std::string, const peg::ast_node*> _fragmentDefinitions;
+	std::set<std::string> _fragmentPath;
+
+	// The cost of each fragment with a multiplier of 1 starting at depth 0, for each connection size.
+	std::map<std::pair<std::string, size_t>, QueryCost> _fragmentCosts;
+	QueryCost _cost;
+};
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <graphqlservice/GraphQLService.h>
+
+#include <memory>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+#include <map>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+// BatchLoader collects the keys which are requested by resolvers in the same selection set and looks
+// them all up with a single call to the batch function. Register it with the RequestState using
+// addBatchDispatcher and it will be dispatched at the end of each selection set. Values are memoized
+// for the lifetime of the BatchLoader, so you should create one per request.
+template <typename _Key, typename _Value, typename _Compare = std::less<_Key>>
+class BatchLoader : public BatchDispatcher, public std::enable_shared_from_this<BatchLoader<_Key, _Value, _Compare>>
+{
+public:
+	// The batch function receives every key which was requested since the last dispatch, and it must
+	// return the values in the same order.
+	using BatchFunction = std::function<std::vector<_Value>(const std::vector<_Key>& keys)>;
+
+	explicit BatchLoader(BatchFunction&& batch)
+		: _batch(std::move(batch))
+	{
+	}
+
+	// Request the value for a key. The std::future is satisfied when the batch is dispatched, and if it
+	// hasn't been dispatched yet, waiting on the std::future will dispatch it.
+	std::future<_Value> load(const _Key& key)
+	{
+		auto spThis = this->shared_from_this();
+
+		return std::async(std::launch::deferred,
+			[spThis](std::shared_future<_Value>&& wrappedValue)
+		{
+			spThis->dispatch();
+			return wrappedValue.get();
+		}, enqueue(key));
+	}
+
+	// Request the values for multiple keys in the same batch.
+	std::future<std::vector<_Value>> loadMany(const std::vector<_Key>& keys)
+	{
+		auto spThis = this->shared_from_this();
+		std::vector<std::shared_future<_Value>> values;
+
+		values.reserve(keys.size());
+
+		for (const auto& key : keys)
+		{
+			values.push_back(enqueue(key));
+		}
+
+		return std::async(std::launch::deferred,
+			[spThis](std::vector<std::shared_future<_Value>>&& wrappedValues)
+		{
+			std::vector<_Value> result;
+
+			spThis->dispatch();
+			result.reserve(wrappedValues.size());
+
+			for (const auto& value : wrappedValues)
+			{
+				result.push_back(value.get());
+			}
+
+			return result;
+		}, std::move(values));
+	}
+
+	// Send all of the pending keys to the batch function.
+	void dispatch() override
+	{
+		std::vector<_Key> keys;
+		std::vector<std::promise<_Value>> promises;
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			keys.swap(_pendingKeys);
+			promises.swap(_pendingPromises);
+		}
+
+		if (keys.empty())
+		{
+			return;
+		}
+
+		try
+		{
+			auto values = _batch(keys);
+
+			if (values.size() != keys.size())
+			{
+				throw schema_exception({ "BatchLoader function returned the wrong number of values" });
+			}
+
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				promises[i].set_value(std::move(values[i]));
+			}
+		}
+		catch (...)
+		{
+			const auto ex = std::current_exception();
+
+			for (auto& promise : promises)
+			{
+				try
+				{
+					promise.set_exception(ex);
+				}
+				catch (const std::future_error&)
+				{
+					// This promise was already satisfied before the exception.
+				}
+			}
+		}
+	}
+
+private:
+	std::shared_future<_Value> enqueue(const _Key& key)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto itr = _values.find(key);
+
+		if (itr != _values.end())
+		{
+			return itr->second;
+		}
+
+		std::promise<_Value> promise;
+		auto value = promise.get_future().share();
+
+		_values.insert({ key, value });
+		_pendingKeys.push_back(key);
+		_pendingPromises.push_back(std::move(promise));
+
+		return value;
+	}
+
+	const BatchFunction _batch;
+
+	std::mutex _mutex;
+	std::map<_Key, std::shared_future<_Value>, _Compare> _values;
+	std::vector<_Key> _pendingKeys;
+	std::vector<std::promise<_Value>> _pendingPromises;
+};
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
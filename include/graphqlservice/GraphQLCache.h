@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <graphqlservice/GraphQLResponse.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+// The scope argument to the @cacheControl(maxAge: Int, scope: PUBLIC | PRIVATE) schema directive.
+// Public values are shared by every request, private values are only shared by requests with the same
+// RequestState::cacheScope (e.g. the same user).
+enum class CacheScope
+{
+	Public,
+	Private,
+};
+
+// Generated resolvers for fields with a @cacheControl hint in the schema look for the result in the
+// FieldCache set on the RequestState before calling the accessor, and store it there afterwards. The
+// keys already include everything the value depends on, so a FieldCache can be shared by any number
+// of requests, and it may be called concurrently from any thread.
+class FieldCache
+{
+public:
+	virtual ~FieldCache() = default;
+
+	// Return true and fill in the value if there's an entry for the key which hasn't expired yet.
+	virtual bool find(const std::string& key, response::Value& value) = 0;
+
+	// Add or replace the entry for the key, which expires after maxAge.
+	virtual void insert(const std::string& key, const response::Value& value, std::chrono::seconds maxAge) = 0;
+};
+
+// ShardedFieldCache is the default in-process FieldCache. The keys are spread across shards which each
+// have their own lock, and once a shard is full it drops the expired entries (or the one which expires
+// soonest if none of them have expired) to make room for new ones.
+class ShardedFieldCache : public FieldCache
+{
+public:
+	explicit ShardedFieldCache(size_t shardCount = 16, size_t maxEntriesPerShard = 1024);
+
+	bool find(const std::string& key, response::Value& value) override;
+	void insert(const std::string& key, const response::Value& value, std::chrono::seconds maxAge) override;
+
+	// Drop all of the entries, e.g. after the backing data changes.
+	void clear();
+
+private:
+	struct Entry
+	{
+		response::Value value;
+		std::chrono::steady_clock::time_point expires;
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, Entry> entries;
+	};
+
+	Shard& getShard(const std::string& key);
+
+	const size_t _maxEntriesPerShard;
+	std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+// ResponseCache holds the serialized responses to whole query operations for Request::resolveCached.
+// The keys don't include anything about the schema, so each ResponseCache should only be used with a
+// single Request, but it may be shared by any number of requests on different threads.
+class ResponseCache
+{
+public:
+	// Serialize a response, e.g. with response::toJSON from the graphqljson library.
+	using Serializer = std::function<std::string(response::Value&&)>;
+
+	explicit ResponseCache(Serializer&& serialize, size_t maxEntries = 1024);
+
+	std::shared_ptr<const std::string> serialize(response::Value&& response) const;
+
+	// Return nullptr if there's no entry for the key or it has expired.
+	std::shared_ptr<const std::string> find(const std::string& key);
+
+	// Add or replace the entry for the key, which expires after maxAge or when any of the tags are
+	// invalidated. Once the cache is full, it drops the expired entries (or the one which expires
+	// soonest if none of them have expired) to make room for new ones.
+	void insert(std::string&& key, std::shared_ptr<const std::string> response, std::chrono::seconds maxAge, const std::vector<std::string>& tags);
+
+	// Drop every entry which was added with this tag, e.g. when the data it depends on changes.
+	void invalidate(const std::string& tag);
+
+	// Drop all of the entries.
+	void clear();
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<const std::string> response;
+		std::chrono::steady_clock::time_point expires;
+		std::vector<std::string> tags;
+	};
+
+	using EntryMap = std::unordered_map<std::string, Entry>;
+
+	EntryMap::iterator erase(EntryMap::iterator itr);
+
+	const Serializer _serialize;
+	const size_t _maxEntries;
+
+	std::mutex _mutex;
+	EntryMap _entries;
+	std::unordered_map<std::string, std::unordered_set<std::string>> _tags;
+};
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -0,0 +1,311 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <queue>
+#include <vector>
+#include <type_traits>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+// Executors schedule asynchronous work for resolvers and the GraphQLService library. Set one on the
+// RequestState to share a fixed set of threads between all of the resolvers in a request instead of
+// launching a new thread for every call to std::async.
+class Executor
+{
+public:
+	virtual ~Executor() = default;
+
+	// Schedule the work to run eventually. Implementations may run it in the calling thread if they
+	// can't accept any more work.
+	virtual void post(std::function<void()>&& work) = 0;
+};
+
+// Thrown instead of starting work for a request which was cancelled or passed its deadline. Resolvers
+// can throw it too, and the GraphQLService library reports the field as null with an error instead
+// of failing the whole operation.
+class cancelled_exception : public std::runtime_error
+{
+public:
+	explicit cancelled_exception(const std::string& reason)
+		: std::runtime_error(reason)
+	{
+	}
+};
+
+// Cancellation is shared between the resolvers for a request and whatever can cancel it, e.g. the
+// connection to the client or a deadline. Set it on the RequestState and the GraphQLService library
+// checks it before calling each resolver, between the entries in lists of Objects, and before
+// starting any work which is still queued on the Executor. Work that has already started is allowed
+// to finish, so resolvers which make expensive backend calls should check it too. Once the deadline
+// passes, nothing waits for work which is still running on the Executor, it's abandoned and
+// reported as cancelled instead.
+class Cancellation
+{
+public:
+	Cancellation() noexcept;
+	explicit Cancellation(std::chrono::steady_clock::time_point deadline) noexcept;
+
+	// Cancel the request, e.g. when the client disconnects.
+	void cancel() noexcept;
+
+	// Returns true once cancel has been called or the deadline has passed.
+	bool isCancelled() const noexcept;
+
+	// Throw a cancelled_exception if the request has been cancelled.
+	void throwIfCancelled() const;
+
+	// Resolvers can pass the deadline along to backends which support timeouts.
+	bool hasDeadline() const noexcept;
+	std::chrono::steady_clock::time_point getDeadline() const noexcept;
+
+	// The GraphQLService library records an error for each field which was cancelled, and adds them
+	// to the errors in the response.
+	void addError(std::string&& error);
+	std::vector<std::string> releaseErrors();
+
+	// Abandoned work keeps running in the background with its own references to the Objects and the
+	// operation, but it still borrows the document, so wait for it to finish before releasing that.
+	void waitForAbandoned();
+
+	// Keep the owner alive until all of the abandoned work has finished, or release it right away
+	// if there isn't any.
+	void holdWhileAbandoned(std::shared_ptr<const void>&& owner);
+
+	// launchCancellable tracks the work it stopped waiting for with these.
+	void addAbandoned();
+	void releaseAbandoned();
+
+private:
+	std::atomic<bool> _cancelled;
+	const bool _hasDeadline;
+	const std::chrono::steady_clock::time_point _deadline;
+
+	std::mutex _errorsMutex;
+	std::vector<std::string> _errors;
+
+	std::mutex _abandonedMutex;
+	std::condition_variable _abandonedFinished;
+	size_t _abandoned;
+	std::vector<std::shared_ptr<const void>> _abandonedOwners;
+};
+
+// Shared state between the work posted to an Executor and the std::future returned to the caller.
+// Whichever side claims it first runs the task, so waiting on the std::future never depends on a
+// free thread in the Executor. That lets resolvers running in the Executor wait on other work
+// they've scheduled in the same Executor without deadlocking.
+template <typename _Result>
+class ScheduledTask
+{
+public:
+	explicit ScheduledTask(std::future<_Result>&& deferred)
+		: _deferred(std::move(deferred))
+		, _task([this]()
+		{
+			return _deferred.get();
+		})
+		, _claimed(false)
+		, _state(State::Pending)
+	{
+	}
+
+	std::future<_Result> getFuture()
+	{
+		return _task.get_future();
+	}
+
+	void run()
+	{
+		if (!_claimed.exchange(true))
+		{
+			_task();
+
+			// If the caller stopped waiting for it, let the Cancellation know that it's done.
+			if (State::Abandoned == _state.exchange(State::Finished))
+			{
+				auto abandonedBy = std::move(_abandonedBy);
+
+				abandonedBy->releaseAbandoned();
+			}
+		}
+	}
+
+	// Claim the task without running it. Returns false if it's already been claimed.
+	bool skip() noexcept
+	{
+		return !_claimed.exchange(true);
+	}
+
+	// Stop waiting for a task which is running on another thread, and track it in the Cancellation
+	// until it finishes. Returns false if it's already finished.
+	bool abandon(const std::shared_ptr<Cancellation>& cancellation)
+	{
+		State pending = State::Pending;
+
+		_abandonedBy = cancellation;
+		_abandonedBy->addAbandoned();
+
+		if (!_state.compare_exchange_strong(pending, State::Abandoned))
+		{
+			_abandonedBy->releaseAbandoned();
+			_abandonedBy.reset();
+
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	enum class State
+	{
+		Pending,
+		Abandoned,
+		Finished
+	};
+
+	std::future<_Result> _deferred;
+	std::packaged_task<_Result()> _task;
+	std::atomic<bool> _claimed;
+	std::atomic<State> _state;
+	std::shared_ptr<Cancellation> _abandonedBy;
+};
+
+// Schedule a function on the Executor and return a std::future for the result, the same way you would
+// use std::async. If the Executor is null, the function is deferred until the std::future is waited on.
+// If the Cancellation is cancelled before the function starts, waiting on the std::future throws a
+// cancelled_exception instead of running it. If it's still running on another thread when the
+// deadline passes, waiting on the std::future throws a cancelled_exception and abandons it.
+template <typename _Function, typename... _Args>
+std::future<typename std::result_of<typename std::decay<_Function>::type(typename std::decay<_Args>::type...)>::type>
+	launchCancellable(const std::shared_ptr<Executor>& executor, const std::shared_ptr<Cancellation>& cancellation, _Function&& function, _Args&&... args)
+{
+	using result_type = typename std::result_of<typename std::decay<_Function>::type(typename std::decay<_Args>::type...)>::type;
+
+	// Let std::async take care of capturing the function and its arguments.
+	auto deferred = std::async(std::launch::deferred, std::forward<_Function>(function), std::forward<_Args>(args)...);
+
+	if (!executor)
+	{
+		if (!cancellation)
+		{
+			return deferred;
+		}
+
+		return std::async(std::launch::deferred,
+			[cancellation](std::future<result_type>&& wrappedDeferred)
+		{
+			cancellation->throwIfCancelled();
+			return wrappedDeferred.get();
+		}, std::move(deferred));
+	}
+
+	auto task = std::make_shared<ScheduledTask<result_type>>(std::move(deferred));
+	auto result = task->getFuture();
+	std::weak_ptr<ScheduledTask<result_type>> weakTask(task);
+
+	// If the caller releases the std::future before a worker gets to it, skip it the same way
+	// std::launch::deferred would.
+	executor->post([weakTask]()
+	{
+		auto task = weakTask.lock();
+
+		if (task)
+		{
+			task->run();
+		}
+	});
+
+	return std::async(std::launch::deferred,
+		[cancellation](std::shared_ptr<ScheduledTask<result_type>>&& wrappedTask, std::future<result_type>&& wrappedResult)
+	{
+		// If a worker hasn't picked it up yet, there's no need to start it now.
+		if (cancellation
+			&& cancellation->isCancelled()
+			&& wrappedTask->skip())
+		{
+			cancellation->throwIfCancelled();
+		}
+
+		wrappedTask->run();
+
+		if (cancellation
+			&& cancellation->hasDeadline()
+			&& std::future_status::timeout == wrappedResult.wait_until(cancellation->getDeadline())
+			&& wrappedTask->abandon(cancellation))
+		{
+			throw cancelled_exception("Deadline exceeded");
+		}
+
+		return wrappedResult.get();
+	}, std::move(task), std::move(result));
+}
+
+template <typename _Function, typename... _Args>
+std::future<typename std::result_of<typename std::decay<_Function>::type(typename std::decay<_Args>::type...)>::type>
+	launch(const std::shared_ptr<Executor>& executor, _Function&& function, _Args&&... args)
+{
+	return launchCancellable(executor, nullptr, std::forward<_Function>(function), std::forward<_Args>(args)...);
+}
+
+// Bounded work-stealing thread pool. Each worker thread has its own queue, and work posted from one of
+// the workers goes on that worker's queue. Idle workers steal from the other queues. Once the number of
+// pending work items reaches the limit, post runs the work in the calling thread instead of queuing it.
+class ThreadPool : public Executor
+{
+public:
+	explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency(), size_t queueLimit = 1024);
+	~ThreadPool() override;
+
+	void post(std::function<void()>&& work) override;
+
+private:
+	// The worker threads share ownership of this with the ThreadPool, so the last reference to the
+	// ThreadPool can safely be released by work running in one of its own threads.
+	struct SharedState;
+
+	static void runWorker(std::shared_ptr<SharedState> shared, size_t index);
+
+	std::shared_ptr<SharedState> _shared;
+	std::vector<std::thread> _threads;
+};
+
+// Limit the number of concurrent work items that a single request can have running in a shared
+// Executor. Anything over the limit waits in a local queue until one of the running work items
+// finishes. Create one of these per request and set it on the RequestState to keep a single
+// request from monopolizing a ThreadPool.
+class LimitedExecutor : public Executor, public std::enable_shared_from_this<LimitedExecutor>
+{
+public:
+	explicit LimitedExecutor(std::shared_ptr<Executor> executor, size_t maxConcurrency);
+
+	void post(std::function<void()>&& work) override;
+
+private:
+	void dispatch(std::function<void()>&& work);
+	void complete();
+
+	const std::shared_ptr<Executor> _executor;
+	const size_t _maxConcurrency;
+
+	std::mutex _mutex;
+	std::queue<std::function<void()>> _waiting;
+	size_t _running = 0;
+};
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
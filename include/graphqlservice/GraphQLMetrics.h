@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace facebook {
+namespace graphql {
+namespace service {
+
+// The phases of handling a request which report their latency to the installed Metrics.
+enum class MetricsPhase
+{
+	// peg::parseString, peg::parseFile, and the _graphql literal.
+	Parse,
+
+	// Request::validate, which is also called by Request::resolve and Request::subscribe.
+	Validate,
+
+	// Visiting the fragment and operation definitions in Request::resolve, until it returns the
+	// std::future for the operation.
+	Prepare,
+
+	// Each resolver call, until its value (including any sub-selections) is available.
+	Resolve,
+
+	// response::toJSON
+	Serialize,
+
+	// Request::deliver, including the subscription callbacks.
+	Deliver,
+};
+
+// The GraphQL libraries call into the installed Metrics at the end of each phase. The default
+// implementation of record doesn't do anything, and if nothing is installed the libraries don't
+// even read the clock.
+class Metrics
+{
+public:
+	virtual ~Metrics() = default;
+
+	// This may be called concurrently from any thread.
+	virtual void record(MetricsPhase phase, std::chrono::steady_clock::duration latency);
+
+	// Install the Metrics for the whole process, or pass nullptr to stop recording. Other threads may
+	// still be recording to the previous Metrics, so it's kept alive until the process exits.
+	static void install(std::shared_ptr<Metrics> metrics);
+
+	// Get the installed Metrics, or nullptr if there aren't any.
+	static Metrics* get() noexcept;
+};
+
+// Time a phase from construction until destruction and record it in the installed Metrics.
+class MetricsTimer
+{
+public:
+	explicit MetricsTimer(MetricsPhase phase) noexcept;
+	~MetricsTimer();
+
+private:
+	Metrics* const _metrics;
+	const MetricsPhase _phase;
+	std::chrono::steady_clock::time_point _start;
+};
+
+// AggregateMetrics counts the calls to each phase and builds a histogram of their latency. Each
+// thread records to its own counters without any locks, and getPhaseMetrics adds them up.
+class AggregateMetrics : public Metrics
+{
+public:
+	static constexpr size_t s_phaseCount = static_cast<size_t>(MetricsPhase::Deliver) + 1;
+
+	// Bucket 0 counts latencies under 1 microsecond, bucket N counts latencies from 2^(N-1) up to
+	// 2^N microseconds, and the last bucket counts everything slower than that.
+	static constexpr size_t s_bucketCount = 24;
+
+	struct PhaseMetrics
+	{
+		uint64_t count;
+		std::chrono::nanoseconds totalLatency;
+		std::array<uint64_t, s_bucketCount> histogram;
+	};
+
+	AggregateMetrics();
+	~AggregateMetrics() override;
+
+	void record(MetricsPhase phase, std::chrono::steady_clock::duration latency) override;
+
+	PhaseMetrics getPhaseMetrics(MetricsPhase phase) const;
+
+private:
+	struct ThreadMetrics;
+
+	ThreadMetrics& getThreadMetrics();
+
+	// Threads cache their counters by this id instead of the address, which could be reused.
+	const uint64_t _id;
+
+	mutable std::mutex _threadsMutex;
+	std::vector<std::unique_ptr<ThreadMetrics>> _threads;
+};
+
+} /* namespace service */
+} /* namespace graphql */
+} /* namespace facebook */
@@ -96,17 +96,27 @@ struct Value
 	_Value release();
 
 private:
+	// Allocate the members of a Type::Map the first time something is added to it.
+	void allocateMap();
+
+	// Copies share the members of a Type::Map, Type::List, Type::String, Type::EnumValue, or
+	// Type::Scalar until one of them is modified, e.g. a variable which is referenced in the arguments
+	// of every field in a list. Anything which modifies the value copies the members first if they're
+	// still shared.
+	void detachMap();
+	void detachList();
+
 	const Type _type;
 
-	// Type::Map
-	std::unique_ptr<std::unordered_map<std::string, size_t>> _members;
-	std::unique_ptr<MapType> _map;
+	// Type::Map, these are null until the first member is added.
+	std::shared_ptr<std::unordered_map<std::string, size_t>> _members;
+	std::shared_ptr<MapType> _map;
 
 	// Type::List
-	std::unique_ptr<ListType> _list;
+	std::shared_ptr<ListType> _list;
 
 	// Type::String or Type::EnumValue
-	std::unique_ptr<StringType> _string;
+	std::shared_ptr<StringType> _string;
 	bool _from_json = false;
 
 	// Type::Boolean
@@ -119,7 +129,7 @@ private:
 	FloatType _float = 0.0;
 
 	// Type::Scalar
-	std::unique_ptr<ScalarType> _scalar;
+	std::shared_ptr<ScalarType> _scalar;
 };
 
 } /* namespace response */
@@ -5,7 +5,10 @@
 
 #include <graphqlservice/GraphQLTree.h>
 #include <graphqlservice/GraphQLResponse.h>
+#include <graphqlservice/GraphQLExecutor.h>
+#include <graphqlservice/GraphQLCache.h>
 
+#include <array>
 #include <memory>
 #include <string>
 #include <sstream>
@@ -16,9 +19,12 @@
 #include <stdexcept>
 #include <type_traits>
 #include <future>
+#include <mutex>
 #include <queue>
 #include <map>
 #include <set>
+#include <tuple>
+#include <chrono>
 
 namespace facebook {
 namespace graphql {
@@ -36,12 +42,270 @@ private:
 	response::Value _errors;
 };
 
+// Thrown in place of a cancelled_exception once the error has been recorded on the Cancellation, so
+// the null for a non-null field which was cancelled propagates to its nearest nullable parent.
+class propagated_cancellation : public cancelled_exception
+{
+public:
+	explicit propagated_cancellation(const std::string& reason)
+		: cancelled_exception(reason)
+	{
+	}
+};
+
+class Object;
+class Fragment;
+class FieldBatch;
+struct RequestState;
+struct ResolverParams;
+struct OperationData;
+struct CollectedSelection;
+class ValidationSchema;
+
+// Resolvers for complex types need to be able to find fragment definitions anywhere in
+// the request document by name.
+using FragmentMap = std::unordered_map<std::string, Fragment>;
+
+// Anything which accumulates work while the resolvers in a selection set are called and then sends it
+// all at once, like a BatchLoader, can register with the RequestState to be dispatched at the end of
+// each selection set.
+class BatchDispatcher
+{
+public:
+	virtual ~BatchDispatcher() = default;
+
+	virtual void dispatch() = 0;
+};
+
+// One step in the path to a field in the response, either the response key of a field or the index
+// of an entry in a list. Paths are only tracked in operations which are being traced, and the root of
+// each path is an empty segment without a parent.
+struct PathSegment
+{
+	std::shared_ptr<const PathSegment> parent;
+	std::string responseKey;
+	size_t index;
+};
+
+using ResponsePath = std::shared_ptr<const PathSegment>;
+
+// The timing of a single resolver call, from when the resolver was called until its value (including
+// any sub-selections) was available.
+struct FieldTrace
+{
+	response::Value path;
+	std::string parentType;
+	std::string fieldName;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+};
+
+// Tracer records the timing of every resolver call in a random sample of the operations. By default
+// the traces are added to a "tracing" entry in the "extensions" of the response, so each request
+// should have its own Tracer. Sub-classes can override traceField to send them somewhere else.
+class Tracer
+{
+public:
+	// Trace each operation with this probability, from 0 (never) to 1 (always).
+	explicit Tracer(double sampleRate = 1.0);
+	virtual ~Tracer() = default;
+
+	// Decide whether to trace the next operation.
+	virtual bool sample();
+
+	// This is called once for each resolver in a traced operation, possibly from the Executor's threads.
+	virtual void traceField(FieldTrace&& trace);
+
+	// Take the traces which were collected by the default implementation of traceField.
+	std::vector<FieldTrace> releaseTraces();
+
+private:
+	const double _sampleRate;
+
+	std::mutex _tracesMutex;
+	std::vector<FieldTrace> _traces;
+};
+
+// Incremental delivery callbacks receive the initial payload of an operation started with
+// Request::resolveIncremental, followed by a patch for each @defer fragment and @stream list entry.
+// Every payload has a hasNext entry, which is false in the last one.
+using IncrementalCallback = std::function<void(response::Value&& payload)>;
+
+// The arguments to an @stream directive on a list field.
+struct StreamDirective
+{
+	size_t initialCount;
+	std::string label;
+};
+
+// IncrementalDelivery queues the patches for an operation started with Request::resolveIncremental,
+// and delivers them in the order they were added after the initial payload. The work for each patch
+// borrows from the operation, so this keeps the operation alive until the last patch is delivered.
+class IncrementalDelivery
+{
+public:
+	explicit IncrementalDelivery(IncrementalCallback&& callback);
+
+	// The RequestState for the operation, which outlives every patch.
+	const std::shared_ptr<RequestState>& getState() const;
+
+	// Add the data for an @defer fragment at the path of the selection set which contains it.
+	void addDeferredFragment(const ResponsePath& path, const std::string& label, std::future<response::Value>&& data);
+
+	// Add an entry in a list with an @stream directive at the path of the entry.
+	void addStreamedItem(const ResponsePath& path, const std::string& label, std::future<response::Value>&& item);
+
+private:
+	friend class Request;
+	friend class OperationDefinitionVisitor;
+
+	struct Patch
+	{
+		response::Value path;
+		std::string label;
+		bool streamed;
+		std::future<response::Value> value;
+	};
+
+	void addPatch(Patch&& patch);
+	bool popPatch(Patch& patch);
+
+	// Patches only hold a weak reference to the IncrementalDelivery, but some of them still borrow
+	// it through their ResolverParams. If the patches aren't all delivered, e.g. because the callback
+	// threw or the caller released the std::future, drop the rest so they can release it.
+	void clearPatches() noexcept;
+
+	// Send the initial payload and then each of the patches, including any which are added while
+	// waiting for the earlier patches.
+	void deliver(response::Value&& document);
+	void deliverPatches(response::Value&& document);
+
+	IncrementalCallback _callback;
+	std::shared_ptr<OperationData> _operation;
+
+	std::mutex _patchesMutex;
+	std::queue<Patch> _patches;
+};
+
+// One of the fields requested in the selection set of another field, see FieldParams::getSelectedFields.
+struct SelectedField
+{
+	std::string name;
+	std::string alias;
+	response::Value arguments;
+
+	// The type condition of the innermost fragment which selected it, or empty if it's selected
+	// directly in the selection set of the field.
+	std::string typeCondition;
+};
+
+using SelectedFields = std::vector<SelectedField>;
+
 // The RequestState is nullable, but if you have multiple threads processing requests and there's any
 // per-request state that you want to maintain throughout the request (e.g. optimizing or batching
 // backend requests), you can inherit from RequestState and pass it to Request::resolve to correlate the
 // asynchronous/recursive callbacks and accumulate state in it.
 struct RequestState : std::enable_shared_from_this<RequestState>
 {
+	// Optional Executor for any asynchronous work in this request. If it's null, the work will be
+	// deferred until the std::future is waited on.
+	std::shared_ptr<Executor> executor;
+
+	// Lists of Objects with more than this many entries are split into chunks of this size and
+	// resolved in parallel on the Executor. Shorter lists, or any list if this is 0, are resolved
+	// in order on a single thread. LazyLists of Objects are always resolved in order, but they're
+	// pulled in chunks of this size (or one at a time if this is 0), so only the Objects in one
+	// chunk are alive at the same time.
+	size_t listChunkSize = 256;
+
+	// Register a BatchDispatcher for the rest of this request.
+	void addBatchDispatcher(std::shared_ptr<BatchDispatcher> dispatcher);
+
+	// Dispatch all of the registered BatchDispatchers, this is called at the end of each selection set.
+	void dispatchBatches();
+
+	// Opt in to sharing the results of fields marked @pure in the schema when they're resolved more
+	// than once on the same object with the same arguments, field directives, and sub-selection in
+	// this request. The memo holds the result after the sub-selection has been resolved, so the
+	// sub-selection is identified by its nodes in the AST. Fields with a sub-selection are only shared
+	// when they're reached through the same selection set, e.g. the same fragment, not when they're
+	// reached through different paths with matching selections written out separately.
+	bool memoizePureFields = false;
+
+	// Reject operations which nest fields more than maxDepth levels deep, or whose estimated
+	// complexity is more than maxComplexity, before any of the resolvers run. Either limit is
+	// ignored if it's 0. See Request::analyzeCost for how the complexity is estimated.
+	size_t maxDepth = 0;
+	size_t maxComplexity = 0;
+
+	// List fields without a first or last argument are assumed to return this many entries when
+	// estimating the complexity of an operation.
+	size_t defaultListSize = 10;
+
+	// Optional Cancellation for this request. Once it's cancelled or passes its deadline, any fields
+	// which haven't been resolved yet are returned as null with an error, and if they're non-null the
+	// null propagates to the nearest nullable parent the way the spec describes for field errors. The
+	// executor looks up which fields are non-null in the schema from introspection, so if the query
+	// type doesn't support introspection the null is left in place of the field. Fields which are
+	// still running on the Executor at the deadline are abandoned, see Cancellation::waitForAbandoned.
+	std::shared_ptr<Cancellation> cancellation;
+
+	// Optional Tracer for the resolvers in this request.
+	std::shared_ptr<Tracer> tracer;
+
+	// Optional FieldCache for fields with a @cacheControl hint in the schema, which is usually shared
+	// with other requests. Fields with the PRIVATE scope are only cached if cacheScope is also set,
+	// e.g. to the ID of the user, and then they're only shared with requests in the same scope.
+	std::shared_ptr<FieldCache> fieldCache;
+	std::string cacheScope;
+
+	// Opt in to coalescing this request with an identical query operation which is already in flight
+	// in Request::resolveShared. Requests are only coalesced with others in the same shareScope, so set
+	// it if the result depends on anything else in the RequestState, e.g. the user.
+	bool shareable = false;
+	std::string shareScope;
+
+private:
+	friend class Object;
+	friend struct OperationData;
+	friend class Request;
+	friend struct FieldParams;
+
+	template <typename _Type>
+	friend struct ModifiedResult;
+
+	// Request::resolveBatch holds the BatchDispatchers until every operation in the batch has called
+	// the resolvers in its top level selection set, then releases them and dispatches them together.
+	// ModifiedResult does the same while it resolves each of the Objects in a list.
+	void holdBatches();
+	void releaseBatches();
+
+	// Hold onto the Object in the key so its address can't be reused by another Object. The last
+	// member is the canonical form of the arguments followed by the field directives.
+	using FieldMemoKey = std::tuple<std::shared_ptr<const Object>, std::string, std::vector<const peg::ast_node*>, std::string>;
+
+	// Collected fields only depend on the operation (identified by its FragmentMap, which is owned
+	// by the OperationData along with the variables), the type of the Object, and the selection sets.
+	using CollectedFieldsKey = std::tuple<const FragmentMap*, std::string, std::vector<const peg::ast_node*>>;
+	using CollectedFields = std::shared_ptr<const CollectedSelection>;
+
+	// The lookahead for FieldParams::getSelectedFields uses the same key with an empty type.
+	using SelectedFieldsKey = CollectedFieldsKey;
+
+	// Drop the collected fields and lookahead for an operation when its OperationData is destroyed.
+	void releaseCollectedFields(const FragmentMap& fragments);
+
+	std::mutex _batchMutex;
+	std::vector<std::shared_ptr<BatchDispatcher>> _batchDispatchers;
+	size_t _batchHolds = 0;
+	std::unordered_map<std::string, std::shared_ptr<FieldBatch>> _fieldBatches;
+
+	std::mutex _memoMutex;
+	std::map<FieldMemoKey, std::shared_future<response::Value>> _fieldMemo;
+
+	std::mutex _collectedFieldsMutex;
+	std::map<CollectedFieldsKey, CollectedFields> _collectedFields;
+	std::map<SelectedFieldsKey, std::shared_ptr<const SelectedFields>> _selectedFields;
 };
 
 // Pass a common bundle of parameters to all of the generated Object::getField accessors in a SelectionSet
@@ -58,6 +322,24 @@ struct SelectionSetParams
 	// you'll need to explicitly copy them into other instances of response::Value.
 	const response::Value& fragmentSpreadDirectives;
 	const response::Value& inlineFragmentDirectives;
+
+	// These are only set for operations which are being traced or delivered incrementally, otherwise
+	// they're empty. The path to this selection set in the response is set for either of them.
+	ResponsePath path;
+	std::shared_ptr<Tracer> tracer;
+	std::shared_ptr<IncrementalDelivery> incremental;
+
+	// Set if the document passed Request::validate, so the executor can skip the checks which the
+	// validation rules already cover.
+	bool validated;
+
+	// The schema from introspection, which tells the executor which fields are non-null when one of
+	// them is cancelled. It's null if the query type doesn't support introspection.
+	const ValidationSchema* schema;
+
+	// Resolvers can check this before starting any expensive work for a request which was cancelled
+	// or passed its deadline.
+	bool isCancelled() const noexcept;
 };
 
 // Pass a common bundle of parameters to all of the generated Object::getField accessors.
@@ -65,9 +347,28 @@ struct FieldParams : SelectionSetParams
 {
 	explicit FieldParams(const SelectionSetParams& selectionSetParams, response::Value&& directives);
 
+	// The generated resolvers pass the ResolverParams, so the accessors can look ahead at the selection set.
+	explicit FieldParams(const ResolverParams& resolverParams, response::Value&& directives);
+
 	// Each field owns its own field-specific directives. Once the accessor returns it will be destroyed,
 	// but you can move it into another instance of response::Value to keep it alive longer.
 	response::Value fieldDirectives;
+
+	// Look ahead at the fields requested in the selection set of this field, after expanding fragments
+	// and applying @skip and @include, e.g. to only fetch the columns which are needed from storage.
+	// It's computed once for each selection set in the operation and shared through the RequestState.
+	// Fields in fragments are included regardless of their type condition, so if this field returns an
+	// interface or union, it's a superset of the fields which will be resolved. Fragments with different
+	// type conditions may use the same alias for different fields, in which case there's one entry for
+	// each type condition. It's empty for scalar fields, or if the FieldParams were copied from another
+	// SelectionSetParams instead of the ResolverParams.
+	std::shared_ptr<const SelectedFields> getSelectedFields() const;
+
+private:
+	const peg::ast_node* _selection = nullptr;
+	std::vector<const peg::ast_node*> _mergedSelections;
+	const FragmentMap* _fragments = nullptr;
+	const response::Value* _variables = nullptr;
 };
 
 // Fragments are referenced by name and have a single type condition (except for inline
@@ -89,10 +390,6 @@ private:
 	const peg::ast_node& _selection;
 };
 
-// Resolvers for complex types need to be able to find fragment definitions anywhere in
-// the request document by name.
-using FragmentMap = std::unordered_map<std::string, Fragment>;
-
 // Resolver functors take a set of arguments encoded as members on a JSON object
 // with an optional selection set for complex types and return a JSON value for
 // a single field.
@@ -106,15 +403,70 @@ struct ResolverParams : SelectionSetParams
 	response::Value fieldDirectives { response::Type::Map };
 	const peg::ast_node* selection;
 
+	// If the same response key is selected more than once in a selection set, e.g. in different
+	// fragments, the field is only resolved once and this holds all of the sub-selections which
+	// need to be merged, starting with the selection member. Otherwise it's empty.
+	std::vector<const peg::ast_node*> mergedSelections;
+
 	// These values remain unchanged for the entire operation, but they're passed to each of the
 	// resolvers recursively through ResolverParams.
 	const FragmentMap& fragments;
 	const response::Value& variables;
+
+	// Set if the field has an @stream directive in an operation which is delivered incrementally.
+	std::shared_ptr<const StreamDirective> stream;
 };
 
 using Resolver = std::function<std::future<response::Value>(ResolverParams&&)>;
 using ResolverMap = std::unordered_map<std::string, Resolver>;
 
+// Fields marked @batch in the schema queue each of the parent Objects with the ResolverParams for
+// that field, and then the batch resolver is called once with all of them. It must return the
+// results in the same order.
+struct BatchedField
+{
+	std::shared_ptr<const Object> object;
+	ResolverParams params;
+};
+
+using BatchResolver = std::function<std::vector<std::future<response::Value>>(std::vector<BatchedField>&&)>;
+
+// Accessors for list fields marked @lazy in the schema return a LazyList instead of a std::vector, and
+// the entries are pulled from the generator one at a time while the list is converted. The generator
+// is called after the accessor returns, possibly on another thread, so it needs to hold onto anything
+// it uses. It isn't called again once it returns false.
+template <typename _Entry>
+class LazyList
+{
+public:
+	// Move the next entry into the parameter and return true, or return false at the end of the list.
+	using Generator = std::function<bool(_Entry& entry)>;
+
+	explicit LazyList(Generator&& generator = nullptr)
+		: _generator(std::move(generator))
+	{
+	}
+
+	bool next(_Entry& entry)
+	{
+		if (!_generator)
+		{
+			return false;
+		}
+
+		if (!_generator(entry))
+		{
+			_generator = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	Generator _generator;
+};
+
 // Binary data and opaque strings like IDs are encoded in Base64.
 class Base64
 {
@@ -197,26 +549,36 @@ struct ModifiedArgument
 	// Call convert on this type without any modifiers.
 	static _Type require(const std::string& name, const response::Value& arguments)
 	{
+		const auto itr = arguments.find(name);
+
+		if (itr == arguments.end())
+		{
+			throw schema_exception({ missingError(name) });
+		}
+
 		try
 		{
-			return convert(arguments[name]);
+			return convert(itr->second);
 		}
 		catch (const schema_exception& ex)
 		{
-			std::ostringstream error;
-
-			error << "Invalid argument: " << name
-				<< " message: " << ex.getErrors()[0]["message"].get<const response::StringType&>();
-			throw schema_exception({ error.str() });
+			throw schema_exception({ argumentError(name, ex) });
 		}
 	}
 
-	// Wrap require in a try/catch block.
+	// Look for an optional argument and convert it if it's there. Missing arguments don't throw.
 	static std::pair<_Type, bool> find(const std::string& name, const response::Value& arguments) noexcept
 	{
+		const auto itr = arguments.find(name);
+
+		if (itr == arguments.end())
+		{
+			return { _Type{}, false };
+		}
+
 		try
 		{
-			return { require(name, arguments), true };
+			return { convert(itr->second), true };
 		}
 		catch (const std::exception&)
 		{
@@ -225,7 +587,7 @@ struct ModifiedArgument
 	}
 
 	// Peel off the none modifier. If it's included, it should always be last in the list.
-	template <TypeModifier _Modifier = TypeModifier::None , TypeModifier... _Other >
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
 	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0, _Type>::type require(
 		const std::string& name, const response::Value& arguments)
 	{
@@ -233,59 +595,121 @@ struct ModifiedArgument
 		return require(name, arguments);
 	}
 
-	// Peel off nullable modifiers.
+	// Look up the argument once and decode it with all of the modifiers. A missing nullable argument
+	// is the same as an explicit null.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
-	static typename std::enable_if<TypeModifier::Nullable == _Modifier, typename ArgumentTraits<_Type, _Modifier, _Other...>::type>::type require(
+	static typename std::enable_if<TypeModifier::None != _Modifier, typename ArgumentTraits<_Type, _Modifier, _Other...>::type>::type require(
 		const std::string& name, const response::Value& arguments)
 	{
-		const auto& valueItr = arguments.find(name);
+		const auto itr = arguments.find(name);
 
-		if (valueItr == arguments.get<const response::MapType&>().cend()
-			|| valueItr->second.type() == response::Type::Null)
+		if (itr == arguments.end())
 		{
-			return nullptr;
-		}
+			if (TypeModifier::Nullable != _Modifier)
+			{
+				throw schema_exception({ missingError(name) });
+			}
 
-		auto result = require<_Other...>(name, arguments);
+			return decode<_Modifier, _Other...>(response::Value());
+		}
 
-		return std::unique_ptr<decltype(result)> { new decltype(result)(std::move(result)) };
+		try
+		{
+			return decode<_Modifier, _Other...>(itr->second);
+		}
+		catch (const schema_exception& ex)
+		{
+			throw schema_exception({ argumentError(name, ex) });
+		}
 	}
 
-	// Peel off list modifiers.
+	// Look for an optional argument and decode it with all of the modifiers if it's there. Missing
+	// arguments don't throw.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
-	static typename std::enable_if<TypeModifier::List == _Modifier, typename ArgumentTraits<_Type, _Modifier, _Other...>::type>::type require(
-		const std::string& name, const response::Value& arguments)
+	static std::pair<typename ArgumentTraits<_Type, _Modifier, _Other...>::type, bool> find(
+		const std::string& name, const response::Value& arguments) noexcept
 	{
-		const auto& values = arguments[name];
-		typename ArgumentTraits<_Type, _Modifier, _Other...>::type result(values.size());
-		const auto& elements = values.get<const response::ListType&>();
+		const auto itr = arguments.find(name);
 
-		std::transform(elements.cbegin(), elements.cend(), result.begin(),
-			[&name](const response::Value& element)
+		if (itr == arguments.end())
 		{
-			response::Value single(response::Type::Map);
+			return { typename ArgumentTraits<_Type, _Modifier, _Other...>::type{}, false };
+		}
 
-			single.emplace_back(std::string(name), response::Value(element));
+		try
+		{
+			return { decode<_Modifier, _Other...>(itr->second), true };
+		}
+		catch (const std::exception&)
+		{
+			return { typename ArgumentTraits<_Type, _Modifier, _Other...>::type{}, false };
+		}
+	}
 
-			return require<_Other...>(name, single);
-		});
+	// Peel off the none modifier and convert the value.
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0, _Type>::type decode(
+		const response::Value& value)
+	{
+		return convert(value);
+	}
 
-		return result;
+	// Peel off nullable modifiers.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::Nullable == _Modifier, typename ArgumentTraits<_Type, _Modifier, _Other...>::type>::type decode(
+		const response::Value& value)
+	{
+		if (value.type() == response::Type::Null)
+		{
+			return nullptr;
+		}
+
+		auto result = decode<_Other...>(value);
+
+		return std::unique_ptr<decltype(result)> { new decltype(result)(std::move(result)) };
 	}
 
-	// Wrap require with modifiers in a try/catch block.
+	// Peel off list modifiers and decode each of the elements in place.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
-	static std::pair<typename ArgumentTraits<_Type, _Modifier, _Other...>::type, bool> find(
-		const std::string& name, const response::Value& arguments) noexcept
+	static typename std::enable_if<TypeModifier::List == _Modifier, typename ArgumentTraits<_Type, _Modifier, _Other...>::type>::type decode(
+		const response::Value& value)
 	{
-		try
+		if (value.type() != response::Type::List)
 		{
-			return { require<_Modifier, _Other...>(name, arguments), true };
+			throw schema_exception({ "not a list" });
 		}
-		catch (const std::exception&)
+
+		const auto& elements = value.get<const response::ListType&>();
+		typename ArgumentTraits<_Type, _Modifier, _Other...>::type result;
+
+		result.reserve(elements.size());
+
+		for (const auto& element : elements)
 		{
-			return { typename ArgumentTraits<_Type, _Modifier, _Other...>::type{}, false };
+			result.push_back(decode<_Other...>(element));
 		}
+
+		return result;
+	}
+
+	static std::string missingError(const std::string& name)
+	{
+		std::ostringstream error;
+
+		error << "Invalid argument: " << name
+			<< " message: missing value";
+
+		return error.str();
+	}
+
+	static std::string argumentError(const std::string& name, const schema_exception& ex)
+	{
+		std::ostringstream error;
+
+		error << "Invalid argument: " << name
+			<< " message: " << ex.getErrors()[0]["message"].get<const response::StringType&>();
+
+		return error.str();
 	}
 };
 
@@ -303,6 +727,14 @@ using ScalarArgument = ModifiedArgument<response::Value>;
 // name and any inheritted interfaces.
 using TypeNames = std::unordered_set<std::string>;
 
+// Sibling fields in a query can be resolved concurrently on the RequestState Executor, but the top
+// level fields in a mutation must be resolved serially in the order they appear in the operation.
+enum class ExecutionMode
+{
+	Concurrent,
+	Serial,
+};
+
 // Object parses argument values, performs variable lookups, expands fragments, evaluates @include
 // and @skip directives, and calls through to the resolver functor for each selected field with
 // its arguments. This may be a recursive process for fields which return another complex type,
@@ -310,10 +742,18 @@ using TypeNames = std::unordered_set<std::string>;
 class Object : public std::enable_shared_from_this<Object>
 {
 public:
-	explicit Object(TypeNames&& typeNames, ResolverMap&& resolvers);
+	// The typeName is the name of the concrete type, which is reported in traces. It can be omitted if
+	// typeNames only has one entry.
+	explicit Object(TypeNames&& typeNames, ResolverMap&& resolvers, std::string&& typeName = std::string());
 	virtual ~Object() = default;
 
-	std::future<response::Value> resolve(const SelectionSetParams& selectionSetParams, const peg::ast_node& selection, const FragmentMap& fragments, const response::Value& variables) const;
+	std::future<response::Value> resolve(const SelectionSetParams& selectionSetParams, const peg::ast_node& selection, const FragmentMap& fragments, const response::Value& variables,
+		ExecutionMode mode = ExecutionMode::Concurrent) const;
+
+	// Resolve the merged selection sets from every field with the same response key as if they were
+	// a single selection set.
+	std::future<response::Value> resolve(const SelectionSetParams& selectionSetParams, const std::vector<const peg::ast_node*>& selections, const FragmentMap& fragments, const response::Value& variables,
+		ExecutionMode mode = ExecutionMode::Concurrent) const;
 
 	bool matchesType(const std::string& typeName) const;
 
@@ -326,13 +766,47 @@ protected:
 	virtual void beginSelectionSet(const SelectionSetParams& params) const;
 	virtual void endSelectionSet(const SelectionSetParams& params) const;
 
+	// Generated resolvers for fields marked @pure in the schema call through this to share the
+	// result with any other resolution of the same field in the request, see
+	// RequestState::memoizePureFields for what counts as the same field.
+	std::future<response::Value> memoize(const char* fieldName, ResolverParams&& params, Resolver&& resolver) const;
+
+	// Objects with a stable identity across requests, e.g. the ID of a Node, can override this so the
+	// generated resolvers for fields with a @cacheControl hint use the FieldCache in the RequestState.
+	// The default is an empty string, which means the fields on this Object aren't cached.
+	virtual std::string getCacheIdentity() const;
+
+	// Generated resolvers for scalar and enum fields with a @cacheControl(maxAge: Int, scope: PUBLIC |
+	// PRIVATE) hint in the schema call through this to look for the result in the FieldCache before
+	// calling the accessor.
+	std::future<response::Value> cacheField(const char* fieldName, std::chrono::seconds maxAge, CacheScope scope, ResolverParams&& params, Resolver&& resolver) const;
+
+	// Generated resolvers for fields marked @batch in the schema call through this to queue the Object
+	// with every other Object of the same type which selects the field with the same arguments and
+	// directives. The batch resolver is called when the RequestState dispatches the batches, or when
+	// something waits on one of the results.
+	std::future<response::Value> batchField(const char* fieldName, ResolverParams&& params, BatchResolver&& resolver) const;
+
 private:
+	// Resolve the fields which were collected from the selection sets, and queue any @defer fragments
+	// in the IncrementalDelivery to be resolved later.
+	std::future<response::Value> resolveCollected(const SelectionSetParams& selectionSetParams, RequestState::CollectedFields&& fields, const FragmentMap& fragments, const response::Value& variables,
+		ExecutionMode mode) const;
+
 	TypeNames _typeNames;
 	ResolverMap _resolvers;
+	std::string _typeName;
+
+	// Objects with the same set of type names expand fragments the same way, so they can share
+	// the collected fields in the RequestState.
+	std::string _typeKey;
 };
 
 // Convert the result of a resolver function with chained type modifiers that add nullable or
 // list wrappers. This is the inverse of ModifiedArgument for output types instead of input types.
+// Accessors can either return a std::future or, if the field is marked @synchronous in the schema,
+// the value itself. Values which are already available skip the future/promise overhead and are
+// converted to JSON immediately.
 template <typename _Type>
 struct ModifiedResult
 {
@@ -363,119 +837,739 @@ struct ModifiedResult
 			U>::type;
 	};
 
-	// Convert a single value of the specified type to JSON.
-	static std::future<response::Value> convert(
-		typename std::conditional<std::is_base_of<Object, _Type>::value,
-			std::future<std::shared_ptr<Object>>,
-			std::future<typename ResultTraits<_Type>::type>&&>::type result,
-		ResolverParams&& params);
+	// Test for Object in a way that depends on the modifiers, otherwise the overloads which don't
+	// apply to this type would be hard errors instead of being skipped by SFINAE.
+	template <TypeModifier _Modifier>
+	struct IsObject : std::is_base_of<Object, _Type>
+	{
+	};
+
+	// Serialize a single value of the specified type to JSON. This is specialized for the built-in
+	// scalar types in the GraphQLService library and for enum types in the generated code.
+	static response::Value serialize(typename ResultTraits<_Type>::type&& result, const ResolverParams& params);
 
 	// Peel off the none modifier. If it's included, it should always be last in the list.
 	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
-	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0 && !std::is_same<Object, _Type>::value && std::is_base_of<Object, _Type>::value,
-		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type>::type>&& result, ResolverParams&& params)
+	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0 && !std::is_base_of<Object, _Type>::value,
+		response::Value>::type serialize(typename ResultTraits<_Type>::type&& result, const ResolverParams& params)
 	{
-		// Call through to the Object specialization with a static_pointer_cast for subclasses of Object.
-		static_assert(std::is_same<std::shared_ptr<_Type>, typename ResultTraits<_Type>::type>::value, "this is the derived object type");
-		auto resultFuture = std::async(std::launch::deferred,
-			[](std::future<std::shared_ptr<_Type>>&& objectType)
+		// Just call through to the partial specialization without the modifier.
+		return serialize(std::move(result), params);
+	}
+
+	// Peel off nullable modifiers, which should all be std::unique_ptr for anything other than Object.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::Nullable == _Modifier && !std::is_base_of<Object, _Type>::value,
+		response::Value>::type serialize(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
+	{
+		if (!result)
 		{
-			return std::static_pointer_cast<Object>(objectType.get());
-		}, std::move(result));
+			return response::Value();
+		}
 
-		return ModifiedResult<Object>::convert(std::move(resultFuture), std::move(params));
+		return serialize<_Other...>(std::move(*result), params);
 	}
 
-	// Peel off the none modifier. If it's included, it should always be last in the list.
+	// Peel off list modifiers.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::List == _Modifier && !std::is_base_of<Object, _Type>::value,
+		response::Value>::type serialize(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
+	{
+		auto value = response::Value(response::Type::List);
+
+		value.reserve(result.size());
+
+		for (auto& entry : result)
+		{
+			value.emplace_back(serialize<_Other...>(std::move(entry), params));
+		}
+
+		return value;
+	}
+
+	// Anything other than an Object can be serialized as soon as the value is available, so there's
+	// no need to defer it or resolve any sub-selections.
 	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
-	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0 && (std::is_same<Object, _Type>::value || !std::is_base_of<Object, _Type>::value),
-		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type>::type>&& result, ResolverParams&& params)
+	static typename std::enable_if<!IsObject<_Modifier>::value,
+		std::future<response::Value>>::type convert(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
 	{
-		// Just call through to the partial specialization without the modifier.
-		return convert(std::move(result), std::move(params));
+		std::promise<response::Value> promise;
+
+		promise.set_value(serialize<_Modifier, _Other...>(std::move(result), params));
+
+		return promise.get_future();
+	}
+
+	// Wait for the future and then serialize the result.
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
+	static typename std::enable_if<!IsObject<_Modifier>::value,
+		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& result, ResolverParams&& params)
+	{
+		return std::async(std::launch::deferred,
+			[](std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& wrappedFuture, ResolverParams&& wrappedParams)
+		{
+			return serialize<_Modifier, _Other...>(wrappedFuture.get(), wrappedParams);
+		}, std::move(result), std::move(params));
+	}
+
+	// Peel off the none modifier for Object and subclasses of Object and resolve the sub-selection.
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::None == _Modifier && sizeof...(_Other) == 0 && std::is_base_of<Object, _Type>::value,
+		std::future<response::Value>>::type convert(std::shared_ptr<_Type>&& result, const ResolverParams& params)
+	{
+		if (!result || !params.selection)
+		{
+			std::promise<response::Value> promise;
+
+			promise.set_value(response::Value(!result
+				? response::Type::Null
+				: response::Type::Map));
+
+			return promise.get_future();
+		}
+
+		std::shared_ptr<Object> object(std::move(result));
+		auto values = params.mergedSelections.empty()
+			? object->resolve(params, *params.selection, params.fragments, params.variables)
+			: object->resolve(params, params.mergedSelections, params.fragments, params.variables);
+
+		// Keep the object alive until all of the futures for its fields have been resolved.
+		return std::async(std::launch::deferred,
+			[](std::shared_ptr<Object>&&, std::future<response::Value>&& wrappedValues)
+		{
+			return wrappedValues.get();
+		}, std::move(object), std::move(values));
 	}
 
 	// Peel off final nullable modifiers for std::shared_ptr of Object and subclasses of Object.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
 	static typename std::enable_if<TypeModifier::Nullable == _Modifier && std::is_same<std::shared_ptr<_Type>, typename ResultTraits<_Type, _Other...>::type>::value,
-		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& result, ResolverParams&& params)
+		std::future<response::Value>>::type convert(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
+	{
+		if (!result)
+		{
+			std::promise<response::Value> promise;
+
+			promise.set_value(response::Value());
+
+			return promise.get_future();
+		}
+
+		return convert<_Other...>(std::move(result), params);
+	}
+
+	// Peel off nullable modifiers wrapping a list of Object or subclasses of Object, which should
+	// all be std::unique_ptr.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::Nullable == _Modifier && std::is_base_of<Object, _Type>::value
+		&& !std::is_same<std::shared_ptr<_Type>, typename ResultTraits<_Type, _Other...>::type>::value,
+		std::future<response::Value>>::type convert(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
+	{
+		static_assert(std::is_same<std::unique_ptr<typename ResultTraits<_Type, _Other...>::type>, typename ResultTraits<_Type, _Modifier, _Other...>::type>::value,
+			"this is the unique_ptr version");
+
+		if (!result)
+		{
+			std::promise<response::Value> promise;
+
+			promise.set_value(response::Value());
+
+			return promise.get_future();
+		}
+
+		return convert<_Other...>(std::move(*result), params);
+	}
+
+	// Wait for an entry in a list of Object or subclasses of Object. If a non-null field inside of it
+	// was cancelled and the entry is nullable, only the entry is null instead of the whole list.
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier...>
+	static response::Value getEntryValue(std::future<response::Value>&& entry)
+	{
+		if (TypeModifier::Nullable != _Modifier)
+		{
+			return entry.get();
+		}
+
+		try
+		{
+			return entry.get();
+		}
+		catch (const propagated_cancellation&)
+		{
+			return response::Value();
+		}
+	}
+
+	// Peel off list modifiers for Object and subclasses of Object.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::List == _Modifier && std::is_base_of<Object, _Type>::value,
+		std::future<response::Value>>::type convert(typename ResultTraits<_Type, _Modifier, _Other...>::type&& result, const ResolverParams& params)
 	{
+		if (params.stream && params.incremental && result.size() > params.stream->initialCount)
+		{
+			return convertStream<_Other...>(std::move(result), params);
+		}
+
+		const size_t chunkSize = (params.state && params.state->executor)
+			? params.state->listChunkSize
+			: 0;
+
+		if (chunkSize > 0 && result.size() > chunkSize)
+		{
+			return convertChunks<_Other...>(std::move(result), params, chunkSize);
+		}
+
+		std::queue<std::future<response::Value>> children;
+		size_t index = 0;
+
+		// Hold the batches until every Object in the list has called its resolvers, so fields marked
+		// @batch and any BatchLoaders see all of them at once instead of one Object at a time.
+		if (params.state)
+		{
+			params.state->holdBatches();
+		}
+
+		try
+		{
+			for (auto& entry : result)
+			{
+				// Stop resolving the rest of the list if the request was cancelled.
+				if (params.state && params.state->cancellation)
+				{
+					params.state->cancellation->throwIfCancelled();
+				}
+
+				if (params.path)
+				{
+					// Only traced operations pay for copying the params to add the index to the path.
+					ResolverParams entryParams(params);
+
+					entryParams.path = std::make_shared<const PathSegment>(PathSegment { params.path, std::string(), index++ });
+					children.push(convert<_Other...>(std::move(entry), entryParams));
+					continue;
+				}
+
+				children.push(convert<_Other...>(std::move(entry), params));
+			}
+		}
+		catch (...)
+		{
+			if (params.state)
+			{
+				params.state->releaseBatches();
+			}
+
+			throw;
+		}
+
+		if (params.state)
+		{
+			params.state->releaseBatches();
+		}
+
 		return std::async(std::launch::deferred,
-			[](std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& wrappedFuture, ResolverParams&& wrappedParams)
+			[](std::queue<std::future<response::Value>>&& wrappedChildren)
 		{
-			auto wrappedResult = wrappedFuture.get();
+			auto value = response::Value(response::Type::List);
 
-			if (!wrappedResult)
+			value.reserve(wrappedChildren.size());
+
+			while (!wrappedChildren.empty())
 			{
-				return response::Value();
+				value.emplace_back(getEntryValue<_Other...>(std::move(wrappedChildren.front())));
+				wrappedChildren.pop();
+			}
+
+			return value;
+		}, std::move(children));
+	}
+
+	// Resolve the first initialCount entries in a list of Object or subclasses of Object with an @stream
+	// directive in the initial payload, and deliver each of the rest in a separate patch.
+	template <TypeModifier... _Other>
+	static std::future<response::Value> convertStream(std::vector<typename ResultTraits<_Type, _Other...>::type>&& result, const ResolverParams& params)
+	{
+		using entry_type = typename ResultTraits<_Type, _Other...>::type;
+
+		const auto& incremental = params.incremental;
+		const auto& state = incremental->getState();
+		const std::weak_ptr<IncrementalDelivery> weakIncremental(incremental);
+		const auto stream = params.stream;
+		std::shared_ptr<std::array<response::Value, 3>> fragmentDirectives;
+		std::queue<std::future<response::Value>> children;
+
+		for (size_t i = 0; i < result.size(); ++i)
+		{
+			auto entryPath = std::make_shared<const PathSegment>(PathSegment { params.path, std::string(), i });
+
+			if (i < stream->initialCount)
+			{
+				ResolverParams entryParams(params);
+
+				entryParams.path = std::move(entryPath);
+				entryParams.stream.reset();
+				children.push(convert<_Other...>(std::move(result[i]), entryParams));
+				continue;
+			}
+
+			// The patches may be resolved after the caller's ResolverParams are gone, so they borrow
+			// the RequestState from the operation and hold onto their own copy of the fragment directives.
+			// The IncrementalDelivery holds onto the patches, so they only get a weak reference to it.
+			if (!fragmentDirectives)
+			{
+				fragmentDirectives = std::make_shared<std::array<response::Value, 3>>(std::array<response::Value, 3> { {
+					response::Value(params.fragmentDefinitionDirectives),
+					response::Value(params.fragmentSpreadDirectives),
+					response::Value(params.inlineFragmentDirectives)
+					} });
 			}
 
-			std::promise<typename ResultTraits<_Type, _Other...>::type> promise;
+			const SelectionSetParams selectionSetParams {
+				state,
+				params.operationDirectives,
+				(*fragmentDirectives)[0],
+				(*fragmentDirectives)[1],
+				(*fragmentDirectives)[2],
+				entryPath,
+				params.tracer,
+				nullptr,
+				params.validated,
+				params.schema
+			};
+			auto entryParams = std::make_shared<ResolverParams>(selectionSetParams, response::Value(response::Type::Map), response::Value(response::Type::Map),
+				params.selection, params.fragments, params.variables);
+
+			entryParams->mergedSelections = params.mergedSelections;
+			incremental->addStreamedItem(entryPath, stream->label, launchCancellable(state->executor, state->cancellation,
+				[fragmentDirectives, entryParams, weakIncremental](entry_type&& entry)
+			{
+				ResolverParams streamParams(*entryParams);
+
+				streamParams.incremental = weakIncremental.lock();
+
+				// Everything else that entryParams borrows is released along with the IncrementalDelivery.
+				if (!streamParams.incremental)
+				{
+					return response::Value();
+				}
+
+				return getEntryValue<_Other...>(convert<_Other...>(std::move(entry), streamParams));
+			}, std::move(result[i])));
+		}
+
+		return std::async(std::launch::deferred,
+			[](std::queue<std::future<response::Value>>&& wrappedChildren)
+		{
+			auto value = response::Value(response::Type::List);
+
+			value.reserve(wrappedChildren.size());
+
+			while (!wrappedChildren.empty())
+			{
+				value.emplace_back(getEntryValue<_Other...>(std::move(wrappedChildren.front())));
+				wrappedChildren.pop();
+			}
+
+			return value;
+		}, std::move(children));
+	}
+
+	// Split a long list of Object or subclasses of Object into chunks which are resolved on the
+	// Executor, then concatenate the chunks in their original order.
+	template <TypeModifier... _Other>
+	static std::future<response::Value> convertChunks(std::vector<typename ResultTraits<_Type, _Other...>::type>&& result, const ResolverParams& params, size_t chunkSize)
+	{
+		using entries_type = std::vector<typename ResultTraits<_Type, _Other...>::type>;
+
+		// The chunks may still be running after the caller's ResolverParams are gone.
+		auto entries = std::make_shared<entries_type>(std::move(result));
+		auto sharedParams = std::make_shared<ResolverParams>(params);
+		const size_t size = entries->size();
+		std::queue<std::future<response::Value>> chunks;
+
+		for (size_t begin = 0; begin < size; begin += chunkSize)
+		{
+			const size_t end = (size - begin > chunkSize)
+				? begin + chunkSize
+				: size;
+
+			chunks.push(launchCancellable(params.state->executor, params.state->cancellation,
+				[entries, sharedParams, begin, end]()
+			{
+				const auto& cancellation = sharedParams->state->cancellation;
+				auto value = response::Value(response::Type::List);
+
+				value.reserve(end - begin);
+
+				for (size_t i = begin; i < end; ++i)
+				{
+					if (cancellation)
+					{
+						cancellation->throwIfCancelled();
+					}
+
+					if (sharedParams->path)
+					{
+						ResolverParams entryParams(*sharedParams);
+
+						entryParams.path = std::make_shared<const PathSegment>(PathSegment { sharedParams->path, std::string(), i });
+						value.emplace_back(getEntryValue<_Other...>(convert<_Other...>(std::move((*entries)[i]), entryParams)));
+						continue;
+					}
+
+					value.emplace_back(getEntryValue<_Other...>(convert<_Other...>(std::move((*entries)[i]), *sharedParams)));
+				}
+
+				return value;
+			}));
+		}
+
+		return std::async(std::launch::deferred,
+			[size](std::queue<std::future<response::Value>>&& wrappedChunks)
+		{
+			auto value = response::Value(response::Type::List);
+
+			value.reserve(size);
+
+			while (!wrappedChunks.empty())
+			{
+				auto chunk = wrappedChunks.front().get();
+
+				wrappedChunks.pop();
 
-			promise.set_value(std::move(wrappedResult));
+				for (auto& entry : chunk.release<response::ListType>())
+				{
+					value.emplace_back(std::move(entry));
+				}
+			}
+
+			return value;
+		}, std::move(chunks));
+	}
 
-			return convert<_Other...>(promise.get_future(), std::move(wrappedParams)).get();
+	// Wait for the future and then resolve the Object or subclass of Object on the same path as
+	// a value which is already available.
+	template <TypeModifier _Modifier = TypeModifier::None, TypeModifier... _Other>
+	static typename std::enable_if<IsObject<_Modifier>::value,
+		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& result, ResolverParams&& params)
+	{
+		return std::async(std::launch::deferred,
+			[](std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& wrappedFuture, ResolverParams&& wrappedParams)
+		{
+			return convert<_Modifier, _Other...>(wrappedFuture.get(), wrappedParams).get();
 		}, std::move(result), std::move(params));
 	}
 
-	// Peel off nullable modifiers for anything else, which should all be std::unique_ptr.
+	// Pull each entry from the LazyList returned by the accessor for a list field marked @lazy in the
+	// schema and serialize it right away, instead of waiting for the whole list.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
-	static typename std::enable_if<TypeModifier::Nullable == _Modifier && !std::is_same<std::shared_ptr<_Type>, typename ResultTraits<_Type, _Other...>::type>::value,
-		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& result, ResolverParams&& params)
+	static typename std::enable_if<TypeModifier::List == _Modifier && !std::is_base_of<Object, _Type>::value,
+		std::future<response::Value>>::type convertLazy(LazyList<typename ResultTraits<_Type, _Other...>::type>&& result, ResolverParams&& params)
 	{
-		static_assert(std::is_same<std::unique_ptr<typename ResultTraits<_Type, _Other...>::type>, typename ResultTraits<_Type, _Modifier, _Other...>::type>::value,
-			"this is the unique_ptr version");
+		using entry_type = typename ResultTraits<_Type, _Other...>::type;
 
 		return std::async(std::launch::deferred,
-			[](std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& wrappedFuture, ResolverParams&& wrappedParams)
+			[](LazyList<entry_type>&& wrappedResult, ResolverParams&& wrappedParams)
 		{
-			auto wrappedResult = wrappedFuture.get();
+			const auto& state = wrappedParams.state;
+			auto value = response::Value(response::Type::List);
+			entry_type entry {};
 
-			if (!wrappedResult)
+			while (wrappedResult.next(entry))
 			{
-				return response::Value();
+				if (state && state->cancellation)
+				{
+					state->cancellation->throwIfCancelled();
+				}
+
+				value.emplace_back(serialize<_Other...>(std::move(entry), wrappedParams));
 			}
 
-			std::promise<typename ResultTraits<_Type, _Other...>::type> promise;
+			return value;
+		}, std::move(result), std::move(params));
+	}
+
+	// Pull the entries from the LazyList returned by the accessor for a list field of Object or
+	// subclasses of Object marked @lazy in the schema, and resolve them in chunks of listChunkSize.
+	template <TypeModifier _Modifier, TypeModifier... _Other>
+	static typename std::enable_if<TypeModifier::List == _Modifier && std::is_base_of<Object, _Type>::value,
+		std::future<response::Value>>::type convertLazy(LazyList<typename ResultTraits<_Type, _Other...>::type>&& result, ResolverParams&& params)
+	{
+		using entry_type = typename ResultTraits<_Type, _Other...>::type;
+
+		if (params.stream && params.incremental)
+		{
+			return convertLazyStream<_Other...>(std::move(result), params);
+		}
+
+		return std::async(std::launch::deferred,
+			[](LazyList<entry_type>&& wrappedResult, ResolverParams&& wrappedParams)
+		{
+			const auto& state = wrappedParams.state;
+			const size_t chunkSize = (state && state->listChunkSize > 0)
+				? state->listChunkSize
+				: 1;
+			auto value = response::Value(response::Type::List);
+			std::queue<std::future<response::Value>> children;
+			entry_type entry {};
+			bool hasNext = true;
+			size_t index = 0;
 
-			promise.set_value(std::move(*wrappedResult));
+			while (hasNext)
+			{
+				// Hold the batches until every Object in the chunk has called its resolvers.
+				if (state)
+				{
+					state->holdBatches();
+				}
+
+				try
+				{
+					while (children.size() < chunkSize
+						&& (hasNext = wrappedResult.next(entry)))
+					{
+						if (state && state->cancellation)
+						{
+							state->cancellation->throwIfCancelled();
+						}
+
+						if (wrappedParams.path)
+						{
+							ResolverParams entryParams(wrappedParams);
+
+							entryParams.path = std::make_shared<const PathSegment>(PathSegment { wrappedParams.path, std::string(), index++ });
+							children.push(convert<_Other...>(std::move(entry), entryParams));
+							continue;
+						}
+
+						children.push(convert<_Other...>(std::move(entry), wrappedParams));
+					}
+				}
+				catch (...)
+				{
+					if (state)
+					{
+						state->releaseBatches();
+					}
+
+					throw;
+				}
+
+				if (state)
+				{
+					state->releaseBatches();
+				}
+
+				// Finish the chunk before pulling any more entries from the LazyList.
+				while (!children.empty())
+				{
+					value.emplace_back(getEntryValue<_Other...>(std::move(children.front())));
+					children.pop();
+				}
+			}
 
-			return convert<_Other...>(promise.get_future(), std::move(wrappedParams)).get();
+			return value;
 		}, std::move(result), std::move(params));
 	}
 
-	// Peel off list modifiers.
+	// Wait for the future and then convert the LazyList.
 	template <TypeModifier _Modifier, TypeModifier... _Other>
 	static typename std::enable_if<TypeModifier::List == _Modifier,
-		std::future<response::Value>>::type convert(std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& result, ResolverParams&& params)
+		std::future<response::Value>>::type convertLazy(std::future<LazyList<typename ResultTraits<_Type, _Other...>::type>>&& result, ResolverParams&& params)
 	{
 		return std::async(std::launch::deferred,
-			[](std::future<typename ResultTraits<_Type, _Modifier, _Other...>::type>&& wrappedFuture, ResolverParams&& wrappedParams)
+			[](std::future<LazyList<typename ResultTraits<_Type, _Other...>::type>>&& wrappedFuture, ResolverParams&& wrappedParams)
 		{
-			auto wrappedResult = wrappedFuture.get();
-			std::queue<std::future<response::Value>> children;
+			return convertLazy<_Modifier, _Other...>(wrappedFuture.get(), std::move(wrappedParams)).get();
+		}, std::move(result), std::move(params));
+	}
+
+	// Resolve the first initialCount entries in a LazyList with an @stream directive in the initial
+	// payload like convertStream, and then deliver each of the rest in a separate patch. The patch for
+	// each entry pulls the next one from the LazyList when it's done, so the patches don't hold onto
+	// more than one entry at a time.
+	template <TypeModifier... _Other>
+	static std::future<response::Value> convertLazyStream(LazyList<typename ResultTraits<_Type, _Other...>::type>&& result, const ResolverParams& params)
+	{
+		using entry_type = typename ResultTraits<_Type, _Other...>::type;
+
+		const auto& incremental = params.incremental;
+		const auto stream = params.stream;
+		std::queue<std::future<response::Value>> children;
+		entry_type entry {};
+		size_t index = 0;
+
+		while (index < stream->initialCount && result.next(entry))
+		{
+			ResolverParams entryParams(params);
 
-			for (auto& entry : wrappedResult)
+			entryParams.path = std::make_shared<const PathSegment>(PathSegment { params.path, std::string(), index++ });
+			entryParams.stream.reset();
+			children.push(convert<_Other...>(std::move(entry), entryParams));
+		}
+
+		if (index == stream->initialCount && result.next(entry))
+		{
+			auto fragmentDirectives = std::make_shared<std::array<response::Value, 3>>(std::array<response::Value, 3> { {
+				response::Value(params.fragmentDefinitionDirectives),
+				response::Value(params.fragmentSpreadDirectives),
+				response::Value(params.inlineFragmentDirectives)
+				} });
+			const SelectionSetParams selectionSetParams {
+				incremental->getState(),
+				params.operationDirectives,
+				(*fragmentDirectives)[0],
+				(*fragmentDirectives)[1],
+				(*fragmentDirectives)[2],
+				params.path,
+				params.tracer,
+				nullptr,
+				params.validated,
+				params.schema
+			};
+			auto listParams = std::make_shared<ResolverParams>(selectionSetParams, response::Value(response::Type::Map), response::Value(response::Type::Map),
+				params.selection, params.fragments, params.variables);
+
+			listParams->mergedSelections = params.mergedSelections;
+			listParams->stream = stream;
+			addLazyStreamedItem<_Other...>(incremental, std::make_shared<LazyList<entry_type>>(std::move(result)), std::move(fragmentDirectives), std::move(listParams),
+				index, std::move(entry));
+		}
+
+		return std::async(std::launch::deferred,
+			[](std::queue<std::future<response::Value>>&& wrappedChildren)
+		{
+			auto value = response::Value(response::Type::List);
+
+			value.reserve(wrappedChildren.size());
+
+			while (!wrappedChildren.empty())
 			{
-				std::promise<typename ResultTraits<_Type, _Other...>::type> promise;
+				value.emplace_back(getEntryValue<_Other...>(std::move(wrappedChildren.front())));
+				wrappedChildren.pop();
+			}
+
+			return value;
+		}, std::move(children));
+	}
 
-				promise.set_value(std::move(entry));
+	// Add the patch for one of the entries after the initialCount in a LazyList with an @stream directive.
+	// The listParams borrow the fragment directives from the shared array, so the patch holds onto both.
+	// The IncrementalDelivery holds onto the patch, so the patch only gets a weak reference to it.
+	template <TypeModifier... _Other>
+	static void addLazyStreamedItem(const std::shared_ptr<IncrementalDelivery>& incremental, std::shared_ptr<LazyList<typename ResultTraits<_Type, _Other...>::type>> result,
+		std::shared_ptr<std::array<response::Value, 3>> fragmentDirectives, std::shared_ptr<const ResolverParams> listParams, size_t index, typename ResultTraits<_Type, _Other...>::type&& entry)
+	{
+		using entry_type = typename ResultTraits<_Type, _Other...>::type;
+
+		const auto& state = incremental->getState();
+		const std::weak_ptr<IncrementalDelivery> weakIncremental(incremental);
+		auto entryPath = std::make_shared<const PathSegment>(PathSegment { listParams->path, std::string(), index });
+		const SelectionSetParams selectionSetParams {
+			state,
+			listParams->operationDirectives,
+			listParams->fragmentDefinitionDirectives,
+			listParams->fragmentSpreadDirectives,
+			listParams->inlineFragmentDirectives,
+			entryPath,
+			listParams->tracer,
+			nullptr,
+			listParams->validated,
+			listParams->schema
+		};
+		auto entryParams = std::make_shared<ResolverParams>(selectionSetParams, response::Value(response::Type::Map), response::Value(response::Type::Map),
+			listParams->selection, listParams->fragments, listParams->variables);
+
+		entryParams->mergedSelections = listParams->mergedSelections;
+		incremental->addStreamedItem(entryPath, listParams->stream->label, launchCancellable(state->executor, state->cancellation,
+			[result, fragmentDirectives, listParams, entryParams, index, weakIncremental](entry_type&& wrappedEntry)
+		{
+			ResolverParams streamParams(*entryParams);
 
-				children.push(convert<_Other...>(promise.get_future(), ResolverParams(wrappedParams)));
+			streamParams.incremental = weakIncremental.lock();
+
+			// Everything else that entryParams borrows is released along with the IncrementalDelivery.
+			if (!streamParams.incremental)
+			{
+				return response::Value();
 			}
 
-			auto value = response::Value(response::Type::List);
+			std::exception_ptr error;
+			response::Value value;
+
+			try
+			{
+				value = getEntryValue<_Other...>(convert<_Other...>(std::move(wrappedEntry), streamParams));
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
 
-			value.reserve(wrappedResult.size());
+			// Keep pulling entries even if this one failed, each of them is delivered in its own patch.
+			entry_type next {};
+
+			if (result->next(next))
+			{
+				addLazyStreamedItem<_Other...>(streamParams.incremental, result, fragmentDirectives, listParams, index + 1, std::move(next));
+			}
 
-			while (!children.empty())
+			if (error)
 			{
-				value.emplace_back(children.front().get());
-				children.pop();
+				std::rethrow_exception(error);
 			}
 
 			return value;
-		}, std::move(result), std::move(params));
+		}, std::move(entry)));
+	}
+
+	// Split the results from the accessor for a field marked @batch in the schema, and convert each of
+	// them with the ResolverParams for its parent Object.
+	template <TypeModifier... _Modifiers>
+	static std::vector<std::future<response::Value>> convertBatch(std::future<std::vector<typename ResultTraits<_Type, _Modifiers...>::type>>&& result, std::vector<BatchedField>&& fields)
+	{
+		using values_type = std::vector<typename ResultTraits<_Type, _Modifiers...>::type>;
+
+		// Each of the entries moves its own value out of the shared vector once the accessor is done.
+		auto values = std::make_shared<values_type>();
+		const size_t size = fields.size();
+		auto ready = std::async(std::launch::deferred,
+			[values, size](std::future<values_type>&& wrappedResult)
+		{
+			*values = wrappedResult.get();
+
+			if (values->size() != size)
+			{
+				throw schema_exception({ "Batch accessor returned the wrong number of results" });
+			}
+		}, std::move(result)).share();
+		std::vector<std::future<response::Value>> entries;
+
+		entries.reserve(size);
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			entries.push_back(std::async(std::launch::deferred,
+				[values, ready, i](ResolverParams&& wrappedParams)
+			{
+				ready.get();
+
+				return convert<_Modifiers...>(std::move((*values)[i]), wrappedParams).get();
+			}, std::move(fields[i].params)));
+		}
+
+		return entries;
+	}
+
+	// Batch accessors for fields marked @synchronous return the results directly.
+	template <TypeModifier... _Modifiers>
+	static std::vector<std::future<response::Value>> convertBatch(std::vector<typename ResultTraits<_Type, _Modifiers...>::type>&& result, std::vector<BatchedField>&& fields)
+	{
+		std::promise<std::vector<typename ResultTraits<_Type, _Modifiers...>::type>> promise;
+
+		promise.set_value(std::move(result));
+
+		return convertBatch<_Modifiers...>(promise.get_future(), std::move(fields));
 	}
 };
 
@@ -513,11 +1607,14 @@ struct OperationData : std::enable_shared_from_this<OperationData>
 {
 	explicit OperationData(std::shared_ptr<RequestState>&& state, response::Value&& variables,
 		response::Value&& directives, FragmentMap&& fragments);
+	~OperationData();
 
 	std::shared_ptr<RequestState> state;
 	response::Value variables;
 	response::Value directives;
 	FragmentMap fragments;
+	bool validated = false;
+	std::shared_ptr<const ValidationSchema> schema;
 };
 
 // Subscription callbacks receive the response::Value representing the result of evaluating the
@@ -545,17 +1642,86 @@ struct SubscriptionData : std::enable_shared_from_this<SubscriptionData>
 	const peg::ast_node& selection;
 };
 
+// Cost weights for fields which are more or less expensive than the default, keyed by the type name
+// and the field name separated by a '.', e.g. "Query.appointments". Without a weight, fields which
+// return an object cost 1 and fields which return a scalar or enum are free. The weights come from
+// the @cost(weight: Int) directive in the schema, and schemagen passes them to the Request.
+using FieldCosts = std::unordered_map<std::string, size_t>;
+
+// Static estimate of how expensive an operation will be to execute.
+struct QueryCost
+{
+	// The number of levels of nested fields in the operation.
+	size_t depth = 0;
+
+	// The sum of the weights of every field, multiplied by the number of times it could be resolved.
+	size_t complexity = 0;
+};
+
+// One of the operations sent together to Request::resolveBatch. The AST is borrowed, so it must outlive
+// the std::future for the batch.
+struct BatchedOperation
+{
+	const peg::ast_node& root;
+	std::string operationName;
+	response::Value variables;
+};
+
 // Request scans the fragment definitions and finds the right operation definition to interpret
 // depending on the operation name (which might be empty for a single-operation document). It
 // also needs the values of the request variables.
 class Request : public std::enable_shared_from_this<Request>
 {
 public:
-	explicit Request(TypeMap&& operationTypes);
+	explicit Request(TypeMap&& operationTypes, FieldCosts&& fieldCosts = FieldCosts());
 	virtual ~Request() = default;
 
 	std::future<response::Value> resolve(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables) const;
 
+	// Resolve an operation with @defer fragments and @stream list fields incrementally. The callback
+	// receives the initial payload as soon as everything else in the operation has been resolved,
+	// and then a patch for each of the deferred fragments and streamed list entries. The future is
+	// ready once the last payload has been delivered, and the AST must stay alive until then.
+	std::future<void> resolveIncremental(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+		IncrementalCallback&& callback) const;
+
+	// Resolve several operations which were sent together with the same RequestState, so BatchLoaders
+	// and memoized fields are shared by all of them. The operations run concurrently on the Executor
+	// in the RequestState if it has one, and the result is a list of the response to each operation
+	// in the same order. Invalid operations only report errors in their own response.
+	std::future<response::Value> resolveBatch(const std::shared_ptr<RequestState>& state, std::vector<BatchedOperation>&& operations) const;
+
+	// Opt in to caching the serialized response to a public, read-only query operation for maxAge, or
+	// until one of the tags is invalidated in the ResponseCache. The key combines the text of the
+	// document, the operation name, and the variables, so a hit skips validation, execution, and
+	// serialization and shares the same buffer with every other hit. Responses with errors aren't
+	// cached, and mutations are always executed.
+	std::future<std::shared_ptr<const std::string>> resolveCached(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+		const std::shared_ptr<ResponseCache>& cache, std::chrono::seconds maxAge, std::vector<std::string>&& tags = std::vector<std::string>()) const;
+
+	// Attach shareable requests for a query operation to an identical one (same shareScope, document,
+	// operation name, and variables) which is already in flight, and share its result. The execution
+	// uses the RequestState from the first request, and any of the requests may end up running it,
+	// so this takes shared ownership of the document instead of borrowing it. Use the aliasing
+	// constructor of std::shared_ptr to point at the root of a peg::ast which it keeps alive. Requests
+	// which aren't shareable, have a Cancellation, or aren't queries are resolved on their own.
+	std::future<response::Value> resolveShared(const std::shared_ptr<RequestState>& state, const std::shared_ptr<const peg::ast_node>& root, const std::string& operationName, response::Value&& variables) const;
+
+	// Check the document against the validation rules in the spec before executing any of it, and
+	// throw a schema_exception with all of the errors if it's invalid, or if it's nested too deeply to
+	// validate. The result is cached for each document, so a document which is requested repeatedly is
+	// only validated the first time. Returns false if the query type doesn't support introspection, so
+	// there's nothing to validate against.
+	bool validate(const peg::ast_node& root) const;
+
+	// Estimate the depth and complexity of an operation in a valid document without executing it, e.g.
+	// to deprioritize expensive operations. Fields with a list type multiply the cost of everything in
+	// their selection set by the first or last argument on the field or the connection which contains
+	// them, or by the defaultListSize in the RequestState. If the query type doesn't support
+	// introspection, there's no schema to analyze and this returns 0 for both. Throws a
+	// schema_exception if the document is nested too deeply to analyze.
+	QueryCost analyzeCost(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, const response::Value& variables) const;
+
 	SubscriptionKey subscribe(SubscriptionParams&& params, SubscriptionCallback&& callback);
 	void unsubscribe(SubscriptionKey key);
 
@@ -564,7 +1730,23 @@ public:
 	void deliver(const SubscriptionName& name, const SubscriptionFilterCallback& apply, const std::shared_ptr<Object>& subscriptionObject) const;
 
 private:
+	// Validate the document and check the cost limits in the RequestState before executing it.
+	std::future<response::Value> admit(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+		const std::shared_ptr<IncrementalDelivery>& incremental) const;
+	std::future<response::Value> execute(const std::shared_ptr<RequestState>& state, const peg::ast_node& root, const std::string& operationName, response::Value&& variables,
+		const std::shared_ptr<IncrementalDelivery>& incremental = nullptr, bool validated = false) const;
+
+	// The execution shared by the requests coalesced in resolveShared, it stops accepting new requests
+	// once it's complete or all of the requests have released their std::future.
+	struct SharedFlight;
+
 	TypeMap _operations;
+	std::shared_ptr<const ValidationSchema> _validation;
+	const FieldCosts _fieldCosts;
+	mutable std::mutex _validationMutex;
+	mutable std::unordered_map<std::string, std::vector<std::string>> _validationResults;
+	mutable std::mutex _flightsMutex;
+	mutable std::unordered_map<std::string, std::weak_ptr<SharedFlight>> _flights;
 	std::map<SubscriptionKey, std::shared_ptr<SubscriptionData>> _subscriptions;
 	std::unordered_map<SubscriptionName, std::set<SubscriptionKey>> _listeners;
 	SubscriptionKey _nextKey = 0;
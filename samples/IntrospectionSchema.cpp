@@ -43,7 +43,7 @@ introspection::__TypeKind ModifiedArgument<introspection::__TypeKind>::convert(c
 }
 
 template <>
-std::future<response::Value> ModifiedResult<introspection::__TypeKind>::convert(std::future<introspection::__TypeKind>&& value, ResolverParams&&)
+response::Value ModifiedResult<introspection::__TypeKind>::serialize(introspection::__TypeKind&& value, const ResolverParams&)
 {
 	static const std::string s_names[] = {
 		"SCALAR",
@@ -56,13 +56,11 @@ std::future<response::Value> ModifiedResult<introspection::__TypeKind>::convert(
 		"NON_NULL"
 	};
 
-	std::promise<response::Value> promise;
 	response::Value result(response::Type::EnumValue);
 
-	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value.get())]));
-	promise.set_value(std::move(result));
+	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value)]));
 
-	return promise.get_future();
+	return result;
 }
 
 template <>
@@ -105,7 +103,7 @@ introspection::__DirectiveLocation ModifiedArgument<introspection::__DirectiveLo
 }
 
 template <>
-std::future<response::Value> ModifiedResult<introspection::__DirectiveLocation>::convert(std::future<introspection::__DirectiveLocation>&& value, ResolverParams&&)
+response::Value ModifiedResult<introspection::__DirectiveLocation>::serialize(introspection::__DirectiveLocation&& value, const ResolverParams&)
 {
 	static const std::string s_names[] = {
 		"QUERY",
@@ -128,13 +126,11 @@ std::future<response::Value> ModifiedResult<introspection::__DirectiveLocation>:
 		"INPUT_FIELD_DEFINITION"
 	};
 
-	std::promise<response::Value> promise;
 	response::Value result(response::Type::EnumValue);
 
-	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value.get())]));
-	promise.set_value(std::move(result));
+	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value)]));
 
-	return promise.get_future();
+	return result;
 }
 
 } /* namespace service */
@@ -152,7 +148,7 @@ __Schema::__Schema()
 		{ "subscriptionType", [this](service::ResolverParams&& params) { return resolveSubscriptionType(std::move(params)); } },
 		{ "directives", [this](service::ResolverParams&& params) { return resolveDirectives(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__Schema")
 {
 }
 
@@ -214,7 +210,7 @@ __Type::__Type()
 		{ "inputFields", [this](service::ResolverParams&& params) { return resolveInputFields(std::move(params)); } },
 		{ "ofType", [this](service::ResolverParams&& params) { return resolveOfType(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__Type")
 {
 }
 
@@ -241,7 +237,7 @@ std::future<response::Value> __Type::resolveDescription(service::ResolverParams&
 
 std::future<response::Value> __Type::resolveFields(service::ResolverParams&& params)
 {
-	const auto defaultArguments = []()
+	static const auto defaultArguments = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -277,7 +273,7 @@ std::future<response::Value> __Type::resolvePossibleTypes(service::ResolverParam
 
 std::future<response::Value> __Type::resolveEnumValues(service::ResolverParams&& params)
 {
-	const auto defaultArguments = []()
+	static const auto defaultArguments = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -331,7 +327,7 @@ __Field::__Field()
 		{ "isDeprecated", [this](service::ResolverParams&& params) { return resolveIsDeprecated(std::move(params)); } },
 		{ "deprecationReason", [this](service::ResolverParams&& params) { return resolveDeprecationReason(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__Field")
 {
 }
 
@@ -395,7 +391,7 @@ __InputValue::__InputValue()
 		{ "type", [this](service::ResolverParams&& params) { return resolveType(std::move(params)); } },
 		{ "defaultValue", [this](service::ResolverParams&& params) { return resolveDefaultValue(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__InputValue")
 {
 }
 
@@ -445,7 +441,7 @@ __EnumValue::__EnumValue()
 		{ "isDeprecated", [this](service::ResolverParams&& params) { return resolveIsDeprecated(std::move(params)); } },
 		{ "deprecationReason", [this](service::ResolverParams&& params) { return resolveDeprecationReason(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__EnumValue")
 {
 }
 
@@ -495,7 +491,7 @@ __Directive::__Directive()
 		{ "locations", [this](service::ResolverParams&& params) { return resolveLocations(std::move(params)); } },
 		{ "args", [this](service::ResolverParams&& params) { return resolveArgs(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "__Directive")
 {
 }
 
@@ -41,7 +41,7 @@ today::TaskState ModifiedArgument<today::TaskState>::convert(const response::Val
 }
 
 template <>
-std::future<response::Value> ModifiedResult<today::TaskState>::convert(std::future<today::TaskState>&& value, ResolverParams&&)
+response::Value ModifiedResult<today::TaskState>::serialize(today::TaskState&& value, const ResolverParams&)
 {
 	static const std::string s_names[] = {
 		"New",
@@ -50,19 +50,17 @@ std::future<response::Value> ModifiedResult<today::TaskState>::convert(std::futu
 		"Unassigned"
 	};
 
-	std::promise<response::Value> promise;
 	response::Value result(response::Type::EnumValue);
 
-	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value.get())]));
-	promise.set_value(std::move(result));
+	result.set<response::StringType>(std::string(s_names[static_cast<size_t>(value)]));
 
-	return promise.get_future();
+	return result;
 }
 
 template <>
 today::CompleteTaskInput ModifiedArgument<today::CompleteTaskInput>::convert(const response::Value& value)
 {
-	const auto defaultValue = []()
+	static const auto defaultValue = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -96,18 +94,18 @@ Query::Query()
 	: service::Object({
 		"Query"
 	}, {
-		{ "node", [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); } },
+		{ "node", [this](service::ResolverParams&& params) { return memoize("node", std::move(params), [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); }); } },
 		{ "appointments", [this](service::ResolverParams&& params) { return resolveAppointments(std::move(params)); } },
 		{ "tasks", [this](service::ResolverParams&& params) { return resolveTasks(std::move(params)); } },
 		{ "unreadCounts", [this](service::ResolverParams&& params) { return resolveUnreadCounts(std::move(params)); } },
-		{ "appointmentsById", [this](service::ResolverParams&& params) { return resolveAppointmentsById(std::move(params)); } },
-		{ "tasksById", [this](service::ResolverParams&& params) { return resolveTasksById(std::move(params)); } },
-		{ "unreadCountsById", [this](service::ResolverParams&& params) { return resolveUnreadCountsById(std::move(params)); } },
+		{ "appointmentsById", [this](service::ResolverParams&& params) { return memoize("appointmentsById", std::move(params), [this](service::ResolverParams&& params) { return resolveAppointmentsById(std::move(params)); }); } },
+		{ "tasksById", [this](service::ResolverParams&& params) { return memoize("tasksById", std::move(params), [this](service::ResolverParams&& params) { return resolveTasksById(std::move(params)); }); } },
+		{ "unreadCountsById", [this](service::ResolverParams&& params) { return memoize("unreadCountsById", std::move(params), [this](service::ResolverParams&& params) { return resolveUnreadCountsById(std::move(params)); }); } },
 		{ "nested", [this](service::ResolverParams&& params) { return resolveNested(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } },
 		{ "__schema", [this](service::ResolverParams&& params) { return resolve__schema(std::move(params)); } },
 		{ "__type", [this](service::ResolverParams&& params) { return resolve__type(std::move(params)); } }
-	})
+	}, "Query")
 	, _schema(std::make_shared<introspection::Schema>())
 {
 	introspection::AddTypesToSchema(_schema);
@@ -157,7 +155,7 @@ std::future<response::Value> Query::resolveUnreadCounts(service::ResolverParams&
 
 std::future<response::Value> Query::resolveAppointmentsById(service::ResolverParams&& params)
 {
-	const auto defaultArguments = []()
+	static const auto defaultArguments = []()
 	{
 		response::Value values(response::Type::Map);
 		response::Value entry;
@@ -190,7 +188,7 @@ std::future<response::Value> Query::resolveTasksById(service::ResolverParams&& p
 	auto argIds = service::ModifiedArgument<std::vector<uint8_t>>::require<service::TypeModifier::List>("ids", params.arguments);
 	auto result = getTasksById(service::FieldParams(params, std::move(params.fieldDirectives)), std::move(argIds));
 
-	return service::ModifiedResult<Task>::convert<service::TypeModifier::List, service::TypeModifier::Nullable>(std::move(result), std::move(params));
+	return service::ModifiedResult<Task>::convertLazy<service::TypeModifier::List, service::TypeModifier::Nullable>(std::move(result), std::move(params));
 }
 
 std::future<response::Value> Query::resolveUnreadCountsById(service::ResolverParams&& params)
@@ -243,7 +241,7 @@ PageInfo::PageInfo()
 		{ "hasNextPage", [this](service::ResolverParams&& params) { return resolveHasNextPage(std::move(params)); } },
 		{ "hasPreviousPage", [this](service::ResolverParams&& params) { return resolveHasPreviousPage(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "PageInfo")
 {
 }
 
@@ -277,7 +275,7 @@ AppointmentEdge::AppointmentEdge()
 		{ "node", [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); } },
 		{ "cursor", [this](service::ResolverParams&& params) { return resolveCursor(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "AppointmentEdge")
 {
 }
 
@@ -311,7 +309,7 @@ AppointmentConnection::AppointmentConnection()
 		{ "pageInfo", [this](service::ResolverParams&& params) { return resolvePageInfo(std::move(params)); } },
 		{ "edges", [this](service::ResolverParams&& params) { return resolveEdges(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "AppointmentConnection")
 {
 }
 
@@ -345,7 +343,7 @@ TaskEdge::TaskEdge()
 		{ "node", [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); } },
 		{ "cursor", [this](service::ResolverParams&& params) { return resolveCursor(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "TaskEdge")
 {
 }
 
@@ -379,7 +377,7 @@ TaskConnection::TaskConnection()
 		{ "pageInfo", [this](service::ResolverParams&& params) { return resolvePageInfo(std::move(params)); } },
 		{ "edges", [this](service::ResolverParams&& params) { return resolveEdges(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "TaskConnection")
 {
 }
 
@@ -413,7 +411,7 @@ FolderEdge::FolderEdge()
 		{ "node", [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); } },
 		{ "cursor", [this](service::ResolverParams&& params) { return resolveCursor(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "FolderEdge")
 {
 }
 
@@ -447,7 +445,7 @@ FolderConnection::FolderConnection()
 		{ "pageInfo", [this](service::ResolverParams&& params) { return resolvePageInfo(std::move(params)); } },
 		{ "edges", [this](service::ResolverParams&& params) { return resolveEdges(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "FolderConnection")
 {
 }
 
@@ -481,7 +479,7 @@ CompleteTaskPayload::CompleteTaskPayload()
 		{ "task", [this](service::ResolverParams&& params) { return resolveTask(std::move(params)); } },
 		{ "clientMutationId", [this](service::ResolverParams&& params) { return resolveClientMutationId(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "CompleteTaskPayload")
 {
 }
 
@@ -514,7 +512,7 @@ Mutation::Mutation()
 	}, {
 		{ "completeTask", [this](service::ResolverParams&& params) { return resolveCompleteTask(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "Mutation")
 {
 }
 
@@ -542,7 +540,7 @@ Subscription::Subscription()
 		{ "nextAppointmentChange", [this](service::ResolverParams&& params) { return resolveNextAppointmentChange(std::move(params)); } },
 		{ "nodeChange", [this](service::ResolverParams&& params) { return resolveNodeChange(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "Subscription")
 {
 }
 
@@ -577,10 +575,10 @@ Appointment::Appointment()
 	}, {
 		{ "id", [this](service::ResolverParams&& params) { return resolveId(std::move(params)); } },
 		{ "when", [this](service::ResolverParams&& params) { return resolveWhen(std::move(params)); } },
-		{ "subject", [this](service::ResolverParams&& params) { return resolveSubject(std::move(params)); } },
+		{ "subject", [this](service::ResolverParams&& params) { return cacheField("subject", std::chrono::seconds(60), service::CacheScope::Public, std::move(params), [this](service::ResolverParams&& params) { return resolveSubject(std::move(params)); }); } },
 		{ "isNow", [this](service::ResolverParams&& params) { return resolveIsNow(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "Appointment")
 {
 }
 
@@ -630,7 +628,7 @@ Task::Task()
 		{ "title", [this](service::ResolverParams&& params) { return resolveTitle(std::move(params)); } },
 		{ "isComplete", [this](service::ResolverParams&& params) { return resolveIsComplete(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "Task")
 {
 }
 
@@ -670,10 +668,10 @@ Folder::Folder()
 		"Folder"
 	}, {
 		{ "id", [this](service::ResolverParams&& params) { return resolveId(std::move(params)); } },
-		{ "name", [this](service::ResolverParams&& params) { return resolveName(std::move(params)); } },
-		{ "unreadCount", [this](service::ResolverParams&& params) { return resolveUnreadCount(std::move(params)); } },
+		{ "name", [this](service::ResolverParams&& params) { return cacheField("name", std::chrono::seconds(60), service::CacheScope::Public, std::move(params), [this](service::ResolverParams&& params) { return resolveName(std::move(params)); }); } },
+		{ "unreadCount", [this](service::ResolverParams&& params) { return batchField("unreadCount", std::move(params), [](std::vector<service::BatchedField>&& fields) { return resolveUnreadCount(std::move(fields)); }); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "Folder")
 {
 }
 
@@ -691,11 +689,21 @@ std::future<response::Value> Folder::resolveName(service::ResolverParams&& param
 	return service::ModifiedResult<response::StringType>::convert<service::TypeModifier::Nullable>(std::move(result), std::move(params));
 }
 
-std::future<response::Value> Folder::resolveUnreadCount(service::ResolverParams&& params)
+std::vector<std::future<response::Value>> Folder::resolveUnreadCount(std::vector<service::BatchedField>&& fields)
 {
-	auto result = getUnreadCount(service::FieldParams(params, std::move(params.fieldDirectives)));
+	auto& params = fields.front().params;
+	std::vector<const Folder*> parents;
 
-	return service::ModifiedResult<response::IntType>::convert(std::move(result), std::move(params));
+	parents.reserve(fields.size());
+
+	for (const auto& field : fields)
+	{
+		parents.push_back(static_cast<const Folder*>(field.object.get()));
+	}
+
+	auto result = parents.front()->getUnreadCount(service::FieldParams(params, std::move(params.fieldDirectives)), parents);
+
+	return service::ModifiedResult<response::IntType>::convertBatch(std::move(result), std::move(fields));
 }
 
 std::future<response::Value> Folder::resolve__typename(service::ResolverParams&&)
@@ -714,7 +722,7 @@ NestedType::NestedType()
 		{ "depth", [this](service::ResolverParams&& params) { return resolveDepth(std::move(params)); } },
 		{ "nested", [this](service::ResolverParams&& params) { return resolveNested(std::move(params)); } },
 		{ "__typename", [this](service::ResolverParams&& params) { return resolve__typename(std::move(params)); } }
-	})
+	}, "NestedType")
 {
 }
 
@@ -748,6 +756,10 @@ Operations::Operations(std::shared_ptr<object::Query> query, std::shared_ptr<obj
 		{ "query", query },
 		{ "mutation", mutation },
 		{ "subscription", subscription }
+	}, {
+		{ "Query.appointments", 2 },
+		{ "Query.tasks", 2 },
+		{ "Query.unreadCounts", 2 }
 	})
 	, _query(std::move(query))
 	, _mutation(std::move(mutation))
@@ -56,7 +56,7 @@ class NestedType;
 
 struct Node
 {
-	virtual std::future<std::vector<uint8_t>> getId(service::FieldParams&& params) const = 0;
+	virtual std::vector<uint8_t> getId(service::FieldParams&& params) const = 0;
 };
 
 namespace object {
@@ -73,7 +73,7 @@ public:
 	virtual std::future<std::shared_ptr<TaskConnection>> getTasks(service::FieldParams&& params, std::unique_ptr<response::IntType>&& firstArg, std::unique_ptr<response::Value>&& afterArg, std::unique_ptr<response::IntType>&& lastArg, std::unique_ptr<response::Value>&& beforeArg) const = 0;
 	virtual std::future<std::shared_ptr<FolderConnection>> getUnreadCounts(service::FieldParams&& params, std::unique_ptr<response::IntType>&& firstArg, std::unique_ptr<response::Value>&& afterArg, std::unique_ptr<response::IntType>&& lastArg, std::unique_ptr<response::Value>&& beforeArg) const = 0;
 	virtual std::future<std::vector<std::shared_ptr<Appointment>>> getAppointmentsById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& idsArg) const = 0;
-	virtual std::future<std::vector<std::shared_ptr<Task>>> getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& idsArg) const = 0;
+	virtual std::future<service::LazyList<std::shared_ptr<Task>>> getTasksById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& idsArg) const = 0;
 	virtual std::future<std::vector<std::shared_ptr<Folder>>> getUnreadCountsById(service::FieldParams&& params, std::vector<std::vector<uint8_t>>&& idsArg) const = 0;
 	virtual std::future<std::shared_ptr<NestedType>> getNested(service::FieldParams&& params) const = 0;
 
@@ -101,8 +101,8 @@ protected:
 	PageInfo();
 
 public:
-	virtual std::future<response::BooleanType> getHasNextPage(service::FieldParams&& params) const = 0;
-	virtual std::future<response::BooleanType> getHasPreviousPage(service::FieldParams&& params) const = 0;
+	virtual response::BooleanType getHasNextPage(service::FieldParams&& params) const = 0;
+	virtual response::BooleanType getHasPreviousPage(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveHasNextPage(service::ResolverParams&& params);
@@ -118,8 +118,8 @@ protected:
 	AppointmentEdge();
 
 public:
-	virtual std::future<std::shared_ptr<Appointment>> getNode(service::FieldParams&& params) const = 0;
-	virtual std::future<response::Value> getCursor(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<Appointment> getNode(service::FieldParams&& params) const = 0;
+	virtual response::Value getCursor(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveNode(service::ResolverParams&& params);
@@ -135,8 +135,8 @@ protected:
 	AppointmentConnection();
 
 public:
-	virtual std::future<std::shared_ptr<PageInfo>> getPageInfo(service::FieldParams&& params) const = 0;
-	virtual std::future<std::unique_ptr<std::vector<std::shared_ptr<AppointmentEdge>>>> getEdges(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<PageInfo> getPageInfo(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<std::vector<std::shared_ptr<AppointmentEdge>>> getEdges(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolvePageInfo(service::ResolverParams&& params);
@@ -152,8 +152,8 @@ protected:
 	TaskEdge();
 
 public:
-	virtual std::future<std::shared_ptr<Task>> getNode(service::FieldParams&& params) const = 0;
-	virtual std::future<response::Value> getCursor(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<Task> getNode(service::FieldParams&& params) const = 0;
+	virtual response::Value getCursor(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveNode(service::ResolverParams&& params);
@@ -169,8 +169,8 @@ protected:
 	TaskConnection();
 
 public:
-	virtual std::future<std::shared_ptr<PageInfo>> getPageInfo(service::FieldParams&& params) const = 0;
-	virtual std::future<std::unique_ptr<std::vector<std::shared_ptr<TaskEdge>>>> getEdges(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<PageInfo> getPageInfo(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<std::vector<std::shared_ptr<TaskEdge>>> getEdges(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolvePageInfo(service::ResolverParams&& params);
@@ -186,8 +186,8 @@ protected:
 	FolderEdge();
 
 public:
-	virtual std::future<std::shared_ptr<Folder>> getNode(service::FieldParams&& params) const = 0;
-	virtual std::future<response::Value> getCursor(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<Folder> getNode(service::FieldParams&& params) const = 0;
+	virtual response::Value getCursor(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveNode(service::ResolverParams&& params);
@@ -203,8 +203,8 @@ protected:
 	FolderConnection();
 
 public:
-	virtual std::future<std::shared_ptr<PageInfo>> getPageInfo(service::FieldParams&& params) const = 0;
-	virtual std::future<std::unique_ptr<std::vector<std::shared_ptr<FolderEdge>>>> getEdges(service::FieldParams&& params) const = 0;
+	virtual std::shared_ptr<PageInfo> getPageInfo(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<std::vector<std::shared_ptr<FolderEdge>>> getEdges(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolvePageInfo(service::ResolverParams&& params);
@@ -270,9 +270,9 @@ protected:
 	Appointment();
 
 public:
-	virtual std::future<std::unique_ptr<response::Value>> getWhen(service::FieldParams&& params) const = 0;
-	virtual std::future<std::unique_ptr<response::StringType>> getSubject(service::FieldParams&& params) const = 0;
-	virtual std::future<response::BooleanType> getIsNow(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<response::Value> getWhen(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<response::StringType> getSubject(service::FieldParams&& params) const = 0;
+	virtual response::BooleanType getIsNow(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveId(service::ResolverParams&& params);
@@ -291,8 +291,8 @@ protected:
 	Task();
 
 public:
-	virtual std::future<std::unique_ptr<response::StringType>> getTitle(service::FieldParams&& params) const = 0;
-	virtual std::future<response::BooleanType> getIsComplete(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<response::StringType> getTitle(service::FieldParams&& params) const = 0;
+	virtual response::BooleanType getIsComplete(service::FieldParams&& params) const = 0;
 
 private:
 	std::future<response::Value> resolveId(service::ResolverParams&& params);
@@ -310,13 +310,13 @@ protected:
 	Folder();
 
 public:
-	virtual std::future<std::unique_ptr<response::StringType>> getName(service::FieldParams&& params) const = 0;
-	virtual std::future<response::IntType> getUnreadCount(service::FieldParams&& params) const = 0;
+	virtual std::unique_ptr<response::StringType> getName(service::FieldParams&& params) const = 0;
+	virtual std::vector<response::IntType> getUnreadCount(service::FieldParams&& params, const std::vector<const Folder*>& parents) const = 0;
 
 private:
 	std::future<response::Value> resolveId(service::ResolverParams&& params);
 	std::future<response::Value> resolveName(service::ResolverParams&& params);
-	std::future<response::Value> resolveUnreadCount(service::ResolverParams&& params);
+	static std::vector<std::future<response::Value>> resolveUnreadCount(std::vector<service::BatchedField>&& fields);
 
 	std::future<response::Value> resolve__typename(service::ResolverParams&& params);
 };
@@ -5,8 +5,10 @@
 
 #include "Today.h"
 #include "GraphQLGrammar.h"
+#include "Validation.h"
 
 #include <graphqlservice/JSONResponse.h>
+#include <graphqlservice/GraphQLMetrics.h>
 
 #include <tao/pegtl/analyze.hpp>
 
@@ -182,6 +184,82 @@ TEST_F(TodayServiceCase, QueryEverything)
 	}
 }
 
+TEST_F(TodayServiceCase, QueryEverythingConcurrently)
+{
+	auto ast = R"(
+		query Everything {
+			appointments {
+				edges {
+					node {
+						id
+						subject
+					}
+				}
+			}
+			tasks {
+				edges {
+					node {
+						id
+						title
+					}
+				}
+			}
+			unreadCounts {
+				edges {
+					node {
+						id
+						unreadCount
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(15);
+	state->executor = std::make_shared<service::ThreadPool>(4);
+	auto result = _service->resolve(state, *ast.root, "Everything", std::move(variables)).get();
+	EXPECT_EQ(size_t(15), state->appointmentsRequestId) << "today service passed the same RequestState";
+	EXPECT_EQ(size_t(15), state->tasksRequestId) << "today service passed the same RequestState";
+	EXPECT_EQ(size_t(15), state->unreadCountsRequestId) << "today service passed the same RequestState";
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+		ASSERT_EQ(size_t(3), data.size()) << "should have all of the top level fields";
+		EXPECT_EQ("appointments", data.begin()->first) << "should preserve the order of the fields";
+
+		const auto appointments = service::ScalarArgument::require("appointments", data);
+		const auto appointmentEdges = service::ScalarArgument::require<service::TypeModifier::List>("edges", appointments);
+		ASSERT_EQ(1, appointmentEdges.size()) << "appointments should have 1 entry";
+		const auto appointmentNode = service::ScalarArgument::require("node", appointmentEdges[0]);
+		EXPECT_EQ(_fakeAppointmentId, service::IdArgument::require("id", appointmentNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Lunch?", service::StringArgument::require("subject", appointmentNode)) << "subject should match";
+
+		const auto tasks = service::ScalarArgument::require("tasks", data);
+		const auto taskEdges = service::ScalarArgument::require<service::TypeModifier::List>("edges", tasks);
+		ASSERT_EQ(1, taskEdges.size()) << "tasks should have 1 entry";
+		const auto taskNode = service::ScalarArgument::require("node", taskEdges[0]);
+		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("id", taskNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
+
+		const auto unreadCounts = service::ScalarArgument::require("unreadCounts", data);
+		const auto unreadCountEdges = service::ScalarArgument::require<service::TypeModifier::List>("edges", unreadCounts);
+		ASSERT_EQ(1, unreadCountEdges.size()) << "unreadCounts should have 1 entry";
+		const auto unreadCountNode = service::ScalarArgument::require("node", unreadCountEdges[0]);
+		EXPECT_EQ(_fakeFolderId, service::IdArgument::require("id", unreadCountNode)) << "id should match in base64 encoding";
+		EXPECT_EQ(3, service::IntArgument::require("unreadCount", unreadCountNode)) << "unreadCount should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
 TEST_F(TodayServiceCase, QueryAppointments)
 {
 	auto ast = R"({
@@ -235,6 +313,96 @@ TEST_F(TodayServiceCase, QueryAppointments)
 	}
 }
 
+TEST_F(TodayServiceCase, MergeFragmentFields)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						appointmentId: id
+					}
+				}
+			}
+			...on Query {
+				appointments {
+					edges {
+						node {
+							subject
+						}
+					}
+				}
+			}
+			...AppointmentsFragment
+		}
+
+		fragment AppointmentsFragment on Query {
+			appointments {
+				edges {
+					node {
+						appointmentId: id
+						when
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(32);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		EXPECT_EQ(size_t(1), data.size()) << "appointments should be merged into a single response key";
+		const auto appointments = service::ScalarArgument::require("appointments", data);
+		const auto appointmentEdges = service::ScalarArgument::require<service::TypeModifier::List>("edges", appointments);
+		ASSERT_EQ(1, appointmentEdges.size()) << "appointments should have 1 entry";
+		ASSERT_TRUE(appointmentEdges[0].type() == response::Type::Map) << "appointment should be an object";
+		const auto appointmentNode = service::ScalarArgument::require("node", appointmentEdges[0]);
+		const auto& members = appointmentNode.get<const response::MapType&>();
+		ASSERT_EQ(size_t(3), members.size()) << "node should merge the fields from every fragment";
+		EXPECT_EQ("appointmentId", members[0].first) << "fields should be in the order they were first selected";
+		EXPECT_EQ("subject", members[1].first) << "fields should be in the order they were first selected";
+		EXPECT_EQ("when", members[2].first) << "fields should be in the order they were first selected";
+		EXPECT_EQ(_fakeAppointmentId, service::IdArgument::require("appointmentId", appointmentNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Lunch?", service::StringArgument::require("subject", appointmentNode)) << "subject should match";
+		EXPECT_EQ("tomorrow", service::StringArgument::require("when", appointmentNode)) << "when should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, ConflictingFieldsError)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						subject: id
+						...on Appointment {
+							subject
+						}
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(33);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "conflicting fields with the same response key should be an error";
+}
+
 TEST_F(TodayServiceCase, QueryTasks)
 {
 	auto ast = R"gql({
@@ -481,7 +649,10 @@ TEST_F(TodayServiceCase, Introspection)
 					kind
 					name
 					description
-					ofType
+					ofType {
+						kind
+						name
+					}
 				}
 				queryType {
 					kind
@@ -543,7 +714,10 @@ TEST_F(TodayServiceCase, SkipDirective)
 					kind
 					name
 					description
-					ofType
+					ofType {
+						kind
+						name
+					}
 				}
 				queryType @skip(if: false) {
 					kind
@@ -605,7 +779,10 @@ TEST_F(TodayServiceCase, IncludeDirective)
 					kind
 					name
 					description
-					ofType
+					ofType {
+						kind
+						name
+					}
 				}
 				queryType @include(if: false) {
 					kind
@@ -833,34 +1010,24 @@ TEST_F(TodayServiceCase, QueryAppointmentsById)
 	}
 }
 
-TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingId)
+TEST_F(TodayServiceCase, ReuseCollectedFields)
 {
-	auto ast = peg::parseString(R"(subscription TestSubscription {
-			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
-				changedId: id
-				...on Task {
-					title
-					isComplete
-				}
+	auto ast = R"(query RepeatedAppointments($appointmentId: ID!, $includeWhen: Boolean!) {
+			appointmentsById(ids: [$appointmentId, $appointmentId, $appointmentId]) {
+				...AppointmentFragment
 			}
-		})");
+		}
+
+		fragment AppointmentFragment on Appointment {
+			appointmentId: id
+			subject
+			when @include(if: $includeWhen)
+		})"_graphql;
 	response::Value variables(response::Type::Map);
-	auto state = std::make_shared<today::RequestState>(13);
-	auto subscriptionObject = std::make_shared<today::NodeChange>(
-		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
-	{
-		EXPECT_EQ(13, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
-		EXPECT_EQ(_fakeTaskId, idArg);
-		return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
-	});
-	response::Value result;
-	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
-		[&result](std::future<response::Value> response)
-	{
-		result = response.get();
-	});
-	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZVRhc2tJZA==")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
-	_service->unsubscribe(key);
+	variables.emplace_back("appointmentId", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")));
+	variables.emplace_back("includeWhen", response::Value(false));
+	auto state = std::make_shared<today::RequestState>(34);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
 
 	try
 	{
@@ -872,10 +1039,16 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingId)
 		}
 		const auto data = service::ScalarArgument::require("data", result);
 
-		const auto taskNode = service::ScalarArgument::require("changedNode", data);
-		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
-		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
-		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
+		const auto appointmentsById = service::ScalarArgument::require<service::TypeModifier::List>("appointmentsById", data);
+		ASSERT_EQ(size_t(3), appointmentsById.size());
+
+		for (const auto& appointmentEntry : appointmentsById)
+		{
+			ASSERT_TRUE(appointmentEntry.type() == response::Type::Map) << "appointment should be an object";
+			EXPECT_EQ(size_t(2), appointmentEntry.size()) << "every entry should skip the same fields";
+			EXPECT_EQ(_fakeAppointmentId, service::IdArgument::require("appointmentId", appointmentEntry)) << "id should match in base64 encoding";
+			EXPECT_EQ("Lunch?", service::StringArgument::require("subject", appointmentEntry)) << "subject should match";
+		}
 	}
 	catch (const service::schema_exception& ex)
 	{
@@ -883,38 +1056,38 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingId)
 	}
 }
 
-TEST_F(TodayServiceCase, SubscribeNodeChangeMismatchedId)
+TEST_F(TodayServiceCase, BatchUnreadCount)
 {
-	auto ast = peg::parseString(R"(subscription TestSubscription {
-			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
-				changedId: id
-				...on Task {
-					title
-					isComplete
-				}
+	auto ast = R"(query BatchedFolders($folderId: ID!) {
+			unreadCountsById(ids: [$folderId, $folderId, $folderId]) {
+				unreadCount
 			}
-		})");
+		})"_graphql;
 	response::Value variables(response::Type::Map);
-	bool calledResolver = false;
-	auto subscriptionObject = std::make_shared<today::NodeChange>(
-		[this, &calledResolver](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
-	{
-		calledResolver = true;
-		return nullptr;
-	});
-	bool calledGet = false;
-	auto key = _service->subscribe(service::SubscriptionParams { nullptr, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
-		[&calledGet](std::future<response::Value>)
-	{
-		calledGet = true;
-	});
-	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
-	_service->unsubscribe(key);
+	variables.emplace_back("folderId", response::Value(std::string("ZmFrZUZvbGRlcklk")));
+	auto state = std::make_shared<today::RequestState>(62);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
 
 	try
 	{
-		ASSERT_FALSE(calledResolver);
-		ASSERT_FALSE(calledGet);
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto unreadCountsById = service::ScalarArgument::require<service::TypeModifier::List>("unreadCountsById", data);
+		ASSERT_EQ(size_t(3), unreadCountsById.size());
+
+		for (const auto& unreadCountEntry : unreadCountsById)
+		{
+			ASSERT_TRUE(unreadCountEntry.type() == response::Type::Map) << "folder should be an object";
+			EXPECT_EQ(3, service::IntArgument::require("unreadCount", unreadCountEntry)) << "unreadCount should match";
+		}
+
+		EXPECT_EQ(size_t(1), state->unreadCountBatchesCount) << "should call the batch accessor once for the whole list";
 	}
 	catch (const service::schema_exception& ex)
 	{
@@ -922,61 +1095,42 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeMismatchedId)
 	}
 }
 
-TEST_F(TodayServiceCase, SubscribeNodeChangeFuzzyComparator)
+// Resolve a query which nests the nested field depth levels deep, and check the depth at every level.
+static void resolveDeeplyNested(const service::Request& service, const std::shared_ptr<service::RequestState>& state, size_t depth)
 {
-	auto ast = peg::parseString(R"(subscription TestSubscription {
-			changedNode: nodeChange(id: "ZmFr") {
-				changedId: id
-				...on Task {
-					title
-					isComplete
-				}
-			}
-		})");
-	response::Value variables(response::Type::Map);
-	auto state = std::make_shared<today::RequestState>(14);
-	bool filterCalled = false;
-	auto filterCallback = [&filterCalled](response::MapType::const_reference fuzzy) noexcept -> bool
+	std::string query("{ ");
+
+	for (size_t i = 0; i < depth; ++i)
 	{
-		EXPECT_FALSE(filterCalled);
-		EXPECT_EQ("id", fuzzy.first) << "should only get called once for the id argument";
-		EXPECT_EQ("ZmFr", fuzzy.second.get<const response::StringType&>());
-		filterCalled = true;
-		return true;
-	};
-	auto subscriptionObject = std::make_shared<today::NodeChange>(
-		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+		query.append("nested { depth ");
+	}
+
+	query.append(depth, '}');
+	query.append(" }");
+
+	auto ast = peg::parseString(std::move(query));
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
 		{
-			const std::vector<uint8_t> fuzzyId { 'f', 'a', 'k' };
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+		const response::Value* nested = &data;
 
-			EXPECT_EQ(14, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
-			EXPECT_EQ(fuzzyId, idArg);
-			return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
-		});
-	response::Value result;
-	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
-		[&result](std::future<response::Value> response)
+		for (size_t i = 1; i <= depth; ++i)
 		{
-			result = response.get();
-		});
-	_service->deliver("nodeChange", filterCallback, std::static_pointer_cast<service::Object>(subscriptionObject));
-	_service->unsubscribe(key);
+			auto itrNested = nested->find("nested");
 
-	try
-	{
-		ASSERT_TRUE(filterCalled) << "should match the id parameter in the subscription";
-		ASSERT_TRUE(result.type() == response::Type::Map);
-		auto errorsItr = result.find("errors");
-		if (errorsItr != result.get<const response::MapType&>().cend())
-		{
-			FAIL() << response::toJSON(response::Value(errorsItr->second));
+			ASSERT_TRUE(itrNested != nested->end()) << "should resolve every level";
+			ASSERT_TRUE(itrNested->second.type() == response::Type::Map) << "nested should be an object";
+			nested = &itrNested->second;
+			ASSERT_EQ(static_cast<response::IntType>(i), service::IntArgument::require("depth", *nested)) << "depth should match";
 		}
-		const auto data = service::ScalarArgument::require("data", result);
-
-		const auto taskNode = service::ScalarArgument::require("changedNode", data);
-		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
-		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
-		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
 	}
 	catch (const service::schema_exception& ex)
 	{
@@ -984,84 +1138,121 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeFuzzyComparator)
 	}
 }
 
-TEST_F(TodayServiceCase, SubscribeNodeChangeFuzzyMismatch)
+TEST_F(TodayServiceCase, DeeplyNestedQuery)
 {
-	auto ast = peg::parseString(R"(subscription TestSubscription {
-			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
-				changedId: id
-				...on Task {
-					title
-					isComplete
-				}
-			}
-		})");
+	// Waiting for each level recursively would need hundreds of nested calls on the same stack. It
+	// still has to be shallow enough to validate.
+	resolveDeeplyNested(*_service, std::make_shared<today::RequestState>(63), 400);
+	today::NestedType::getCapturedParams();
+}
+
+TEST_F(TodayServiceCase, DeeplyNestedQueryWithoutState)
+{
+	// Without a RequestState, nothing caches the collected fields for the fields which are queued.
+	resolveDeeplyNested(*_service, nullptr, 400);
+	today::NestedType::getCapturedParams();
+}
+
+TEST_F(TodayServiceCase, RejectDeeplyNestedDocument)
+{
+	std::string query("{ ");
+
+	for (size_t i = 0; i < 2000; ++i)
+	{
+		query.append("nested { depth ");
+	}
+
+	query.append(2000, '}');
+	query.append(" }");
+
+	auto ast = peg::parseString(std::move(query));
 	response::Value variables(response::Type::Map);
-	bool filterCalled = false;
-	auto filterCallback = [&filterCalled](response::MapType::const_reference fuzzy) noexcept -> bool
+	auto state = std::make_shared<today::RequestState>(71);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	EXPECT_TRUE(result.find("data") == result.get<const response::MapType&>().cend()) << "rejected documents should not have a data entry";
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "deeply nested documents should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_EQ(R"js(["Document nesting depth: 4005 exceeds the limit: 1024"])js", errors) << "error should report the depth";
+}
+
+TEST_F(TodayServiceCase, RejectDeeplyNestedFragments)
+{
+	// Each fragment is shallow, but spreading them inside of each other nests the operation just as
+	// deeply as writing it out.
+	std::ostringstream query;
+
+	query << "query { nested { ...Nested0 } }";
+
+	for (size_t i = 0; i < 599; ++i)
 	{
-		EXPECT_FALSE(filterCalled);
-		EXPECT_EQ("id", fuzzy.first) << "should only get called once for the id argument";
-		EXPECT_EQ("ZmFrZVRhc2tJZA==", fuzzy.second.get<const response::StringType&>());
-		filterCalled = true;
-		return false;
-	};
-	bool calledResolver = false;
-	auto subscriptionObject = std::make_shared<today::NodeChange>(
-		[this, &calledResolver](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
-		{
-			calledResolver = true;
-			return nullptr;
-		});
-	bool calledGet = false;
-	auto key = _service->subscribe(service::SubscriptionParams { nullptr, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
-		[&calledGet](std::future<response::Value>)
-		{
-			calledGet = true;
-		});
-	_service->deliver("nodeChange", filterCallback, std::static_pointer_cast<service::Object>(subscriptionObject));
-	_service->unsubscribe(key);
+		query << " fragment Nested" << i << " on NestedType { nested { ...Nested" << (i + 1) << " } }";
+	}
 
-	try
+	query << " fragment Nested599 on NestedType { depth }";
+
+	auto ast = peg::parseString(query.str());
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(72);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	EXPECT_TRUE(result.find("data") == result.get<const response::MapType&>().cend()) << "rejected documents should not have a data entry";
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "deeply nested fragments should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_EQ(R"js(["Document nesting depth: 3005 exceeds the limit: 1024"])js", errors) << "error should report the depth";
+}
+
+// A recursive type which returns the next level right away, the same way the resolvers for a type
+// marked @synchronous in the schema do.
+class SynchronousNested : public service::Object
+{
+public:
+	explicit SynchronousNested(response::IntType depth)
+		: service::Object({ "SynchronousNested" }, {
+			{ "depth", [this](service::ResolverParams&& params) { return resolveDepth(std::move(params)); } },
+			{ "nested", [this](service::ResolverParams&& params) { return resolveNested(std::move(params)); } }
+		})
+		, _depth(depth)
 	{
-		ASSERT_TRUE(filterCalled) << "should not match the id parameter in the subscription";
-		ASSERT_FALSE(calledResolver);
-		ASSERT_FALSE(calledGet);
 	}
-	catch (const service::schema_exception& ex)
+
+private:
+	std::future<response::Value> resolveDepth(service::ResolverParams&& params) const
 	{
-		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+		return service::ModifiedResult<response::IntType>::convert(response::IntType(_depth), std::move(params));
+	}
+
+	std::future<response::Value> resolveNested(service::ResolverParams&& params) const
+	{
+		return service::ModifiedResult<SynchronousNested>::convert(std::make_shared<SynchronousNested>(_depth + 1), std::move(params));
 	}
+
+	const response::IntType _depth;
+};
+
+TEST(ExecutorCase, DeeplyNestedSynchronousQuery)
+{
+	// Each level resolves the next one before anything waits for a value, so the queue for nested
+	// selection sets never sees them.
+	service::Request service({ { "query", std::make_shared<SynchronousNested>(0) } });
+
+	resolveDeeplyNested(service, std::make_shared<service::RequestState>(), 2000);
 }
 
-TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingVariable)
+TEST_F(TodayServiceCase, LazyTasksById)
 {
-	auto ast = peg::parseString(R"(subscription TestSubscription($taskId: ID!) {
-			changedNode: nodeChange(id: $taskId) {
-				changedId: id
-				...on Task {
-					title
-					isComplete
-				}
+	auto ast = R"({
+			tasksById(ids: ["ZmFrZVRhc2tJZA==", "ZmFrZUFwcG9pbnRtZW50SWQ="]) {
+				id
+				title
 			}
-		})");
-	response::Value variables(response::Type::Map);
-	variables.emplace_back("taskId", response::Value(std::string("ZmFrZVRhc2tJZA==")));
-	auto state = std::make_shared<today::RequestState>(14);
-	auto subscriptionObject = std::make_shared<today::NodeChange>(
-		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
-	{
-		EXPECT_EQ(14, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
-		EXPECT_EQ(_fakeTaskId, idArg);
-		return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
-	});
-	response::Value result;
-	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
-		[&result](std::future<response::Value> response)
-	{
-		result = response.get();
-	});
-	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZVRhc2tJZA==")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
-	_service->unsubscribe(key);
+		})"_graphql;
+	auto state = std::make_shared<today::RequestState>(64);
+	auto result = _service->resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
 	try
 	{
@@ -1071,12 +1262,13 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingVariable)
 		{
 			FAIL() << response::toJSON(response::Value(errorsItr->second));
 		}
+		EXPECT_EQ(size_t(1), state->loadTasksCount) << "should load the tasks once";
 		const auto data = service::ScalarArgument::require("data", result);
-
-		const auto taskNode = service::ScalarArgument::require("changedNode", data);
-		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
-		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
-		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
+		const auto tasks = service::ScalarArgument::require<service::TypeModifier::List>("tasksById", data);
+		ASSERT_EQ(size_t(2), tasks.size()) << "should pull an entry for each id";
+		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("id", tasks[0])) << "id should match in base64 encoding";
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", tasks[0])) << "title should match";
+		EXPECT_TRUE(tasks[1].type() == response::Type::Null) << "should not find a task for the appointment id";
 	}
 	catch (const service::schema_exception& ex)
 	{
@@ -1084,596 +1276,3123 @@ TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingVariable)
 	}
 }
 
-TEST(ArgumentsCase, ListArgumentStrings)
+TEST_F(TodayServiceCase, FragmentDefinitionDirectiveDefaultVariable)
 {
-	auto parsed = response::parseJSON(R"js({"value":[
-		"string1",
-		"string2",
-		"string3"
-	]})js");
-	std::vector<std::string> actual;
+	auto ast = R"(query FragmentDefaults($tag: String = "defaultTag") {
+			nested {
+				...NestedFragment
+			}
+		}
+
+		fragment NestedFragment on NestedType @fragmentDefinitionTag(fragmentDefinition: $tag) {
+			nested {
+				depth
+			}
+		})"_graphql;
+	auto state = std::make_shared<today::RequestState>(65);
+	auto result = _service->resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+	auto capturedParams = today::NestedType::getCapturedParams();
 
 	try
 	{
-		actual = service::StringArgument::require<service::TypeModifier::List>("value", parsed);
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		ASSERT_EQ(size_t(2), capturedParams.size()) << "should capture both nested fields";
+		const auto params2 = std::move(capturedParams.top());
+		const auto fragmentDefinitionTag = service::ScalarArgument::require("fragmentDefinitionTag", params2.fragmentDefinitionDirectives);
+		EXPECT_EQ("defaultTag", service::StringArgument::require("fragmentDefinition", fragmentDefinitionTag)) << "should use the coerced default value";
 	}
 	catch (const service::schema_exception& ex)
 	{
 		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
-
-	ASSERT_EQ(3, actual.size()) << "should get 3 entries";
-	EXPECT_EQ("string1", actual[0]) << "entry should match";
-	EXPECT_EQ("string2", actual[1]) << "entry should match";
-	EXPECT_EQ("string3", actual[2]) << "entry should match";
 }
 
-TEST(ArgumentsCase, ListArgumentStringsNonNullable)
+TEST_F(TodayServiceCase, CoerceVariables)
 {
-	auto parsed = response::parseJSON(R"js({"value":[
-		"string1",
-		null,
-		"string2",
-		"string3"
-	]})js");
-	bool caughtException = false;
-	std::string exceptionWhat;
+	auto ast = R"(query CoercedAppointments($appointmentIds: [ID!]!) {
+			appointmentsById(ids: $appointmentIds) {
+				appointmentId: id
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("appointmentIds", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")));
+	auto state = std::make_shared<today::RequestState>(35);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
 
 	try
 	{
-		auto actual = service::StringArgument::require<service::TypeModifier::List>("value", parsed);
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto appointmentsById = service::ScalarArgument::require<service::TypeModifier::List>("appointmentsById", data);
+		ASSERT_EQ(size_t(1), appointmentsById.size()) << "single value should be coerced to a list";
+		EXPECT_EQ(_fakeAppointmentId, service::IdArgument::require("appointmentId", appointmentsById.front())) << "id should match in base64 encoding";
 	}
 	catch (const service::schema_exception& ex)
 	{
-		exceptionWhat = response::toJSON(response::Value(ex.getErrors()));
-		caughtException = true;
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
-
-	ASSERT_TRUE(caughtException);
-	EXPECT_EQ(R"js([{"message":"Invalid argument: value message: not a string"}])js", exceptionWhat) << "exception should match";
 }
 
-TEST(ArgumentsCase, ListArgumentStringsNullable)
+TEST_F(TodayServiceCase, InvalidVariables)
 {
-	auto parsed = response::parseJSON(R"js({"value":[
-		"string1",
-		"string2",
-		null,
-		"string3"
-	]})js");
-	std::vector<std::unique_ptr<std::string>> actual;
+	auto ast = R"(query InvalidAppointments($appointmentId: ID!, $includeSubject: Boolean!) {
+			appointmentsById(ids: [$appointmentId]) {
+				appointmentId: id
+				subject @include(if: $includeSubject)
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("appointmentId", response::Value(1));
+	auto state = std::make_shared<today::RequestState>(36);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
 
-	try
-	{
-		actual = service::StringArgument::require<
-			service::TypeModifier::List,
-			service::TypeModifier::Nullable
-		>("value", parsed);
-	}
-	catch (const service::schema_exception& ex)
-	{
-		FAIL() << response::toJSON(response::Value(ex.getErrors()));
-	}
+	EXPECT_EQ(size_t(0), state->appointmentsRequestId) << "today service should not call the resolvers";
+	EXPECT_EQ(size_t(0), state->loadAppointmentsCount) << "today service should not call the loader";
 
-	ASSERT_EQ(4, actual.size()) << "should get 4 entries";
-	ASSERT_NE(nullptr, actual[0]) << "should not be null";
-	EXPECT_EQ("string1", *actual[0]) << "entry should match";
-	ASSERT_NE(nullptr, actual[1]) << "should not be null";
-	EXPECT_EQ("string2", *actual[1]) << "entry should match";
-	EXPECT_EQ(nullptr, actual[2]) << "should be null";
-	ASSERT_NE(nullptr, actual[3]) << "should not be null";
-	EXPECT_EQ("string3", *actual[3]) << "entry should match";
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "invalid variables should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Invalid variable: appointmentId")) << "error should name the variable";
+	EXPECT_NE(std::string::npos, errors.find("message: not a string")) << "error should match";
 }
 
-TEST(ArgumentsCase, ListArgumentListArgumentStrings)
+TEST_F(TodayServiceCase, InvalidInputObjectVariable)
 {
-	auto parsed = response::parseJSON(R"js({"value":[
-		["list1string1", "list1string2"],
-		["list2string1", "list2string2"]
-	]})js");
-	std::vector<std::vector<std::string>> actual;
-
-	try
-	{
-		actual = service::StringArgument::require<
-			service::TypeModifier::List,
-			service::TypeModifier::List
-		>("value", parsed);
-	}
-	catch (const service::schema_exception& ex)
-	{
-		FAIL() << response::toJSON(response::Value(ex.getErrors()));
-	}
+	auto ast = R"(mutation CompleteTask($input: CompleteTaskInput!) {
+			completeTask(input: $input) {
+				clientMutationId
+			}
+		})"_graphql;
+	auto variables = response::parseJSON(R"js({ "input": { "id": "ZmFrZVRhc2tJZA==", "isCompleted": true } })js");
+	auto state = std::make_shared<today::RequestState>(68);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
 
-	ASSERT_EQ(2, actual.size()) << "should get 2 entries";
-	ASSERT_EQ(2, actual[0].size()) << "should get 2 entries";
-	EXPECT_EQ("list1string1", actual[0][0]) << "entry should match";
-	EXPECT_EQ("list1string2", actual[0][1]) << "entry should match";
-	ASSERT_EQ(2, actual[1].size()) << "should get 2 entries";
-	EXPECT_EQ("list2string1", actual[1][0]) << "entry should match";
-	EXPECT_EQ("list2string2", actual[1][1]) << "entry should match";
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "invalid variables should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Invalid variable: input")) << "error should name the variable";
+	EXPECT_NE(std::string::npos, errors.find("unknown field: isCompleted")) << "error should name the field";
+	EXPECT_EQ(R"js(null)js", response::toJSON(response::Value(result["data"]))) << "should not call the resolver";
 }
 
-TEST(ArgumentsCase, ListArgumentNullableListArgumentStrings)
+TEST_F(TodayServiceCase, ValidateUnknownField)
 {
-	auto parsed = response::parseJSON(R"js({"value":[
-		null,
-		["list2string1", "list2string2"]
-	]})js");
-	std::vector<std::unique_ptr<std::vector<std::string>>> actual;
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						appointmentId: id
+						unknownField
+					}
+				}
+			}
+		})"_graphql;
+	const auto getAppointmentsCount = _getAppointmentsCount;
+
+	for (size_t requestId = 37; requestId < 39; ++requestId)
+	{
+		response::Value variables(response::Type::Map);
+		auto state = std::make_shared<today::RequestState>(requestId);
+		auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+		EXPECT_EQ(size_t(0), state->appointmentsRequestId) << "today service should not call the resolvers";
+		EXPECT_EQ(getAppointmentsCount, _getAppointmentsCount) << "today service should not call the loader";
+
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		EXPECT_TRUE(result.find("data") == result.get<const response::MapType&>().cend()) << "invalid documents should not have a data entry";
+		auto errorsItr = result.find("errors");
+		ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "unknown fields should be an error";
+		const auto errors = response::toJSON(response::Value(errorsItr->second));
+		EXPECT_NE(std::string::npos, errors.find("Unknown field type: Appointment name: unknownField")) << "error should name the field";
+	}
+}
+
+TEST_F(TodayServiceCase, ValidateFragments)
+{
+	auto ast = R"(query CyclicFragments($unusedId: ID) {
+			nested {
+				...Fragment1
+			}
+			tasks {
+				edges {
+					node {
+						...on Folder {
+							name
+						}
+					}
+				}
+			}
+		}
+
+		fragment Fragment1 on NestedType {
+			nested {
+				...Fragment2
+			}
+		}
+
+		fragment Fragment2 on NestedType {
+			nested {
+				...Fragment1
+			}
+		}
+
+		fragment UnusedFragment on Query {
+			__typename
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(39);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	EXPECT_EQ(size_t(0), state->tasksRequestId) << "today service should not call the resolvers";
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "invalid fragments should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Cyclic fragment spread name: Fragment1")) << "fragment cycles should be an error";
+	EXPECT_NE(std::string::npos, errors.find("Incompatible target type on inline fragment name: Folder")) << "impossible spreads should be an error";
+	EXPECT_NE(std::string::npos, errors.find("Unused fragment definition name: UnusedFragment")) << "unused fragments should be an error";
+	EXPECT_NE(std::string::npos, errors.find("Unused variable name: unusedId")) << "unused variables should be an error";
+}
+
+TEST_F(TodayServiceCase, ValidateConflictingFields)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						key: id
+						...on Node {
+							key: id
+						}
+						...AppointmentFragment
+					}
+				}
+			}
+		}
+
+		fragment AppointmentFragment on Appointment {
+			key: subject
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(66);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	EXPECT_EQ(size_t(0), state->appointmentsRequestId) << "today service should not call the resolvers";
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "conflicting fields should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Conflicting fields for response key: key")) << "error should name the response key";
+}
+
+TEST_F(TodayServiceCase, AnalyzeConnectionCost)
+{
+	auto ast = R"(query ConnectionCost($taskCount: Int) {
+			appointments(first: 5) {
+				pageInfo {
+					hasNextPage
+				}
+				edges {
+					node {
+						id
+						subject
+					}
+				}
+			}
+			tasks(last: $taskCount) {
+				edges {
+					node {
+						...TaskFragment
+					}
+				}
+			}
+			unreadCounts {
+				edges {
+					node {
+						name
+					}
+				}
+			}
+		}
+
+		fragment TaskFragment on Task {
+			id
+			title
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("taskCount", response::Value(3));
+	auto state = std::make_shared<today::RequestState>(40);
+	const auto cost = _service->analyzeCost(state, *ast.root, "", variables);
+
+	EXPECT_EQ(size_t(4), cost.depth) << "depth should count the nested fields";
+	// appointments: 2 + pageInfo: 1 + edges: 1 + node: 5 * 1
+	// tasks: 2 + edges: 1 + node: 3 * 1
+	// unreadCounts: 2 + edges: 1 + node: defaultListSize * 1
+	EXPECT_EQ(size_t(9 + 6 + 13), cost.complexity) << "complexity should multiply by the connection size";
+}
+
+TEST_F(TodayServiceCase, AnalyzeRepeatedFragmentCost)
+{
+	// Each fragment spreads the next one twice, so expanding every spread would visit 2^40 fields.
+	constexpr size_t fragmentCount = 40;
+	std::ostringstream query;
+
+	query << R"({
+			nested {
+				...Fragment1
+			}
+		})";
+
+	for (size_t index = 1; index < fragmentCount; ++index)
+	{
+		query << R"(
+
+		fragment Fragment)" << index << R"( on NestedType {
+			first: nested {
+				...Fragment)" << index + 1 << R"(
+			}
+			second: nested {
+				...Fragment)" << index + 1 << R"(
+			}
+		})";
+	}
+
+	query << R"(
+
+		fragment Fragment)" << fragmentCount << R"( on NestedType {
+			depth
+		})";
+
+	auto ast = peg::parseString(query.str());
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(67);
+	const auto cost = _service->analyzeCost(state, *ast.root, "", variables);
+
+	EXPECT_EQ(fragmentCount + 1, cost.depth) << "depth should count the fields in every fragment";
+	// nested: 1 + 2 nested fields in Fragment1, 4 in Fragment2, ... 2^39 in Fragment39
+	EXPECT_EQ((size_t(1) << fragmentCount) - 1, cost.complexity) << "complexity should count each spread of the fragments";
+}
+
+TEST_F(TodayServiceCase, CostLimits)
+{
+	auto ast = R"({
+			appointments(first: 100) {
+				edges {
+					node {
+						id
+					}
+				}
+			}
+			nested {
+				nested {
+					nested {
+						depth
+					}
+				}
+			}
+		})"_graphql;
+	const auto getAppointmentsCount = _getAppointmentsCount;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(41);
+
+	state->maxDepth = 3;
+	state->maxComplexity = 50;
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	EXPECT_EQ(getAppointmentsCount, _getAppointmentsCount) << "today service should not call the loader";
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	EXPECT_TRUE(result.find("data") == result.get<const response::MapType&>().cend()) << "rejected operations should not have a data entry";
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "expensive operations should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Query depth: 4 exceeds the limit: 3")) << "error should report the depth";
+	EXPECT_NE(std::string::npos, errors.find("Query complexity: 106 exceeds the limit: 50")) << "error should report the complexity";
+}
+
+TEST_F(TodayServiceCase, CancelRequest)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						id
+					}
+				}
+			}
+			tasks {
+				edges {
+					node {
+						id
+					}
+				}
+			}
+		})"_graphql;
+	const auto getAppointmentsCount = _getAppointmentsCount;
+	const auto getTasksCount = _getTasksCount;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(42);
+
+	state->cancellation = std::make_shared<service::Cancellation>();
+	state->cancellation->cancel();
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	EXPECT_EQ(getAppointmentsCount, _getAppointmentsCount) << "today service should not call the loader";
+	EXPECT_EQ(getTasksCount, _getTasksCount) << "today service should not call the loader";
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "cancelled fields should be errors";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Request cancelled field: appointments")) << "error should name the field";
+
+	// Both of the fields are non-null, so the null propagates all the way to the data.
+	auto dataItr = result.find("data");
+	ASSERT_FALSE(dataItr == result.get<const response::MapType&>().cend()) << "data should still be in the response";
+	EXPECT_TRUE(dataItr->second.type() == response::Type::Null) << "cancelled non-null fields should make the data null";
+}
+
+TEST_F(TodayServiceCase, DeadlineExceeded)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						id
+					}
+				}
+			}
+			unreadCounts {
+				edges {
+					node {
+						id
+					}
+				}
+			}
+		})"_graphql;
+	const auto getAppointmentsCount = _getAppointmentsCount;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(43);
+
+	state->executor = std::make_shared<service::ThreadPool>(2);
+	state->cancellation = std::make_shared<service::Cancellation>(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	EXPECT_EQ(getAppointmentsCount, _getAppointmentsCount) << "today service should not call the loader";
+	EXPECT_TRUE(state->cancellation->hasDeadline()) << "cancellation should have a deadline";
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "fields past the deadline should be errors";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Deadline exceeded field: appointments")) << "error should name the field";
+
+	auto dataItr = result.find("data");
+	ASSERT_FALSE(dataItr == result.get<const response::MapType&>().cend()) << "data should still be in the response";
+	EXPECT_TRUE(dataItr->second.type() == response::Type::Null) << "non-null fields past the deadline should make the data null";
+}
+
+// Cancel the request once every resolver in the top level selection set has been called, so the
+// nested selection sets are cancelled.
+class CancelOnDispatch : public service::BatchDispatcher
+{
+public:
+	explicit CancelOnDispatch(std::shared_ptr<service::Cancellation> cancellation)
+		: _cancellation(std::move(cancellation))
+	{
+	}
+
+	void dispatch() override
+	{
+		_cancellation->cancel();
+	}
+
+private:
+	const std::shared_ptr<service::Cancellation> _cancellation;
+};
+
+TEST_F(TodayServiceCase, CancelledNonNullFieldPropagatesToData)
+{
+	auto ast = R"({
+			nested {
+				depth
+				nested {
+					depth
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(69);
+
+	state->cancellation = std::make_shared<service::Cancellation>();
+	state->addBatchDispatcher(std::make_shared<CancelOnDispatch>(state->cancellation));
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "cancelled fields should be errors";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Request cancelled field: depth")) << "error should name the field";
+	EXPECT_EQ(std::string::npos, errors.find("field: nested")) << "parents which were nulled should not be errors";
+
+	auto dataItr = result.find("data");
+	ASSERT_FALSE(dataItr == result.get<const response::MapType&>().cend()) << "data should still be in the response";
+	EXPECT_TRUE(dataItr->second.type() == response::Type::Null) << "every field up to the root is non-null";
+}
+
+TEST_F(TodayServiceCase, CancelledNonNullFieldNullsNullableParent)
+{
+	auto ast = R"({
+			node(id: "ZmFrZUFwcG9pbnRtZW50SWQ=") {
+				id
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(70);
+
+	state->cancellation = std::make_shared<service::Cancellation>();
+	state->addBatchDispatcher(std::make_shared<CancelOnDispatch>(state->cancellation));
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "cancelled fields should be errors";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Request cancelled field: id")) << "error should name the field";
+
+	const auto data = service::ScalarArgument::require("data", result);
+	ASSERT_TRUE(data.type() == response::Type::Map);
+	EXPECT_TRUE(data["node"].type() == response::Type::Null) << "the nullable parent should be null";
+}
+
+TEST_F(TodayServiceCase, TraceFields)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(44);
+
+	state->tracer = std::make_shared<service::Tracer>();
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+
+		const auto extensions = service::ScalarArgument::require("extensions", result);
+		const auto tracing = service::ScalarArgument::require("tracing", extensions);
+		EXPECT_EQ(1, service::IntArgument::require("version", tracing)) << "tracing should have a version";
+		const auto execution = service::ScalarArgument::require("execution", tracing);
+		const auto resolvers = service::ScalarArgument::require<service::TypeModifier::List>("resolvers", execution);
+		EXPECT_EQ(size_t(4), resolvers.size()) << "there should be a trace for every resolver";
+
+		bool foundSubject = false;
+
+		for (const auto& resolver : resolvers)
+		{
+			if (service::StringArgument::require("fieldName", resolver) != "subject")
+			{
+				continue;
+			}
+
+			foundSubject = true;
+			EXPECT_EQ("Appointment", service::StringArgument::require("parentType", resolver)) << "parentType should match";
+			EXPECT_EQ(R"js(["appointments","edges",0,"node","subject"])js", response::toJSON(response::Value(resolver["path"]))) << "path should include the list index";
+			EXPECT_LE(0.0, service::FloatArgument::require("duration", resolver)) << "duration should not be negative";
+		}
+
+		EXPECT_TRUE(foundSubject) << "should trace the subject field";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, TraceSampling)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(45);
+
+	state->tracer = std::make_shared<service::Tracer>(0.0);
+
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::Map);
+	EXPECT_TRUE(result.find("extensions") == result.get<const response::MapType&>().cend()) << "operations which aren't sampled should not be traced";
+	EXPECT_TRUE(state->tracer->releaseTraces().empty()) << "operations which aren't sampled should not be traced";
+}
+
+TEST_F(TodayServiceCase, RecordPhaseMetrics)
+{
+	auto metrics = std::make_shared<service::AggregateMetrics>();
+
+	service::Metrics::install(metrics);
+
+	auto query = peg::parseString(R"({
+			appointments {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(46);
+	auto result = response::toJSON(_service->resolve(state, *query.root, "", std::move(variables)).get());
+
+	service::Metrics::install(nullptr);
+
+	EXPECT_EQ(std::string::npos, result.find("errors")) << "query should succeed";
+	EXPECT_EQ(uint64_t(1), metrics->getPhaseMetrics(service::MetricsPhase::Parse).count) << "should parse once";
+	EXPECT_EQ(uint64_t(1), metrics->getPhaseMetrics(service::MetricsPhase::Validate).count) << "should validate once";
+	EXPECT_EQ(uint64_t(1), metrics->getPhaseMetrics(service::MetricsPhase::Prepare).count) << "should prepare once";
+	EXPECT_EQ(uint64_t(4), metrics->getPhaseMetrics(service::MetricsPhase::Resolve).count) << "should record every resolver";
+	EXPECT_EQ(uint64_t(1), metrics->getPhaseMetrics(service::MetricsPhase::Serialize).count) << "should serialize once";
+	EXPECT_EQ(uint64_t(0), metrics->getPhaseMetrics(service::MetricsPhase::Deliver).count) << "should not deliver anything";
+
+	const auto resolve = metrics->getPhaseMetrics(service::MetricsPhase::Resolve);
+	uint64_t histogramCount = 0;
+
+	for (auto bucket : resolve.histogram)
+	{
+		histogramCount += bucket;
+	}
+
+	EXPECT_EQ(resolve.count, histogramCount) << "every resolver should be in the histogram";
+}
+
+TEST_F(TodayServiceCase, DeferFragment)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						id
+						... @defer(label: "details") {
+							subject
+						}
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(47);
+	std::vector<std::string> payloads;
+
+	_service->resolveIncremental(state, *ast.root, "", std::move(variables),
+		[&payloads](response::Value&& payload)
+	{
+		payloads.push_back(response::toJSON(std::move(payload)));
+	}).get();
+
+	ASSERT_EQ(size_t(2), payloads.size()) << "should deliver the initial payload and one patch";
+	EXPECT_EQ(std::string::npos, payloads[0].find("errors")) << "initial payload should not have errors";
+	EXPECT_EQ(std::string::npos, payloads[0].find("subject")) << "initial payload should not include the deferred field";
+	EXPECT_NE(std::string::npos, payloads[0].find(R"js("hasNext":true)js")) << "initial payload should have more to come";
+	EXPECT_EQ(R"js({"data":{"subject":"Lunch?"},"path":["appointments","edges",0,"node"],"label":"details","hasNext":false})js", payloads[1]) << "patch should have the deferred field";
+}
+
+TEST_F(TodayServiceCase, StreamList)
+{
+	auto ast = R"({
+			appointments {
+				edges @stream(initialCount: 0, label: "edges") {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(48);
+	std::vector<std::string> payloads;
+
+	_service->resolveIncremental(state, *ast.root, "", std::move(variables),
+		[&payloads](response::Value&& payload)
+	{
+		payloads.push_back(response::toJSON(std::move(payload)));
+	}).get();
+
+	ASSERT_EQ(size_t(2), payloads.size()) << "should deliver the initial payload and one patch";
+	EXPECT_EQ(R"js({"data":{"appointments":{"edges":[]}},"hasNext":true})js", payloads[0]) << "initial payload should have an empty list";
+	EXPECT_EQ(R"js({"items":[{"node":{"subject":"Lunch?"}}],"path":["appointments","edges",0],"label":"edges","hasNext":false})js", payloads[1]) << "patch should have the streamed entry";
+}
+
+TEST_F(TodayServiceCase, IgnoreDeferInResolve)
+{
+	auto ast = R"({
+			appointments {
+				edges {
+					node {
+						... @defer {
+							subject
+						}
+					}
+				}
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(49);
+	auto result = response::toJSON(_service->resolve(state, *ast.root, "", std::move(variables)).get());
+
+	EXPECT_EQ(R"js({"data":{"appointments":{"edges":[{"node":{"subject":"Lunch?"}}]}}})js", result) << "resolve should not defer anything";
+}
+
+TEST_F(TodayServiceCase, ResolveBatch)
+{
+	auto appointmentsQuery = R"({
+			appointments {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql;
+	auto tasksQuery = R"(query Tasks($first: Int) {
+			tasks(first: $first) {
+				edges {
+					node {
+						title
+					}
+				}
+			}
+		})"_graphql;
+	auto invalidQuery = R"({
+			unknownField
+		})"_graphql;
+	auto state = std::make_shared<today::RequestState>(50);
+	std::vector<service::BatchedOperation> operations;
+	response::Value tasksVariables(response::Type::Map);
+
+	tasksVariables.emplace_back("first", response::Value(1));
+	operations.push_back({ *appointmentsQuery.root, "", response::Value(response::Type::Map) });
+	operations.push_back({ *invalidQuery.root, "", response::Value(response::Type::Map) });
+	operations.push_back({ *tasksQuery.root, "Tasks", std::move(tasksVariables) });
+
+	auto result = _service->resolveBatch(state, std::move(operations)).get();
+
+	ASSERT_TRUE(result.type() == response::Type::List);
+	ASSERT_EQ(size_t(3), result.size()) << "should have a response for every operation";
+	EXPECT_EQ(R"js({"data":{"appointments":{"edges":[{"node":{"subject":"Lunch?"}}]}}})js", response::toJSON(response::Value(result[0]))) << "first response should be the appointments";
+	EXPECT_TRUE(result[1].find("errors") != result[1].end()) << "invalid operation should only report errors in its own response";
+	EXPECT_EQ(R"js({"data":{"tasks":{"edges":[{"node":{"title":"Don't forget"}}]}}})js", response::toJSON(response::Value(result[2]))) << "third response should be the tasks";
+	EXPECT_EQ(size_t(50), state->appointmentsRequestId) << "today service passed the same RequestState";
+	EXPECT_EQ(size_t(50), state->tasksRequestId) << "today service passed the same RequestState";
+}
+
+TEST_F(TodayServiceCase, ResolveCachedResponse)
+{
+	auto ast = R"(query Appointments($first: Int) {
+			appointments(first: $first) {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql;
+	auto cache = std::make_shared<service::ResponseCache>(response::toJSON);
+	const auto resolve = [this, &ast, &cache](size_t requestId, response::IntType first)
+	{
+		response::Value variables(response::Type::Map);
+
+		variables.emplace_back("first", response::Value(first));
+
+		auto state = std::make_shared<today::RequestState>(requestId);
+		auto response = _service->resolveCached(state, *ast.root, "Appointments", std::move(variables), cache, std::chrono::seconds(60), { "appointments" }).get();
+
+		return std::make_pair(response, state->loadAppointmentsCount);
+	};
+
+	const auto first = resolve(51, 1);
+	const auto second = resolve(52, 1);
+	const auto otherVariables = resolve(53, 2);
+
+	cache->invalidate("appointments");
+
+	const auto invalidated = resolve(54, 1);
+
+	ASSERT_TRUE(first.first) << "should return a response";
+	EXPECT_EQ(R"js({"data":{"appointments":{"edges":[{"node":{"subject":"Lunch?"}}]}}})js", *first.first) << "should serialize the response";
+	EXPECT_EQ(size_t(1), first.second) << "first request should execute the query";
+	EXPECT_EQ(first.first, second.first) << "second request should share the cached buffer";
+	EXPECT_EQ(size_t(0), second.second) << "second request should not execute the query";
+	EXPECT_EQ(size_t(1), otherVariables.second) << "different variables should execute the query";
+	EXPECT_NE(first.first, invalidated.first) << "invalidating the tag should drop the cached response";
+	EXPECT_EQ(*first.first, *invalidated.first) << "should get the same response again";
+	EXPECT_EQ(size_t(1), invalidated.second) << "should execute the query after invalidating the tag";
+}
+
+TEST_F(TodayServiceCase, ResolveCachedSkipsMutations)
+{
+	auto ast = R"(mutation {
+			completedTask: completeTask(input: {id: "ZmFrZVRhc2tJZA==", isComplete: true}) {
+				completedTask: task {
+					isComplete
+				}
+			}
+		})"_graphql;
+	auto cache = std::make_shared<service::ResponseCache>(response::toJSON);
+	auto first = _service->resolveCached(std::make_shared<today::RequestState>(55), *ast.root, "", response::Value(response::Type::Map), cache, std::chrono::seconds(60)).get();
+	auto second = _service->resolveCached(std::make_shared<today::RequestState>(56), *ast.root, "", response::Value(response::Type::Map), cache, std::chrono::seconds(60)).get();
+
+	ASSERT_TRUE(first && second) << "should return a response";
+	EXPECT_EQ(*first, *second) << "should get the same response";
+	EXPECT_NE(first, second) << "should not cache mutations";
+}
+
+TEST_F(TodayServiceCase, ResolveSharedCoalesces)
+{
+	auto ast = std::make_shared<peg::ast<const char*>>(R"({
+			appointments {
+				edges {
+					node {
+						subject
+					}
+				}
+			}
+		})"_graphql);
+	std::shared_ptr<const peg::ast_node> root(ast, ast->root.get());
+	const auto makeState = [](size_t requestId, bool shareable, std::string&& shareScope)
+	{
+		auto state = std::make_shared<today::RequestState>(requestId);
+
+		state->shareable = shareable;
+		state->shareScope = std::move(shareScope);
+
+		return state;
+	};
+	auto leaderState = makeState(57, true, std::string());
+	auto followerState = makeState(58, true, std::string());
+	auto otherScopeState = makeState(59, true, "other");
+	auto privateState = makeState(60, false, std::string());
+
+	auto leader = _service->resolveShared(leaderState, root, "", response::Value(response::Type::Map));
+	auto follower = _service->resolveShared(followerState, root, "", response::Value(response::Type::Map));
+	auto otherScope = _service->resolveShared(otherScopeState, root, "", response::Value(response::Type::Map));
+	auto notShared = _service->resolveShared(privateState, root, "", response::Value(response::Type::Map));
+
+	// Release the caller's reference to the document, the requests should keep it alive.
+	ast.reset();
+
+	const auto expected = R"js({"data":{"appointments":{"edges":[{"node":{"subject":"Lunch?"}}]}}})js";
+
+	EXPECT_EQ(expected, response::toJSON(follower.get())) << "follower should get the shared result";
+	EXPECT_EQ(expected, response::toJSON(leader.get())) << "leader should get the shared result";
+	EXPECT_EQ(expected, response::toJSON(otherScope.get())) << "other scope should get its own result";
+	EXPECT_EQ(expected, response::toJSON(notShared.get())) << "request which isn't shareable should get its own result";
+	EXPECT_EQ(size_t(1), leaderState->loadAppointmentsCount) << "leader should execute the operation";
+	EXPECT_EQ(size_t(0), followerState->loadAppointmentsCount) << "follower should attach to the leader";
+	EXPECT_EQ(size_t(1), otherScopeState->loadAppointmentsCount) << "requests in a different scope should not be coalesced";
+	EXPECT_EQ(size_t(1), privateState->loadAppointmentsCount) << "requests which aren't shareable should not be coalesced";
+
+	auto nextState = makeState(61, true, std::string());
+
+	EXPECT_EQ(expected, response::toJSON(_service->resolveShared(nextState, root, "", response::Value(response::Type::Map)).get())) << "next request should get the same result";
+	EXPECT_EQ(size_t(1), nextState->loadAppointmentsCount) << "should not attach to an execution which is already complete";
+}
+
+TEST_F(TodayServiceCase, QueryAppointmentsByIdInChunks)
+{
+	auto ast = R"(query SpecificAppointments($appointmentId: ID!, $missingId: ID!) {
+			appointmentsById(ids: [$appointmentId, $missingId, $appointmentId, $appointmentId, $missingId]) {
+				appointmentId: id
+				subject
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("appointmentId", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")));
+	variables.emplace_back("missingId", response::Value(std::string("bWlzc2luZ0lk")));
+	auto state = std::make_shared<today::RequestState>(16);
+	state->executor = std::make_shared<service::ThreadPool>(2);
+	state->listChunkSize = 2;
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto appointmentsById = service::ScalarArgument::require<service::TypeModifier::List>("appointmentsById", data);
+		ASSERT_EQ(size_t(5), appointmentsById.size()) << "should get all of the entries from every chunk";
+
+		for (size_t i = 0; i < appointmentsById.size(); ++i)
+		{
+			const auto& appointmentEntry = appointmentsById[i];
+
+			if (i == 1 || i == 4)
+			{
+				EXPECT_TRUE(appointmentEntry.type() == response::Type::Null) << "missing entry should be null at index: " << i;
+				continue;
+			}
+
+			EXPECT_EQ(_fakeAppointmentId, service::IdArgument::require("appointmentId", appointmentEntry)) << "id should match at index: " << i;
+			EXPECT_EQ("Lunch?", service::StringArgument::require("subject", appointmentEntry)) << "subject should match at index: " << i;
+		}
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, QueryNodesInBatch)
+{
+	auto ast = R"(query NodesById($appointmentId: ID!, $taskId: ID!, $missingId: ID!) {
+			appointment: node(id: $appointmentId) {
+				...on Appointment {
+					subject
+				}
+			}
+			task: node(id: $taskId) {
+				...on Task {
+					title
+				}
+			}
+			missing: node(id: $missingId) {
+				id
+			}
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("appointmentId", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")));
+	variables.emplace_back("taskId", response::Value(std::string("ZmFrZVRhc2tJZA==")));
+	variables.emplace_back("missingId", response::Value(std::string("bWlzc2luZ0lk")));
+	auto state = std::make_shared<today::RequestState>(17);
+	auto result = _service->resolve(state, *ast.root, "", std::move(variables)).get();
+	EXPECT_EQ(size_t(1), state->loadNodesCount) << "today service looked up all of the nodes in one batch";
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto appointment = service::ScalarArgument::require("appointment", data);
+		EXPECT_EQ("Lunch?", service::StringArgument::require("subject", appointment)) << "subject should match";
+		const auto task = service::ScalarArgument::require("task", data);
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", task)) << "title should match";
+		const auto missing = service::ScalarArgument::require<service::TypeModifier::Nullable>("missing", data);
+		EXPECT_FALSE(missing) << "missing node should be null";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingId)
+{
+	auto ast = peg::parseString(R"(subscription TestSubscription {
+			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
+				changedId: id
+				...on Task {
+					title
+					isComplete
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(13);
+	auto subscriptionObject = std::make_shared<today::NodeChange>(
+		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+	{
+		EXPECT_EQ(13, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
+		EXPECT_EQ(_fakeTaskId, idArg);
+		return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
+	});
+	response::Value result;
+	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
+		[&result](std::future<response::Value> response)
+	{
+		result = response.get();
+	});
+	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZVRhc2tJZA==")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
+	_service->unsubscribe(key);
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto taskNode = service::ScalarArgument::require("changedNode", data);
+		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
+		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, SubscribeNodeChangeMismatchedId)
+{
+	auto ast = peg::parseString(R"(subscription TestSubscription {
+			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
+				changedId: id
+				...on Task {
+					title
+					isComplete
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	bool calledResolver = false;
+	auto subscriptionObject = std::make_shared<today::NodeChange>(
+		[this, &calledResolver](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+	{
+		calledResolver = true;
+		return nullptr;
+	});
+	bool calledGet = false;
+	auto key = _service->subscribe(service::SubscriptionParams { nullptr, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
+		[&calledGet](std::future<response::Value>)
+	{
+		calledGet = true;
+	});
+	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZUFwcG9pbnRtZW50SWQ=")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
+	_service->unsubscribe(key);
+
+	try
+	{
+		ASSERT_FALSE(calledResolver);
+		ASSERT_FALSE(calledGet);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, SubscribeNodeChangeFuzzyComparator)
+{
+	auto ast = peg::parseString(R"(subscription TestSubscription {
+			changedNode: nodeChange(id: "ZmFr") {
+				changedId: id
+				...on Task {
+					title
+					isComplete
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<today::RequestState>(14);
+	bool filterCalled = false;
+	auto filterCallback = [&filterCalled](response::MapType::const_reference fuzzy) noexcept -> bool
+	{
+		EXPECT_FALSE(filterCalled);
+		EXPECT_EQ("id", fuzzy.first) << "should only get called once for the id argument";
+		EXPECT_EQ("ZmFr", fuzzy.second.get<const response::StringType&>());
+		filterCalled = true;
+		return true;
+	};
+	auto subscriptionObject = std::make_shared<today::NodeChange>(
+		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+		{
+			const std::vector<uint8_t> fuzzyId { 'f', 'a', 'k' };
+
+			EXPECT_EQ(14, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
+			EXPECT_EQ(fuzzyId, idArg);
+			return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
+		});
+	response::Value result;
+	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
+		[&result](std::future<response::Value> response)
+		{
+			result = response.get();
+		});
+	_service->deliver("nodeChange", filterCallback, std::static_pointer_cast<service::Object>(subscriptionObject));
+	_service->unsubscribe(key);
+
+	try
+	{
+		ASSERT_TRUE(filterCalled) << "should match the id parameter in the subscription";
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto taskNode = service::ScalarArgument::require("changedNode", data);
+		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
+		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, SubscribeNodeChangeFuzzyMismatch)
+{
+	auto ast = peg::parseString(R"(subscription TestSubscription {
+			changedNode: nodeChange(id: "ZmFrZVRhc2tJZA==") {
+				changedId: id
+				...on Task {
+					title
+					isComplete
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	bool filterCalled = false;
+	auto filterCallback = [&filterCalled](response::MapType::const_reference fuzzy) noexcept -> bool
+	{
+		EXPECT_FALSE(filterCalled);
+		EXPECT_EQ("id", fuzzy.first) << "should only get called once for the id argument";
+		EXPECT_EQ("ZmFrZVRhc2tJZA==", fuzzy.second.get<const response::StringType&>());
+		filterCalled = true;
+		return false;
+	};
+	bool calledResolver = false;
+	auto subscriptionObject = std::make_shared<today::NodeChange>(
+		[this, &calledResolver](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+		{
+			calledResolver = true;
+			return nullptr;
+		});
+	bool calledGet = false;
+	auto key = _service->subscribe(service::SubscriptionParams { nullptr, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
+		[&calledGet](std::future<response::Value>)
+		{
+			calledGet = true;
+		});
+	_service->deliver("nodeChange", filterCallback, std::static_pointer_cast<service::Object>(subscriptionObject));
+	_service->unsubscribe(key);
+
+	try
+	{
+		ASSERT_TRUE(filterCalled) << "should not match the id parameter in the subscription";
+		ASSERT_FALSE(calledResolver);
+		ASSERT_FALSE(calledGet);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST_F(TodayServiceCase, SubscribeNodeChangeMatchingVariable)
+{
+	auto ast = peg::parseString(R"(subscription TestSubscription($taskId: ID!) {
+			changedNode: nodeChange(id: $taskId) {
+				changedId: id
+				...on Task {
+					title
+					isComplete
+				}
+			}
+		})");
+	response::Value variables(response::Type::Map);
+	variables.emplace_back("taskId", response::Value(std::string("ZmFrZVRhc2tJZA==")));
+	auto state = std::make_shared<today::RequestState>(14);
+	auto subscriptionObject = std::make_shared<today::NodeChange>(
+		[this](const std::shared_ptr<service::RequestState>& state, std::vector<uint8_t>&& idArg) -> std::shared_ptr<service::Object>
+	{
+		EXPECT_EQ(14, std::static_pointer_cast<today::RequestState>(state)->requestId) << "should pass the RequestState to the subscription resolvers";
+		EXPECT_EQ(_fakeTaskId, idArg);
+		return std::static_pointer_cast<service::Object>(std::make_shared<today::Task>(std::vector<uint8_t>(_fakeTaskId), "Don't forget", true));
+	});
+	response::Value result;
+	auto key = _service->subscribe(service::SubscriptionParams { state, std::move(ast), "TestSubscription", std::move(std::move(variables)) },
+		[&result](std::future<response::Value> response)
+	{
+		result = response.get();
+	});
+	_service->deliver("nodeChange", { {"id", response::Value(std::string("ZmFrZVRhc2tJZA==")) } }, std::static_pointer_cast<service::Object>(subscriptionObject));
+	_service->unsubscribe(key);
+
+	try
+	{
+		ASSERT_TRUE(result.type() == response::Type::Map);
+		auto errorsItr = result.find("errors");
+		if (errorsItr != result.get<const response::MapType&>().cend())
+		{
+			FAIL() << response::toJSON(response::Value(errorsItr->second));
+		}
+		const auto data = service::ScalarArgument::require("data", result);
+
+		const auto taskNode = service::ScalarArgument::require("changedNode", data);
+		EXPECT_EQ(_fakeTaskId, service::IdArgument::require("changedId", taskNode)) << "id should match in base64 encoding";
+		EXPECT_EQ("Don't forget", service::StringArgument::require("title", taskNode)) << "title should match";
+		EXPECT_TRUE(service::BooleanArgument::require("isComplete", taskNode)) << "isComplete should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST(ArgumentsCase, ListArgumentStrings)
+{
+	auto parsed = response::parseJSON(R"js({"value":[
+		"string1",
+		"string2",
+		"string3"
+	]})js");
+	std::vector<std::string> actual;
+
+	try
+	{
+		actual = service::StringArgument::require<service::TypeModifier::List>("value", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	ASSERT_EQ(3, actual.size()) << "should get 3 entries";
+	EXPECT_EQ("string1", actual[0]) << "entry should match";
+	EXPECT_EQ("string2", actual[1]) << "entry should match";
+	EXPECT_EQ("string3", actual[2]) << "entry should match";
+}
+
+TEST(ArgumentsCase, ListArgumentStringsNonNullable)
+{
+	auto parsed = response::parseJSON(R"js({"value":[
+		"string1",
+		null,
+		"string2",
+		"string3"
+	]})js");
+	bool caughtException = false;
+	std::string exceptionWhat;
+
+	try
+	{
+		auto actual = service::StringArgument::require<service::TypeModifier::List>("value", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		exceptionWhat = response::toJSON(response::Value(ex.getErrors()));
+		caughtException = true;
+	}
+
+	ASSERT_TRUE(caughtException);
+	EXPECT_EQ(R"js([{"message":"Invalid argument: value message: not a string"}])js", exceptionWhat) << "exception should match";
+}
+
+TEST(ArgumentsCase, ListArgumentStringsNullable)
+{
+	auto parsed = response::parseJSON(R"js({"value":[
+		"string1",
+		"string2",
+		null,
+		"string3"
+	]})js");
+	std::vector<std::unique_ptr<std::string>> actual;
+
+	try
+	{
+		actual = service::StringArgument::require<
+			service::TypeModifier::List,
+			service::TypeModifier::Nullable
+		>("value", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	ASSERT_EQ(4, actual.size()) << "should get 4 entries";
+	ASSERT_NE(nullptr, actual[0]) << "should not be null";
+	EXPECT_EQ("string1", *actual[0]) << "entry should match";
+	ASSERT_NE(nullptr, actual[1]) << "should not be null";
+	EXPECT_EQ("string2", *actual[1]) << "entry should match";
+	EXPECT_EQ(nullptr, actual[2]) << "should be null";
+	ASSERT_NE(nullptr, actual[3]) << "should not be null";
+	EXPECT_EQ("string3", *actual[3]) << "entry should match";
+}
+
+TEST(ArgumentsCase, ListArgumentListArgumentStrings)
+{
+	auto parsed = response::parseJSON(R"js({"value":[
+		["list1string1", "list1string2"],
+		["list2string1", "list2string2"]
+	]})js");
+	std::vector<std::vector<std::string>> actual;
+
+	try
+	{
+		actual = service::StringArgument::require<
+			service::TypeModifier::List,
+			service::TypeModifier::List
+		>("value", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	ASSERT_EQ(2, actual.size()) << "should get 2 entries";
+	ASSERT_EQ(2, actual[0].size()) << "should get 2 entries";
+	EXPECT_EQ("list1string1", actual[0][0]) << "entry should match";
+	EXPECT_EQ("list1string2", actual[0][1]) << "entry should match";
+	ASSERT_EQ(2, actual[1].size()) << "should get 2 entries";
+	EXPECT_EQ("list2string1", actual[1][0]) << "entry should match";
+	EXPECT_EQ("list2string2", actual[1][1]) << "entry should match";
+}
+
+TEST(ArgumentsCase, ListArgumentNullableListArgumentStrings)
+{
+	auto parsed = response::parseJSON(R"js({"value":[
+		null,
+		["list2string1", "list2string2"]
+	]})js");
+	std::vector<std::unique_ptr<std::vector<std::string>>> actual;
+
+	try
+	{
+		actual = service::StringArgument::require<
+			service::TypeModifier::List,
+			service::TypeModifier::Nullable,
+			service::TypeModifier::List
+		>("value", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	ASSERT_EQ(2, actual.size()) << "should get 2 entries";
+	EXPECT_EQ(nullptr, actual[0].get()) << "should be null";
+	ASSERT_EQ(2, actual[1]->size()) << "should get 2 entries";
+	EXPECT_EQ("list2string1", (*actual[1])[0]) << "entry should match";
+	EXPECT_EQ("list2string2", (*actual[1])[1]) << "entry should match";
+}
+
+TEST(ArgumentsCase, MissingArguments)
+{
+	auto parsed = response::parseJSON(R"js({"value":"string1"})js");
+	bool caughtException = false;
+	std::string exceptionWhat;
+
+	auto nullable = service::StringArgument::require<service::TypeModifier::Nullable>("missing", parsed);
+	auto optional = service::StringArgument::find<service::TypeModifier::List>("missing", parsed);
+	auto found = service::StringArgument::find("value", parsed);
+
+	EXPECT_EQ(nullptr, nullable) << "missing nullable argument should be null";
+	EXPECT_FALSE(optional.second) << "should not find a missing argument";
+	EXPECT_TRUE(found.second) << "should find the argument";
+	EXPECT_EQ("string1", found.first) << "argument should match";
+
+	try
+	{
+		auto actual = service::StringArgument::require<service::TypeModifier::List>("missing", parsed);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		exceptionWhat = response::toJSON(response::Value(ex.getErrors()));
+		caughtException = true;
+	}
+
+	ASSERT_TRUE(caughtException);
+	EXPECT_EQ(R"js([{"message":"Invalid argument: missing message: missing value"}])js", exceptionWhat) << "exception should match";
+}
+
+TEST(ArgumentsCase, TaskStateEnum)
+{
+	response::Value response(response::Type::Map);
+	response::Value status(response::Type::EnumValue);
+	status.set<response::StringType>("Started");
+	response.emplace_back("status", std::move(status));
+	today::TaskState actual = static_cast<today::TaskState>(-1);
+
+	try
+	{
+		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	EXPECT_EQ(today::TaskState::Started, actual) << "should parse the enum";
+}
+
+TEST(ArgumentsCase, TaskStateEnumFromString)
+{
+	response::Value response(response::Type::Map);
+	response::Value status("Started");
+	response.emplace_back("status", std::move(status));
+	today::TaskState actual = static_cast<today::TaskState>(-1);
+	bool caughtException = false;
+	std::string exceptionWhat;
+
+	try
+	{
+		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		caughtException = true;
+		exceptionWhat = response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	EXPECT_NE(today::TaskState::Started, actual) << "should not parse the enum from a known string value";
+	ASSERT_TRUE(caughtException);
+	EXPECT_EQ(R"js([{"message":"Invalid argument: status message: not a valid TaskState value"}])js", exceptionWhat) << "exception should match";
+}
+
+TEST(ArgumentsCase, TaskStateEnumFromJSONString)
+{
+	response::Value response(response::Type::Map);
+	response::Value status("Started");
+	response.emplace_back("status", status.from_json());
+	today::TaskState actual = static_cast<today::TaskState>(-1);
+
+
+	try
+	{
+		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	EXPECT_EQ(today::TaskState::Started, actual) << "should parse the enum";
+}
+
+TEST(PegtlCase, ParseKitchenSinkQuery)
+{
+	memory_input<> input(R"gql(
+		# Copyright (c) 2015-present, Facebook, Inc.
+		#
+		# This source code is licensed under the MIT license found in the
+		# LICENSE file in the root directory of this source tree.
+
+		query queryName($foo: ComplexType, $site: Site = MOBILE) {
+		  whoever123is: node(id: [123, 456]) {
+			id ,
+			... on User @defer {
+			  field2 {
+				id ,
+				alias: field1(first:10, after:$foo,) @include(if: $foo) {
+				  id,
+				  ...frag
+				}
+			  }
+			}
+			... @skip(unless: $foo) {
+			  id
+			}
+			... {
+			  id
+			}
+		  }
+		}
+
+		mutation likeStory {
+		  like(story: 123) @defer {
+			story {
+			  id
+			}
+		  }
+		}
+
+		subscription StoryLikeSubscription($input: StoryLikeSubscribeInput) {
+		  storyLikeSubscribe(input: $input) {
+			story {
+			  likers {
+				count
+			  }
+			  likeSentence {
+				text
+			  }
+			}
+		  }
+		}
+
+		fragment frag on Friend {
+		  foo(size: $size, bar: $b, obj: {key: "value", block: """
+
+			  block string uses \"""
+
+		  """})
+		}
+
+		{
+		  unnamed(truthy: true, falsey: false, nullish: null),
+		  query
+		})gql", "ParseKitchenSinkQuery");
+
+	const bool result = parse<document>(input);
+
+	ASSERT_TRUE(result) << "we should be able to parse the doc";
+}
+
+TEST(PegtlCase, ParseKitchenSinkSchema)
+{
+	memory_input<> input(R"gql(
+		# Copyright (c) 2015-present, Facebook, Inc.
+		#
+		# This source code is licensed under the MIT license found in the
+		# LICENSE file in the root directory of this source tree.
+
+		# (this line is padding to maintain test line numbers)
+
+		schema {
+		  query: QueryType
+		  mutation: MutationType
+		}
+
+		type Foo implements Bar {
+		  one: Type
+		  two(argument: InputType!): Type
+		  three(argument: InputType, other: String): Int
+		  four(argument: String = "string"): String
+		  five(argument: [String] = ["string", "string"]): String
+		  six(argument: InputType = {key: "value"}): Type
+		  seven(argument: Int = null): Type
+		}
+
+		type AnnotatedObject @onObject(arg: "value") {
+		  annotatedField(arg: Type = "default" @onArg): Type @onField
+		}
+
+		interface Bar {
+		  one: Type
+		  four(argument: String = "string"): String
+		}
+
+		interface AnnotatedInterface @onInterface {
+		  annotatedField(arg: Type @onArg): Type @onField
+		}
+
+		union Feed = Story | Article | Advert
+
+		union AnnotatedUnion @onUnion = A | B
+
+		scalar CustomScalar
+
+		scalar AnnotatedScalar @onScalar
+
+		enum Site {
+		  DESKTOP
+		  MOBILE
+		}
+
+		enum AnnotatedEnum @onEnum {
+		  ANNOTATED_VALUE @onEnumValue
+		  OTHER_VALUE
+		}
+
+		input InputType {
+		  key: String!
+		  answer: Int = 42
+		}
+
+		input AnnotatedInput @onInputObjectType {
+		  annotatedField: Type @onField
+		}
+
+		extend type Foo {
+		  seven(argument: [String]): Type
+		}
+
+		# NOTE: out-of-spec test cases commented out until the spec is clarified; see
+		# https://github.com/graphql/graphql-js/issues/650 .
+		# extend type Foo @onType {}
+
+		#type NoFields {}
+
+		directive @skip(if: Boolean!) on FIELD | FRAGMENT_SPREAD | INLINE_FRAGMENT
+
+		directive @include(if: Boolean!)
+		  on FIELD
+		   | FRAGMENT_SPREAD
+		   | INLINE_FRAGMENT)gql", "ParseKitchenSinkSchema");
+
+	const bool result = parse<document>(input);
+
+	ASSERT_TRUE(result) << "we should be able to parse the doc";
+}
+
+TEST(PegtlCase, ParseKitchenSink)
+{
+	memory_input<> input(R"gql(
+		# Copyright (c) 2015-present, Facebook, Inc.
+		#
+		# This source code is licensed under the MIT license found in the
+		# LICENSE file in the root directory of this source tree.
+
+		query queryName($foo: ComplexType, $site: Site = MOBILE) {
+		  whoever123is: node(id: [123, 456]) {
+			id ,
+			... on User @defer {
+			  field2 {
+				id ,
+				alias: field1(first:10, after:$foo,) @include(if: $foo) {
+				  id,
+				  ...frag
+				}
+			  }
+			}
+			... @skip(unless: $foo) {
+			  id
+			}
+			... {
+			  id
+			}
+		  }
+		}
+
+		mutation likeStory {
+		  like(story: 123) @defer {
+			story {
+			  id
+			}
+		  }
+		}
+
+		subscription StoryLikeSubscription($input: StoryLikeSubscribeInput) {
+		  storyLikeSubscribe(input: $input) {
+			story {
+			  likers {
+				count
+			  }
+			  likeSentence {
+				text
+			  }
+			}
+		  }
+		}
+
+		fragment frag on Friend {
+		  foo(size: $size, bar: $b, obj: {key: "value", block: """
+
+			  block string uses \"""
+
+		  """})
+		}
+
+		{
+		  unnamed(truthy: true, falsey: false, nullish: null),
+		  query
+		})gql", "ParseKitchenSinkSchema");
+
+	const bool result = parse<document>(input);
+
+	ASSERT_TRUE(result) << "we should be able to parse the doc";
+}
+
+TEST(PegtlCase, ParseTodayQuery)
+{
+	memory_input<> input(R"gql(
+		query Everything {
+			appointments {
+				edges {
+					node {
+						id
+						subject
+						when
+						isNow
+					}
+				}
+			}
+			tasks {
+				edges {
+					node {
+						id
+						title
+						isComplete
+					}
+				}
+			}
+			unreadCounts {
+				edges {
+					node {
+						id
+						name
+						unreadCount
+					}
+				}
+			}
+		})gql", "ParseTodayQuery");
+
+	const bool result = parse<document>(input);
+
+	ASSERT_TRUE(result) << "we should be able to parse the doc";
+}
+
+TEST(PegtlCase, ParseTodaySchema)
+{
+	memory_input<> input(R"gql(
+		# Copyright (c) Microsoft Corporation. All rights reserved.
+		# Licensed under the MIT License.
+
+		schema {
+			query: Query
+			mutation: Mutation
+			subscription: Subscription
+		}
+
+		scalar ItemCursor
+
+		type Query {
+			node(id: ID!) : Node
+
+			appointments(first: Int, after: ItemCursor, last: Int, before: ItemCursor): AppointmentConnection!
+			tasks(first: Int, after: ItemCursor, last: Int, before: ItemCursor): TaskConnection!
+			unreadCounts(first: Int, after: ItemCursor, last: Int, before: ItemCursor): FolderConnection!
+
+			appointmentsById(ids: [ID!]!) : [Appointment]!
+			tasksById(ids: [ID!]!): [Task]!
+			unreadCountsById(ids: [ID!]!): [Folder]!
+		}
+
+		interface Node {
+			id: ID!
+		}
+
+		type PageInfo {
+			hasNextPage: Boolean!
+			hasPreviousPage: Boolean!
+		}
+
+		type AppointmentEdge {
+			node: Appointment
+			cursor: ItemCursor!
+		}
+
+		type AppointmentConnection {
+			pageInfo: PageInfo!
+			edges: [AppointmentEdge]
+		}
+
+		type TaskEdge {
+			node: Task
+			cursor: ItemCursor!
+		}
+
+		type TaskConnection {
+			pageInfo: PageInfo!
+			edges: [TaskEdge]
+		}
+
+		type FolderEdge {
+			node: Folder
+			cursor: ItemCursor!
+		}
+
+		type FolderConnection {
+			pageInfo: PageInfo!
+			edges: [FolderEdge]
+		}
+
+		input CompleteTaskInput {
+			id: ID!
+			isComplete: Boolean = true
+			clientMutationId: String
+		}
+
+		type CompleteTaskPayload {
+			task: Task
+			clientMutationId: String
+		}
+
+		type Mutation {
+			completeTask(input: CompleteTaskInput!) : CompleteTaskPayload!
+		}
+
+		type Subscription {
+			nextAppointmentChange : Appointment
+		}
+
+		scalar DateTime
+
+		enum TaskState {
+			New
+			Started
+			Complete
+		}
+
+		type Appointment implements Node {
+			id: ID!
+			when: DateTime
+			subject: String
+			isNow: Boolean!
+		}
+
+		type Task implements Node {
+			id: ID!
+			title: String
+			isComplete: Boolean!
+		}
+
+		type Folder implements Node {
+			id: ID!
+			name: String
+			unreadCount: Int!
+		})gql", "ParseTodaySchema");
+
+	const bool result = parse<document>(input);
+
+	ASSERT_TRUE(result) << "we should be able to parse the doc";
+}
+
+TEST(PegtlCase, AnalyzeGrammar)
+{
+	ASSERT_EQ(0, analyze<document>(true)) << "there shuldn't be any infinite loops in the PEG version of the grammar";
+}
+
+TEST(ResponseCase, ValueConstructorFromStringLiteral)
+{
+	auto expected = "Test String";
+	auto actual = response::Value(expected);
+
+	ASSERT_TRUE(response::Type::String == actual.type());
+	ASSERT_EQ(expected, actual.release<response::StringType>());
+}
+
+TEST(ResponseCase, EmptyMapMembers)
+{
+	const response::Value empty(response::Type::Map);
+	response::Value copy(empty);
+
+	EXPECT_EQ(size_t(0), empty.size()) << "empty map should have no members";
+	EXPECT_TRUE(empty.begin() == empty.end()) << "empty map should have no members";
+	EXPECT_TRUE(empty.find("member") == empty.end()) << "empty map should not find a member";
+	EXPECT_TRUE(empty == copy) << "copy of an empty map should match";
+
+	copy.emplace_back("member", response::Value(1));
+
+	EXPECT_FALSE(empty == copy) << "copy should not share members with the original";
+	EXPECT_EQ(size_t(1), copy.size()) << "copy should have the new member";
+	EXPECT_EQ(1, copy["member"].get<response::IntType>()) << "member should match";
+	EXPECT_EQ(size_t(1), copy.release<response::MapType>().size()) << "should release the new member";
+	EXPECT_EQ(size_t(0), copy.size()) << "released map should be empty";
+}
+
+TEST(ResponseCase, CopiesShareMembersUntilModified)
+{
+	response::Value original(response::Type::Map);
+	response::Value list(response::Type::List);
+
+	list.emplace_back(response::Value("entry"));
+	original.emplace_back("list", std::move(list));
+
+	response::Value copy(original);
+
+	EXPECT_TRUE(original == copy) << "copy should match";
+	EXPECT_EQ(&original.get<const response::MapType&>(), &copy.get<const response::MapType&>()) << "copy should share the members";
+
+	copy.emplace_back("other", response::Value(1));
+
+	EXPECT_NE(&original.get<const response::MapType&>(), &copy.get<const response::MapType&>()) << "modified copy should have its own members";
+	EXPECT_EQ(size_t(1), original.size()) << "original should not change";
+	EXPECT_EQ(size_t(2), copy.size()) << "copy should have the new member";
+
+	response::Value listCopy(original["list"]);
+	auto released = listCopy.release<response::ListType>();
+
+	ASSERT_EQ(size_t(1), released.size()) << "should release a copy of the shared list";
+	EXPECT_EQ(size_t(1), original["list"].size()) << "releasing the copy should not change the original";
+	EXPECT_EQ("entry", original["list"][0].get<const response::StringType&>()) << "original entry should not change";
+}
+
+TEST(ResponseCase, SynchronousResultIsReady)
+{
+	const response::Value unusedDirectives;
+	const service::FragmentMap unusedFragments;
+	const service::SelectionSetParams selectionSetParams {
+		nullptr,
+		unusedDirectives,
+		unusedDirectives,
+		unusedDirectives,
+		unusedDirectives,
+		nullptr,
+		nullptr,
+		nullptr,
+		false,
+		nullptr
+	};
+	service::ResolverParams params(selectionSetParams, response::Value(response::Type::Map), response::Value(response::Type::Map),
+		nullptr, unusedFragments, unusedDirectives);
+	std::vector<std::unique_ptr<response::StringType>> strings;
+
+	strings.push_back(std::unique_ptr<response::StringType>(new response::StringType("string1")));
+	strings.push_back(nullptr);
+
+	auto result = service::StringResult::convert<service::TypeModifier::List, service::TypeModifier::Nullable>(std::move(strings), params);
+
+	ASSERT_TRUE(std::future_status::ready == result.wait_for(std::chrono::seconds(0))) << "should not need to wait for a value which is already available";
+	EXPECT_EQ(R"js(["string1",null])js", response::toJSON(result.get())) << "value should match";
+}
+
+TEST(ExecutorCase, ThreadPoolLaunch)
+{
+	auto executor = std::make_shared<service::ThreadPool>(2);
+	std::vector<std::future<int>> results;
+
+	for (int i = 0; i < 100; ++i)
+	{
+		results.push_back(service::launch(executor,
+			[](int value)
+		{
+			return value * 2;
+		}, i));
+	}
+
+	int actual = 0;
+
+	for (auto& result : results)
+	{
+		actual += result.get();
+	}
+
+	EXPECT_EQ(9900, actual) << "should run all of the work";
+}
+
+TEST(ExecutorCase, NestedLaunchDoesNotDeadlock)
+{
+	auto executor = std::make_shared<service::ThreadPool>(1);
+	auto outer = service::launch(executor,
+		[executor]()
+	{
+		auto inner = service::launch(executor,
+			[]()
+		{
+			return std::string("inner");
+		});
+
+		// The only worker thread is busy running this function, so waiting on inner should run it here.
+		return inner.get() + " outer";
+	});
+
+	EXPECT_EQ("inner outer", outer.get()) << "should run the inner work while waiting for it";
+}
+
+TEST(ExecutorCase, LimitedExecutorConcurrency)
+{
+	auto pool = std::make_shared<service::ThreadPool>(4);
+	auto executor = std::make_shared<service::LimitedExecutor>(pool, 2);
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t running = 0;
+	size_t maxRunning = 0;
+	size_t completed = 0;
+
+	for (size_t i = 0; i < 16; ++i)
+	{
+		executor->post([&]()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				maxRunning = std::max(maxRunning, ++running);
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				--running;
+				++completed;
+				condition.notify_one();
+			}
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	condition.wait(lock, [&]()
+	{
+		return completed == 16;
+	});
+
+	EXPECT_GE(size_t(2), maxRunning) << "should not run more than 2 at a time";
+}
+
+class ErrorQuery : public service::Object
+{
+public:
+	ErrorQuery()
+		: service::Object({ "Query" }, {
+			{ "fail", [](service::ResolverParams&&) { return resolveFail(); } },
+			{ "slow", [this](service::ResolverParams&&) { return resolveSlow(); } }
+		})
+		, slowFinished(false)
+	{
+	}
+
+	std::atomic<bool> slowFinished;
+
+private:
+	static std::future<response::Value> resolveFail()
+	{
+		std::promise<response::Value> promise;
+
+		promise.set_exception(std::make_exception_ptr(service::schema_exception({ "field failed" })));
+
+		return promise.get_future();
+	}
+
+	std::future<response::Value> resolveSlow()
+	{
+		std::promise<response::Value> promise;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		slowFinished = true;
+		promise.set_value(response::Value(true));
+
+		return promise.get_future();
+	}
+};
+
+TEST(ExecutorCase, SiblingFieldsFinishBeforeError)
+{
+	auto query = std::make_shared<ErrorQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			fail
+			slow
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+
+	state->executor = std::make_shared<service::ThreadPool>(2);
+
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+
+	EXPECT_TRUE(result.find("errors") != result.end()) << "should return the error";
+	EXPECT_TRUE(query->slowFinished) << "should wait for the launched sibling before releasing the operation";
+}
+
+// The blocked field keeps running on the Executor until the test releases it.
+class BlockingQuery : public service::Object
+{
+public:
+	BlockingQuery()
+		: service::Object({ "Query" }, {
+			{ "blocked", [this](service::ResolverParams&&) { return resolveBlocked(); } },
+			{ "fast", [](service::ResolverParams&&) { return resolveFast(); } }
+		})
+		, release(releasePromise.get_future().share())
+		, blockedFinished(false)
+	{
+	}
+
+	std::promise<void> startedPromise;
+	std::promise<void> releasePromise;
+	std::shared_future<void> release;
+	std::atomic<bool> blockedFinished;
+
+private:
+	std::future<response::Value> resolveBlocked()
+	{
+		std::promise<response::Value> promise;
+
+		startedPromise.set_value();
+		release.wait_for(std::chrono::seconds(5));
+		blockedFinished = true;
+		promise.set_value(response::Value(true));
+
+		return promise.get_future();
+	}
+
+	static std::future<response::Value> resolveFast()
+	{
+		std::promise<response::Value> promise;
+
+		promise.set_value(response::Value(true));
+
+		return promise.get_future();
+	}
+};
+
+TEST(ExecutorCase, AbandonFieldsPastDeadline)
+{
+	auto query = std::make_shared<BlockingQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			blocked
+			fast
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+
+	state->executor = std::make_shared<service::ThreadPool>(2);
+	state->cancellation = std::make_shared<service::Cancellation>(std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+
+	auto future = service.resolve(state, *ast.root, "", response::Value(response::Type::Map));
+
+	// Make sure a worker is running the blocked field, instead of this thread when it waits for it.
+	query->startedPromise.get_future().wait();
+
+	auto result = future.get();
+
+	EXPECT_FALSE(query->blockedFinished) << "should not wait for the blocked field past the deadline";
+
+	auto errorsItr = result.find("errors");
+	ASSERT_FALSE(errorsItr == result.get<const response::MapType&>().cend()) << "the abandoned field should be an error";
+	const auto errors = response::toJSON(response::Value(errorsItr->second));
+	EXPECT_NE(std::string::npos, errors.find("Deadline exceeded field: blocked")) << "error should name the field";
+
+	const auto data = service::ScalarArgument::require("data", result);
+	ASSERT_TRUE(data.type() == response::Type::Map);
+	EXPECT_TRUE(data["blocked"].type() == response::Type::Null) << "the abandoned field should be null";
+	EXPECT_TRUE(data["fast"].type() == response::Type::Boolean) << "the other field should still be resolved";
+
+	query->releasePromise.set_value();
+	state->cancellation->waitForAbandoned();
+
+	EXPECT_TRUE(query->blockedFinished) << "waitForAbandoned should wait for the blocked field";
+}
+
+// Without an Executor, the slow field only blocks when its value is waited on after every
+// resolver in the selection set has been called.
+class SiblingTimingQuery : public service::Object
+{
+public:
+	SiblingTimingQuery()
+		: service::Object({ "Query" }, {
+			{ "slow", [](service::ResolverParams&&) { return resolveSlow(); } },
+			{ "fast", [](service::ResolverParams&&) { return resolveFast(); } }
+		})
+	{
+	}
+
+private:
+	static std::future<response::Value> resolveSlow()
+	{
+		return std::async(std::launch::deferred,
+			[]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+			return response::Value(true);
+		});
+	}
+
+	static std::future<response::Value> resolveFast()
+	{
+		std::promise<response::Value> promise;
+
+		promise.set_value(response::Value(true));
+
+		return promise.get_future();
+	}
+};
+
+TEST(TracingCase, SiblingFieldDurations)
+{
+	auto query = std::make_shared<SiblingTimingQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			slow
+			fast
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+
+	state->tracer = std::make_shared<service::Tracer>();
+
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
 	try
 	{
-		actual = service::StringArgument::require<
-			service::TypeModifier::List,
-			service::TypeModifier::Nullable,
-			service::TypeModifier::List
-		>("value", parsed);
+		const auto extensions = service::ScalarArgument::require("extensions", result);
+		const auto tracing = service::ScalarArgument::require("tracing", extensions);
+		const auto execution = service::ScalarArgument::require("execution", tracing);
+		const auto resolvers = service::ScalarArgument::require<service::TypeModifier::List>("resolvers", execution);
+		ASSERT_EQ(size_t(2), resolvers.size()) << "there should be a trace for every resolver";
+
+		for (const auto& resolver : resolvers)
+		{
+			const auto fieldName = service::StringArgument::require("fieldName", resolver);
+			const auto duration = service::FloatArgument::require("duration", resolver);
+
+			if (fieldName == "slow")
+			{
+				EXPECT_LE(50000000.0, duration) << "slow field should include the time it spent blocking";
+			}
+			else
+			{
+				EXPECT_GT(25000000.0, duration) << "fast field should not include the time spent waiting for the slow field";
+			}
+		}
 	}
 	catch (const service::schema_exception& ex)
 	{
 		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
+}
 
-	ASSERT_EQ(2, actual.size()) << "should get 2 entries";
-	EXPECT_EQ(nullptr, actual[0].get()) << "should be null";
-	ASSERT_EQ(2, actual[1]->size()) << "should get 2 entries";
-	EXPECT_EQ("list2string1", (*actual[1])[0]) << "entry should match";
-	EXPECT_EQ("list2string2", (*actual[1])[1]) << "entry should match";
+TEST(MetricsCase, SiblingFieldLatency)
+{
+	auto metrics = std::make_shared<service::AggregateMetrics>();
+	auto query = std::make_shared<SiblingTimingQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			slow
+			fast
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+
+	service::Metrics::install(metrics);
+
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+
+	service::Metrics::install(nullptr);
+
+	const auto resolve = metrics->getPhaseMetrics(service::MetricsPhase::Resolve);
+
+	EXPECT_TRUE(result.find("errors") == result.end()) << "query should succeed";
+	EXPECT_EQ(uint64_t(2), resolve.count) << "should record every resolver";
+	EXPECT_LE(std::chrono::milliseconds(50), resolve.totalLatency) << "slow field should include the time it spent blocking";
+	EXPECT_GT(std::chrono::milliseconds(75), resolve.totalLatency) << "fast field should not include the time spent waiting for the slow field";
 }
 
-TEST(ArgumentsCase, TaskStateEnum)
+TEST(ExecutorCase, LimitedExecutorReleasesThrowingWork)
 {
-	response::Value response(response::Type::Map);
-	response::Value status(response::Type::EnumValue);
-	status.set<response::StringType>("Started");
-	response.emplace_back("status", std::move(status));
-	today::TaskState actual = static_cast<today::TaskState>(-1);
+	auto pool = std::make_shared<service::ThreadPool>(2);
+	auto executor = std::make_shared<service::LimitedExecutor>(pool, 1);
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t completed = 0;
+
+	for (size_t i = 0; i < 4; ++i)
+	{
+		executor->post([&, i]()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				++completed;
+				condition.notify_one();
+			}
+
+			if (i % 2 == 0)
+			{
+				throw std::runtime_error("work failed");
+			}
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	EXPECT_TRUE(condition.wait_for(lock, std::chrono::seconds(10), [&]()
+	{
+		return completed == 4;
+	})) << "should keep running the waiting work after some of it throws";
+}
+
+TEST(MetricsCase, LatencyHistogram)
+{
+	service::AggregateMetrics metrics;
+
+	metrics.record(service::MetricsPhase::Parse, std::chrono::nanoseconds(500));
+	metrics.record(service::MetricsPhase::Parse, std::chrono::microseconds(1));
+	metrics.record(service::MetricsPhase::Parse, std::chrono::microseconds(1500));
+	metrics.record(service::MetricsPhase::Parse, std::chrono::hours(1));
+
+	const auto parse = metrics.getPhaseMetrics(service::MetricsPhase::Parse);
+
+	EXPECT_EQ(uint64_t(4), parse.count) << "should count every call";
+	EXPECT_EQ(uint64_t(1), parse.histogram[0]) << "under 1 microsecond";
+	EXPECT_EQ(uint64_t(1), parse.histogram[1]) << "1 microsecond";
+	EXPECT_EQ(uint64_t(1), parse.histogram[11]) << "1.5 milliseconds";
+	EXPECT_EQ(uint64_t(1), parse.histogram[service::AggregateMetrics::s_bucketCount - 1]) << "1 hour";
+	EXPECT_EQ(uint64_t(0), metrics.getPhaseMetrics(service::MetricsPhase::Serialize).count) << "phases are counted separately";
+}
+
+TEST(MetricsCase, RecordFromManyThreads)
+{
+	service::AggregateMetrics metrics;
+	std::vector<std::thread> threads;
+
+	for (size_t i = 0; i < 4; ++i)
+	{
+		threads.push_back(std::thread([&metrics]()
+		{
+			for (size_t j = 0; j < 1000; ++j)
+			{
+				metrics.record(service::MetricsPhase::Resolve, std::chrono::microseconds(2));
+			}
+		}));
+	}
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	const auto resolve = metrics.getPhaseMetrics(service::MetricsPhase::Resolve);
+
+	EXPECT_EQ(uint64_t(4000), resolve.count) << "should count every call from every thread";
+	EXPECT_EQ(uint64_t(4000), resolve.histogram[2]) << "2 microseconds";
+	EXPECT_EQ(std::chrono::nanoseconds(std::chrono::microseconds(8000)), resolve.totalLatency) << "should add up the latency";
+}
+
+TEST(BatchLoaderCase, LoadDuplicateKeysInOneBatch)
+{
+	std::vector<std::vector<int>> batches;
+	auto loader = std::make_shared<service::BatchLoader<int, std::string>>(
+		[&batches](const std::vector<int>& keys)
+	{
+		std::vector<std::string> values;
+
+		batches.push_back(keys);
+
+		for (auto key : keys)
+		{
+			values.push_back(std::to_string(key));
+		}
+
+		return values;
+	});
+
+	auto first = loader->load(1);
+	auto second = loader->load(2);
+	auto duplicate = loader->load(1);
+
+	loader->dispatch();
+
+	EXPECT_EQ("1", first.get()) << "should get the first value";
+	EXPECT_EQ("2", second.get()) << "should get the second value";
+	EXPECT_EQ("1", duplicate.get()) << "should get the duplicate value";
+	ASSERT_EQ(size_t(1), batches.size()) << "should call the batch function once";
+	EXPECT_EQ((std::vector<int> { 1, 2 }), batches.front()) << "should only request each key once";
+
+	auto memoized = loader->load(2).get();
+	auto many = loader->loadMany({ 2, 3 }).get();
+
+	EXPECT_EQ("2", memoized) << "should get the memoized value";
+	EXPECT_EQ((std::vector<std::string> { "2", "3" }), many) << "should get all of the values";
+	ASSERT_EQ(size_t(2), batches.size()) << "waiting should dispatch the new key";
+	EXPECT_EQ(std::vector<int> { 3 }, batches.back()) << "should not request the memoized key again";
+}
+
+class MemoizedQuery : public service::Object
+{
+public:
+	MemoizedQuery()
+		: service::Object({ "Query" }, {
+			{ "count", [this](service::ResolverParams&& params) { return memoize("count", std::move(params), [this](service::ResolverParams&& params) { return resolveCount(std::move(params)); }); } }
+		})
+	{
+	}
+
+	size_t resolverCalls = 0;
+
+private:
+	std::future<response::Value> resolveCount(service::ResolverParams&&)
+	{
+		std::promise<response::Value> promise;
+
+		promise.set_value(response::Value(static_cast<response::IntType>(++resolverCalls)));
+
+		return promise.get_future();
+	}
+};
+
+TEST(MemoizeCase, PureFieldSharesResult)
+{
+	auto query = std::make_shared<MemoizedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			first: count
+			second: count
+			third: count(step: 2)
+			fourth: count(step: 2)
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+	state->memoizePureFields = true;
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
 	try
 	{
-		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+		const auto data = service::ScalarArgument::require("data", result);
+
+		EXPECT_EQ(size_t(2), query->resolverCalls) << "should call the resolver once for each set of arguments";
+		EXPECT_EQ(1, service::IntArgument::require("first", data)) << "first should match";
+		EXPECT_EQ(1, service::IntArgument::require("second", data)) << "second should share the first result";
+		EXPECT_EQ(2, service::IntArgument::require("third", data)) << "third should match";
+		EXPECT_EQ(2, service::IntArgument::require("fourth", data)) << "fourth should share the third result";
 	}
 	catch (const service::schema_exception& ex)
 	{
 		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
-
-	EXPECT_EQ(today::TaskState::Started, actual) << "should parse the enum";
 }
 
-TEST(ArgumentsCase, TaskStateEnumFromString)
+TEST(MemoizeCase, FieldDirectivesInKey)
 {
-	response::Value response(response::Type::Map);
-	response::Value status("Started");
-	response.emplace_back("status", std::move(status));
-	today::TaskState actual = static_cast<today::TaskState>(-1);
-	bool caughtException = false;
-	std::string exceptionWhat;
+	auto query = std::make_shared<MemoizedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			first: count @fieldTag(field: "a")
+			second: count @fieldTag(field: "a")
+			third: count @fieldTag(field: "b")
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+	state->memoizePureFields = true;
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
 	try
 	{
-		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+		const auto data = service::ScalarArgument::require("data", result);
+
+		EXPECT_EQ(size_t(2), query->resolverCalls) << "should call the resolver once for each set of field directives";
+		EXPECT_EQ(1, service::IntArgument::require("first", data)) << "first should match";
+		EXPECT_EQ(1, service::IntArgument::require("second", data)) << "second should share the first result";
+		EXPECT_EQ(2, service::IntArgument::require("third", data)) << "third should not share the result with different directives";
 	}
 	catch (const service::schema_exception& ex)
 	{
-		caughtException = true;
-		exceptionWhat = response::toJSON(response::Value(ex.getErrors()));
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
-
-	EXPECT_NE(today::TaskState::Started, actual) << "should not parse the enum from a known string value";
-	ASSERT_TRUE(caughtException);
-	EXPECT_EQ(R"js([{"message":"Invalid argument: status message: not a valid TaskState value"}])js", exceptionWhat) << "exception should match";
 }
 
-TEST(ArgumentsCase, TaskStateEnumFromJSONString)
+TEST(MemoizeCase, OptIn)
 {
-	response::Value response(response::Type::Map);
-	response::Value status("Started");
-	response.emplace_back("status", status.from_json());
-	today::TaskState actual = static_cast<today::TaskState>(-1);
-
+	auto query = std::make_shared<MemoizedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			first: count
+			second: count
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
 	try
 	{
-		actual = service::ModifiedArgument<today::TaskState>::require("status", response);
+		const auto data = service::ScalarArgument::require("data", result);
+
+		EXPECT_EQ(size_t(2), query->resolverCalls) << "should call the resolver for every field without opting in";
+		EXPECT_EQ(1, service::IntArgument::require("first", data)) << "first should match";
+		EXPECT_EQ(2, service::IntArgument::require("second", data)) << "second should match";
 	}
 	catch (const service::schema_exception& ex)
 	{
 		FAIL() << response::toJSON(response::Value(ex.getErrors()));
 	}
-
-	EXPECT_EQ(today::TaskState::Started, actual) << "should parse the enum";
 }
 
-TEST(PegtlCase, ParseKitchenSinkQuery)
+class CachedQuery : public service::Object
 {
-	memory_input<> input(R"gql(
-		# Copyright (c) 2015-present, Facebook, Inc.
-		#
-		# This source code is licensed under the MIT license found in the
-		# LICENSE file in the root directory of this source tree.
+public:
+	CachedQuery()
+		: service::Object({ "Query" }, {
+			{ "publicCount", [this](service::ResolverParams&& params) { return cacheField("publicCount", std::chrono::seconds(60), service::CacheScope::Public, std::move(params), [this](service::ResolverParams&& params) { return resolveCount(std::move(params)); }); } },
+			{ "privateCount", [this](service::ResolverParams&& params) { return cacheField("privateCount", std::chrono::seconds(60), service::CacheScope::Private, std::move(params), [this](service::ResolverParams&& params) { return resolveCount(std::move(params)); }); } }
+		})
+	{
+	}
 
-		query queryName($foo: ComplexType, $site: Site = MOBILE) {
-		  whoever123is: node(id: [123, 456]) {
-			id ,
-			... on User @defer {
-			  field2 {
-				id ,
-				alias: field1(first:10, after:$foo,) @include(if: $foo) {
-				  id,
-				  ...frag
-				}
-			  }
-			}
-			... @skip(unless: $foo) {
-			  id
-			}
-			... {
-			  id
-			}
-		  }
-		}
+	size_t resolverCalls = 0;
 
-		mutation likeStory {
-		  like(story: 123) @defer {
-			story {
-			  id
-			}
-		  }
-		}
+protected:
+	std::string getCacheIdentity() const override
+	{
+		return "query";
+	}
 
-		subscription StoryLikeSubscription($input: StoryLikeSubscribeInput) {
-		  storyLikeSubscribe(input: $input) {
-			story {
-			  likers {
-				count
-			  }
-			  likeSentence {
-				text
-			  }
-			}
-		  }
-		}
+private:
+	std::future<response::Value> resolveCount(service::ResolverParams&&)
+	{
+		std::promise<response::Value> promise;
 
-		fragment frag on Friend {
-		  foo(size: $size, bar: $b, obj: {key: "value", block: """
+		promise.set_value(response::Value(static_cast<response::IntType>(++resolverCalls)));
 
-			  block string uses \"""
+		return promise.get_future();
+	}
+};
 
-		  """})
-		}
+TEST(FieldCacheCase, ShareAcrossRequests)
+{
+	auto query = std::make_shared<CachedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			publicCount
+			other: publicCount(step: 2)
+		})"_graphql;
+	auto fieldCache = std::make_shared<service::ShardedFieldCache>();
+	auto firstState = std::make_shared<service::RequestState>();
+	auto secondState = std::make_shared<service::RequestState>();
 
-		{
-		  unnamed(truthy: true, falsey: false, nullish: null),
-		  query
-		})gql", "ParseKitchenSinkQuery");
+	firstState->fieldCache = fieldCache;
+	secondState->fieldCache = fieldCache;
 
-	const bool result = parse<document>(input);
+	auto first = response::toJSON(service.resolve(firstState, *ast.root, "", response::Value(response::Type::Map)).get());
+	auto second = response::toJSON(service.resolve(secondState, *ast.root, "", response::Value(response::Type::Map)).get());
+	auto uncached = response::toJSON(service.resolve(std::make_shared<service::RequestState>(), *ast.root, "", response::Value(response::Type::Map)).get());
 
-	ASSERT_TRUE(result) << "we should be able to parse the doc";
+	EXPECT_EQ(R"js({"data":{"publicCount":1,"other":2}})js", first) << "first request should call the resolvers";
+	EXPECT_EQ(first, second) << "second request should get the cached values";
+	EXPECT_EQ(R"js({"data":{"publicCount":3,"other":4}})js", uncached) << "requests without a FieldCache should call the resolvers";
+	EXPECT_EQ(size_t(4), query->resolverCalls) << "should only call the resolvers for each set of arguments once per FieldCache";
 }
 
-TEST(PegtlCase, ParseKitchenSinkSchema)
+TEST(FieldCacheCase, PrivateScope)
 {
-	memory_input<> input(R"gql(
-		# Copyright (c) 2015-present, Facebook, Inc.
-		#
-		# This source code is licensed under the MIT license found in the
-		# LICENSE file in the root directory of this source tree.
-
-		# (this line is padding to maintain test line numbers)
+	auto query = std::make_shared<CachedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			privateCount
+		})"_graphql;
+	auto fieldCache = std::make_shared<service::ShardedFieldCache>();
+	const auto resolve = [&service, &ast, &fieldCache](std::string&& cacheScope)
+	{
+		auto state = std::make_shared<service::RequestState>();
 
-		schema {
-		  query: QueryType
-		  mutation: MutationType
-		}
+		state->fieldCache = fieldCache;
+		state->cacheScope = std::move(cacheScope);
 
-		type Foo implements Bar {
-		  one: Type
-		  two(argument: InputType!): Type
-		  three(argument: InputType, other: String): Int
-		  four(argument: String = "string"): String
-		  five(argument: [String] = ["string", "string"]): String
-		  six(argument: InputType = {key: "value"}): Type
-		  seven(argument: Int = null): Type
-		}
+		return response::toJSON(service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get());
+	};
 
-		type AnnotatedObject @onObject(arg: "value") {
-		  annotatedField(arg: Type = "default" @onArg): Type @onField
-		}
+	EXPECT_EQ(R"js({"data":{"privateCount":1}})js", resolve(std::string())) << "should not cache without a scope";
+	EXPECT_EQ(R"js({"data":{"privateCount":2}})js", resolve(std::string())) << "should not cache without a scope";
+	EXPECT_EQ(R"js({"data":{"privateCount":3}})js", resolve("alice")) << "should call the resolver in a new scope";
+	EXPECT_EQ(R"js({"data":{"privateCount":4}})js", resolve("bob")) << "should not share the value between scopes";
+	EXPECT_EQ(R"js({"data":{"privateCount":3}})js", resolve("alice")) << "should share the value in the same scope";
+}
 
-		interface Bar {
-		  one: Type
-		  four(argument: String = "string"): String
-		}
+TEST(FieldCacheCase, FieldDirectivesInKey)
+{
+	auto query = std::make_shared<CachedQuery>();
+	service::Request service({ { "query", query } });
+	auto fieldCache = std::make_shared<service::ShardedFieldCache>();
+	const auto resolve = [&service, &fieldCache](const peg::ast<const char*>& ast)
+	{
+		auto state = std::make_shared<service::RequestState>();
 
-		interface AnnotatedInterface @onInterface {
-		  annotatedField(arg: Type @onArg): Type @onField
-		}
+		state->fieldCache = fieldCache;
 
-		union Feed = Story | Article | Advert
+		return response::toJSON(service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get());
+	};
+	auto first = R"({
+			publicCount @fieldTag(field: "a")
+		})"_graphql;
+	auto second = R"({
+			publicCount @fieldTag(field: "b")
+		})"_graphql;
 
-		union AnnotatedUnion @onUnion = A | B
+	EXPECT_EQ(R"js({"data":{"publicCount":1}})js", resolve(first)) << "first request should call the resolver";
+	EXPECT_EQ(R"js({"data":{"publicCount":2}})js", resolve(second)) << "should not share the value with different directives";
+	EXPECT_EQ(R"js({"data":{"publicCount":1}})js", resolve(first)) << "should share the value with the same directives";
+}
 
-		scalar CustomScalar
+TEST(FieldCacheCase, ExpireAndEvict)
+{
+	service::ShardedFieldCache fieldCache(1, 2);
+	response::Value value;
 
-		scalar AnnotatedScalar @onScalar
+	fieldCache.insert("expired", response::Value(1), std::chrono::seconds(0));
+	EXPECT_FALSE(fieldCache.find("expired", value)) << "should expire after maxAge";
 
-		enum Site {
-		  DESKTOP
-		  MOBILE
-		}
+	fieldCache.insert("first", response::Value(1), std::chrono::seconds(10));
+	fieldCache.insert("second", response::Value(2), std::chrono::seconds(20));
+	fieldCache.insert("third", response::Value(3), std::chrono::seconds(30));
 
-		enum AnnotatedEnum @onEnum {
-		  ANNOTATED_VALUE @onEnumValue
-		  OTHER_VALUE
-		}
+	EXPECT_FALSE(fieldCache.find("first", value)) << "should evict the entry which expires soonest";
+	ASSERT_TRUE(fieldCache.find("second", value)) << "should keep the second entry";
+	EXPECT_EQ(2, value.get<response::IntType>()) << "should get the second value";
+	ASSERT_TRUE(fieldCache.find("third", value)) << "should keep the third entry";
+	EXPECT_EQ(3, value.get<response::IntType>()) << "should get the third value";
 
-		input InputType {
-		  key: String!
-		  answer: Int = 42
-		}
+	fieldCache.clear();
+	EXPECT_FALSE(fieldCache.find("third", value)) << "should drop everything";
+}
 
-		input AnnotatedInput @onInputObjectType {
-		  annotatedField: Type @onField
+TEST(CollectFieldsCase, ResolveResponseKeyOnce)
+{
+	auto query = std::make_shared<MemoizedQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			count
+			...on Query {
+				count
+			}
+			...CountFragment
 		}
 
-		extend type Foo {
-		  seven(argument: [String]): Type
-		}
+		fragment CountFragment on Query {
+			count
+		})"_graphql;
+	auto result = service.resolve(nullptr, *ast.root, "", response::Value(response::Type::Map)).get();
 
-		# NOTE: out-of-spec test cases commented out until the spec is clarified; see
-		# https://github.com/graphql/graphql-js/issues/650 .
-		# extend type Foo @onType {}
+	try
+	{
+		const auto data = service::ScalarArgument::require("data", result);
 
-		#type NoFields {}
+		EXPECT_EQ(size_t(1), query->resolverCalls) << "should only call the resolver once for each response key";
+		EXPECT_EQ(size_t(1), data.size()) << "should only have one response key";
+		EXPECT_EQ(1, service::IntArgument::require("count", data)) << "count should match";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
 
-		directive @skip(if: Boolean!) on FIELD | FRAGMENT_SPREAD | INLINE_FRAGMENT
+class LookaheadNode : public service::Object
+{
+public:
+	LookaheadNode()
+		: service::Object({ "Node", "Item" }, {
+			{ "id", [](service::ResolverParams&&) { return resolveString("id"); } },
+			{ "name", [](service::ResolverParams&&) { return resolveString("name"); } },
+			{ "price", [](service::ResolverParams&&) { return resolveString("price"); } }
+		})
+	{
+	}
 
-		directive @include(if: Boolean!)
-		  on FIELD
-		   | FRAGMENT_SPREAD
-		   | INLINE_FRAGMENT)gql", "ParseKitchenSinkSchema");
+private:
+	static std::future<response::Value> resolveString(const char* value)
+	{
+		std::promise<response::Value> promise;
 
-	const bool result = parse<document>(input);
+		promise.set_value(response::Value(std::string(value)));
 
-	ASSERT_TRUE(result) << "we should be able to parse the doc";
-}
+		return promise.get_future();
+	}
+};
 
-TEST(PegtlCase, ParseKitchenSink)
+class LookaheadQuery : public service::Object
 {
-	memory_input<> input(R"gql(
-		# Copyright (c) 2015-present, Facebook, Inc.
-		#
-		# This source code is licensed under the MIT license found in the
-		# LICENSE file in the root directory of this source tree.
+public:
+	LookaheadQuery()
+		: service::Object({ "Query" }, {
+			{ "node", [this](service::ResolverParams&& params) { return resolveNode(std::move(params)); } }
+		})
+	{
+	}
 
-		query queryName($foo: ComplexType, $site: Site = MOBILE) {
-		  whoever123is: node(id: [123, 456]) {
-			id ,
-			... on User @defer {
-			  field2 {
-				id ,
-				alias: field1(first:10, after:$foo,) @include(if: $foo) {
-				  id,
-				  ...frag
+	std::vector<std::shared_ptr<const service::SelectedFields>> lookahead;
+
+private:
+	std::future<response::Value> resolveNode(service::ResolverParams&& params)
+	{
+		service::FieldParams fieldParams(params, std::move(params.fieldDirectives));
+
+		lookahead.push_back(fieldParams.getSelectedFields());
+
+		return service::ModifiedResult<service::Object>::convert(std::make_shared<LookaheadNode>(), std::move(params));
+	}
+};
+
+TEST(LookaheadCase, ExpandFragmentsAndDirectives)
+{
+	auto query = std::make_shared<LookaheadQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"(query Lookahead($withPrice: Boolean!) {
+			first: node {
+				id
+				label: name @include(if: false)
+				...on Item {
+					price(currency: "USD") @include(if: $withPrice)
 				}
-			  }
+				...NodeFragment
 			}
-			... @skip(unless: $foo) {
-			  id
-			}
-			... {
-			  id
+			second: node {
+				id
+				...on Item {
+					price(currency: "USD") @include(if: $withPrice)
+				}
+				...NodeFragment
 			}
-		  }
 		}
 
-		mutation likeStory {
-		  like(story: 123) @defer {
-			story {
-			  id
-			}
-		  }
-		}
+		fragment NodeFragment on Node {
+			id
+			name @skip(if: false)
+		})"_graphql;
+	response::Value variables(response::Type::Map);
+	auto state = std::make_shared<service::RequestState>();
 
-		subscription StoryLikeSubscription($input: StoryLikeSubscribeInput) {
-		  storyLikeSubscribe(input: $input) {
-			story {
-			  likers {
-				count
-			  }
-			  likeSentence {
-				text
-			  }
-			}
-		  }
-		}
+	variables.emplace_back("withPrice", response::Value(true));
 
-		fragment frag on Friend {
-		  foo(size: $size, bar: $b, obj: {key: "value", block: """
+	auto result = service.resolve(state, *ast.root, "", std::move(variables)).get();
 
-			  block string uses \"""
+	try
+	{
+		ASSERT_EQ(size_t(2), query->lookahead.size()) << "should resolve both fields";
 
-		  """})
-		}
+		const auto& selected = *query->lookahead.front();
 
-		{
-		  unnamed(truthy: true, falsey: false, nullish: null),
-		  query
-		})gql", "ParseKitchenSinkSchema");
+		ASSERT_EQ(size_t(3), selected.size()) << "should merge the fragments and skip the excluded alias";
+		EXPECT_EQ("id", selected[0].name) << "first field should be id";
+		EXPECT_EQ("price", selected[1].name) << "second field should be price";
+		EXPECT_EQ("price", selected[1].alias) << "price alias should default to the name";
+		EXPECT_EQ("USD", service::StringArgument::require("currency", selected[1].arguments)) << "should include the arguments";
+		EXPECT_EQ("name", selected[2].name) << "third field should be name";
+		EXPECT_NE(query->lookahead.front().get(), query->lookahead.back().get()) << "different selection sets should have their own lookahead";
 
-	const bool result = parse<document>(input);
+		const auto data = service::ScalarArgument::require("data", result);
+		const auto first = service::ScalarArgument::require("first", data);
 
-	ASSERT_TRUE(result) << "we should be able to parse the doc";
+		EXPECT_EQ(size_t(3), first.size()) << "should resolve the same fields";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
 }
 
-TEST(PegtlCase, ParseTodayQuery)
+TEST(LookaheadCase, AliasesInDifferentTypeConditions)
 {
-	memory_input<> input(R"gql(
-		query Everything {
-			appointments {
-				edges {
-					node {
-						id
-						subject
-						when
-						isNow
-					}
+	auto query = std::make_shared<LookaheadQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			node {
+				id
+				...on Item {
+					label: name
 				}
-			}
-			tasks {
-				edges {
-					node {
-						id
-						title
-						isComplete
-					}
+				...on Folder {
+					label: price(currency: "USD")
 				}
 			}
-			unreadCounts {
-				edges {
-					node {
-						id
-						name
-						unreadCount
-					}
-				}
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+
+	try
+	{
+		ASSERT_EQ(size_t(1), query->lookahead.size()) << "should resolve the field";
+
+		const auto& selected = *query->lookahead.front();
+
+		ASSERT_EQ(size_t(3), selected.size()) << "should keep one entry for each type condition";
+		EXPECT_EQ("id", selected[0].name) << "first field should be id";
+		EXPECT_TRUE(selected[0].typeCondition.empty()) << "id is selected directly";
+		EXPECT_EQ("name", selected[1].name) << "second field should be name";
+		EXPECT_EQ("label", selected[1].alias) << "name should use the alias";
+		EXPECT_EQ("Item", selected[1].typeCondition) << "name should be selected on Item";
+		EXPECT_EQ("price", selected[2].name) << "third field should be price";
+		EXPECT_EQ("label", selected[2].alias) << "price should use the alias";
+		EXPECT_EQ("Folder", selected[2].typeCondition) << "price should be selected on Folder";
+
+		const auto data = service::ScalarArgument::require("data", result);
+		const auto node = service::ScalarArgument::require("node", data);
+
+		EXPECT_EQ("name", service::StringArgument::require("label", node)) << "should resolve the field for the concrete type";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
+
+TEST(LookaheadCase, ReleasedWithOperation)
+{
+	auto query = std::make_shared<LookaheadQuery>();
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			node {
+				id
 			}
-		})gql", "ParseTodayQuery");
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
 
-	const bool result = parse<document>(input);
+	service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
-	ASSERT_TRUE(result) << "we should be able to parse the doc";
+	ASSERT_EQ(size_t(1), query->lookahead.size()) << "should resolve the field";
+	ASSERT_EQ(size_t(1), query->lookahead.front()->size()) << "should only select id";
+	EXPECT_EQ("id", query->lookahead.front()->front().name) << "should select id";
+
+	service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
+
+	ASSERT_EQ(size_t(2), query->lookahead.size()) << "should resolve the field again";
+	EXPECT_NE(query->lookahead.front().get(), query->lookahead.back().get()) << "should release the lookahead with the operation";
 }
 
-TEST(PegtlCase, ParseTodaySchema)
+class LazyListNode : public service::Object
 {
-	memory_input<> input(R"gql(
-		# Copyright (c) Microsoft Corporation. All rights reserved.
-		# Licensed under the MIT License.
+public:
+	struct Counters
+	{
+		size_t created = 0;
+		size_t alive = 0;
+		size_t maxAlive = 0;
+	};
 
-		schema {
-			query: Query
-			mutation: Mutation
-			subscription: Subscription
-		}
+	explicit LazyListNode(std::shared_ptr<Counters> counters, response::IntType index)
+		: service::Object({ "Node" }, {
+			{ "index", [index](service::ResolverParams&&) { return resolveIndex(index); } }
+		})
+		, _counters(std::move(counters))
+	{
+		++_counters->created;
+		_counters->maxAlive = std::max(_counters->maxAlive, ++_counters->alive);
+	}
 
-		scalar ItemCursor
+	~LazyListNode()
+	{
+		--_counters->alive;
+	}
 
-		type Query {
-			node(id: ID!) : Node
+private:
+	static std::future<response::Value> resolveIndex(response::IntType index)
+	{
+		std::promise<response::Value> promise;
 
-			appointments(first: Int, after: ItemCursor, last: Int, before: ItemCursor): AppointmentConnection!
-			tasks(first: Int, after: ItemCursor, last: Int, before: ItemCursor): TaskConnection!
-			unreadCounts(first: Int, after: ItemCursor, last: Int, before: ItemCursor): FolderConnection!
+		promise.set_value(response::Value(index));
 
-			appointmentsById(ids: [ID!]!) : [Appointment]!
-			tasksById(ids: [ID!]!): [Task]!
-			unreadCountsById(ids: [ID!]!): [Folder]!
-		}
+		return promise.get_future();
+	}
 
-		interface Node {
-			id: ID!
-		}
+	const std::shared_ptr<Counters> _counters;
+};
 
-		type PageInfo {
-			hasNextPage: Boolean!
-			hasPreviousPage: Boolean!
-		}
+class LazyListQuery : public service::Object
+{
+public:
+	explicit LazyListQuery(response::IntType count)
+		: service::Object({ "Query" }, {
+			{ "nodes", [this](service::ResolverParams&& params) { return resolveNodes(std::move(params)); } }
+		})
+		, counters(std::make_shared<LazyListNode::Counters>())
+		, _count(count)
+	{
+	}
 
-		type AppointmentEdge {
-			node: Appointment
-			cursor: ItemCursor!
-		}
+	const std::shared_ptr<LazyListNode::Counters> counters;
 
-		type AppointmentConnection {
-			pageInfo: PageInfo!
-			edges: [AppointmentEdge]
-		}
+private:
+	std::future<response::Value> resolveNodes(service::ResolverParams&& params)
+	{
+		auto nodeCounters = counters;
+		const auto count = _count;
+		response::IntType index = 0;
 
-		type TaskEdge {
-			node: Task
-			cursor: ItemCursor!
-		}
+		return service::ModifiedResult<service::Object>::convertLazy<service::TypeModifier::List>(service::LazyList<std::shared_ptr<service::Object>>(
+			[nodeCounters, count, index](std::shared_ptr<service::Object>& entry) mutable
+		{
+			if (index == count)
+			{
+				return false;
+			}
 
-		type TaskConnection {
-			pageInfo: PageInfo!
-			edges: [TaskEdge]
-		}
+			entry = std::make_shared<LazyListNode>(nodeCounters, index++);
 
-		type FolderEdge {
-			node: Folder
-			cursor: ItemCursor!
-		}
+			return true;
+		}), std::move(params));
+	}
 
-		type FolderConnection {
-			pageInfo: PageInfo!
-			edges: [FolderEdge]
-		}
+	const response::IntType _count;
+};
 
-		input CompleteTaskInput {
-			id: ID!
-			isComplete: Boolean = true
-			clientMutationId: String
-		}
+TEST(LazyListCase, ResolveInChunks)
+{
+	auto query = std::make_shared<LazyListQuery>(10);
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			nodes {
+				index
+			}
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
 
-		type CompleteTaskPayload {
-			task: Task
-			clientMutationId: String
-		}
+	state->listChunkSize = 3;
 
-		type Mutation {
-			completeTask(input: CompleteTaskInput!) : CompleteTaskPayload!
-		}
+	auto result = service.resolve(state, *ast.root, "", response::Value(response::Type::Map)).get();
 
-		type Subscription {
-			nextAppointmentChange : Appointment
-		}
+	try
+	{
+		const auto data = service::ScalarArgument::require("data", result);
+		const auto nodes = service::ScalarArgument::require<service::TypeModifier::List>("nodes", data);
 
-		scalar DateTime
+		ASSERT_EQ(size_t(10), nodes.size()) << "should pull every entry";
 
-		enum TaskState {
-			New
-			Started
-			Complete
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			EXPECT_EQ(static_cast<response::IntType>(i), service::IntArgument::require("index", nodes[i])) << "should keep the entries in order";
 		}
 
-		type Appointment implements Node {
-			id: ID!
-			when: DateTime
-			subject: String
-			isNow: Boolean!
-		}
+		EXPECT_EQ(size_t(10), query->counters->created) << "should create each node once";
+		EXPECT_EQ(size_t(0), query->counters->alive) << "should release every node";
+		EXPECT_GE(size_t(3), query->counters->maxAlive) << "should only hold one chunk of nodes at a time";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+}
 
-		type Task implements Node {
-			id: ID!
-			title: String
-			isComplete: Boolean!
-		}
+TEST(LazyListCase, StreamEachEntry)
+{
+	auto query = std::make_shared<LazyListQuery>(4);
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			nodes @stream(initialCount: 1, label: "rest") {
+				index
+			}
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
+	std::vector<std::string> payloads;
 
-		type Folder implements Node {
-			id: ID!
-			name: String
-			unreadCount: Int!
-		})gql", "ParseTodaySchema");
+	service.resolveIncremental(state, *ast.root, "", response::Value(response::Type::Map),
+		[&payloads](response::Value&& payload)
+	{
+		payloads.push_back(response::toJSON(std::move(payload)));
+	}).get();
+
+	ASSERT_EQ(size_t(4), payloads.size()) << "should deliver the initial payload and a patch for each of the other entries";
+	EXPECT_EQ(R"js({"data":{"nodes":[{"index":0}]},"hasNext":true})js", payloads[0]) << "initial payload should only include the initialCount";
+	EXPECT_EQ(R"js({"items":[{"index":1}],"path":["nodes",1],"label":"rest","hasNext":true})js", payloads[1]) << "patch should have the second entry";
+	EXPECT_EQ(R"js({"items":[{"index":2}],"path":["nodes",2],"label":"rest","hasNext":true})js", payloads[2]) << "patch should have the third entry";
+	EXPECT_EQ(R"js({"items":[{"index":3}],"path":["nodes",3],"label":"rest","hasNext":false})js", payloads[3]) << "last patch should have the fourth entry";
+	EXPECT_EQ(size_t(4), query->counters->created) << "should create each node once";
+	EXPECT_EQ(size_t(0), query->counters->alive) << "should release every node";
+	EXPECT_GE(size_t(2), query->counters->maxAlive) << "should only pull the next entry after the previous patch is done";
+}
 
-	const bool result = parse<document>(input);
+TEST(LazyListCase, StreamReleasedAfterCallbackThrows)
+{
+	auto query = std::make_shared<LazyListQuery>(4);
+	service::Request service({ { "query", query } });
+	auto ast = R"({
+			nodes @stream(initialCount: 1, label: "rest") {
+				index
+			}
+		})"_graphql;
+	auto state = std::make_shared<service::RequestState>();
 
-	ASSERT_TRUE(result) << "we should be able to parse the doc";
+	EXPECT_THROW(service.resolveIncremental(state, *ast.root, "", response::Value(response::Type::Map),
+		[](response::Value&&)
+	{
+		throw std::runtime_error("client went away");
+	}).get(), std::runtime_error);
+
+	EXPECT_EQ(size_t(2), query->counters->created) << "should not pull any more entries after the callback throws";
+	EXPECT_EQ(size_t(0), query->counters->alive) << "should release the entry waiting in the next patch";
 }
 
-TEST(PegtlCase, AnalyzeGrammar)
+// The type of the ids field wraps the innerType in [[...!]!]!, which needs 5 levels of ofType for ID.
+static response::Value getNestedTypeSchema(const std::string& innerType)
 {
-	ASSERT_EQ(0, analyze<document>(true)) << "there shuldn't be any infinite loops in the PEG version of the grammar";
+	return response::parseJSON(R"js({
+		"queryType": { "name": "Query" },
+		"mutationType": null,
+		"subscriptionType": null,
+		"types": [{
+			"kind": "OBJECT",
+			"name": "Query",
+			"fields": [{
+				"name": "ids",
+				"args": [],
+				"type": { "kind": "NON_NULL", "name": null, "ofType":
+					{ "kind": "LIST", "name": null, "ofType":
+						{ "kind": "NON_NULL", "name": null, "ofType":
+							{ "kind": "LIST", "name": null, "ofType":
+								{ "kind": "NON_NULL", "name": null, "ofType": )js" + innerType + R"js( }
+							}
+						}
+					}
+				}
+			}],
+			"inputFields": null,
+			"interfaces": [],
+			"enumValues": null,
+			"possibleTypes": null
+		}, {
+			"kind": "SCALAR",
+			"name": "ID",
+			"fields": null,
+			"inputFields": null,
+			"interfaces": null,
+			"enumValues": null,
+			"possibleTypes": null
+		}],
+		"directives": []
+	})js");
 }
 
-TEST(ResponseCase, ValueConstructorFromStringLiteral)
+TEST(ValidationCase, NestedTypeModifiers)
 {
-	auto expected = "Test String";
-	auto actual = response::Value(expected);
+	const service::ValidationSchema schema(getNestedTypeSchema(R"js({ "kind": "SCALAR", "name": "ID" })js"));
+	const auto queryType = schema.getType("Query");
 
-	ASSERT_TRUE(response::Type::String == actual.type());
-	ASSERT_EQ(expected, actual.release<response::StringType>());
+	ASSERT_NE(nullptr, queryType) << "should load the query type";
+	const auto field = schema.getField("Query", *queryType, "ids");
+	ASSERT_NE(nullptr, field) << "should load the ids field";
+	EXPECT_EQ("[[ID!]!]!", field->type) << "should keep every type modifier";
+}
+
+TEST(ValidationCase, TruncatedTypeModifiers)
+{
+	// The introspection query stopped before the ofType on the innermost NON_NULL.
+	try
+	{
+		service::ValidationSchema schema(getNestedTypeSchema(R"js({ "kind": "NON_NULL", "name": null })js"));
+
+		FAIL() << "should not load a type whose modifiers were truncated";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		const auto errors = response::toJSON(response::Value(ex.getErrors()));
+
+		EXPECT_NE(std::string::npos, errors.find("Type modifiers are nested too deeply")) << "error should explain the failure";
+	}
+}
+
+static response::Value getInputObjectSchema()
+{
+	return response::parseJSON(R"js({
+		"queryType": { "name": "Query" },
+		"mutationType": null,
+		"subscriptionType": null,
+		"types": [{
+			"kind": "OBJECT",
+			"name": "Query",
+			"fields": [],
+			"inputFields": null,
+			"interfaces": [],
+			"enumValues": null,
+			"possibleTypes": null
+		}, {
+			"kind": "ENUM",
+			"name": "Color",
+			"fields": null,
+			"inputFields": null,
+			"interfaces": null,
+			"enumValues": [{ "name": "RED" }, { "name": "GREEN" }],
+			"possibleTypes": null
+		}, {
+			"kind": "INPUT_OBJECT",
+			"name": "Filter",
+			"fields": null,
+			"inputFields": [{
+				"name": "color",
+				"type": { "kind": "NON_NULL", "name": null, "ofType": { "kind": "ENUM", "name": "Color", "ofType": null } },
+				"defaultValue": null
+			}, {
+				"name": "limit",
+				"type": { "kind": "SCALAR", "name": "Int", "ofType": null },
+				"defaultValue": "10"
+			}],
+			"interfaces": null,
+			"enumValues": null,
+			"possibleTypes": null
+		}, {
+			"kind": "SCALAR",
+			"name": "Int",
+			"fields": null,
+			"inputFields": null,
+			"interfaces": null,
+			"enumValues": null,
+			"possibleTypes": null
+		}],
+		"directives": []
+	})js");
+}
+
+TEST(ValidationCase, CoerceInputObjectVariables)
+{
+	const service::ValidationSchema schema(getInputObjectSchema());
+	auto ast = R"(query($filter: Filter!) { __typename })"_graphql;
+	const peg::ast_node* type = nullptr;
+
+	peg::on_first_child<peg::operation_definition>(*ast.root,
+		[&type](const peg::ast_node& operationDefinition)
+		{
+			peg::on_first_child<peg::variable>(operationDefinition,
+				[&type](const peg::ast_node& variable)
+				{
+					type = variable.children.back().get();
+				});
+		});
+
+	ASSERT_NE(nullptr, type) << "should parse the variable type";
+
+	try
+	{
+		auto filter = service::coerceVariableValue(&schema, *type, response::parseJSON(R"js({ "color": "GREEN" })js"));
+
+		EXPECT_TRUE(filter["color"].type() == response::Type::EnumValue) << "color should be coerced to an enum value";
+		EXPECT_EQ("GREEN", filter["color"].get<const response::StringType&>()) << "color should match";
+		EXPECT_EQ(10, filter["limit"].get<response::IntType>()) << "should fill in the default limit";
+	}
+	catch (const service::schema_exception& ex)
+	{
+		FAIL() << response::toJSON(response::Value(ex.getErrors()));
+	}
+
+	const std::pair<const char*, const char*> invalidValues[] = {
+		{ R"js({ "color": "BLUE" })js", "not a valid Color value" },
+		{ R"js({ "color": "RED", "size": 1 })js", "unknown field: size" },
+		{ R"js({ "limit": 1 })js", "missing non-null field: color" },
+		{ R"js({ "color": "RED", "limit": "many" })js", "field: limit not an integer" }
+	};
+
+	for (const auto& invalidValue : invalidValues)
+	{
+		try
+		{
+			service::coerceVariableValue(&schema, *type, response::parseJSON(invalidValue.first));
+
+			FAIL() << "should not coerce " << invalidValue.first;
+		}
+		catch (const service::schema_exception& ex)
+		{
+			const auto errors = response::toJSON(response::Value(ex.getErrors()));
+
+			EXPECT_NE(std::string::npos, errors.find(invalidValue.second)) << "error should explain the failure: " << errors;
+		}
+	}
 }